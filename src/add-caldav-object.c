@@ -22,6 +22,8 @@
 #endif
 
 #include "add-caldav-object.h"
+#include "lock-caldav-object.h"
+#include "caldav-cache.h"
 #include <glib.h>
 #include <curl/curl.h>
 #include <stdio.h>
@@ -38,17 +40,24 @@ gboolean caldav_add(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
 	struct curl_slist *http_header = NULL;
 	gboolean result = FALSE;
 	gchar* url;
+	caldav_upload local;
+	caldav_upload* body = caldav_upload_of(settings, &local);
 
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -64,8 +73,7 @@ gboolean caldav_add(caldav_settings* settings, caldav_error* error) {
 	http_header = curl_slist_append(http_header, "If-None-Match: *");
 	http_header = curl_slist_append(http_header, "Expect:");
 	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
+	http_header = caldav_lock_header(settings, http_header);
 
 	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
 	/* send all data to this function  */
@@ -77,36 +85,16 @@ gboolean caldav_add(caldav_settings* settings, caldav_error* error) {
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	gchar* tmp = random_file_name(settings->file);
-	gchar* s = rebuild_url(settings, NULL);
-	if (g_str_has_suffix(s, "/")) {
-		url = g_strdup_printf("%slibcaldav-%s.ics", s, tmp);
-	}
-	else {
-		url = g_strdup_printf("%s/libcaldav-%s.ics", s, tmp);
-	}
-	g_free(s);
-	g_free(tmp);
+	/* a missing UID is sent along with the object, not copied into it */
+	url = caldav_arena_take(caldav_upload_resource(settings, body));
 	curl_easy_setopt(curl, CURLOPT_URL, url);
-	tmp = g_strdup(settings->file);
-	g_free(settings->file);
-	settings->file = verify_uid(tmp);
-	g_free(tmp);
-	/* enable uploading */
-	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, settings->file);
-	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(settings->file));
 	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_put(settings, curl, body, http_header, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -115,18 +103,24 @@ gboolean caldav_add(caldav_settings* settings, caldav_error* error) {
 	else {
 		long code;
 		res = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
-		if (code != 201) {
+		if (code < 200 || code >= 300) {
 			error->str = g_strdup(chunk.memory);
 			error->code = code;
 			result = TRUE;
 		}
+		else if (settings->cache) {
+			caldav_cache_written(settings, url, &headers,
+					caldav_upload_text(body));
+		}
 	}
 	if (chunk.memory)
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
 	curl_slist_free_all(http_header);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
+	if (body == &local)
+		caldav_upload_clear(&local);
 	return result;
 }
 
@@ -0,0 +1,1680 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "caldav-async.h"
+#include "caldav-cache.h"
+#include "options-caldav-server.h"
+#include "get-caldav-report.h"
+#include "get-display-name.h"
+#include "get-freebusy-report.h"
+#include "modify-caldav-object.h"
+#include "lock-caldav-object.h"
+#include <glib.h>
+#include <curl/curl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @enum ASYNC_STEP
+ * The request an operation is waiting for. Each step is one HTTP request
+ * and its completion decides which request to send next.
+ */
+typedef enum {
+	STEP_PROBE,		/* OPTIONS */
+	STEP_QUERY,		/* REPORT or PROPFIND returning the result */
+	STEP_FIND,		/* REPORT locating the object by UID */
+	STEP_LOCK,		/* LOCK */
+	STEP_SEND,		/* PUT or DELETE */
+	STEP_UNLOCK		/* UNLOCK */
+} ASYNC_STEP;
+
+/**
+ * @typedef struct _async_op async_op
+ * A pointer to a struct _async_op
+ */
+typedef struct _async_op async_op;
+
+/**
+ * @struct _async_op
+ * One CALDAV_ACTION in flight. The operation owns its easy handle and
+ * every buffer the current request refers to.
+ */
+struct _async_op {
+	caldav_async* async;
+	caldav_settings settings;
+	ASYNC_STEP step;
+	gboolean done;
+	gboolean failed;
+	gboolean waiting;
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	struct curl_slist* http_header;
+	gchar* body;
+	gchar* packed;		/* body gzip compressed, sent in its place */
+	gsize packed_len;
+	gchar* url;
+	gchar* etag;
+	gchar* allow;
+	gchar* lock_token;
+	caldav_error error;
+	char error_buf[CURL_ERROR_SIZE];
+	caldav_async_callback callback;
+	void* user_data;
+	gint64 sent;		/* when the request was queued */
+	gint64 wake;		/* when a request waiting to be repeated goes */
+	int attempts;
+	gboolean hedged;
+	CURL* hedge;		/* a second copy of a slow read */
+	struct MemoryStruct hedge_chunk;
+	struct MemoryStruct hedge_headers;
+	char hedge_error_buf[CURL_ERROR_SIZE];
+};
+
+/**
+ * @struct _async_source
+ * A GSource polling the sockets libcurl is currently interested in.
+ */
+typedef struct {
+	GSource source;
+	caldav_async* async;
+	GSList* fds;
+} async_source;
+
+static void op_send_step(async_op* op);
+static void op_probed(async_op* op);
+static void op_wake_waiting(async_op* op);
+static gboolean op_queue(async_op* op);
+
+/**
+ * Free the buffers belonging to the previous request of an operation.
+ * @param op An async_op.
+ */
+static void op_reset(async_op* op) {
+	if (op->chunk.memory)
+		free(op->chunk.memory);
+	op->chunk.memory = NULL;
+	op->chunk.size = 0;
+	op->chunk.capacity = 0;
+	op->chunk.fields = 0;
+	op->chunk.body = NULL;
+	if (op->headers.memory)
+		free(op->headers.memory);
+	op->headers.memory = NULL;
+	op->headers.size = 0;
+	op->headers.capacity = 0;
+	op->headers.fields = 0;
+	op->headers.body = &op->chunk;
+	if (op->http_header)
+		curl_slist_free_all(op->http_header);
+	op->http_header = NULL;
+	g_free(op->body);
+	op->body = NULL;
+	g_free(op->packed);
+	op->packed = NULL;
+}
+
+/**
+ * Abandon the second copy of a read, if any.
+ * @param op An async_op.
+ */
+static void op_drop_hedge(async_op* op) {
+	if (op->hedge) {
+		curl_multi_remove_handle(op->async->multi, op->hedge);
+		curl_easy_cleanup(op->hedge);
+		op->hedge = NULL;
+	}
+	if (op->hedge_chunk.memory)
+		free(op->hedge_chunk.memory);
+	if (op->hedge_headers.memory)
+		free(op->hedge_headers.memory);
+	memset(&op->hedge_chunk, 0, sizeof(op->hedge_chunk));
+	memset(&op->hedge_headers, 0, sizeof(op->hedge_headers));
+}
+
+/**
+ * Make the second copy of a read the request of the operation,
+ * abandoning the first. Only a copy which finished is adopted: libcurl
+ * keeps writing a running one to the hedge buffers.
+ * @param op An async_op with a hedge.
+ */
+static void op_adopt_hedge(async_op* op) {
+	if (op->settings.curl) {
+		curl_multi_remove_handle(op->async->multi, op->settings.curl);
+		curl_easy_cleanup(op->settings.curl);
+	}
+	op->settings.curl = op->hedge;
+	op->hedge = NULL;
+	if (op->chunk.memory)
+		free(op->chunk.memory);
+	if (op->headers.memory)
+		free(op->headers.memory);
+	op->chunk = op->hedge_chunk;
+	op->headers = op->hedge_headers;
+	op->headers.body = &op->chunk;
+	memcpy(op->error_buf, op->hedge_error_buf, CURL_ERROR_SIZE);
+	memset(&op->hedge_chunk, 0, sizeof(op->hedge_chunk));
+	memset(&op->hedge_headers, 0, sizeof(op->hedge_headers));
+}
+
+/**
+ * Free an operation and its easy handle.
+ * @param op An async_op.
+ */
+static void op_free(async_op* op) {
+	op_drop_hedge(op);
+	op_reset(op);
+	if (op->settings.curl) {
+		curl_multi_remove_handle(op->async->multi, op->settings.curl);
+		curl_easy_cleanup(op->settings.curl);
+		op->settings.curl = NULL;
+	}
+	free_caldav_settings(&op->settings);
+	g_free(op->url);
+	g_free(op->etag);
+	g_free(op->allow);
+	g_free(op->lock_token);
+	g_free(op->error.str);
+	g_free(op);
+}
+
+/**
+ * Mark an operation as finished. The callback is called from the next
+ * caldav_async_perform().
+ * @param op An async_op.
+ */
+static void op_finish(async_op* op) {
+	op_reset(op);
+	op->done = TRUE;
+}
+
+/**
+ * Record an error and finish the operation.
+ * @param op An async_op.
+ * @param code @see caldav_error
+ * @param str Human readable message. Copied.
+ */
+static void op_fail(async_op* op, long code, const gchar* str) {
+	op->error.code = code;
+	g_free(op->error.str);
+	op->error.str = g_strdup(str);
+	op->failed = TRUE;
+	op_finish(op);
+}
+
+/**
+ * Start one request for an operation. The request body and headers must
+ * be set up in op->body and op->http_header before calling.
+ * @param op An async_op.
+ * @param method The HTTP method.
+ * @param url Full URL of the request or NULL for the collection.
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+static gboolean op_request(async_op* op, const char* method, gchar* url) {
+	CURL* curl;
+
+	/* the handle is back here only after it left the multi handle */
+	curl = get_curl(&op->settings);
+	if (!curl) {
+		op_fail(op, -1, "Could not initialize libcurl");
+		return TRUE;
+	}
+	op->settings.curl = curl;
+	op->http_header = curl_slist_append(op->http_header, "Expect:");
+	op->http_header = curl_slist_append(op->http_header, "Transfer-Encoding:");
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, op);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, op->http_header);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+	/* we pass our 'chunk' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&op->chunk);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+	/* we pass our 'headers' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&op->headers);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) op->error_buf);
+	if (url)
+		curl_easy_setopt(curl, CURLOPT_URL, url);
+	if (op->packed) {
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, op->packed);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) op->packed_len);
+	}
+	else if (op->body) {
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, op->body);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(op->body));
+	}
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	/* rather wait for a multiplexed connection than open another one */
+	curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+	op->attempts = 0;
+	return op_queue(op);
+}
+
+/**
+ * Start the PUT of op->body, gzip compressed as caldav_put() would.
+ * @param op An async_op.
+ * @param url Full URL of the request.
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+static gboolean op_put(async_op* op, gchar* url) {
+	caldav_upload upload;
+
+	caldav_upload_string(&upload, op->body);
+	op->packed = caldav_upload_pack(&op->settings, &upload, &op->packed_len);
+	if (op->packed)
+		op->http_header = curl_slist_append(op->http_header,
+				"Content-Encoding: gzip");
+	return op_request(op, "PUT", url);
+}
+
+/**
+ * Send the PUT of an operation again as it is after the server refused
+ * the gzip compressed body with 415 (RFC7694).
+ * @param op An async_op whose handle is out of the multi handle.
+ */
+static void op_put_plain(async_op* op) {
+	struct curl_slist* plain = NULL;
+	struct curl_slist* item;
+
+	caldav_capabilities_refuse(&op->settings, "gzip");
+	for (item = op->http_header; item; item = item->next)
+		if (g_ascii_strncasecmp(item->data, "Content-Encoding:", 17) != 0)
+			plain = curl_slist_append(plain, item->data);
+	curl_slist_free_all(op->http_header);
+	op->http_header = plain;
+	g_free(op->packed);
+	op->packed = NULL;
+	curl_easy_setopt(op->settings.curl, CURLOPT_HTTPHEADER, op->http_header);
+	curl_easy_setopt(op->settings.curl, CURLOPT_POSTFIELDS, op->body);
+	curl_easy_setopt(op->settings.curl, CURLOPT_POSTFIELDSIZE,
+			strlen(op->body));
+	op->chunk.size = 0;
+	op->chunk.fields = 0;
+	op->headers.size = 0;
+	op->headers.fields = 0;
+	op_queue(op);
+}
+
+/**
+ * Hand the request set up on the handle of an operation to libcurl,
+ * unless the circuit breaker of the host holds it back.
+ * @param op An async_op.
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+static gboolean op_queue(async_op* op) {
+	gchar* refused;
+
+	op->wake = 0;
+	op->hedged = FALSE;
+	refused = caldav_breaker_check(&op->settings);
+	if (refused) {
+		op_fail(op, -4, refused);
+		g_free(refused);
+	}
+	else if (curl_multi_add_handle(op->async->multi, op->settings.curl) !=
+			CURLM_OK) {
+		op_fail(op, -1, "Could not queue request");
+	}
+	else {
+		op->sent = g_get_monotonic_time();
+		return FALSE;
+	}
+	if (op->step == STEP_PROBE)
+		op_wake_waiting(op);
+	return TRUE;
+}
+
+/**
+ * Send a second copy of a read which takes long, on a connection of its
+ * own where possible. The first answer is used.
+ * @param op An async_op. @see op_may_hedge
+ */
+static void op_start_hedge(async_op* op) {
+	CURL* curl;
+
+	op->hedged = TRUE;
+	curl = curl_easy_duphandle(op->settings.curl);
+	if (! curl)
+		return;
+	op->hedge_headers.body = &op->hedge_chunk;
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, op);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&op->hedge_chunk);
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&op->hedge_headers);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) op->hedge_error_buf);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	/* the first may be stuck behind a slow connection */
+	curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 0L);
+#endif
+	if (curl_multi_add_handle(op->async->multi, curl) != CURLM_OK) {
+		curl_easy_cleanup(curl);
+		return;
+	}
+	op->hedge = curl;
+}
+
+/**
+ * Settle which copy of a hedged read answers for the operation. A copy
+ * which failed leaves the answer to the other one still running, which
+ * is adopted once it finished too.
+ * @param op An async_op.
+ * @param curl The handle which finished, already out of the multi handle.
+ * @param res The libcurl result of the transfer.
+ * @return TRUE if the other copy is still awaited.
+ */
+static gboolean op_hedge_done(async_op* op, CURL* curl, CURLcode res) {
+	long code = 0;
+	gboolean failed;
+
+	if (! op->hedge)
+		return FALSE;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+	failed = (res != CURLE_OK || caldav_transient(res, code));
+	if (curl == op->hedge) {
+		if (failed && op->settings.curl) {
+			/* the loser is traffic too */
+			caldav_account(&op->settings, curl, res);
+			op_drop_hedge(op);
+			return TRUE;
+		}
+		/* the copy abandoned in flight */
+		if (op->settings.curl)
+			caldav_account(&op->settings, op->settings.curl,
+					CURLE_ABORTED_BY_CALLBACK);
+		op_adopt_hedge(op);
+		return FALSE;
+	}
+	if (! failed) {
+		caldav_account(&op->settings, op->hedge, CURLE_ABORTED_BY_CALLBACK);
+		op_drop_hedge(op);
+		return FALSE;
+	}
+	/* the hedge is still streaming into its own buffers, wait for it */
+	caldav_account(&op->settings, curl, res);
+	curl_easy_cleanup(op->settings.curl);
+	op->settings.curl = NULL;
+	return TRUE;
+}
+
+/**
+ * Test whether an operation is a read still waiting for its first
+ * answer which may be sent a second time.
+ * @param op An async_op.
+ * @return TRUE if op_start_hedge may be called.
+ */
+static gboolean op_may_hedge(async_op* op) {
+	return op->settings.hedge > 0 && op->step == STEP_QUERY &&
+		! op->done && ! op->wake && ! op->hedged && op->sent &&
+		op->settings.curl;
+}
+
+/**
+ * Remember how long a read took for the hedging delay.
+ * @param async A caldav_async.
+ * @param latency Microseconds.
+ */
+static void async_sample(caldav_async* async, gint64 latency) {
+	async->latency[async->latencies % CALDAV_HEDGE_SAMPLES] = latency;
+	async->latencies++;
+}
+
+static int compare_latency(const void* a, const void* b) {
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * The 95th percentile of the latencies of earlier reads.
+ * @param async A caldav_async.
+ * @return Microseconds or 0 (zero) if nothing was read yet.
+ */
+static gint64 async_p95(caldav_async* async) {
+	gint64 sorted[CALDAV_HEDGE_SAMPLES];
+	int count;
+
+	count = MIN(async->latencies, CALDAV_HEDGE_SAMPLES);
+	if (count == 0)
+		return 0;
+	memcpy(sorted, async->latency, count * sizeof(gint64));
+	qsort(sorted, count, sizeof(gint64), compare_latency);
+	return sorted[(count * 95) / 100];
+}
+
+/**
+ * When the timer of an operation fires, the repetition of a request
+ * after a transient failure or the hedge of a slow read.
+ * @param op An async_op.
+ * @param p95 @see async_p95
+ * @return Monotonic time in microseconds or 0 (zero) if none is set.
+ */
+static gint64 op_due(async_op* op, gint64 p95) {
+	if (op->done)
+		return 0;
+	if (op->wake)
+		return op->wake;
+	if (op_may_hedge(op))
+		return op->sent + MAX((gint64) op->settings.hedge * 1000, p95);
+	return 0;
+}
+
+/**
+ * Fire the timers of the operations which are due.
+ * @param async A caldav_async.
+ */
+static void async_timers(caldav_async* async) {
+	GList* list;
+	async_op* op;
+	gint64 now;
+	gint64 p95;
+	gint64 due;
+
+	now = g_get_monotonic_time();
+	p95 = async_p95(async);
+	for (list = async->ops; list; list = list->next) {
+		op = (async_op *) list->data;
+		due = op_due(op, p95);
+		if (! due || due > now)
+			continue;
+		if (op->wake)
+			op_queue(op);
+		else
+			op_start_hedge(op);
+	}
+}
+
+/**
+ * Milliseconds until the next timer of an operation fires.
+ * @param async A caldav_async.
+ * @return Milliseconds or -1 if no timer is set.
+ */
+static long async_next_timer(caldav_async* async) {
+	GList* list;
+	gint64 now;
+	gint64 p95;
+	gint64 due;
+	gint64 next = 0;
+
+	now = g_get_monotonic_time();
+	p95 = async_p95(async);
+	for (list = async->ops; list; list = list->next) {
+		due = op_due((async_op *) list->data, p95);
+		if (due && (! next || due < next))
+			next = due;
+	}
+	if (! next)
+		return -1;
+	return (next <= now) ? 0 : (long) ((next - now + 999) / 1000);
+}
+
+/**
+ * Arrange for the request of an operation to be repeated later if it
+ * failed in a way which may pass. Only reads are repeated.
+ * @param op An async_op whose handle is out of the multi handle.
+ * @param res The libcurl result of the transfer.
+ * @param code The HTTP status or 0 (zero).
+ * @return TRUE if the request will be repeated.
+ */
+static gboolean op_retry(async_op* op, CURLcode res, long code) {
+	int retries;
+	long wait;
+
+	if (op->step != STEP_PROBE && op->step != STEP_QUERY &&
+			op->step != STEP_FIND)
+		return FALSE;
+	retries = (op->settings.retries > 0) ? op->settings.retries :
+		(op->settings.retries < 0) ? 0 : CALDAV_RETRIES;
+	if (op->attempts >= retries || ! caldav_transient(res, code))
+		return FALSE;
+	wait = caldav_backoff(op->attempts,
+			caldav_retry_after(op->settings.curl));
+	if (wait < 0)
+		return FALSE;
+	op->attempts++;
+	op->chunk.size = 0;
+	op->chunk.fields = 0;
+	op->headers.size = 0;
+	op->headers.fields = 0;
+	op->wake = g_get_monotonic_time() + wait * 1000;
+	return TRUE;
+}
+
+/**
+ * Test whether an Allow header lists a method.
+ * @param allow Value of the Allow header or NULL.
+ * @param method The method to look for.
+ * @return TRUE if the method is allowed.
+ */
+static gboolean allow_has(const gchar* allow, const gchar* method) {
+	gchar** methods;
+	gchar** tmp;
+	gboolean found = FALSE;
+
+	if (! allow)
+		return FALSE;
+	methods = g_strsplit(allow, ",", 0);
+	for (tmp = methods; *tmp; tmp++) {
+		if (strcmp(g_strstrip(*tmp), method) == 0) {
+			found = TRUE;
+			break;
+		}
+	}
+	g_strfreev(methods);
+	return found;
+}
+
+/**
+ * Test whether two operations address the same collection as the same user.
+ * @param a An async_op.
+ * @param b An async_op.
+ * @return TRUE if a probe of one answers for the other.
+ */
+static gboolean same_collection(async_op* a, async_op* b) {
+	return a->settings.usehttps == b->settings.usehttps &&
+		g_strcmp0(a->settings.url, b->settings.url) == 0 &&
+		g_strcmp0(a->settings.username, b->settings.username) == 0;
+}
+
+/**
+ * Start the operation. The OPTIONS round trip is skipped when the
+ * capabilities of the collection are cached.
+ * @param op An async_op.
+ */
+static void op_start(async_op* op) {
+	GList* list;
+	async_op* other;
+
+	if (caldav_capabilities_lookup(&op->settings, &op->allow)) {
+		op_probed(op);
+		return;
+	}
+	op->step = STEP_PROBE;
+	/* wait for a probe of the same collection already in flight */
+	for (list = op->async->ops; list; list = list->next) {
+		other = (async_op *) list->data;
+		if (other != op && other->step == STEP_PROBE && ! other->waiting &&
+				! other->done && same_collection(op, other)) {
+			op->waiting = TRUE;
+			return;
+		}
+	}
+	op_request(op, "OPTIONS", NULL);
+}
+
+/**
+ * Resume the operations waiting for the probe of an operation.
+ * @param op The async_op which finished probing.
+ */
+static void op_wake_waiting(async_op* op) {
+	GList* list;
+	async_op* other;
+
+	for (list = op->async->ops; list; list = list->next) {
+		other = (async_op *) list->data;
+		if (! other->waiting || ! same_collection(op, other))
+			continue;
+		other->waiting = FALSE;
+		if (op->failed) {
+			other->error.code = op->error.code;
+			other->error.str = g_strdup(op->error.str);
+			other->failed = TRUE;
+			op_finish(other);
+		}
+		else {
+			other->allow = g_strdup(op->allow);
+			op_probed(other);
+		}
+	}
+}
+
+/**
+ * Send the first request of the action once the collection is known to
+ * be a CalDAV collection.
+ * @param op An async_op.
+ */
+static void op_probed(async_op* op) {
+	caldav_upload upload;
+	gchar* uid;
+	gchar* tmp;
+	gchar* url;
+
+	op_reset(op);
+	switch (op->settings.ACTION) {
+		case GETALL:
+		case GET:
+		case GETALLTASKS:
+		case GETTASKS:
+		case FREEBUSY:
+			if (op->settings.ACTION == FREEBUSY)
+				op->body = caldav_freebusy_request(&op->settings);
+			else
+				op->body = caldav_report_request(&op->settings);
+			op->http_header = curl_slist_append(op->http_header,
+					"Content-Type: application/xml; charset=\"utf-8\"");
+			op->http_header = curl_slist_append(op->http_header, "Depth: 1");
+			op->step = STEP_QUERY;
+			op_request(op, "REPORT", NULL);
+			break;
+		case GETCALNAME:
+			op->body = g_strdup(caldav_getname_request());
+			op->http_header = curl_slist_append(op->http_header,
+					"Content-Type: application/xml; charset=\"utf-8\"");
+			op->http_header = curl_slist_append(op->http_header, "Depth: 0");
+			op->step = STEP_QUERY;
+			op_request(op, "PROPFIND", NULL);
+			break;
+		case ADD:
+			caldav_upload_string(&upload, op->settings.file);
+			url = caldav_upload_resource(&op->settings, &upload);
+			tmp = op->settings.file;
+			op->settings.file = caldav_upload_dup(&upload);
+			caldav_upload_clear(&upload);
+			g_free(tmp);
+			op->body = g_strdup(op->settings.file);
+			op->http_header = curl_slist_append(op->http_header,
+					"Content-Type: text/calendar; charset=\"utf-8\"");
+			op->http_header = curl_slist_append(op->http_header,
+					"If-None-Match: *");
+			op->http_header = caldav_lock_header(&op->settings,
+					op->http_header);
+			op->step = STEP_SEND;
+			op_put(op, url);
+			op->url = url;
+			break;
+		case MODIFY:
+		case DELETE:
+		case MODIFYTASKS:
+		case DELETETASKS:
+			if ((uid = get_ical_property(
+						op->settings.file, "UID")) == NULL) {
+				op_fail(op, 1, "Error: Missing required UID for object");
+				break;
+			}
+			op->body = caldav_uid_request(uid,
+					(op->settings.ACTION == MODIFYTASKS ||
+					 op->settings.ACTION == DELETETASKS));
+			g_free(uid);
+			op->http_header = curl_slist_append(op->http_header,
+					"Content-Type: application/xml; charset=\"utf-8\"");
+			op->http_header = curl_slist_append(op->http_header, "Depth: 1");
+			op->step = STEP_FIND;
+			op_request(op, "REPORT", NULL);
+			break;
+		case ISCALDAV:
+			/* answered by the probe or the cached capabilities */
+			op_finish(op);
+			break;
+		case OPTIONS:
+			g_free(op->settings.file);
+			op->settings.file = g_strdup((op->allow) ? op->allow : "");
+			op_finish(op);
+			break;
+		default:
+			op_fail(op, -1, "Unsupported action");
+			break;
+	}
+}
+
+/**
+ * Send the PUT or DELETE for a modify or delete, holding the lock if
+ * one was acquired.
+ * @param op An async_op.
+ */
+static void op_send_step(async_op* op) {
+	gchar* url;
+
+	op_reset(op);
+	op->http_header = curl_slist_append(op->http_header,
+			caldav_arena_strdup_printf("If-Match: %s", op->etag));
+	op->http_header = curl_slist_append(op->http_header,
+			"Content-Type: text/calendar; charset=\"utf-8\"");
+	if (op->lock_token && *op->lock_token) {
+		op->http_header = curl_slist_append(op->http_header,
+				caldav_arena_strdup_printf("If: (%s)", op->lock_token));
+	}
+	op->http_header = caldav_lock_header(&op->settings, op->http_header);
+	url = caldav_arena_take(rebuild_url(&op->settings, op->url));
+	op->step = STEP_SEND;
+	if (op->settings.ACTION == MODIFY || op->settings.ACTION == MODIFYTASKS) {
+		op->body = g_strdup(op->settings.file);
+		op_put(op, url);
+	}
+	else {
+		op_request(op, "DELETE", url);
+	}
+}
+
+/**
+ * Send UNLOCK for a previously acquired lock, or finish if there is none.
+ * @param op An async_op.
+ */
+static void op_unlock_step(async_op* op) {
+	if (! op->lock_token || ! *op->lock_token) {
+		op_finish(op);
+		return;
+	}
+	op_reset(op);
+	op->http_header = curl_slist_append(op->http_header,
+			caldav_arena_strdup_printf("Lock-Token: %s", op->lock_token));
+	op->step = STEP_UNLOCK;
+	op_request(op, "UNLOCK",
+			caldav_arena_take(rebuild_url(&op->settings, op->url)));
+}
+
+/**
+ * Handle the completion of the current request of an operation.
+ * @param op An async_op.
+ * @param res The libcurl result of the transfer.
+ */
+static void op_step_done(async_op* op, CURLcode res) {
+	long code = 0;
+	gchar* head;
+	gchar* tmp;
+	gchar* host;
+	gchar* url;
+
+	caldav_account(&op->settings, op->settings.curl, res);
+	curl_easy_getinfo(op->settings.curl, CURLINFO_RESPONSE_CODE, &code);
+	caldav_breaker_record(&op->settings, res, code);
+	if (op_retry(op, res, code))
+		return;
+	if (code == 503 || code == 429)
+		op->error.retry_after = caldav_retry_after(op->settings.curl);
+	if (res != CURLE_OK) {
+		if (op->step == STEP_UNLOCK)
+			op_finish(op);
+		else
+			op_fail(op, caldav_transfer_code(res), op->error_buf);
+		if (op->step == STEP_PROBE)
+			op_wake_waiting(op);
+		return;
+	}
+	switch (op->step) {
+		case STEP_PROBE:
+			head = get_response_header("DAV", &op->headers, TRUE);
+			if (head && strstr(head, "calendar-access") != NULL) {
+				op->allow = get_response_header(
+						"Allow", &op->headers, FALSE);
+				tmp = get_response_header("Accept-Encoding",
+						&op->headers, TRUE);
+				caldav_capabilities_store(&op->settings, head,
+						op->allow, tmp);
+				g_free(tmp);
+				op_wake_waiting(op);
+				op_probed(op);
+			}
+			else {
+				if (code == 200)
+					op_fail(op, -1, "URL is not a CalDAV resource");
+				else
+					op_fail(op, -1 * code, op->headers.memory);
+				op_wake_waiting(op);
+			}
+			g_free(head);
+			break;
+		case STEP_QUERY:
+			if (code != ((op->settings.ACTION == FREEBUSY) ? 200 : 207)) {
+				op_fail(op, code, op->headers.memory);
+				break;
+			}
+			async_sample(op->async, g_get_monotonic_time() - op->sent);
+			g_free(op->settings.file);
+			if (op->settings.ACTION == GETCALNAME) {
+				tmp = get_tag("displayname", op->chunk.memory);
+				/* Maybe namespace prefixed */
+				if (!tmp)
+					tmp = get_tag("D:displayname", op->chunk.memory);
+				op->settings.file = (tmp) ? tmp : g_strdup("");
+			}
+			else if (op->settings.ACTION == FREEBUSY) {
+				op->settings.file = g_strdup(op->chunk.memory);
+			}
+			else {
+				op->settings.file = parse_caldav_report(
+					op->chunk.memory, "calendar-data",
+					(op->settings.ACTION == GETALL ||
+					 op->settings.ACTION == GET) ? "VEVENT" : "VTODO");
+				caldav_account_parse(&op->settings);
+			}
+			op_finish(op);
+			break;
+		case STEP_FIND:
+			if (code != 207) {
+				op_fail(op, code, op->chunk.memory);
+				break;
+			}
+			url = get_url(op->chunk.memory);
+			if (! url) {
+				/*
+				 * No object found on server. Posible synchronization
+				 * problem or a server side race condition
+				 */
+				op_fail(op, 409, "No object found");
+				break;
+			}
+			op->etag = get_etag(op->chunk.memory);
+			host = get_host(op->settings.url);
+			if (! op->etag || ! host) {
+				g_free(url);
+				g_free(host);
+				op_fail(op, code, "No object found");
+				break;
+			}
+			op->url = g_strdup_printf("%s%s", host, url);
+			g_free(url);
+			g_free(host);
+			if (op->settings.use_locking && ! op->settings.lock &&
+					allow_has(op->allow, "LOCK")) {
+				op_reset(op);
+				op->body = g_strdup(caldav_lock_request());
+				op->http_header = curl_slist_append(op->http_header,
+						"Content-Type: application/xml; charset=\"utf-8\"");
+				op->http_header = curl_slist_append(op->http_header,
+						"Timeout: Second-300");
+				op->step = STEP_LOCK;
+				op_request(op, "LOCK", caldav_arena_take(
+						rebuild_url(&op->settings, op->url)));
+			}
+			else {
+				op_send_step(op);
+			}
+			break;
+		case STEP_LOCK:
+			if (code == 200) {
+				op->lock_token = get_response_header(
+						"Lock-Token", &op->headers, FALSE);
+				op_send_step(op);
+			}
+			/* continue hoping for the best */
+			else if (code == 501) {
+				op_send_step(op);
+			}
+			else {
+				tmp = get_tag("status", op->chunk.memory);
+				if (tmp && strstr(tmp, "423") != NULL)
+					op_fail(op, 423, tmp);
+				else
+					op_fail(op, code, op->chunk.memory);
+				g_free(tmp);
+			}
+			break;
+		case STEP_SEND:
+			if (code == 415 && op->packed) {
+				op_put_plain(op);
+				break;
+			}
+			if (code < 200 || code >= 300) {
+				op->error.code = code;
+				op->error.str = g_strdup(op->chunk.memory);
+				op->failed = TRUE;
+			}
+			else {
+				caldav_cache_written(&op->settings, op->url, &op->headers,
+					(op->settings.ACTION == DELETE ||
+					 op->settings.ACTION == DELETETASKS) ?
+							NULL : op->settings.file);
+			}
+			op_unlock_step(op);
+			break;
+		case STEP_UNLOCK:
+			/* the outcome of the PUT or DELETE stands */
+			op_finish(op);
+			break;
+	}
+}
+
+/**
+ * Call the callbacks of finished operations and free them.
+ * @param async A caldav_async.
+ */
+static void async_dispatch(caldav_async* async) {
+	GList* done = NULL;
+	GList* list;
+	async_op* op;
+	response result;
+	CALDAV_RESPONSE status;
+
+	for (list = async->ops; list; ) {
+		op = (async_op *) list->data;
+		list = list->next;
+		if (op->done) {
+			async->ops = g_list_remove(async->ops, op);
+			done = g_list_append(done, op);
+		}
+	}
+	for (list = done; list; list = list->next) {
+		op = (async_op *) list->data;
+		if (op->failed) {
+			status = caldav_error_response(&op->error);
+			result.msg = NULL;
+			result.len = 0;
+		}
+		else {
+			status = OK;
+			result.msg = op->settings.file;
+			result.len = (result.msg) ? strlen(result.msg) : 0;
+			op->settings.file = NULL;
+		}
+		if (op->callback)
+			op->callback(status, &result, &op->error, op->user_data);
+		g_free(result.msg);
+		op_free(op);
+	}
+	g_list_free(done);
+}
+
+/**
+ * Test whether any operation waits for its callback.
+ * @param async A caldav_async.
+ * @return TRUE if a finished operation is pending.
+ */
+static gboolean async_has_done(caldav_async* async) {
+	GList* list;
+
+	for (list = async->ops; list; list = list->next) {
+		if (((async_op *) list->data)->done)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * Function for creating an engine running CalDAV operations without
+ * blocking. An engine must only be used from one thread.
+ * @return A new caldav_async or NULL in case of error.
+ */
+caldav_async* caldav_async_new(void) {
+	caldav_async* async;
+
+	init_curl_global();
+	async = g_new0(caldav_async, 1);
+	async->multi = curl_multi_init();
+	if (! async->multi) {
+		g_free(async);
+		return NULL;
+	}
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	/* many requests share one HTTP/2 connection when the server allows */
+	curl_multi_setopt(async->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+	return async;
+}
+
+/**
+ * Function for limiting the connections an engine opens. Operations
+ * beyond the limits wait in the engine until a request finishes.
+ * @param async A caldav_async. @see caldav_async_new
+ * @param connections Connections per host. 0 (zero) for no limit.
+ * @param streams Requests multiplexed over one HTTP/2 connection. 0 (zero)
+ * leaves it to libcurl and the server.
+ */
+void caldav_async_limit(caldav_async* async, int connections, int streams) {
+	g_return_if_fail(async != NULL);
+
+#if LIBCURL_VERSION_NUM >= 0x071e00
+	curl_multi_setopt(async->multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+			(long) ((connections > 0) ? connections : 0));
+#endif
+#if LIBCURL_VERSION_NUM >= 0x074300
+	/* libcurl's own default is 100 */
+	curl_multi_setopt(async->multi, CURLMOPT_MAX_CONCURRENT_STREAMS,
+			(long) ((streams > 0) ? streams : 100));
+#endif
+}
+
+/**
+ * Function for freeing an engine. Operations still in flight are
+ * abandoned without calling their callbacks.
+ * @param async Address to a pointer to a caldav_async.
+ */
+void caldav_async_free(caldav_async** async) {
+	caldav_async* a;
+	GList* list;
+
+	if (*async) {
+		a = *async;
+		if (a->source) {
+			g_source_destroy(a->source);
+			g_source_unref(a->source);
+			a->source = NULL;
+		}
+		for (list = a->ops; list; list = list->next)
+			op_free((async_op *) list->data);
+		g_list_free(a->ops);
+		curl_multi_cleanup(a->multi);
+		g_free(a);
+		*async = a = NULL;
+	}
+}
+
+/**
+ * Function for starting a CalDAV operation without blocking.
+ * @param async A caldav_async. @see caldav_async_new
+ * @param action The CALDAV_ACTION to perform.
+ * @param object Calendar object for ADD, MODIFY, DELETE, MODIFYTASKS and
+ * DELETETASKS, otherwise NULL. Copied.
+ * @param start Start of time range for GET, GETTASKS and FREEBUSY.
+ * @param end End of time range for GET, GETTASKS and FREEBUSY.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure or NULL. Only the options
+ * are used, they are copied. @see runtime_info
+ * @param callback Called from caldav_async_perform() when the operation
+ * is finished. ISCALDAV succeeds once the URL is known to be a CalDAV
+ * collection, OPTIONS returns its Allow header in result->msg.
+ * @param user_data Passed to callback.
+ * @return 0 (zero) if the operation was started, -1 otherwise.
+ */
+int caldav_async_submit(caldav_async* async,
+			CALDAV_ACTION action,
+			const char* object,
+			time_t start,
+			time_t end,
+			const char* URL,
+			runtime_info* info,
+			caldav_async_callback callback,
+			void* user_data) {
+	async_op* op;
+
+	g_return_val_if_fail(async != NULL, -1);
+	g_return_val_if_fail(URL != NULL, -1);
+
+	op = g_new0(async_op, 1);
+	op->async = async;
+	op->callback = callback;
+	op->user_data = user_data;
+	init_caldav_settings(&op->settings);
+	op->settings.file = (object) ? g_strdup(object) : NULL;
+	op->settings.ACTION = action;
+	op->settings.start = start;
+	op->settings.end = end;
+	op->settings.use_locking = TRUE;
+	copy_caldav_options(&op->settings, info);
+	parse_url(&op->settings, URL);
+	async->ops = g_list_append(async->ops, op);
+	caldav_arena_begin();
+	op_start(op);
+	caldav_arena_end();
+	if (async->source)
+		g_main_context_wakeup(async->context);
+	return 0;
+}
+
+/**
+ * Function for making progress on all operations. Call it whenever one
+ * of the descriptors from caldav_async_fdset() is ready or the timeout
+ * from caldav_async_timeout() expired. Callbacks of finished operations
+ * are called from here.
+ * @param async A caldav_async. @see caldav_async_new
+ * @return The number of operations still in flight.
+ */
+int caldav_async_perform(caldav_async* async) {
+	CURLMsg* msg;
+	int running;
+	int left;
+	int finished;
+	char* priv;
+
+	g_return_val_if_fail(async != NULL, 0);
+
+	/* strings built for the next steps live until every step is sent */
+	caldav_arena_begin();
+	async_timers(async);
+	do {
+		finished = 0;
+		curl_multi_perform(async->multi, &running);
+		while ((msg = curl_multi_info_read(async->multi, &left)) != NULL) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			CURL* curl = msg->easy_handle;
+			CURLcode res = msg->data.result;
+			curl_easy_getinfo(curl, CURLINFO_PRIVATE, &priv);
+			curl_multi_remove_handle(async->multi, curl);
+			finished++;
+			if (op_hedge_done((async_op *) priv, curl, res))
+				continue;
+			op_step_done((async_op *) priv, res);
+		}
+		/* a finished step may have queued the next request */
+	} while (finished > 0);
+	caldav_arena_end();
+	async_dispatch(async);
+	return g_list_length(async->ops);
+}
+
+/**
+ * Function for getting the descriptors the engine waits for.
+ * @param async A caldav_async. @see caldav_async_new
+ * @param read_fd_set Descriptors to watch for reading.
+ * @param write_fd_set Descriptors to watch for writing.
+ * @param exc_fd_set Descriptors to watch for exceptions.
+ * @param max_fd Set to the highest descriptor added or -1 if none.
+ * @return 0 (zero) on success, -1 otherwise.
+ */
+int caldav_async_fdset(caldav_async* async,
+		       fd_set* read_fd_set,
+		       fd_set* write_fd_set,
+		       fd_set* exc_fd_set,
+		       int* max_fd) {
+	g_return_val_if_fail(async != NULL, -1);
+
+	if (curl_multi_fdset(async->multi, read_fd_set, write_fd_set,
+				exc_fd_set, max_fd) != CURLM_OK)
+		return -1;
+	return 0;
+}
+
+/**
+ * Function for getting how long the engine may wait before
+ * caldav_async_perform() must be called again.
+ * @param async A caldav_async. @see caldav_async_new
+ * @return Milliseconds, 0 (zero) to call it now or -1 if nothing is
+ * in flight.
+ */
+long caldav_async_timeout(caldav_async* async) {
+	long timeout = -1;
+	long timer;
+
+	g_return_val_if_fail(async != NULL, -1);
+
+	if (async_has_done(async))
+		return 0;
+	if (! async->ops)
+		return -1;
+	curl_multi_timeout(async->multi, &timeout);
+	/* libcurl has no timer set, poll now and then */
+	if (timeout < 0)
+		timeout = CALDAV_ASYNC_POLL;
+	/* a repetition or a hedge may be due sooner */
+	timer = async_next_timer(async);
+	if (timer >= 0 && timer < timeout)
+		timeout = timer;
+	return timeout;
+}
+
+static void async_source_clear(async_source* s) {
+	GSList* list;
+
+	for (list = s->fds; list; list = list->next) {
+		g_source_remove_poll(&s->source, (GPollFD *) list->data);
+		g_free(list->data);
+	}
+	g_slist_free(s->fds);
+	s->fds = NULL;
+}
+
+static gboolean async_source_prepare(GSource* source, gint* timeout) {
+	async_source* s = (async_source *) source;
+	fd_set fdread;
+	fd_set fdwrite;
+	fd_set fdexcep;
+	int max_fd = -1;
+	int fd;
+	long ms;
+
+	async_source_clear(s);
+	ms = caldav_async_timeout(s->async);
+	if (ms == 0)
+		return TRUE;
+	if (s->async->ops) {
+		FD_ZERO(&fdread);
+		FD_ZERO(&fdwrite);
+		FD_ZERO(&fdexcep);
+		curl_multi_fdset(s->async->multi, &fdread, &fdwrite, &fdexcep, &max_fd);
+		for (fd = 0; fd <= max_fd; fd++) {
+			GPollFD* poll_fd;
+			gushort events = 0;
+
+			if (FD_ISSET(fd, &fdread))
+				events |= G_IO_IN | G_IO_HUP | G_IO_ERR;
+			if (FD_ISSET(fd, &fdwrite))
+				events |= G_IO_OUT | G_IO_ERR;
+			if (FD_ISSET(fd, &fdexcep))
+				events |= G_IO_PRI;
+			if (! events)
+				continue;
+			poll_fd = g_new0(GPollFD, 1);
+			poll_fd->fd = fd;
+			poll_fd->events = events;
+			g_source_add_poll(source, poll_fd);
+			s->fds = g_slist_prepend(s->fds, poll_fd);
+		}
+	}
+	*timeout = (gint) ms;
+	return FALSE;
+}
+
+static gboolean async_source_check(GSource* source) {
+	async_source* s = (async_source *) source;
+	GSList* list;
+
+	for (list = s->fds; list; list = list->next) {
+		if (((GPollFD *) list->data)->revents)
+			return TRUE;
+	}
+	return (s->async->ops && caldav_async_timeout(s->async) == 0);
+}
+
+static gboolean async_source_dispatch(GSource* source,
+				      GSourceFunc callback,
+				      gpointer user_data) {
+	async_source* s = (async_source *) source;
+
+	caldav_async_perform(s->async);
+	return TRUE;
+}
+
+static void async_source_finalize(GSource* source) {
+	async_source* s = (async_source *) source;
+	GSList* list;
+
+	/* the source is gone, its polls went with it */
+	for (list = s->fds; list; list = list->next)
+		g_free(list->data);
+	g_slist_free(s->fds);
+	s->fds = NULL;
+}
+
+static GSourceFuncs async_source_funcs = {
+	.prepare = async_source_prepare,
+	.check = async_source_check,
+	.dispatch = async_source_dispatch,
+	.finalize = async_source_finalize
+};
+
+/**
+ * Function for letting a GLib main loop drive the engine. Afterwards
+ * callbacks are called from the main loop and caldav_async_perform()
+ * need not be called by hand.
+ * @param async A caldav_async. @see caldav_async_new
+ * @param context The GMainContext to attach to or NULL for the default
+ * context.
+ * @return The id of the GSource.
+ */
+unsigned int caldav_async_attach(caldav_async* async, void* context) {
+	async_source* s;
+
+	g_return_val_if_fail(async != NULL, 0);
+
+	if (async->source) {
+		g_source_destroy(async->source);
+		g_source_unref(async->source);
+	}
+	async->context = (context) ?
+		(GMainContext *) context : g_main_context_default();
+	async->source = g_source_new(&async_source_funcs, sizeof(async_source));
+	s = (async_source *) async->source;
+	s->async = async;
+	s->fds = NULL;
+	return g_source_attach(async->source, async->context);
+}
+
+/**
+ * @struct async_batch
+ * The state of one batch call. New operations are submitted as earlier
+ * ones finish so only a bounded number is in flight.
+ */
+typedef struct {
+	caldav_async* async;
+	CALDAV_ACTION action;
+	const char** objects;
+	const char** URLs;
+	int count;
+	int next;
+	int in_flight;
+	int window;
+	time_t start;
+	time_t end;
+	CALDAV_RESPONSE* results;
+	response* responses;
+	caldav_error* errors;
+	CALDAV_RESPONSE first_failure;
+	gboolean failed;
+	const char* URL;
+	runtime_info* info;
+	caldav_fanout_callback callback;
+	void* user_data;
+} async_batch;
+
+/**
+ * @struct async_batch_item
+ * Identifies an object of a batch in callbacks.
+ */
+typedef struct {
+	async_batch* batch;
+	int index;
+} async_batch_item;
+
+static void batch_submit(async_batch* batch);
+
+static void batch_done(CALDAV_RESPONSE status,
+		       response* result,
+		       caldav_error* error,
+		       void* user_data) {
+	async_batch_item* item = (async_batch_item *) user_data;
+	async_batch* batch = item->batch;
+
+	if (batch->callback)
+		batch->callback(item->index, status, result, error,
+				batch->user_data);
+	if (batch->responses) {
+		batch->responses[item->index].msg = result->msg;
+		batch->responses[item->index].len = (result->msg) ? result->len : 0;
+		result->msg = NULL;
+	}
+	if (batch->results)
+		batch->results[item->index] = status;
+	if (batch->errors) {
+		batch->errors[item->index].code = error->code;
+		batch->errors[item->index].str = g_strdup(error->str);
+		batch->errors[item->index].retry_after = error->retry_after;
+	}
+	if (status != OK && ! batch->failed) {
+		batch->failed = TRUE;
+		batch->first_failure = status;
+	}
+	batch->in_flight--;
+	g_free(item);
+	batch_submit(batch);
+}
+
+/**
+ * Submit objects of a batch until the window is full.
+ * @param batch An async_batch.
+ */
+static void batch_submit(async_batch* batch) {
+	async_batch_item* item;
+
+	while (batch->next < batch->count && batch->in_flight < batch->window) {
+		item = g_new0(async_batch_item, 1);
+		item->batch = batch;
+		item->index = batch->next++;
+		batch->in_flight++;
+		caldav_async_submit(batch->async, batch->action,
+				(batch->objects) ? batch->objects[item->index] : NULL,
+				batch->start, batch->end,
+				(batch->URLs) ? batch->URLs[item->index] : batch->URL,
+				batch->info, batch_done, item);
+	}
+}
+
+/**
+ * Submit the operations of a batch and wait for all of them.
+ * @param batch An async_batch with its engine. The engine is freed.
+ * @return OK or the response of the first operation which failed.
+ */
+static CALDAV_RESPONSE batch_drive(async_batch* batch) {
+	long timeout;
+
+	batch_submit(batch);
+	while (caldav_async_perform(batch->async) > 0) {
+		timeout = caldav_async_timeout(batch->async);
+		if (timeout > 0)
+			curl_multi_wait(batch->async->multi, NULL, 0, (int) timeout, NULL);
+	}
+	caldav_async_free(&batch->async);
+	return (batch->failed) ? batch->first_failure : OK;
+}
+
+/**
+ * Run a batch of write operations to completion.
+ * @param action ADD, MODIFY or DELETE.
+ * @see caldav_add_objects
+ */
+static CALDAV_RESPONSE async_batch_run(CALDAV_ACTION action,
+				       const char** objects,
+				       int count,
+				       CALDAV_RESPONSE* results,
+				       caldav_error* errors,
+				       const char* URL,
+				       runtime_info* info) {
+	async_batch batch;
+	int connections = CALDAV_BATCH_CONNECTIONS;
+	int streams = CALDAV_BATCH_DEPTH;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if (errors && count > 0)
+		memset(errors, 0, count * sizeof(caldav_error));
+	if (count <= 0)
+		return OK;
+	memset(&batch, 0, sizeof(async_batch));
+	batch.async = caldav_async_new();
+	if (! batch.async) {
+		if (info->error) {
+			info->error->code = -1;
+			info->error->str = g_strdup("Could not initialize libcurl");
+		}
+		return CONFLICT;
+	}
+	if (info->options && info->options->max_connections > 0)
+		connections = info->options->max_connections;
+	if (info->options && info->options->max_streams > 0)
+		streams = info->options->max_streams;
+	caldav_async_limit(batch.async, connections, streams);
+	batch.action = action;
+	batch.objects = objects;
+	batch.count = count;
+	batch.window = connections * streams;
+	batch.results = results;
+	batch.errors = errors;
+	batch.URL = URL;
+	batch.info = info;
+	return batch_drive(&batch);
+}
+
+/**
+ * Function for adding many events concurrently. At most
+ * debug_curl.max_streams requests are in flight on each of at most
+ * debug_curl.max_connections connections, multiplexed over HTTP/2 where
+ * the server supports it.
+ * @param objects Array of appointments following ICal format (RFC2445).
+ * @param count Number of objects.
+ * @param results NULL or an array of count responses, one per object.
+ * @param errors NULL or an array of count caldav_error, one per object.
+ * Clear it with caldav_free_errors().
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return OK if every object was added, otherwise the response for the
+ * first object which failed. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_add_objects(const char** objects,
+				   int count,
+				   CALDAV_RESPONSE* results,
+				   caldav_error* errors,
+				   const char* URL,
+				   runtime_info* info) {
+	return async_batch_run(ADD, objects, count, results, errors, URL, info);
+}
+
+/**
+ * Function for modifying many events concurrently.
+ * @see caldav_add_objects
+ */
+CALDAV_RESPONSE caldav_modify_objects(const char** objects,
+				      int count,
+				      CALDAV_RESPONSE* results,
+				      caldav_error* errors,
+				      const char* URL,
+				      runtime_info* info) {
+	return async_batch_run(MODIFY, objects, count, results, errors, URL, info);
+}
+
+/**
+ * Function for deleting many events concurrently.
+ * @see caldav_add_objects
+ */
+CALDAV_RESPONSE caldav_delete_objects(const char** objects,
+				      int count,
+				      CALDAV_RESPONSE* results,
+				      caldav_error* errors,
+				      const char* URL,
+				      runtime_info* info) {
+	return async_batch_run(DELETE, objects, count, results, errors, URL, info);
+}
+
+/**
+ * Function for running the same report on many collections at once. At
+ * most debug_curl.max_fanout collections are fetched at the same time and
+ * debug_curl.max_connections and debug_curl.max_streams bound what goes
+ * to each host. Completions are handed to callback in the order they
+ * arrive so a slow server only delays its own collections.
+ * @param action GETALL, GET, GETALLTASKS, GETTASKS, FREEBUSY or
+ * GETCALNAME.
+ * @param URLs Array of count collections. Each carries its own
+ * credentials: [http://][username[:password]@]host[:port]/url-path.
+ * @param count Number of collections.
+ * @param start Start of time range for GET, GETTASKS and FREEBUSY.
+ * @param end End of time range for GET, GETTASKS and FREEBUSY.
+ * @param statuses NULL or an array of count responses, one per collection.
+ * @param results NULL or an array of count response receiving what each
+ * collection returned unless callback kept it. Clear it with
+ * caldav_free_results().
+ * @param errors NULL or an array of count caldav_error, one per
+ * collection. Clear it with caldav_free_errors().
+ * @param callback NULL or called once per collection as soon as it is
+ * done. It may keep result->msg by setting it to NULL.
+ * @param user_data Passed to callback.
+ * @param info Pointer to a runtime_info structure. Only the options are
+ * used. @see runtime_info
+ * @return OK if every collection answered, otherwise the response for
+ * the first one which failed. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_fanout(CALDAV_ACTION action,
+			      const char** URLs,
+			      int count,
+			      time_t start,
+			      time_t end,
+			      CALDAV_RESPONSE* statuses,
+			      response* results,
+			      caldav_error* errors,
+			      caldav_fanout_callback callback,
+			      void* user_data,
+			      runtime_info* info) {
+	async_batch batch;
+	int connections = CALDAV_BATCH_CONNECTIONS;
+	int streams = CALDAV_BATCH_DEPTH;
+	int i;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+	g_return_val_if_fail(URLs != NULL || count <= 0, CONFLICT);
+
+	for (i = 0; i < count; i++) {
+		if (errors)
+			memset(&errors[i], 0, sizeof(caldav_error));
+		if (results) {
+			results[i].msg = NULL;
+			results[i].len = 0;
+		}
+	}
+	if (count <= 0)
+		return OK;
+	switch (action) {
+		case GETALL:
+		case GET:
+		case GETALLTASKS:
+		case GETTASKS:
+		case FREEBUSY:
+		case GETCALNAME:
+			break;
+		default:
+			if (info->error) {
+				info->error->code = -1;
+				info->error->str = g_strdup("Action is not a read");
+			}
+			return CONFLICT;
+	}
+	memset(&batch, 0, sizeof(async_batch));
+	batch.async = caldav_async_new();
+	if (! batch.async) {
+		if (info->error) {
+			info->error->code = -1;
+			info->error->str = g_strdup("Could not initialize libcurl");
+		}
+		return CONFLICT;
+	}
+	if (info->options && info->options->max_connections > 0)
+		connections = info->options->max_connections;
+	if (info->options && info->options->max_streams > 0)
+		streams = info->options->max_streams;
+	caldav_async_limit(batch.async, connections, streams);
+	batch.action = action;
+	batch.URLs = URLs;
+	batch.count = count;
+	batch.start = start;
+	batch.end = end;
+	batch.window = (info->options && info->options->max_fanout > 0) ?
+		info->options->max_fanout : CALDAV_FANOUT_WIDTH;
+	batch.results = statuses;
+	batch.responses = results;
+	batch.errors = errors;
+	batch.info = info;
+	batch.callback = callback;
+	batch.user_data = user_data;
+	return batch_drive(&batch);
+}
+
+/**
+ * Function for freeing the messages in an array of caldav_error filled
+ * by one of the batch calls. The array itself belongs to the caller.
+ * @param errors An array of caldav_error.
+ * @param count Number of elements.
+ */
+void caldav_free_errors(caldav_error* errors, int count) {
+	int i;
+
+	if (! errors)
+		return;
+	for (i = 0; i < count; i++) {
+		g_free(errors[i].str);
+		errors[i].str = NULL;
+		errors[i].code = 0;
+		errors[i].retry_after = 0;
+	}
+}
+
+/**
+ * Function for freeing the messages in an array of response filled by
+ * caldav_fanout(). The array itself belongs to the caller.
+ * @param results An array of response.
+ * @param count Number of elements.
+ */
+void caldav_free_results(response* results, int count) {
+	int i;
+
+	if (! results)
+		return;
+	for (i = 0; i < count; i++) {
+		g_free(results[i].msg);
+		results[i].msg = NULL;
+		results[i].len = 0;
+	}
+}
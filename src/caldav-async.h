@@ -0,0 +1,69 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __CALDAV_ASYNC_H__
+#define __CALDAV_ASYNC_H__
+
+#include "caldav-utils.h"
+#include "caldav.h"
+#include <glib.h>
+#include <curl/curl.h>
+
+/** Milliseconds between polls while libcurl has no timer running */
+#ifndef CALDAV_ASYNC_POLL
+#define CALDAV_ASYNC_POLL 100
+#endif
+
+/** Parallel connections per host used by the batch calls by default */
+#ifndef CALDAV_BATCH_CONNECTIONS
+#define CALDAV_BATCH_CONNECTIONS 6
+#endif
+
+/**
+ * Requests kept in flight per connection by the batch calls by default.
+ * Over HTTP/2 these are concurrent streams
+ */
+#ifndef CALDAV_BATCH_DEPTH
+#define CALDAV_BATCH_DEPTH 8
+#endif
+
+/** Collections fetched at the same time by caldav_fanout by default */
+#ifndef CALDAV_FANOUT_WIDTH
+#define CALDAV_FANOUT_WIDTH 32
+#endif
+
+/** Latencies of earlier reads the hedging delay is taken from */
+#ifndef CALDAV_HEDGE_SAMPLES
+#define CALDAV_HEDGE_SAMPLES 128
+#endif
+
+/**
+ * @struct _caldav_async
+ * A curl_multi handle and the operations running on it.
+ */
+struct _caldav_async {
+	CURLM* multi;
+	GList* ops;
+	GSource* source;
+	GMainContext* context;
+	gint64 latency[CALDAV_HEDGE_SAMPLES];	/* microseconds, a ring */
+	int latencies;
+};
+
+#endif
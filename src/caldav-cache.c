@@ -0,0 +1,958 @@
+/* vim: set textwidth=80 tabstop=4 smarttab: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "caldav-cache.h"
+#include "sync-caldav-collection.h"
+#include "get-multiget-report.h"
+#include "get-caldav-report.h"
+#include "get-freebusy-report.h"
+#include <glib.h>
+#include <curl/curl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * The cache file starts with a cache_header followed by records. Every
+ * record is a cache_record, the NUL terminated key, ETag and data, and
+ * padding to a multiple of 8 bytes. Records are only ever appended, the
+ * newest record for a key wins and a CACHE_REMOVE record forgets it.
+ * A torn record at the end is recognized by its checksum and cut off.
+ * Integers are stored in host byte order.
+ */
+#define CACHE_MAGIC "LCDVCACH"
+#define CACHE_VERSION 1
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_ALIGN(n) (((n) + 7) & ~((gsize) 7))
+
+/**
+ * @struct cache_header
+ * The first bytes of a cache file.
+ */
+typedef struct {
+	gchar magic[8];
+	guint32 version;
+	guint32 byte_order;
+} cache_header;
+
+/**
+ * @enum CACHE_KIND the meaning of a record.
+ */
+typedef enum {
+	CACHE_OBJECT = 1,
+	CACHE_REMOVE,
+	CACHE_TOKEN
+} CACHE_KIND;
+
+/**
+ * @struct cache_record
+ * The fixed part of a record. The lengths do not count the NULs.
+ */
+typedef struct {
+	guint32 kind;
+	guint32 key_len;
+	guint32 etag_len;
+	guint32 data_len;
+	guint32 sum;
+	guint32 reserved;
+} cache_record;
+
+/**
+ * @struct cache_entry
+ * Where the newest record for a key is found in the file.
+ */
+typedef struct {
+	gsize offset;
+	gsize size;
+	CACHE_KIND kind;
+} cache_entry;
+
+/**
+ * @struct cache_interval
+ * The time-range index of a collection and when the collection was last
+ * synchronized, or 0.
+ */
+typedef struct {
+	caldav_index* index;
+	time_t synced;
+} cache_interval;
+
+static gsize record_size(const cache_record* record) {
+	return CACHE_ALIGN(sizeof(cache_record) + (gsize) record->key_len +
+			record->etag_len + record->data_len + 3);
+}
+
+/**
+ * FNV-1a over the lengths and the strings of a record.
+ */
+static guint32 record_sum(const cache_record* record, const gchar* payload) {
+	const guchar* p = (const guchar *) record;
+	guint32 sum = 2166136261u;
+	gsize len, i;
+
+	for (i = 0; i < G_STRUCT_OFFSET(cache_record, sum); i++)
+		sum = (sum ^ p[i]) * 16777619u;
+	p = (const guchar *) payload;
+	len = (gsize) record->key_len + record->etag_len + record->data_len + 3;
+	for (i = 0; i < len; i++)
+		sum = (sum ^ p[i]) * 16777619u;
+	return sum;
+}
+
+static gchar* cache_key(const gchar* collection, const gchar* href) {
+	return g_strdup_printf("%s\n%s", collection, (href) ? href : "");
+}
+
+/**
+ * Make sure the mapping covers the whole file. The mapping is made
+ * larger than the file so appends do not force a new one every time.
+ * @return TRUE if the file is mapped.
+ */
+static gboolean cache_map(caldav_cache* cache) {
+	gpointer map;
+	gsize size;
+
+	if (cache->map && cache->map_size >= cache->size)
+		return TRUE;
+	if (cache->map)
+		munmap(cache->map, cache->map_size);
+	cache->map = NULL;
+	cache->map_size = 0;
+	size = CACHE_ALIGN(cache->size + cache->size / 2 + 4096);
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, cache->fd, 0);
+	if (map == MAP_FAILED)
+		return FALSE;
+	cache->map = (gchar *) map;
+	cache->map_size = size;
+	return TRUE;
+}
+
+/**
+ * Point the index at a new record.
+ * @param key The key. Owned by the index afterwards.
+ */
+static void cache_index(caldav_cache* cache, gchar* key,
+			gsize offset, gsize size, CACHE_KIND kind) {
+	cache_entry* entry;
+
+	entry = g_hash_table_lookup(cache->index, key);
+	if (entry)
+		cache->live -= entry->size;
+	if (kind == CACHE_REMOVE) {
+		g_hash_table_remove(cache->index, key);
+		g_free(key);
+		return;
+	}
+	entry = g_new(cache_entry, 1);
+	entry->offset = offset;
+	entry->size = size;
+	entry->kind = kind;
+	g_hash_table_replace(cache->index, key, entry);
+	cache->live += size;
+}
+
+/**
+ * Build the index from the records in the file.
+ */
+static void cache_load(caldav_cache* cache) {
+	const cache_record* record;
+	const gchar* payload;
+	gsize offset = sizeof(cache_header);
+	gsize size;
+
+	while (offset + sizeof(cache_record) <= cache->size) {
+		record = (const cache_record *) (cache->map + offset);
+		if (record->kind < CACHE_OBJECT || record->kind > CACHE_TOKEN ||
+				record->key_len > cache->size ||
+				record->etag_len > cache->size ||
+				record->data_len > cache->size)
+			break;
+		size = record_size(record);
+		if (offset + size > cache->size)
+			break;
+		payload = (const gchar *) (record + 1);
+		if (record_sum(record, payload) != record->sum)
+			break;
+		cache_index(cache, g_strndup(payload, record->key_len),
+				offset, size, (CACHE_KIND) record->kind);
+		offset += size;
+	}
+	if (offset < cache->size) {
+		/* the last write did not make it, drop it */
+		if (ftruncate(cache->fd, offset) == 0)
+			cache->size = offset;
+	}
+}
+
+/**
+ * Append a record and point the index at it.
+ * @return TRUE if the record was written.
+ */
+static gboolean cache_append(caldav_cache* cache, CACHE_KIND kind,
+			     const gchar* key, const gchar* etag,
+			     const gchar* data) {
+	cache_record record;
+	gchar* buf;
+	gchar* p;
+	gsize size, done = 0;
+	ssize_t n;
+
+	memset(&record, 0, sizeof(cache_record));
+	record.kind = kind;
+	record.key_len = strlen(key);
+	record.etag_len = (etag) ? strlen(etag) : 0;
+	record.data_len = (data) ? strlen(data) : 0;
+	size = record_size(&record);
+	buf = g_malloc0(size);
+	p = buf + sizeof(cache_record);
+	memcpy(p, key, record.key_len);
+	p += record.key_len + 1;
+	if (etag)
+		memcpy(p, etag, record.etag_len);
+	p += record.etag_len + 1;
+	if (data)
+		memcpy(p, data, record.data_len);
+	record.sum = record_sum(&record, buf + sizeof(cache_record));
+	memcpy(buf, &record, sizeof(cache_record));
+	while (done < size) {
+		n = pwrite(cache->fd, buf + done, size - done, cache->size + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			/* leave no half record behind */
+			n = ftruncate(cache->fd, cache->size);
+			g_free(buf);
+			return FALSE;
+		}
+		done += n;
+	}
+	g_free(buf);
+	cache_index(cache, g_strdup(key), cache->size, size, kind);
+	cache->size += size;
+	return TRUE;
+}
+
+/**
+ * Find the newest record for a key.
+ * @return The record or NULL. Only valid while the lock is held.
+ */
+static const cache_record* cache_find(caldav_cache* cache, const gchar* key,
+				      CACHE_KIND kind) {
+	cache_entry* entry;
+
+	entry = g_hash_table_lookup(cache->index, key);
+	if (! entry || entry->kind != kind || ! cache_map(cache))
+		return NULL;
+	return (const cache_record *) (cache->map + entry->offset);
+}
+
+#define RECORD_KEY(r) ((const gchar *) ((r) + 1))
+#define RECORD_ETAG(r) (RECORD_KEY(r) + (r)->key_len + 1)
+#define RECORD_DATA(r) (RECORD_ETAG(r) + (r)->etag_len + 1)
+
+/**
+ * Write the live records to a new file and replace the old one.
+ */
+static void cache_compact(caldav_cache* cache) {
+	GHashTableIter iter;
+	gpointer value;
+	cache_entry* entry;
+	cache_header header;
+	gchar* tmp;
+	int fd;
+	gboolean failed = FALSE;
+
+	if (cache->size < CALDAV_CACHE_COMPACT || cache->live * 2 > cache->size)
+		return;
+	if (! cache_map(cache))
+		return;
+	tmp = g_strdup_printf("%s.tmp", cache->path);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		g_free(tmp);
+		return;
+	}
+	memcpy(header.magic, CACHE_MAGIC, 8);
+	header.version = CACHE_VERSION;
+	header.byte_order = CACHE_BYTE_ORDER;
+	if (write(fd, &header, sizeof(header)) != sizeof(header))
+		failed = TRUE;
+	g_hash_table_iter_init(&iter, cache->index);
+	while (! failed && g_hash_table_iter_next(&iter, NULL, &value)) {
+		entry = (cache_entry *) value;
+		if (write(fd, cache->map + entry->offset, entry->size) !=
+				(ssize_t) entry->size)
+			failed = TRUE;
+	}
+	if (fsync(fd) != 0)
+		failed = TRUE;
+	close(fd);
+	if (failed || rename(tmp, cache->path) != 0)
+		unlink(tmp);
+	g_free(tmp);
+}
+
+static void free_entry(gpointer data) {
+	g_free(data);
+}
+
+static void free_interval(gpointer data) {
+	cache_interval* interval = (cache_interval *) data;
+
+	caldav_index_free(interval->index);
+	g_free(interval);
+}
+
+/**
+ * Function for opening an on-disk object cache. The file is created if
+ * it does not exist. When set in debug_curl.cache, sessions fetching
+ * all events or tasks only download objects whose ETag changed, and
+ * writes update the cache from the ETag the server answers with.
+ * Time-range reads and free/busy queries are answered from the cached
+ * objects unless debug_curl.cache_ttl is negative.
+ * The cache can be shared by any number of sessions and threads, but a
+ * file can only be open once at a time.
+ * @param path Name of the cache file.
+ * @return A new cache or NULL if the file could not be opened or is
+ * already in use.
+ */
+caldav_cache* caldav_cache_open(const char* path) {
+	caldav_cache* cache;
+	cache_header header;
+	struct stat st;
+
+	g_return_val_if_fail(path != NULL, NULL);
+
+	cache = g_new0(caldav_cache, 1);
+	cache->fd = open(path, O_RDWR | O_CREAT, 0600);
+	/* one process at a time, the index is not shared */
+	if (cache->fd < 0 || flock(cache->fd, LOCK_EX | LOCK_NB) != 0 ||
+			fstat(cache->fd, &st) != 0) {
+		if (cache->fd >= 0)
+			close(cache->fd);
+		g_free(cache);
+		return NULL;
+	}
+	cache->path = g_strdup(path);
+	cache->size = st.st_size;
+	cache->index = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, free_entry);
+	cache->intervals = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, free_interval);
+	g_mutex_init(&cache->lock);
+	if (cache->size >= sizeof(cache_header) && cache_map(cache)) {
+		memcpy(&header, cache->map, sizeof(cache_header));
+		if (memcmp(header.magic, CACHE_MAGIC, 8) == 0 &&
+				header.version == CACHE_VERSION &&
+				header.byte_order == CACHE_BYTE_ORDER) {
+			cache_load(cache);
+			return cache;
+		}
+	}
+	/* new or unusable, it is only a cache so start over */
+	memcpy(header.magic, CACHE_MAGIC, 8);
+	header.version = CACHE_VERSION;
+	header.byte_order = CACHE_BYTE_ORDER;
+	if (ftruncate(cache->fd, 0) != 0 ||
+			pwrite(cache->fd, &header, sizeof(header), 0) != sizeof(header)) {
+		caldav_cache_close(&cache);
+		return NULL;
+	}
+	cache->size = sizeof(header);
+	return cache;
+}
+
+/**
+ * Function for closing a cache, compacting the file first if most of it
+ * holds replaced objects.
+ * @param cache Address to a pointer to a caldav_cache.
+ */
+void caldav_cache_close(caldav_cache** cache) {
+	caldav_cache* c;
+
+	if (*cache) {
+		c = *cache;
+		if (c->index)
+			cache_compact(c);
+		if (c->map)
+			munmap(c->map, c->map_size);
+		if (c->index) {
+			g_hash_table_destroy(c->index);
+			g_hash_table_destroy(c->intervals);
+			g_mutex_clear(&c->lock);
+		}
+		close(c->fd);
+		g_free(c->path);
+		g_free(c);
+		*cache = c = NULL;
+	}
+}
+
+/**
+ * Look up a cached object.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param href Path of the object.
+ * @param etag Where to store a copy of the ETag or NULL.
+ * @param data Where to store a copy of the object or NULL.
+ * @return TRUE if the object is cached.
+ */
+gboolean caldav_cache_get(caldav_cache* cache,
+			  const gchar* collection,
+			  const gchar* href,
+			  gchar** etag,
+			  gchar** data) {
+	const cache_record* record;
+	gchar* key;
+
+	key = cache_key(collection, href);
+	g_mutex_lock(&cache->lock);
+	record = cache_find(cache, key, CACHE_OBJECT);
+	if (record) {
+		if (etag)
+			*etag = g_strdup(RECORD_ETAG(record));
+		if (data)
+			*data = g_strdup(RECORD_DATA(record));
+	}
+	g_mutex_unlock(&cache->lock);
+	g_free(key);
+	return (record != NULL);
+}
+
+/**
+ * Store an object and its ETag, replacing any previous version.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param href Path of the object.
+ * @param etag The ETag.
+ * @param data The object.
+ */
+void caldav_cache_put(caldav_cache* cache,
+		      const gchar* collection,
+		      const gchar* href,
+		      const gchar* etag,
+		      const gchar* data) {
+	cache_interval* interval;
+	gchar* key;
+
+	key = cache_key(collection, href);
+	g_mutex_lock(&cache->lock);
+	if (cache_append(cache, CACHE_OBJECT, key, etag, data) &&
+			(interval = g_hash_table_lookup(cache->intervals, collection)))
+		caldav_index_put(interval->index, href, (data) ? data : "",
+				(data) ? strlen(data) : 0);
+	g_mutex_unlock(&cache->lock);
+	g_free(key);
+}
+
+/**
+ * Forget an object.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param href Path of the object.
+ */
+void caldav_cache_remove(caldav_cache* cache,
+			 const gchar* collection,
+			 const gchar* href) {
+	cache_interval* interval;
+	gchar* key;
+
+	key = cache_key(collection, href);
+	g_mutex_lock(&cache->lock);
+	if (g_hash_table_lookup(cache->index, key) &&
+			cache_append(cache, CACHE_REMOVE, key, NULL, NULL) &&
+			(interval = g_hash_table_lookup(cache->intervals, collection)))
+		caldav_index_remove(interval->index, href);
+	g_mutex_unlock(&cache->lock);
+	g_free(key);
+}
+
+/**
+ * Fetch the synchronization token stored for a collection.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @return The token or NULL. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_cache_token(caldav_cache* cache, const gchar* collection) {
+	const cache_record* record;
+	gchar* key;
+	gchar* token = NULL;
+
+	key = cache_key(collection, NULL);
+	g_mutex_lock(&cache->lock);
+	record = cache_find(cache, key, CACHE_TOKEN);
+	if (record)
+		token = g_strdup(RECORD_DATA(record));
+	g_mutex_unlock(&cache->lock);
+	g_free(key);
+	return token;
+}
+
+/**
+ * Store the synchronization token for a collection.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param token The token.
+ */
+void caldav_cache_set_token(caldav_cache* cache,
+			    const gchar* collection,
+			    const gchar* token) {
+	gchar* key;
+
+	key = cache_key(collection, NULL);
+	g_mutex_lock(&cache->lock);
+	cache_append(cache, (token) ? CACHE_TOKEN : CACHE_REMOVE, key, NULL, token);
+	g_mutex_unlock(&cache->lock);
+	g_free(key);
+}
+
+static int compare_objects(const void* a, const void* b) {
+	return strcmp(((const caldav_object *) a)->href,
+			((const caldav_object *) b)->href);
+}
+
+/**
+ * Copy the cached objects of a collection, with or without their data.
+ * Internal function.
+ */
+static void cache_list(caldav_cache* cache,
+		       const gchar* collection,
+		       gboolean data,
+		       caldav_objects* result) {
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	GPtrArray* found;
+	const cache_record* record;
+	cache_entry* entry;
+	gchar* prefix;
+	gsize len;
+	guint i;
+
+	result->objects = NULL;
+	result->count = 0;
+	prefix = cache_key(collection, NULL);
+	len = strlen(prefix);
+	found = g_ptr_array_new();
+	g_mutex_lock(&cache->lock);
+	g_hash_table_iter_init(&iter, cache->index);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		entry = (cache_entry *) value;
+		if (entry->kind == CACHE_OBJECT &&
+				strncmp((const gchar *) key, prefix, len) == 0)
+			g_ptr_array_add(found, entry);
+	}
+	if (found->len && cache_map(cache)) {
+		result->objects = g_new0(caldav_object, found->len);
+		for (i = 0; i < found->len; i++) {
+			entry = (cache_entry *) g_ptr_array_index(found, i);
+			record = (const cache_record *) (cache->map + entry->offset);
+			result->objects[i].href = g_strdup(RECORD_KEY(record) + len);
+			result->objects[i].etag = g_strdup(RECORD_ETAG(record));
+			if (data)
+				result->objects[i].data = g_strdup(RECORD_DATA(record));
+		}
+		result->count = found->len;
+	}
+	g_mutex_unlock(&cache->lock);
+	g_ptr_array_free(found, TRUE);
+	g_free(prefix);
+	qsort(result->objects, result->count, sizeof(caldav_object),
+			compare_objects);
+}
+
+/**
+ * Copy every cached object of a collection.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param result A pointer to caldav_objects receiving the objects sorted
+ * by href. Clear it with caldav_free_objects().
+ */
+void caldav_cache_objects(caldav_cache* cache,
+			  const gchar* collection,
+			  caldav_objects* result) {
+	cache_list(cache, collection, TRUE, result);
+}
+
+/**
+ * List the href and ETag of every cached object of a collection. The
+ * data is left out, so comparing with the server costs no copy of it.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param result A pointer to caldav_objects receiving the objects sorted
+ * by href, data set to NULL. Clear it with caldav_free_objects().
+ */
+void caldav_cache_etags(caldav_cache* cache,
+			const gchar* collection,
+			caldav_objects* result) {
+	cache_list(cache, collection, FALSE, result);
+}
+
+/**
+ * Update the cache after a successful PUT or DELETE. The object is
+ * stored with the ETag from the response, or forgotten if it was deleted
+ * or the server did not send one.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param url URL of the object, with or without scheme.
+ * @param headers The response headers.
+ * @param object The object sent or NULL for a DELETE.
+ */
+void caldav_cache_written(caldav_settings* settings,
+			  const gchar* url,
+			  const struct MemoryStruct* headers,
+			  const gchar* object) {
+	const gchar* href;
+	gchar* collection;
+	gchar* etag = NULL;
+
+	if (! settings->cache || ! url)
+		return;
+	href = (strstr(url, "://")) ? strstr(url, "://") + 3 : url;
+	if ((href = strchr(href, '/')) == NULL)
+		return;
+	collection = collection_key(settings);
+	if (object && headers)
+		etag = get_response_header("ETag", headers, FALSE);
+	/* the server changed what we sent if it did not answer with an ETag */
+	if (etag)
+		caldav_cache_put(settings->cache, collection, href, etag, object);
+	else
+		caldav_cache_remove(settings->cache, collection, href);
+	g_free(etag);
+	g_free(collection);
+}
+
+/**
+ * Find the interval index of a collection, building it from the cached
+ * objects the first time. The lock must be held.
+ */
+static cache_interval* cache_intervals(caldav_cache* cache,
+				       const gchar* collection) {
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	cache_interval* interval;
+	const cache_record* record;
+	cache_entry* entry;
+	gchar* prefix;
+	gsize len;
+
+	interval = g_hash_table_lookup(cache->intervals, collection);
+	if (interval)
+		return interval;
+	interval = g_new0(cache_interval, 1);
+	interval->index = caldav_index_new();
+	prefix = cache_key(collection, NULL);
+	len = strlen(prefix);
+	g_hash_table_iter_init(&iter, cache->index);
+	while (cache_map(cache) && g_hash_table_iter_next(&iter, &key, &value)) {
+		entry = (cache_entry *) value;
+		if (entry->kind != CACHE_OBJECT ||
+				strncmp((const gchar *) key, prefix, len) != 0)
+			continue;
+		record = (const cache_record *) (cache->map + entry->offset);
+		caldav_index_put(interval->index, RECORD_KEY(record) + len,
+				RECORD_DATA(record), record->data_len);
+	}
+	g_free(prefix);
+	g_hash_table_insert(cache->intervals, g_strdup(collection), interval);
+	return interval;
+}
+
+/**
+ * Clear the error from a failed attempt which is recovered from.
+ * @param error A pointer to caldav_error. @see caldav_error
+ */
+static void clear_error(caldav_error* error) {
+	g_free(error->str);
+	error->str = NULL;
+	error->code = 0;
+	error->retry_after = 0;
+}
+
+/**
+ * Bring the cached objects of a collection up to date with caldav_sync
+ * and calendar-multiget. A synchronization still truncated fails too:
+ * what was listed is cached, but neither the token is moved nor the
+ * collection marked synchronized.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param collection Key of the collection. @see collection_key
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+static gboolean cache_refresh(caldav_settings* settings,
+			      const gchar* collection,
+			      caldav_error* error) {
+	caldav_cache* cache = settings->cache;
+	cache_interval* interval;
+	caldav_objects known;
+	caldav_objects fetched;
+	caldav_changes changes;
+	const gchar** hrefs;
+	gchar* token;
+	int i;
+
+	token = caldav_cache_token(cache, collection);
+	caldav_cache_etags(cache, collection, &known);
+	if (caldav_sync(settings, token, &known, &changes, error)) {
+		caldav_free_objects(&known);
+		g_free(token);
+		return TRUE;
+	}
+	g_free(token);
+	caldav_free_objects(&known);
+	for (i = 0; i < changes.deleted_count; i++)
+		caldav_cache_remove(cache, collection, changes.deleted[i]);
+	if (changes.changed_count) {
+		fetched.objects = NULL;
+		fetched.count = 0;
+		hrefs = g_new0(const gchar*, changes.changed_count);
+		for (i = 0; i < changes.changed_count; i++)
+			hrefs[i] = changes.changed[i].href;
+		if (caldav_multiget(settings, hrefs, changes.changed_count, 0,
+					&fetched, error)) {
+			/* the token is kept so the changes are asked for again */
+			g_free(hrefs);
+			caldav_free_objects(&fetched);
+			caldav_free_changes(&changes);
+			return TRUE;
+		}
+		g_free(hrefs);
+		for (i = 0; i < changes.changed_count; i++) {
+			if (! caldav_objects_lookup(&fetched, changes.changed[i].href))
+				caldav_cache_remove(cache, collection,
+						changes.changed[i].href);
+		}
+		for (i = 0; i < fetched.count; i++)
+			caldav_cache_put(cache, collection, fetched.objects[i].href,
+					fetched.objects[i].etag, fetched.objects[i].data);
+		caldav_free_objects(&fetched);
+	}
+	if (changes.partial) {
+		/* the cache holds what was listed, the old token asks again */
+		caldav_free_changes(&changes);
+		return TRUE;
+	}
+	caldav_cache_set_token(cache, collection, changes.token);
+	caldav_free_changes(&changes);
+	g_mutex_lock(&cache->lock);
+	interval = g_hash_table_lookup(cache->intervals, collection);
+	if (interval)
+		interval->synced = time(NULL);
+	g_mutex_unlock(&cache->lock);
+	return FALSE;
+}
+
+/**
+ * Append an object as the calendar-data of a report. The cache holds
+ * the text unescaped by parse_multistatus, so it is escaped again for
+ * parse_caldav_report to return it as a server report would.
+ * @param report The report to append to.
+ * @param data The iCalendar text of the object.
+ */
+static void append_calendar_data(GString* report, const gchar* data) {
+	gchar* escaped = g_markup_escape_text(data, -1);
+
+	g_string_append_printf(report, "<C:calendar-data>%s</C:calendar-data>",
+			escaped);
+	g_free(escaped);
+}
+
+/**
+ * Function for getting all events or tasks of a collection through the
+ * cache. The cache is brought up to date with caldav_sync and
+ * calendar-multiget, so only changed objects are downloaded. The server
+ * is asked itself if the synchronization fails or stays truncated.
+ * @param settings A pointer to caldav_settings. ACTION is GETALL or
+ * GETALLTASKS. On success settings->file holds the result.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_cache_getall(caldav_settings* settings, caldav_error* error) {
+	caldav_objects known;
+	gchar* collection;
+	GString* report;
+	int i;
+
+	g_free(settings->file);
+	settings->file = NULL;
+	collection = collection_key(settings);
+	if (cache_refresh(settings, collection, error)) {
+		/* an incomplete cache cannot answer for the whole collection */
+		g_free(collection);
+		clear_error(error);
+		return (settings->ACTION == GETALLTASKS) ?
+			caldav_tasks_getall(settings, error) :
+			caldav_getall(settings, error);
+	}
+
+	/* the same report the server would have answered with */
+	caldav_cache_objects(settings->cache, collection, &known);
+	report = g_string_new(NULL);
+	for (i = 0; i < known.count; i++)
+		append_calendar_data(report, known.objects[i].data);
+	caldav_free_objects(&known);
+	settings->file = parse_caldav_report(report->str, "calendar-data",
+			(settings->ACTION == GETALLTASKS) ? "VTODO" : "VEVENT");
+	caldav_account_parse(settings);
+	g_string_free(report, TRUE);
+	g_free(collection);
+	return FALSE;
+}
+
+/**
+ * Answer a free-busy-query (RFC4791 7.10) from the index.
+ * @return The VCALENDAR or NULL if the index cannot tell. Caller is
+ * responsible for freeing the memory.
+ */
+static gchar* cache_freebusy(caldav_index* index, time_t start, time_t end) {
+	static const char* types[] = { "BUSY", "BUSY-UNAVAILABLE", "BUSY-TENTATIVE" };
+	caldav_availability busy;
+	gchar from[CALDAV_DATETIME_SIZE];
+	gchar until[CALDAV_DATETIME_SIZE];
+	GString* text;
+	int i;
+
+	memset(&busy, 0, sizeof(caldav_availability));
+	if (! caldav_index_busy(index, start, end, &busy))
+		return NULL;
+	text = g_string_new("BEGIN:VCALENDAR\r\n"
+			"VERSION:2.0\r\n"
+			"PRODID:-//CalDAV Calendar//NONSGML libcaldav//EN\r\n"
+			"BEGIN:VFREEBUSY\r\n"
+			"DTSTAMP:");
+	g_string_append(text, format_caldav_datetime(time(NULL), from));
+	g_string_append_printf(text, "\r\nDTSTART:%s\r\nDTEND:%s\r\n",
+			format_caldav_datetime(start, from),
+			format_caldav_datetime(end, until));
+	for (i = 0; i < busy.count; i++)
+		g_string_append_printf(text, "FREEBUSY;FBTYPE=%s:%s/%s\r\n",
+				types[busy.busy[i].type],
+				format_caldav_datetime(busy.busy[i].start, from),
+				format_caldav_datetime(busy.busy[i].end, until));
+	g_string_append(text, "END:VFREEBUSY\r\nEND:VCALENDAR\r\n");
+	g_free(busy.busy);
+	return g_string_free(text, FALSE);
+}
+
+/**
+ * Answer a time-range calendar-query from the index.
+ * @return The objects as caldav_getrange returns them or NULL if the
+ * index cannot tell. Caller is responsible for freeing the memory.
+ */
+static gchar* cache_range(caldav_cache* cache, const gchar* collection,
+			  caldav_index* index, gboolean todo,
+			  time_t start, time_t end) {
+	const cache_record* record;
+	GPtrArray* hrefs;
+	GString* report;
+	gchar* key;
+	gchar* result;
+	guint i;
+
+	hrefs = g_ptr_array_new();
+	if (! caldav_index_find(index, todo, start, end, hrefs)) {
+		g_ptr_array_free(hrefs, TRUE);
+		return NULL;
+	}
+	report = g_string_new(NULL);
+	for (i = 0; i < hrefs->len; i++) {
+		key = cache_key(collection, g_ptr_array_index(hrefs, i));
+		record = cache_find(cache, key, CACHE_OBJECT);
+		if (record)
+			append_calendar_data(report, RECORD_DATA(record));
+		g_free(key);
+	}
+	g_ptr_array_free(hrefs, TRUE);
+	result = parse_caldav_report(report->str, "calendar-data",
+			(todo) ? "VTODO" : "VEVENT");
+	g_string_free(report, TRUE);
+	return result;
+}
+
+/**
+ * Function for getting the events or tasks in a time range, or free/busy,
+ * of a collection through the cache. The collection is synchronized as
+ * caldav_cache_getall does, which costs one sync-token or CTag request
+ * when nothing changed, and the answer found in an interval index over
+ * the cached objects. A positive settings->cache_ttl skips the
+ * synchronization for that many seconds after the last one. The server
+ * is asked itself if the synchronization fails or stays truncated, or
+ * the index cannot tell.
+ * @param settings A pointer to caldav_settings. ACTION is GET, GETTASKS
+ * or FREEBUSY. On success settings->file holds the result.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_cache_getrange(caldav_settings* settings, caldav_error* error) {
+	caldav_cache* cache = settings->cache;
+	cache_interval* interval;
+	gchar* collection;
+	gchar* result = NULL;
+	gboolean fresh;
+
+	g_free(settings->file);
+	settings->file = NULL;
+	collection = collection_key(settings);
+	g_mutex_lock(&cache->lock);
+	interval = cache_intervals(cache, collection);
+	/* 0 revalidates every read, only a positive ttl trusts the cache */
+	fresh = settings->cache_ttl > 0 && interval->synced &&
+		time(NULL) - interval->synced < settings->cache_ttl;
+	g_mutex_unlock(&cache->lock);
+	if (! fresh && cache_refresh(settings, collection, error)) {
+		/* the server may still answer the query itself */
+		clear_error(error);
+	}
+	else {
+		g_mutex_lock(&cache->lock);
+		interval = cache_intervals(cache, collection);
+		if (settings->ACTION == FREEBUSY)
+			result = cache_freebusy(interval->index,
+					settings->start, settings->end);
+		else
+			result = cache_range(cache, collection, interval->index,
+					settings->ACTION == GETTASKS,
+					settings->start, settings->end);
+		g_mutex_unlock(&cache->lock);
+	}
+	g_free(collection);
+	if (! result) {
+		switch (settings->ACTION) {
+			case GETTASKS: return caldav_tasks_getrange(settings, error);
+			case FREEBUSY: return caldav_freebusy(settings, error);
+			default: return caldav_getrange(settings, error);
+		}
+	}
+	settings->file = result;
+	caldav_account_parse(settings);
+	return FALSE;
+}
@@ -0,0 +1,174 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __CALDAV_CACHE_H__
+#define __CALDAV_CACHE_H__
+
+#include "caldav-utils.h"
+#include "caldav-index.h"
+#include "caldav.h"
+#include <glib.h>
+
+/** Size the cache file must reach before it is worth compacting */
+#ifndef CALDAV_CACHE_COMPACT
+#define CALDAV_CACHE_COMPACT (1024 * 1024)
+#endif
+
+/**
+ * @struct _caldav_cache
+ * An append-only log of records mapped into memory, and an index from
+ * key to the offset of the newest record for that key. intervals maps
+ * collection keys to the time-range index of their objects, built the
+ * first time a collection is read by time range.
+ */
+struct _caldav_cache {
+	gchar* path;
+	int fd;
+	gchar* map;
+	gsize map_size;
+	gsize size;
+	gsize live;
+	GHashTable* index;
+	GHashTable* intervals;
+	GMutex lock;
+};
+
+/**
+ * Look up a cached object.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param href Path of the object.
+ * @param etag Where to store a copy of the ETag or NULL.
+ * @param data Where to store a copy of the object or NULL.
+ * @return TRUE if the object is cached.
+ */
+gboolean caldav_cache_get(caldav_cache* cache,
+			  const gchar* collection,
+			  const gchar* href,
+			  gchar** etag,
+			  gchar** data);
+
+/**
+ * Store an object and its ETag, replacing any previous version.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param href Path of the object.
+ * @param etag The ETag.
+ * @param data The object.
+ */
+void caldav_cache_put(caldav_cache* cache,
+		      const gchar* collection,
+		      const gchar* href,
+		      const gchar* etag,
+		      const gchar* data);
+
+/**
+ * Forget an object.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param href Path of the object.
+ */
+void caldav_cache_remove(caldav_cache* cache,
+			 const gchar* collection,
+			 const gchar* href);
+
+/**
+ * Fetch the synchronization token stored for a collection.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @return The token or NULL. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_cache_token(caldav_cache* cache, const gchar* collection);
+
+/**
+ * Store the synchronization token for a collection.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param token The token.
+ */
+void caldav_cache_set_token(caldav_cache* cache,
+			    const gchar* collection,
+			    const gchar* token);
+
+/**
+ * Copy every cached object of a collection.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param result A pointer to caldav_objects receiving the objects sorted
+ * by href. Clear it with caldav_free_objects().
+ */
+void caldav_cache_objects(caldav_cache* cache,
+			  const gchar* collection,
+			  caldav_objects* result);
+
+/**
+ * List the href and ETag of every cached object of a collection. The
+ * data is left out, so comparing with the server costs no copy of it.
+ * @param cache A caldav_cache.
+ * @param collection Key of the collection. @see collection_key
+ * @param result A pointer to caldav_objects receiving the objects sorted
+ * by href, data set to NULL. Clear it with caldav_free_objects().
+ */
+void caldav_cache_etags(caldav_cache* cache,
+			const gchar* collection,
+			caldav_objects* result);
+
+/**
+ * Update the cache after a successful PUT or DELETE. The object is
+ * stored with the ETag from the response, or forgotten if it was deleted
+ * or the server did not send one.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param url URL of the object, with or without scheme.
+ * @param headers The response headers.
+ * @param object The object sent or NULL for a DELETE.
+ */
+void caldav_cache_written(caldav_settings* settings,
+			  const gchar* url,
+			  const struct MemoryStruct* headers,
+			  const gchar* object);
+
+/**
+ * Function for getting all events or tasks of a collection through the
+ * cache. The cache is brought up to date with caldav_sync and
+ * calendar-multiget, so only changed objects are downloaded. The server
+ * is asked itself if the synchronization fails or stays truncated.
+ * @param settings A pointer to caldav_settings. ACTION is GETALL or
+ * GETALLTASKS. On success settings->file holds the result.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_cache_getall(caldav_settings* settings, caldav_error* error);
+
+/**
+ * Function for getting the events or tasks in a time range, or free/busy,
+ * of a collection through the cache. The collection is synchronized as
+ * caldav_cache_getall does, which costs one sync-token or CTag request
+ * when nothing changed, and the answer found in an interval index over
+ * the cached objects. A positive settings->cache_ttl skips the
+ * synchronization for that many seconds after the last one. The server
+ * is asked itself if the synchronization fails or stays truncated, or
+ * the index cannot tell.
+ * @param settings A pointer to caldav_settings. ACTION is GET, GETTASKS
+ * or FREEBUSY. On success settings->file holds the result.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_cache_getrange(caldav_settings* settings, caldav_error* error);
+
+#endif
@@ -0,0 +1,1376 @@
+/* vim: set textwidth=80 tabstop=4 smarttab: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "caldav-index.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* before and after every time there is */
+#define INDEX_DAWN ((time_t) ((sizeof(time_t) > 4) ? G_MININT64 : G_MININT32))
+#define INDEX_FOREVER ((time_t) ((sizeof(time_t) > 4) ? G_MAXINT64 : G_MAXINT32))
+
+/* no BYDAY, BYMONTHDAY or BYMONTH list is longer in practice */
+#define RULE_LIST 64
+
+/**
+ * @struct index_object
+ * What the index knows of one object. Spans are in no particular order
+ * and their object is only set in the spans of the index.
+ */
+typedef struct {
+	gchar* href;
+	GArray* spans;
+	gboolean expanded;
+	time_t from;
+	time_t until;
+	guint mark;
+} index_object;
+
+/**
+ * @struct index_span
+ * One instance of an event or task.
+ */
+typedef struct {
+	time_t start;
+	time_t end;
+	gint8 type;
+	gboolean todo;
+	index_object* object;
+} index_span;
+
+/**
+ * @struct _caldav_index
+ * The objects by href and, rebuilt when they change, the spans of every
+ * object sorted by start. reach holds the greatest end found in the
+ * subtree below each span of the implicit search tree over the sorted
+ * spans. Recurrences are expanded between dawn and horizon.
+ */
+struct _caldav_index {
+	GHashTable* objects;
+	GHashTable* zones;
+	GArray* spans;
+	time_t* reach;
+	time_t from;
+	time_t until;
+	guint unexpanded;
+	time_t dawn;
+	time_t horizon;
+	guint mark;
+};
+
+/**
+ * @struct index_time
+ * A DATE or DATE-TIME as written, with the zone it is to be read in.
+ */
+typedef struct {
+	GDate date;
+	int hour;
+	int minute;
+	int second;
+	gboolean date_only;
+	GTimeZone* zone;
+} index_time;
+
+/**
+ * @struct index_component
+ * The properties of a VEVENT or VTODO the index looks at, each the
+ * unfolded content line or NULL.
+ */
+typedef struct {
+	gboolean todo;
+	const gchar* dtstart;
+	const gchar* dtend;
+	const gchar* due;
+	const gchar* duration;
+	const gchar* rrule;
+	const gchar* recurrence_id;
+	const gchar* transp;
+	const gchar* status;
+	const gchar* created;
+	const gchar* completed;
+	GPtrArray* rdates;
+	GPtrArray* exdates;
+} index_component;
+
+/**
+ * @struct index_rule
+ * A RRULE (RFC5545 3.3.10) as far as the index expands it.
+ */
+typedef enum {
+	RULE_DAILY,
+	RULE_WEEKLY,
+	RULE_MONTHLY,
+	RULE_YEARLY
+} RULE_FREQ;
+
+typedef struct {
+	RULE_FREQ freq;
+	int interval;
+	int count;
+	gboolean has_until;
+	time_t until;
+	GDateWeekday wkst;
+	int days;
+	int ordinal[RULE_LIST];
+	GDateWeekday weekday[RULE_LIST];
+	guint weekdays;
+	int monthdays;
+	int monthday[RULE_LIST];
+	guint months;
+} index_rule;
+
+/**
+ * @struct index_series
+ * The recurrence set of one component being expanded.
+ */
+typedef struct {
+	index_object* object;
+	index_time first;
+	glong seconds;
+	gint days;
+	gint8 type;
+	gboolean todo;
+	GArray* exdates;
+} index_series;
+
+static void free_object(gpointer data) {
+	index_object* object = (index_object *) data;
+
+	g_free(object->href);
+	g_array_free(object->spans, TRUE);
+	g_free(object);
+}
+
+static void free_zone(gpointer data) {
+	if (data)
+		g_time_zone_unref((GTimeZone *) data);
+}
+
+/**
+ * Create an empty index.
+ * @return A new caldav_index. Free it with caldav_index_free().
+ */
+caldav_index* caldav_index_new(void) {
+	caldav_index* index;
+	time_t now = time(NULL);
+
+	index = g_new0(caldav_index, 1);
+	index->objects = g_hash_table_new_full(g_str_hash, g_str_equal,
+			NULL, free_object);
+	index->zones = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, free_zone);
+	index->dawn = now - (time_t) CALDAV_INDEX_HORIZON * 86400;
+	index->horizon = now + (time_t) CALDAV_INDEX_HORIZON * 86400;
+	return index;
+}
+
+/**
+ * Drop the sorted spans so the next query rebuilds them.
+ */
+static void index_stale(caldav_index* index) {
+	if (index->spans)
+		g_array_free(index->spans, TRUE);
+	g_free(index->reach);
+	index->spans = NULL;
+	index->reach = NULL;
+}
+
+/**
+ * Free an index.
+ * @param index A caldav_index or NULL.
+ */
+void caldav_index_free(caldav_index* index) {
+	if (! index)
+		return;
+	index_stale(index);
+	g_hash_table_destroy(index->objects);
+	g_hash_table_destroy(index->zones);
+	g_free(index);
+}
+
+/**
+ * @return TRUE if the zone database of the system has a zone by name.
+ */
+static gboolean zone_known(const gchar* name) {
+	const gchar* dir = g_getenv("TZDIR");
+	gchar* path;
+	gboolean known;
+
+	if (! name[0] || name[0] == '/' || strstr(name, ".."))
+		return FALSE;
+	path = g_build_filename((dir) ? dir : "/usr/share/zoneinfo", name, NULL);
+	known = g_file_test(path, G_FILE_TEST_IS_REGULAR);
+	g_free(path);
+	return known;
+}
+
+/**
+ * Find the zone a TZID stands for in the zone database of the system.
+ * Names like "Europe/Berlin" are looked up, also when prefixed like
+ * "/mozilla.org/20050126_1/Europe/Berlin".
+ * @param tzid The TZID or NULL for floating time.
+ * @return The zone or NULL if it is not known. Owned by the index.
+ */
+static GTimeZone* index_zone(caldav_index* index, const gchar* tzid) {
+	GTimeZone* zone = NULL;
+	gpointer found;
+	const gchar* name;
+
+	if (g_hash_table_lookup_extended(index->zones, (tzid) ? tzid : "",
+				NULL, &found))
+		return (GTimeZone *) found;
+	if (! tzid)
+		zone = g_time_zone_new_local();
+	else if (g_ascii_strcasecmp(tzid, "UTC") == 0 ||
+			g_ascii_strcasecmp(tzid, "GMT") == 0 ||
+			g_ascii_strcasecmp(tzid, "Etc/UTC") == 0)
+		zone = g_time_zone_new_utc();
+	else {
+		for (name = tzid; name && ! zone; name = strchr(name, '/')) {
+			if (*name == '/')
+				name++;
+			if (strchr(name, '/') && zone_known(name))
+				zone = g_time_zone_new(name);
+		}
+	}
+	g_hash_table_insert(index->zones, g_strdup((tzid) ? tzid : ""), zone);
+	return zone;
+}
+
+/**
+ * Join folded lines (RFC5545 3.1).
+ * @return The content lines, each NUL terminated. Free it with
+ * g_string_free().
+ */
+static GString* index_unfold(const gchar* data, gsize length) {
+	GString* lines;
+	const gchar* stop = data + length;
+	const gchar* pos;
+	const gchar* eol;
+	gsize len;
+
+	lines = g_string_sized_new(length + 1);
+	for (pos = data; pos < stop; pos = eol) {
+		eol = memchr(pos, '\n', stop - pos);
+		eol = (eol) ? eol + 1 : stop;
+		for (len = eol - pos; len && (pos[len - 1] == '\n' ||
+					pos[len - 1] == '\r'); len--)
+			;
+		if ((*pos == ' ' || *pos == '\t') && lines->len) {
+			g_string_truncate(lines, lines->len - 1);
+			if (len)
+				g_string_append_len(lines, pos + 1, len - 1);
+		}
+		else
+			g_string_append_len(lines, pos, len);
+		g_string_append_c(lines, '\0');
+	}
+	return lines;
+}
+
+/**
+ * @return TRUE if the content line is the property name.
+ */
+static gboolean line_is(const gchar* line, const gchar* name) {
+	gsize len = strlen(name);
+
+	return g_ascii_strncasecmp(line, name, len) == 0 &&
+		(line[len] == ';' || line[len] == ':');
+}
+
+/**
+ * @return The value of a content line or NULL if it has none.
+ */
+static const gchar* line_value(const gchar* line) {
+	gboolean quoted = FALSE;
+
+	for (; *line; line++) {
+		if (*line == '"')
+			quoted = ! quoted;
+		else if (*line == ':' && ! quoted)
+			return line + 1;
+	}
+	return NULL;
+}
+
+/**
+ * Fetch a parameter of a content line.
+ * @param line The content line.
+ * @param name Name of the parameter.
+ * @return The value without quotes or NULL. Caller is responsible for
+ * freeing the memory.
+ */
+static gchar* line_param(const gchar* line, const gchar* name) {
+	const gchar* value = line_value(line);
+	const gchar* pos;
+	const gchar* stop;
+	gboolean quoted = FALSE;
+	gsize len = strlen(name);
+
+	if (! value)
+		return NULL;
+	for (pos = line; pos < value - 1; pos++) {
+		if (*pos == '"')
+			quoted = ! quoted;
+		if (quoted || *pos != ';' ||
+				g_ascii_strncasecmp(pos + 1, name, len) != 0 ||
+				pos[len + 1] != '=')
+			continue;
+		pos += len + 2;
+		if (*pos == '"') {
+			stop = strchr(pos + 1, '"');
+			return (stop) ? g_strndup(pos + 1, stop - pos - 1) : NULL;
+		}
+		for (stop = pos; stop < value - 1 && *stop != ';'; stop++)
+			;
+		return g_strndup(pos, stop - pos);
+	}
+	return NULL;
+}
+
+/**
+ * Read a number of decimal digits.
+ * @return The number or -1 if text does not start with count digits.
+ */
+static int read_number(const gchar* text, int count) {
+	int value = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (! g_ascii_isdigit(text[i]))
+			return -1;
+		value = value * 10 + text[i] - '0';
+	}
+	return value;
+}
+
+/**
+ * Read a DATE or DATE-TIME value.
+ * @param text The value.
+ * @param zone Zone of values not ending with Z.
+ * @param t Where to store the time.
+ * @param end NULL or set to the first character after the value.
+ * @return TRUE if text starts with a DATE or DATE-TIME.
+ */
+static gboolean index_time_value(caldav_index* index, const gchar* text,
+				 GTimeZone* zone, index_time* t,
+				 const gchar** end) {
+	int year = read_number(text, 4);
+	int month = read_number(text + 4, 2);
+	int day = read_number(text + 6, 2);
+
+	if (year < 1 || month < 1 || day < 1 ||
+			! g_date_valid_dmy(day, month, year))
+		return FALSE;
+	g_date_clear(&t->date, 1);
+	g_date_set_dmy(&t->date, day, month, year);
+	t->hour = t->minute = t->second = 0;
+	t->date_only = TRUE;
+	t->zone = zone;
+	text += 8;
+	if (*text == 'T') {
+		if ((t->hour = read_number(text + 1, 2)) < 0 ||
+				(t->minute = read_number(text + 3, 2)) < 0 ||
+				(t->second = read_number(text + 5, 2)) < 0)
+			return FALSE;
+		t->date_only = FALSE;
+		text += 7;
+		if (*text == 'Z') {
+			t->zone = index_zone(index, "UTC");
+			text++;
+		}
+	}
+	if (end)
+		*end = text;
+	return t->zone != NULL;
+}
+
+/**
+ * Find the zone values of a content line are to be read in.
+ * @param zone Where to store the zone, which is NULL if it is not known.
+ * @return FALSE if the zone is not known.
+ */
+static gboolean line_zone(caldav_index* index, const gchar* line,
+			  GTimeZone** zone) {
+	gchar* tzid;
+
+	tzid = line_param(line, "TZID");
+	*zone = index_zone(index, tzid);
+	g_free(tzid);
+	return *zone != NULL;
+}
+
+/**
+ * Read the DATE or DATE-TIME of a content line.
+ * @return TRUE if the line holds a time in a known zone.
+ */
+static gboolean index_time_line(caldav_index* index, const gchar* line,
+				index_time* t) {
+	GTimeZone* zone;
+	const gchar* value = line_value(line);
+
+	if (! value || ! line_zone(index, line, &zone))
+		return FALSE;
+	return index_time_value(index, value, zone, t, NULL);
+}
+
+/**
+ * Convert the time of day of t on another day to a time_t.
+ * @param t The time.
+ * @param day The day.
+ * @return The time or -1 if it does not exist.
+ */
+static time_t index_unix(const index_time* t, const GDate* day) {
+	GDateTime* dt;
+	time_t value;
+
+	dt = g_date_time_new(t->zone, g_date_get_year(day),
+			g_date_get_month(day), g_date_get_day(day),
+			t->hour, t->minute, (gdouble) t->second);
+	if (! dt)
+		return (time_t) -1;
+	value = (time_t) g_date_time_to_unix(dt);
+	g_date_time_unref(dt);
+	return value;
+}
+
+static gint compare_time(gconstpointer a, gconstpointer b) {
+	time_t x = *(const time_t *) a;
+	time_t y = *(const time_t *) b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+/**
+ * Add one instance unless it is excluded.
+ * @param series The recurrence set.
+ * @param day The day it starts.
+ * @param start When it starts.
+ * @return FALSE once the object has as many instances as are kept.
+ */
+static gboolean series_add(index_series* series, const GDate* day,
+			   time_t start) {
+	index_object* object = series->object;
+	index_span span;
+	GDate last;
+
+	if (object->spans->len >= CALDAV_INDEX_INSTANCES) {
+		if (start < object->until)
+			object->until = start;
+		return FALSE;
+	}
+	if (series->exdates && bsearch(&start, series->exdates->data,
+				series->exdates->len, sizeof(time_t), compare_time))
+		return TRUE;
+	span.start = start;
+	if (series->days) {
+		last = *day;
+		g_date_add_days(&last, series->days);
+		span.end = index_unix(&series->first, &last);
+	}
+	else
+		span.end = start + series->seconds;
+	if (span.end < span.start)
+		span.end = span.start;
+	span.type = series->type;
+	span.todo = series->todo;
+	span.object = NULL;
+	g_array_append_val(object->spans, span);
+	return TRUE;
+}
+
+/**
+ * Read a weekday ("MO" to "SU").
+ * @return The weekday or G_DATE_BAD_WEEKDAY.
+ */
+static GDateWeekday read_weekday(const gchar* text) {
+	static const char* names[] = { "MO", "TU", "WE", "TH", "FR", "SA", "SU" };
+	int i;
+
+	for (i = 0; i < 7; i++) {
+		if (g_ascii_strncasecmp(text, names[i], 2) == 0)
+			return (GDateWeekday) (i + 1);
+	}
+	return G_DATE_BAD_WEEKDAY;
+}
+
+/**
+ * Parse a RRULE value. Rules by the hour, minute or second, and BYSETPOS,
+ * BYWEEKNO and BYYEARDAY are not expanded.
+ * @param index The index.
+ * @param value The value of the RRULE.
+ * @param first DTSTART, giving the zone of UNTIL.
+ * @param rule Where to store the rule.
+ * @return FALSE if the index does not expand the rule.
+ */
+static gboolean rule_parse(caldav_index* index, const gchar* value,
+			   const index_time* first, index_rule* rule) {
+	gchar** parts;
+	gchar** items;
+	gchar* part;
+	gchar* item;
+	index_time until;
+	GDate next;
+	gboolean ok = TRUE;
+	int i, j, n;
+
+	memset(rule, 0, sizeof(index_rule));
+	rule->freq = -1;
+	rule->interval = 1;
+	rule->wkst = G_DATE_MONDAY;
+	parts = g_strsplit(value, ";", 0);
+	for (i = 0; ok && parts[i]; i++) {
+		part = parts[i];
+		if (! *part)
+			continue;
+		if (g_ascii_strncasecmp(part, "FREQ=", 5) == 0) {
+			if (g_ascii_strcasecmp(part + 5, "DAILY") == 0)
+				rule->freq = RULE_DAILY;
+			else if (g_ascii_strcasecmp(part + 5, "WEEKLY") == 0)
+				rule->freq = RULE_WEEKLY;
+			else if (g_ascii_strcasecmp(part + 5, "MONTHLY") == 0)
+				rule->freq = RULE_MONTHLY;
+			else if (g_ascii_strcasecmp(part + 5, "YEARLY") == 0)
+				rule->freq = RULE_YEARLY;
+			else
+				ok = FALSE;
+		}
+		else if (g_ascii_strncasecmp(part, "INTERVAL=", 9) == 0)
+			ok = (rule->interval = atoi(part + 9)) > 0;
+		else if (g_ascii_strncasecmp(part, "COUNT=", 6) == 0)
+			ok = (rule->count = atoi(part + 6)) > 0;
+		else if (g_ascii_strncasecmp(part, "UNTIL=", 6) == 0) {
+			ok = index_time_value(index, part + 6, first->zone, &until, NULL);
+			if (ok && until.date_only) {
+				/* the whole day is included */
+				next = until.date;
+				g_date_add_days(&next, 1);
+				until.hour = until.minute = until.second = 0;
+				rule->until = index_unix(&until, &next) - 1;
+			}
+			else if (ok)
+				rule->until = index_unix(&until, &until.date);
+			rule->has_until = ok;
+		}
+		else if (g_ascii_strncasecmp(part, "WKST=", 5) == 0)
+			ok = (rule->wkst = read_weekday(part + 5)) != G_DATE_BAD_WEEKDAY;
+		else if (g_ascii_strncasecmp(part, "BYDAY=", 6) == 0) {
+			items = g_strsplit(part + 6, ",", 0);
+			for (j = 0; ok && items[j]; j++) {
+				item = items[j];
+				n = 0;
+				if (*item == '+' || *item == '-' || g_ascii_isdigit(*item)) {
+					n = atoi(item);
+					while (*item == '+' || *item == '-' ||
+							g_ascii_isdigit(*item))
+						item++;
+					ok = n != 0 && n >= -53 && n <= 53;
+				}
+				if (! ok || rule->days >= RULE_LIST ||
+						read_weekday(item) == G_DATE_BAD_WEEKDAY) {
+					ok = FALSE;
+					break;
+				}
+				rule->ordinal[rule->days] = n;
+				rule->weekday[rule->days] = read_weekday(item);
+				rule->weekdays |= 1 << rule->weekday[rule->days];
+				rule->days++;
+			}
+			g_strfreev(items);
+		}
+		else if (g_ascii_strncasecmp(part, "BYMONTHDAY=", 11) == 0) {
+			items = g_strsplit(part + 11, ",", 0);
+			for (j = 0; ok && items[j]; j++) {
+				n = atoi(items[j]);
+				ok = n != 0 && n >= -31 && n <= 31 &&
+					rule->monthdays < RULE_LIST;
+				if (ok)
+					rule->monthday[rule->monthdays++] = n;
+			}
+			g_strfreev(items);
+		}
+		else if (g_ascii_strncasecmp(part, "BYMONTH=", 8) == 0) {
+			items = g_strsplit(part + 8, ",", 0);
+			for (j = 0; ok && items[j]; j++) {
+				n = atoi(items[j]);
+				ok = n >= 1 && n <= 12;
+				if (ok)
+					rule->months |= 1 << n;
+			}
+			g_strfreev(items);
+		}
+		else
+			ok = FALSE;
+	}
+	g_strfreev(parts);
+	if (! ok || (int) rule->freq < 0)
+		return FALSE;
+	/* ordinals only count within a month */
+	for (i = 0; i < rule->days; i++) {
+		if (rule->ordinal[i] && (rule->freq < RULE_MONTHLY ||
+					rule->monthdays ||
+					(rule->freq == RULE_YEARLY && ! rule->months)))
+			return FALSE;
+	}
+	if (rule->freq == RULE_YEARLY && rule->days && ! rule->months)
+		return FALSE;
+	if (rule->freq == RULE_WEEKLY && rule->monthdays)
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * @return TRUE if day is one of the BYMONTHDAY of rule.
+ */
+static gboolean rule_monthday(const index_rule* rule, const GDate* day) {
+	int d = g_date_get_day(day);
+	int last = g_date_get_days_in_month(g_date_get_month(day),
+			g_date_get_year(day));
+	int i;
+
+	for (i = 0; i < rule->monthdays; i++) {
+		if (rule->monthday[i] == d || rule->monthday[i] == d - last - 1)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * Add the days of a month a MONTHLY or YEARLY rule falls on, in order.
+ * @param rule The rule.
+ * @param first DTSTART.
+ * @param month The month.
+ * @param year The year.
+ * @param days GArray of GDate.
+ */
+static void rule_month(const index_rule* rule, const GDate* first,
+		       int month, int year, GArray* days) {
+	gboolean hit[32];
+	GDate day;
+	int last = g_date_get_days_in_month(month, year);
+	int weekday;
+	int d, i, n;
+
+	memset(hit, 0, sizeof(hit));
+	g_date_clear(&day, 1);
+	g_date_set_dmy(&day, 1, month, year);
+	weekday = g_date_get_weekday(&day);
+	if (rule->monthdays) {
+		for (i = 0; i < rule->monthdays; i++) {
+			d = (rule->monthday[i] > 0) ? rule->monthday[i] :
+				last + rule->monthday[i] + 1;
+			if (d >= 1 && d <= last)
+				hit[d] = TRUE;
+		}
+		/* BYDAY only narrows BYMONTHDAY down */
+		for (d = 1; rule->days && d <= last; d++) {
+			if (hit[d] && ! (rule->weekdays &
+						(1 << ((weekday + d - 2) % 7 + 1))))
+				hit[d] = FALSE;
+		}
+	}
+	else if (rule->days) {
+		for (i = 0; i < rule->days; i++) {
+			d = 1 + (rule->weekday[i] - weekday + 7) % 7;
+			n = rule->ordinal[i];
+			if (n > 0)
+				d += (n - 1) * 7;
+			else if (n < 0)
+				d += ((last - d) / 7 + n + 1) * 7;
+			for (; d >= 1 && d <= last; d += 7) {
+				hit[d] = TRUE;
+				if (n)
+					break;
+			}
+		}
+	}
+	else if (g_date_get_day(first) <= last)
+		hit[g_date_get_day(first)] = TRUE;
+	for (d = 1; d <= last; d++) {
+		if (! hit[d])
+			continue;
+		g_date_set_dmy(&day, d, month, year);
+		g_array_append_val(days, day);
+	}
+}
+
+/**
+ * Find the days of one period of a rule.
+ * @param rule The rule.
+ * @param first DTSTART.
+ * @param period Number of the period, 0 for the one starting with DTSTART.
+ * @param days Receives the days in order.
+ * @return The first day of the period.
+ */
+static guint32 rule_period(const index_rule* rule, const GDate* first,
+			   gint64 period, GArray* days) {
+	GDate day;
+	gint64 months;
+	int year = 1;
+	int month = 1;
+	int i;
+
+	g_array_set_size(days, 0);
+	day = *first;
+	switch (rule->freq) {
+		case RULE_DAILY:
+			g_date_add_days(&day, (guint) (period * rule->interval));
+			if ((! rule->months ||
+					(rule->months & (1 << g_date_get_month(&day)))) &&
+					(! rule->monthdays || rule_monthday(rule, &day)) &&
+					(! rule->days ||
+					 (rule->weekdays & (1 << g_date_get_weekday(&day)))))
+				g_array_append_val(days, day);
+			return g_date_get_julian(&day);
+		case RULE_WEEKLY:
+			g_date_subtract_days(&day,
+					(g_date_get_weekday(first) - rule->wkst + 7) % 7);
+			g_date_add_days(&day, (guint) (period * rule->interval * 7));
+			for (i = 0; i < 7; i++) {
+				if (((rule->days) ?
+						(rule->weekdays & (1 << g_date_get_weekday(&day))) :
+						g_date_get_weekday(&day) == g_date_get_weekday(first)) &&
+						(! rule->months ||
+						 (rule->months & (1 << g_date_get_month(&day)))))
+					g_array_append_val(days, day);
+				g_date_add_days(&day, 1);
+			}
+			g_date_subtract_days(&day, 7);
+			return g_date_get_julian(&day);
+		case RULE_MONTHLY:
+			months = (gint64) g_date_get_year(first) * 12 +
+				g_date_get_month(first) - 1 + period * rule->interval;
+			year = (int) (months / 12);
+			month = (int) (months % 12) + 1;
+			if (year > 9999)
+				return G_MAXUINT32;
+			if (! rule->months || (rule->months & (1 << month)))
+				rule_month(rule, first, month, year, days);
+			break;
+		case RULE_YEARLY:
+			year = g_date_get_year(first) + (int) (period * rule->interval);
+			if (year > 9999)
+				return G_MAXUINT32;
+			for (i = 1; i <= 12; i++) {
+				if ((rule->months) ? (rule->months & (1 << i)) :
+						(rule->monthdays || i == g_date_get_month(first)))
+					rule_month(rule, first, i, year, days);
+			}
+			break;
+	}
+	g_date_clear(&day, 1);
+	g_date_set_dmy(&day, 1, month, year);
+	return g_date_get_julian(&day);
+}
+
+/**
+ * Expand a RRULE between the dawn and the horizon of the index.
+ * Instances before dawn still count for COUNT.
+ * @param index The index.
+ * @param series The recurrence set, its first instance already added.
+ * @param value The value of the RRULE.
+ */
+static void rule_expand(caldav_index* index, index_series* series,
+			const gchar* value) {
+	index_object* object = series->object;
+	index_rule rule;
+	GArray* days;
+	GDate* day;
+	GDate edge;
+	guint32 first;
+	guint32 dawn;
+	guint32 horizon;
+	gint64 period = 0;
+	time_t start;
+	int done = 1;
+	guint i;
+
+	if (! rule_parse(index, value, &series->first, &rule)) {
+		object->expanded = FALSE;
+		return;
+	}
+	first = g_date_get_julian(&series->first.date);
+	/* a day of slack either way for the zone */
+	g_date_clear(&edge, 1);
+	g_date_set_dmy(&edge, 1, 1, 1970);
+	dawn = g_date_get_julian(&edge) + (guint32) (index->dawn / 86400) - 1;
+	horizon = g_date_get_julian(&edge) + (guint32) (index->horizon / 86400) + 1;
+	/* periods before dawn are skipped unless they must be counted */
+	if (! rule.count && dawn > first) {
+		if (rule.freq == RULE_DAILY)
+			period = (dawn - first) / rule.interval;
+		else if (rule.freq == RULE_WEEKLY)
+			period = (dawn - first) / (7 * rule.interval);
+		if (period > 1) {
+			period--;
+			if (object->from < index->dawn)
+				object->from = index->dawn;
+		}
+		else
+			period = 0;
+	}
+	days = g_array_new(FALSE, FALSE, sizeof(GDate));
+	for (;; period++) {
+		if (rule_period(&rule, &series->first.date, period, days) > horizon) {
+			if (object->until > index->horizon)
+				object->until = index->horizon;
+			break;
+		}
+		for (i = 0; i < days->len; i++) {
+			day = &g_array_index(days, GDate, i);
+			if (g_date_compare(day, &series->first.date) <= 0)
+				continue;
+			if (rule.count && done >= rule.count)
+				goto finished;
+			if (g_date_get_julian(day) > horizon) {
+				if (object->until > index->horizon)
+					object->until = index->horizon;
+				goto finished;
+			}
+			done++;
+			if (g_date_get_julian(day) < dawn && ! rule.has_until) {
+				if (object->from < index->dawn)
+					object->from = index->dawn;
+				continue;
+			}
+			if ((start = index_unix(&series->first, day)) == (time_t) -1)
+				continue;
+			if (rule.has_until && start > rule.until)
+				goto finished;
+			if (start < index->dawn) {
+				if (object->from < index->dawn)
+					object->from = index->dawn;
+				continue;
+			}
+			if (! series_add(series, day, start))
+				goto finished;
+		}
+	}
+finished:
+	g_array_free(days, TRUE);
+}
+
+/**
+ * Add the values of RDATE or EXDATE properties.
+ * @param lines Content lines.
+ * @param series Where RDATE instances go or NULL to collect EXDATE.
+ * @param exdates Receives EXDATE times.
+ */
+static void index_dates(caldav_index* index, GPtrArray* lines,
+			index_series* series, GArray* exdates) {
+	index_time t;
+	index_time end;
+	GTimeZone* zone;
+	const gchar* pos;
+	const gchar* line;
+	glong seconds;
+	glong length = 0;
+	gint days = 0;
+	time_t start;
+	guint i;
+
+	if (series) {
+		length = series->seconds;
+		days = series->days;
+	}
+	for (i = 0; lines && i < lines->len; i++) {
+		line = (const gchar *) g_ptr_array_index(lines, i);
+		if (! (pos = line_value(line)) || ! line_zone(index, line, &zone)) {
+			if (series)
+				series->object->expanded = FALSE;
+			continue;
+		}
+		while (index_time_value(index, pos, zone, &t, &pos)) {
+			start = index_unix(&t, &t.date);
+			if (! series)
+				g_array_append_val(exdates, start);
+			else if (*pos == '/') {
+				/* a PERIOD has its own length */
+				pos++;
+				series->days = 0;
+				if (index_time_value(index, pos, zone, &end, &pos))
+					series->seconds = index_unix(&end, &end.date) - start;
+				else if (parse_caldav_duration(pos, &pos, &seconds))
+					series->seconds = seconds;
+				series_add(series, &t.date, start);
+				series->seconds = length;
+				series->days = days;
+			}
+			else
+				series_add(series, &t.date, start);
+			if (*pos != ',')
+				break;
+			pos++;
+		}
+	}
+}
+
+/**
+ * The busy type of a component for free/busy.
+ * @return CALDAV_BUSY, CALDAV_BUSY_TENTATIVE or -1 if it is not busy.
+ */
+static gint8 component_type(const index_component* c) {
+	const gchar* value;
+
+	if (c->todo)
+		return -1;
+	if (c->transp && (value = line_value(c->transp)) &&
+			g_ascii_strcasecmp(value, "TRANSPARENT") == 0)
+		return -1;
+	if (c->status && (value = line_value(c->status))) {
+		if (g_ascii_strcasecmp(value, "CANCELLED") == 0)
+			return -1;
+		if (g_ascii_strcasecmp(value, "TENTATIVE") == 0)
+			return CALDAV_BUSY_TENTATIVE;
+	}
+	return CALDAV_BUSY;
+}
+
+/**
+ * Add a task without DTSTART and DUE. It overlaps a range as far as
+ * CREATED and COMPLETED tell (RFC4791 9.9), or any range without them.
+ */
+static void index_undated(caldav_index* index, index_object* object,
+			  const index_component* c) {
+	index_span span;
+	index_time t;
+	gboolean created;
+	gboolean completed;
+	time_t done = 0;
+
+	span.start = INDEX_DAWN;
+	span.end = INDEX_FOREVER;
+	span.type = -1;
+	span.todo = TRUE;
+	span.object = NULL;
+	created = c->created && index_time_line(index, c->created, &t);
+	if (created)
+		span.start = index_unix(&t, &t.date);
+	completed = c->completed && index_time_line(index, c->completed, &t);
+	if (completed) {
+		done = index_unix(&t, &t.date);
+		span.end = done;
+		if (! created)
+			span.start = done;
+	}
+	if (span.end < span.start)
+		span.end = span.start;
+	g_array_append_val(object->spans, span);
+}
+
+/**
+ * Add the instances of a component.
+ * @param index The index.
+ * @param object The object it belongs to.
+ * @param c The component.
+ * @param moved Times of the instances the object overrides, or NULL.
+ */
+static void index_component_add(caldav_index* index, index_object* object,
+				index_component* c, GArray* moved) {
+	index_series series;
+	index_time end;
+	const gchar* anchor;
+	const gchar* until;
+	glong seconds;
+	time_t start;
+
+	anchor = (c->dtstart) ? c->dtstart : (c->todo) ? c->due : NULL;
+	if (! anchor && c->todo) {
+		index_undated(index, object, c);
+		return;
+	}
+	if (! anchor && c->recurrence_id)
+		anchor = c->recurrence_id;
+	if (! anchor || ! index_time_line(index, anchor, &series.first)) {
+		if (anchor)
+			object->expanded = FALSE;
+		return;
+	}
+	series.object = object;
+	series.seconds = 0;
+	series.days = 0;
+	series.type = component_type(c);
+	series.todo = c->todo;
+	series.exdates = NULL;
+	start = index_unix(&series.first, &series.first.date);
+	until = (c->todo) ? ((c->dtstart) ? c->due : NULL) : c->dtend;
+	if (until && index_time_line(index, until, &end)) {
+		if (series.first.date_only && end.date_only)
+			series.days = g_date_days_between(&series.first.date, &end.date);
+		else
+			series.seconds = index_unix(&end, &end.date) - start;
+	}
+	else if (c->duration && parse_caldav_duration(line_value(c->duration),
+				NULL, &seconds))
+		series.seconds = seconds;
+	else if (! c->todo && series.first.date_only)
+		series.days = 1;
+	if (c->rrule || c->rdates) {
+		series.exdates = g_array_new(FALSE, FALSE, sizeof(time_t));
+		if (moved)
+			g_array_append_vals(series.exdates, moved->data, moved->len);
+		index_dates(index, c->exdates, NULL, series.exdates);
+		g_array_sort(series.exdates, compare_time);
+	}
+	series_add(&series, &series.first.date, start);
+	if (c->rrule && line_value(c->rrule))
+		rule_expand(index, &series, line_value(c->rrule));
+	index_dates(index, c->rdates, &series, NULL);
+	if (series.exdates)
+		g_array_free(series.exdates, TRUE);
+}
+
+static void clear_component(index_component* c) {
+	if (c->rdates)
+		g_ptr_array_free(c->rdates, TRUE);
+	if (c->exdates)
+		g_ptr_array_free(c->exdates, TRUE);
+}
+
+/**
+ * Read the instances of every event and task of an object.
+ * @return A new index_object.
+ */
+static index_object* index_parse(caldav_index* index, const gchar* href,
+				 const gchar* data, gsize length) {
+	index_object* object;
+	index_component* c = NULL;
+	GArray* components;
+	GArray* moved;
+	GString* lines;
+	const gchar* line;
+	const gchar* value;
+	gchar* range;
+	index_time t;
+	time_t start;
+	int depth = 0;
+	int level = 0;
+	guint i;
+
+	object = g_new0(index_object, 1);
+	object->href = g_strdup(href);
+	object->spans = g_array_new(FALSE, FALSE, sizeof(index_span));
+	object->expanded = TRUE;
+	object->from = INDEX_DAWN;
+	object->until = INDEX_FOREVER;
+	components = g_array_new(FALSE, TRUE, sizeof(index_component));
+	lines = index_unfold(data, length);
+	for (line = lines->str; line < lines->str + lines->len;
+			line += strlen(line) + 1) {
+		value = line_value(line);
+		if (line_is(line, "BEGIN")) {
+			depth++;
+			if (! c && value && (g_ascii_strcasecmp(value, "VEVENT") == 0 ||
+						g_ascii_strcasecmp(value, "VTODO") == 0)) {
+				g_array_set_size(components, components->len + 1);
+				c = &g_array_index(components, index_component,
+						components->len - 1);
+				c->todo = g_ascii_strcasecmp(value, "VTODO") == 0;
+				level = depth;
+			}
+			continue;
+		}
+		if (line_is(line, "END")) {
+			if (depth-- == level)
+				c = NULL;
+			continue;
+		}
+		/* properties of a VALARM are not the component's */
+		if (! c || depth != level)
+			continue;
+		if (line_is(line, "DTSTART"))
+			c->dtstart = line;
+		else if (line_is(line, "DTEND"))
+			c->dtend = line;
+		else if (line_is(line, "DUE"))
+			c->due = line;
+		else if (line_is(line, "DURATION"))
+			c->duration = line;
+		else if (line_is(line, "RRULE"))
+			c->rrule = line;
+		else if (line_is(line, "RECURRENCE-ID"))
+			c->recurrence_id = line;
+		else if (line_is(line, "TRANSP"))
+			c->transp = line;
+		else if (line_is(line, "STATUS"))
+			c->status = line;
+		else if (line_is(line, "CREATED"))
+			c->created = line;
+		else if (line_is(line, "COMPLETED"))
+			c->completed = line;
+		else if (line_is(line, "RDATE")) {
+			if (! c->rdates)
+				c->rdates = g_ptr_array_new();
+			g_ptr_array_add(c->rdates, (gpointer) line);
+		}
+		else if (line_is(line, "EXDATE")) {
+			if (! c->exdates)
+				c->exdates = g_ptr_array_new();
+			g_ptr_array_add(c->exdates, (gpointer) line);
+		}
+	}
+	/* overrides take the place of the instance they name */
+	moved = g_array_new(FALSE, FALSE, sizeof(time_t));
+	for (i = 0; i < components->len; i++) {
+		c = &g_array_index(components, index_component, i);
+		if (! c->recurrence_id)
+			continue;
+		if ((range = line_param(c->recurrence_id, "RANGE")) != NULL ||
+				! index_time_line(index, c->recurrence_id, &t))
+			object->expanded = FALSE;
+		else {
+			start = index_unix(&t, &t.date);
+			g_array_append_val(moved, start);
+		}
+		g_free(range);
+		index_component_add(index, object, c, NULL);
+	}
+	for (i = 0; i < components->len; i++) {
+		c = &g_array_index(components, index_component, i);
+		if (! c->recurrence_id)
+			index_component_add(index, object, c, moved);
+		clear_component(c);
+	}
+	g_array_free(moved, TRUE);
+	g_array_free(components, TRUE);
+	g_string_free(lines, TRUE);
+	return object;
+}
+
+/**
+ * Add an object or replace the one stored for the same href.
+ * @param index A caldav_index.
+ * @param href Path of the object.
+ * @param data The calendar object following ICal format (RFC2445).
+ * @param length Length of data.
+ */
+void caldav_index_put(caldav_index* index, const gchar* href,
+		      const gchar* data, gsize length) {
+	index_object* object;
+
+	object = index_parse(index, href, data, length);
+	g_hash_table_replace(index->objects, object->href, object);
+	index_stale(index);
+}
+
+/**
+ * Forget an object.
+ * @param index A caldav_index.
+ * @param href Path of the object.
+ */
+void caldav_index_remove(caldav_index* index, const gchar* href) {
+	if (g_hash_table_remove(index->objects, href))
+		index_stale(index);
+}
+
+static gint compare_span(gconstpointer a, gconstpointer b) {
+	const index_span* x = (const index_span *) a;
+	const index_span* y = (const index_span *) b;
+
+	return (x->start < y->start) ? -1 : (x->start > y->start);
+}
+
+/**
+ * Store the greatest end below each span of the search tree.
+ * @return The greatest end of spans lo to hi.
+ */
+static time_t index_reach(caldav_index* index, guint lo, guint hi) {
+	time_t reach;
+	time_t below;
+	guint mid;
+
+	if (lo >= hi)
+		return INDEX_DAWN;
+	mid = lo + (hi - lo) / 2;
+	reach = g_array_index(index->spans, index_span, mid).end;
+	if ((below = index_reach(index, lo, mid)) > reach)
+		reach = below;
+	if ((below = index_reach(index, mid + 1, hi)) > reach)
+		reach = below;
+	index->reach[mid] = reach;
+	return reach;
+}
+
+/**
+ * Sort the spans of every object if they changed since the last query.
+ */
+static void index_build(caldav_index* index) {
+	GHashTableIter iter;
+	gpointer value;
+	index_object* object;
+	index_span* span;
+	guint first;
+	guint i;
+
+	if (index->spans)
+		return;
+	index->spans = g_array_new(FALSE, FALSE, sizeof(index_span));
+	index->unexpanded = 0;
+	index->from = INDEX_DAWN;
+	index->until = INDEX_FOREVER;
+	g_hash_table_iter_init(&iter, index->objects);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		object = (index_object *) value;
+		if (! object->expanded)
+			index->unexpanded++;
+		if (object->from > index->from)
+			index->from = object->from;
+		if (object->until < index->until)
+			index->until = object->until;
+		first = index->spans->len;
+		g_array_append_vals(index->spans, object->spans->data,
+				object->spans->len);
+		for (i = first; i < index->spans->len; i++) {
+			span = &g_array_index(index->spans, index_span, i);
+			span->object = object;
+		}
+	}
+	g_array_sort(index->spans, compare_span);
+	index->reach = g_new(time_t, index->spans->len + 1);
+	index_reach(index, 0, index->spans->len);
+}
+
+/**
+ * Collect the spans overlapping a range, walking the search tree.
+ */
+static void index_search(caldav_index* index, guint lo, guint hi,
+			 time_t start, time_t end, GPtrArray* found) {
+	index_span* span;
+	guint mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->reach[mid] < start)
+			return;
+		index_search(index, lo, mid, start, end, found);
+		span = &g_array_index(index->spans, index_span, mid);
+		if (span->start >= end)
+			return;
+		/* an instant overlaps if it is in the range */
+		if ((span->end > start && span->start < end) ||
+				(span->end == span->start && span->start >= start))
+			g_ptr_array_add(found, span);
+		lo = mid + 1;
+	}
+}
+
+/**
+ * Find the spans overlapping a range if the index can tell.
+ * @return NULL if it cannot, otherwise the spans. Free it with
+ * g_ptr_array_free().
+ */
+static GPtrArray* index_query(caldav_index* index, time_t start,
+			      time_t end) {
+	GPtrArray* found;
+
+	index_build(index);
+	if (index->unexpanded || start < index->from || end > index->until)
+		return NULL;
+	found = g_ptr_array_new();
+	index_search(index, 0, index->spans->len, start, end, found);
+	return found;
+}
+
+static gint compare_href(gconstpointer a, gconstpointer b) {
+	return strcmp(*(const gchar **) a, *(const gchar **) b);
+}
+
+/**
+ * Find the objects with an event, or a task, overlapping a time range as
+ * a calendar-query time-range filter does (RFC4791 9.9).
+ * @param index A caldav_index.
+ * @param todo TRUE for tasks, FALSE for events.
+ * @param start Start of the range.
+ * @param end End of the range, not included.
+ * @param hrefs Receives the hrefs found sorted, owned by the index and
+ * only valid until it changes.
+ * @return FALSE if the index cannot tell, because the range runs past
+ * the horizon or an object uses recurrences the index does not expand.
+ */
+gboolean caldav_index_find(caldav_index* index, gboolean todo,
+			   time_t start, time_t end, GPtrArray* hrefs) {
+	GPtrArray* found;
+	index_span* span;
+	guint i;
+
+	if ((found = index_query(index, start, end)) == NULL)
+		return FALSE;
+	index->mark++;
+	for (i = 0; i < found->len; i++) {
+		span = (index_span *) g_ptr_array_index(found, i);
+		if (span->todo != todo || span->object->mark == index->mark)
+			continue;
+		span->object->mark = index->mark;
+		g_ptr_array_add(hrefs, span->object->href);
+	}
+	g_ptr_array_free(found, TRUE);
+	g_ptr_array_sort(hrefs, compare_href);
+	return TRUE;
+}
+
+static gint compare_busy(gconstpointer a, gconstpointer b) {
+	const caldav_busy* x = (const caldav_busy *) a;
+	const caldav_busy* y = (const caldav_busy *) b;
+
+	if (x->start != y->start)
+		return (x->start < y->start) ? -1 : 1;
+	return (x->end < y->end) ? -1 : (x->end > y->end);
+}
+
+/**
+ * Collect the periods events make busy within a time range, clipped to
+ * it. Transparent and cancelled events are left out.
+ * @param index A caldav_index.
+ * @param start Start of the range.
+ * @param end End of the range, not included.
+ * @param result Receives the periods sorted by start.
+ * @return FALSE if the index cannot tell. @see caldav_index_find
+ */
+gboolean caldav_index_busy(caldav_index* index, time_t start, time_t end,
+			   caldav_availability* result) {
+	GPtrArray* found;
+	GArray* periods;
+	index_span* span;
+	caldav_busy period;
+	guint i;
+
+	if ((found = index_query(index, start, end)) == NULL)
+		return FALSE;
+	periods = g_array_new(FALSE, FALSE, sizeof(caldav_busy));
+	for (i = 0; i < found->len; i++) {
+		span = (index_span *) g_ptr_array_index(found, i);
+		if (span->todo || span->type < 0 || span->end <= span->start)
+			continue;
+		period.start = MAX(span->start, start);
+		period.end = MIN(span->end, end);
+		period.type = span->type;
+		g_array_append_val(periods, period);
+	}
+	g_ptr_array_free(found, TRUE);
+	g_array_sort(periods, compare_busy);
+	g_free(result->busy);
+	result->count = periods->len;
+	result->busy = (caldav_busy *) g_array_free(periods, periods->len == 0);
+	return TRUE;
+}
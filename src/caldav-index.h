@@ -0,0 +1,100 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __CALDAV_INDEX_H__
+#define __CALDAV_INDEX_H__
+
+#include "caldav-utils.h"
+#include "caldav.h"
+#include <glib.h>
+
+/** Days after indexing up to which recurrences are expanded */
+#ifndef CALDAV_INDEX_HORIZON
+#define CALDAV_INDEX_HORIZON 730
+#endif
+
+/** Instances of one recurring object expanded at most */
+#ifndef CALDAV_INDEX_INSTANCES
+#define CALDAV_INDEX_INSTANCES 20000
+#endif
+
+/**
+ * @typedef struct _caldav_index caldav_index
+ * The time ranges of every event and task of one collection, recurrences
+ * expanded, for answering time-range queries without the server.
+ */
+typedef struct _caldav_index caldav_index;
+
+/**
+ * Create an empty index.
+ * @return A new caldav_index. Free it with caldav_index_free().
+ */
+caldav_index* caldav_index_new(void);
+
+/**
+ * Free an index.
+ * @param index A caldav_index or NULL.
+ */
+void caldav_index_free(caldav_index* index);
+
+/**
+ * Add an object or replace the one stored for the same href.
+ * @param index A caldav_index.
+ * @param href Path of the object.
+ * @param data The calendar object following ICal format (RFC2445).
+ * @param length Length of data.
+ */
+void caldav_index_put(caldav_index* index, const gchar* href,
+		      const gchar* data, gsize length);
+
+/**
+ * Forget an object.
+ * @param index A caldav_index.
+ * @param href Path of the object.
+ */
+void caldav_index_remove(caldav_index* index, const gchar* href);
+
+/**
+ * Find the objects with an event, or a task, overlapping a time range as
+ * a calendar-query time-range filter does (RFC4791 9.9).
+ * @param index A caldav_index.
+ * @param todo TRUE for tasks, FALSE for events.
+ * @param start Start of the range.
+ * @param end End of the range, not included.
+ * @param hrefs Receives the hrefs found sorted, owned by the index and
+ * only valid until it changes.
+ * @return FALSE if the index cannot tell, because the range runs past
+ * the horizon or an object uses recurrences the index does not expand.
+ */
+gboolean caldav_index_find(caldav_index* index, gboolean todo,
+			   time_t start, time_t end, GPtrArray* hrefs);
+
+/**
+ * Collect the periods events make busy within a time range, clipped to
+ * it. Transparent and cancelled events are left out.
+ * @param index A caldav_index.
+ * @param start Start of the range.
+ * @param end End of the range, not included.
+ * @param result Receives the periods sorted by start.
+ * @return FALSE if the index cannot tell. @see caldav_index_find
+ */
+gboolean caldav_index_busy(caldav_index* index, time_t start, time_t end,
+			   caldav_availability* result);
+
+#endif
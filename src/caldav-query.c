@@ -0,0 +1,467 @@
+/* vim: set textwidth=80 tabstop=4 smarttab: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#include "caldav-query.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Create a filter with no tests. Internal function.
+ * @param kind Which filter element.
+ * @param name Component, property or parameter name.
+ * @return The filter.
+ */
+static caldav_filter* filter_new(filter_kind kind, const char* name) {
+	caldav_filter* filter = g_new0(caldav_filter, 1);
+
+	filter->kind = kind;
+	filter->name = g_ascii_strup(name, -1);
+	return filter;
+}
+
+/**
+ * Free a filter and all filters below it. Internal function.
+ * @param filter The filter.
+ */
+static void filter_free(caldav_filter* filter) {
+	GSList* child;
+
+	for (child = filter->children; child; child = child->next)
+		filter_free((caldav_filter *) child->data);
+	g_slist_free(filter->children);
+	g_free(filter->name);
+	g_free(filter->text);
+	g_free(filter->collation);
+	g_free(filter);
+}
+
+/**
+ * Add a filter below another one. Internal function.
+ * @param parent The enclosing filter.
+ * @param kind Which filter element.
+ * @param name Component, property or parameter name.
+ * @return The new filter.
+ */
+static caldav_filter* filter_add(caldav_filter* parent,
+				 filter_kind kind, const char* name) {
+	caldav_filter* filter = filter_new(kind, name);
+
+	parent->children = g_slist_append(parent->children, filter);
+	return filter;
+}
+
+/**
+ * Append a time-range element. Either end may be open. Internal function.
+ * @param request Where to append.
+ * @param element Element name including namespace prefix.
+ * @param start Start or 0 (zero).
+ * @param end End or 0 (zero).
+ */
+static void append_range(GString* request, const gchar* element,
+			 time_t start, time_t end) {
+	gchar datetime[CALDAV_DATETIME_SIZE];
+
+	g_string_append_printf(request, "<%s", element);
+	if (start)
+		g_string_append_printf(request, " start=\"%s\"",
+				format_caldav_datetime(start, datetime));
+	if (end)
+		g_string_append_printf(request, " end=\"%s\"",
+				format_caldav_datetime(end, datetime));
+	g_string_append(request, "/>");
+}
+
+/**
+ * Append a name attribute, escaped. Internal function.
+ * @param request Where to append.
+ * @param name The value.
+ */
+static void append_name(GString* request, const gchar* name) {
+	gchar* escaped = g_markup_escape_text(name, -1);
+
+	g_string_append_printf(request, " name=\"%s\"", escaped);
+	g_free(escaped);
+}
+
+/**
+ * Append a filter element and everything below it in the order the
+ * schema wants them (RFC4791 9.7). Internal function.
+ * @param request Where to append.
+ * @param filter The filter.
+ */
+static void append_filter(GString* request, const caldav_filter* filter) {
+	static const gchar* element[] = {
+		"C:comp-filter", "C:prop-filter", "C:param-filter"
+	};
+	gchar* escaped;
+	GSList* child;
+
+	g_string_append_printf(request, "<%s", element[filter->kind]);
+	append_name(request, filter->name);
+	g_string_append_c(request, '>');
+	if (filter->not_defined) {
+		g_string_append(request, "<C:is-not-defined/>");
+	}
+	else {
+		if (filter->time_range)
+			append_range(request, "C:time-range",
+					filter->start, filter->end);
+		if (filter->text) {
+			g_string_append(request, "<C:text-match");
+			if (filter->collation) {
+				escaped = g_markup_escape_text(filter->collation, -1);
+				g_string_append_printf(request,
+						" collation=\"%s\"", escaped);
+				g_free(escaped);
+			}
+			if (filter->negate)
+				g_string_append(request, " negate-condition=\"yes\"");
+			escaped = g_markup_escape_text(filter->text, -1);
+			g_string_append_printf(request, ">%s</C:text-match>", escaped);
+			g_free(escaped);
+		}
+		/* prop-filters and param-filters come before comp-filters */
+		for (child = filter->children; child; child = child->next) {
+			if (((caldav_filter *) child->data)->kind != FILTER_COMP)
+				append_filter(request, child->data);
+		}
+		for (child = filter->children; child; child = child->next) {
+			if (((caldav_filter *) child->data)->kind == FILTER_COMP)
+				append_filter(request, child->data);
+		}
+	}
+	g_string_append_printf(request, "</%s>", element[filter->kind]);
+}
+
+/**
+ * Append the properties wanted from one component. Internal function.
+ * @param request Where to append.
+ * @param select The selection or NULL for every property.
+ */
+static void append_props(GString* request, const query_select* select) {
+	GSList* prop;
+
+	if (! select || select->all) {
+		g_string_append(request, "<C:allprop/>");
+		return;
+	}
+	for (prop = select->properties; prop; prop = prop->next) {
+		g_string_append(request, "<C:prop");
+		append_name(request, (const gchar *) prop->data);
+		g_string_append(request, "/>");
+	}
+}
+
+/**
+ * Append the calendar-data element asking for the selected components
+ * and properties only (RFC4791 9.6). Internal function.
+ * @param request Where to append.
+ * @param query The query.
+ */
+static void append_calendar_data(GString* request, const caldav_query* query) {
+	const query_select* calendar = NULL;
+	const query_select* select;
+	GSList* item;
+
+	if (! query->select && ! query->expand && ! query->limit_set) {
+		g_string_append(request, "<C:calendar-data/>");
+		return;
+	}
+	g_string_append(request, "<C:calendar-data>");
+	if (query->select) {
+		for (item = query->select; item; item = item->next) {
+			select = (const query_select *) item->data;
+			if (strcmp(select->component, "VCALENDAR") == 0)
+				calendar = select;
+		}
+		g_string_append(request, "<C:comp name=\"VCALENDAR\">");
+		append_props(request, calendar);
+		for (item = query->select; item; item = item->next) {
+			select = (const query_select *) item->data;
+			if (select == calendar)
+				continue;
+			g_string_append(request, "<C:comp");
+			append_name(request, select->component);
+			g_string_append_c(request, '>');
+			append_props(request, select);
+			/* a whole component keeps its alarms and the like */
+			if (select->all)
+				g_string_append(request, "<C:allcomp/>");
+			g_string_append(request, "</C:comp>");
+		}
+		g_string_append(request, "</C:comp>");
+	}
+	if (query->expand)
+		append_range(request, "C:expand", query->start, query->end);
+	else if (query->limit_set)
+		append_range(request, "C:limit-recurrence-set",
+				query->start, query->end);
+	g_string_append(request, "</C:calendar-data>");
+}
+
+/**
+ * Function for building the body of the calendar-query REPORT.
+ * @param query A caldav_query.
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_query_request(const caldav_query* query) {
+	GString* request;
+
+	request = g_string_new(
+		"<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+		"<C:calendar-query xmlns:D=\"DAV:\""
+		" xmlns:C=\"urn:ietf:params:xml:ns:caldav\">"
+		"<D:prop><D:getetag/>");
+	append_calendar_data(request, query);
+	g_string_append(request, "</D:prop><C:filter>");
+	append_filter(request, query->root);
+	g_string_append(request, "</C:filter>");
+	/* calendar-query has no limit element, nresults is applied locally */
+	g_string_append(request, "</C:calendar-query>\r\n");
+	return g_string_free(request, FALSE);
+}
+
+/**
+ * Function for creating a calendar-query. Without further filters it
+ * matches every object holding a component.
+ * @param component The component to search for, e.g. VEVENT or VTODO,
+ * or NULL to match every object.
+ * @return A new query. Free it with caldav_query_free().
+ */
+caldav_query* caldav_query_new(const char* component) {
+	caldav_query* query;
+
+	query = g_new0(caldav_query, 1);
+	query->root = filter_new(FILTER_COMP, "VCALENDAR");
+	query->filter = (component) ?
+		filter_add(query->root, FILTER_COMP, component) : query->root;
+	return query;
+}
+
+/**
+ * Function for freeing a query and all its filters.
+ * @param query Address to a pointer to a caldav_query.
+ */
+void caldav_query_free(caldav_query** query) {
+	GSList* item;
+	query_select* select;
+
+	if (! query || ! *query)
+		return;
+	filter_free((*query)->root);
+	for (item = (*query)->select; item; item = item->next) {
+		select = (query_select *) item->data;
+		g_free(select->component);
+		g_slist_free_full(select->properties, g_free);
+		g_free(select);
+	}
+	g_slist_free((*query)->select);
+	g_free(*query);
+	*query = NULL;
+}
+
+/**
+ * Function for getting the comp-filter of the component searched for.
+ * @param query A caldav_query.
+ * @return The filter, owned by the query.
+ */
+caldav_filter* caldav_query_filter(caldav_query* query) {
+	g_return_val_if_fail(query != NULL, NULL);
+
+	return query->filter;
+}
+
+/**
+ * Function for adding a comp-filter matching objects with a component
+ * inside the component of filter, e.g. a VALARM in a VEVENT.
+ * @param filter A comp-filter.
+ * @param name Name of the component.
+ * @return The new filter, owned by the query.
+ */
+caldav_filter* caldav_filter_comp(caldav_filter* filter, const char* name) {
+	g_return_val_if_fail(filter != NULL && name != NULL, NULL);
+	g_return_val_if_fail(filter->kind == FILTER_COMP, NULL);
+
+	return filter_add(filter, FILTER_COMP, name);
+}
+
+/**
+ * Function for adding a prop-filter matching components with a property.
+ * @param filter A comp-filter.
+ * @param name Name of the property, e.g. UID or CATEGORIES.
+ * @return The new filter, owned by the query.
+ */
+caldav_filter* caldav_filter_prop(caldav_filter* filter, const char* name) {
+	g_return_val_if_fail(filter != NULL && name != NULL, NULL);
+	g_return_val_if_fail(filter->kind == FILTER_COMP, NULL);
+
+	return filter_add(filter, FILTER_PROP, name);
+}
+
+/**
+ * Function for adding a param-filter matching properties with a
+ * parameter.
+ * @param filter A prop-filter.
+ * @param name Name of the parameter, e.g. PARTSTAT.
+ * @return The new filter, owned by the query.
+ */
+caldav_filter* caldav_filter_param(caldav_filter* filter, const char* name) {
+	g_return_val_if_fail(filter != NULL && name != NULL, NULL);
+	g_return_val_if_fail(filter->kind == FILTER_PROP, NULL);
+
+	return filter_add(filter, FILTER_PARAM, name);
+}
+
+/**
+ * Function for making a comp-filter or prop-filter only match if it
+ * overlaps a time range.
+ * @param filter A comp-filter or prop-filter.
+ * @param start Start of the range or 0 (zero) for open.
+ * @param end End of the range or 0 (zero) for open.
+ */
+void caldav_filter_time_range(caldav_filter* filter, time_t start, time_t end) {
+	g_return_if_fail(filter != NULL && filter->kind != FILTER_PARAM);
+	g_return_if_fail(start != 0 || end != 0);
+
+	filter->time_range = TRUE;
+	filter->start = start;
+	filter->end = end;
+}
+
+/**
+ * Function for making a prop-filter or param-filter only match if its
+ * value contains a text.
+ * @param filter A prop-filter or param-filter.
+ * @param text The text to search for.
+ * @param collation NULL for the server's default, "i;ascii-casemap",
+ * or "i;octet".
+ * @param negate Non zero to match values not containing text.
+ */
+void caldav_filter_text_match(caldav_filter* filter, const char* text,
+			      const char* collation, int negate) {
+	g_return_if_fail(filter != NULL && filter->kind != FILTER_COMP);
+	g_return_if_fail(text != NULL);
+
+	g_free(filter->text);
+	g_free(filter->collation);
+	filter->text = g_strdup(text);
+	filter->collation = g_strdup(collation);
+	filter->negate = (negate != 0);
+}
+
+/**
+ * Function for making a filter only match if the component, property or
+ * parameter is missing. Other tests of the filter are ignored.
+ * @param filter Any filter.
+ */
+void caldav_filter_not_defined(caldav_filter* filter) {
+	g_return_if_fail(filter != NULL);
+
+	filter->not_defined = TRUE;
+}
+
+/**
+ * Function for asking only for some components and properties instead
+ * of whole objects. Call once for every property wanted. Components not
+ * selected are left out of the objects returned.
+ * @param query A caldav_query.
+ * @param component Name of the component, e.g. VEVENT. VCALENDAR selects
+ * properties of the calendar object itself.
+ * @param property Name of the property, or NULL for the whole component.
+ */
+void caldav_query_select(caldav_query* query, const char* component,
+			 const char* property) {
+	query_select* select = NULL;
+	gchar* name;
+	GSList* item;
+
+	g_return_if_fail(query != NULL && component != NULL);
+
+	name = g_ascii_strup(component, -1);
+	for (item = query->select; item; item = item->next) {
+		if (strcmp(((query_select *) item->data)->component, name) == 0) {
+			select = (query_select *) item->data;
+			break;
+		}
+	}
+	if (! select) {
+		select = g_new0(query_select, 1);
+		select->component = name;
+		query->select = g_slist_append(query->select, select);
+	}
+	else {
+		g_free(name);
+	}
+	if (! property)
+		select->all = TRUE;
+	else
+		select->properties = g_slist_append(select->properties,
+				g_ascii_strup(property, -1));
+}
+
+/**
+ * Function for having the server expand recurring components into the
+ * instances overlapping a time range (RFC4791 9.6.5).
+ * @param query A caldav_query.
+ * @param start Start of the range.
+ * @param end End of the range.
+ */
+void caldav_query_expand(caldav_query* query, time_t start, time_t end) {
+	g_return_if_fail(query != NULL);
+
+	query->expand = TRUE;
+	query->limit_set = FALSE;
+	query->start = start;
+	query->end = end;
+}
+
+/**
+ * Function for having the server leave out overridden instances of
+ * recurring components outside a time range (RFC4791 9.6.6).
+ * @param query A caldav_query.
+ * @param start Start of the range.
+ * @param end End of the range.
+ */
+void caldav_query_limit_recurrence_set(caldav_query* query,
+				       time_t start, time_t end) {
+	g_return_if_fail(query != NULL);
+
+	query->limit_set = TRUE;
+	query->expand = FALSE;
+	query->start = start;
+	query->end = end;
+}
+
+/**
+ * Function for asking for no more than a number of objects. CalDAV has
+ * no way to ask the server for a limit, the transfer is stopped once
+ * that many objects have arrived.
+ * @param query A caldav_query.
+ * @param nresults The number of objects or 0 (zero) for no limit.
+ */
+void caldav_query_limit(caldav_query* query, int nresults) {
+	g_return_if_fail(query != NULL && nresults >= 0);
+
+	query->nresults = nresults;
+}
@@ -0,0 +1,88 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __CALDAV_QUERY_H__
+#define __CALDAV_QUERY_H__
+
+#include "caldav-utils.h"
+#include "caldav.h"
+#include <glib.h>
+
+/**
+ * @enum filter_kind
+ * The CalDAV filter element a caldav_filter stands for (RFC4791 9.7).
+ */
+typedef enum {
+	FILTER_COMP,
+	FILTER_PROP,
+	FILTER_PARAM
+} filter_kind;
+
+/**
+ * @struct _caldav_filter
+ * One comp-filter, prop-filter or param-filter and its tests. Children
+ * are kept in the order they were added.
+ */
+struct _caldav_filter {
+	filter_kind kind;
+	gchar* name;
+	gboolean not_defined;
+	gboolean time_range;
+	time_t start;
+	time_t end;
+	gchar* text;
+	gchar* collation;
+	gboolean negate;
+	GSList* children;
+};
+
+/**
+ * @struct query_select
+ * A component to return and the properties wanted from it. NULL
+ * properties means the whole component.
+ */
+typedef struct {
+	gchar* component;
+	GSList* properties;
+	gboolean all;
+} query_select;
+
+/**
+ * @struct _caldav_query
+ * A calendar-query REPORT (RFC4791 7.8) being built.
+ */
+struct _caldav_query {
+	caldav_filter* root;
+	caldav_filter* filter;
+	GSList* select;
+	gboolean expand;
+	gboolean limit_set;
+	time_t start;
+	time_t end;
+	int nresults;
+};
+
+/**
+ * Function for building the body of the calendar-query REPORT.
+ * @param query A caldav_query.
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_query_request(const caldav_query* query);
+
+#endif
@@ -22,25 +22,2126 @@
 #endif
 
 #include "caldav-utils.h"
+#include "options-caldav-server.h"
 #include "md5.h"
 #include <glib.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include <curl/curl.h>
 #include <ctype.h>
+#include <zlib.h>
 
 /**
  * This function is burrowed from the libcurl documentation
- * @param text
- * @param stream
+ * @param ptr
+ * @param size
+ * @return void* to memory region
+ */
+static void* myrealloc(void* ptr, size_t size) {
+/* There might be a realloc() out there that doesn't like reallocing
+ * NULL pointers, so we take care of it here
+ * */
+	if(ptr)
+		return realloc(ptr, size);
+	else
+		return malloc(size);
+}
+
+/**
+ * @struct transfer_counts
+ * Response bytes handed to the write callbacks of this thread and bytes
+ * saved by compressing request bodies which are not yet added to a
+ * caldav_stats, as are the time spent parsing responses and the transient
+ * allocations made. The outcome of the last request this thread made is
+ * kept along.
+ */
+typedef struct {
+	gint64 received;
+	gint64 packed;
+	long retry_after;
+	gboolean refused;
+	gint64 parse;
+	gint64 arena_allocs;
+	gint64 arena_bytes;
+	gint64 arena_blocks;
+} transfer_counts;
+
+static GPrivate pending_counts = G_PRIVATE_INIT(g_free);
+G_LOCK_DEFINE_STATIC(stats);
+
+static transfer_counts* pending(void) {
+	transfer_counts* counts = g_private_get(&pending_counts);
+
+	if (! counts) {
+		counts = g_new0(transfer_counts, 1);
+		g_private_set(&pending_counts, counts);
+	}
+	return counts;
+}
+
+/** Allocations from an arena are aligned to this */
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~((gsize) ARENA_ALIGN - 1))
+
+/**
+ * @struct arena_block
+ * One heap allocation of an arena. The data follows the header.
+ */
+typedef struct _arena_block arena_block;
+struct _arena_block {
+	arena_block* next;
+	gsize size;
+	gsize used;
+};
+#define ARENA_HEADER ARENA_ROUND(sizeof(arena_block))
+#define ARENA_DATA(block) ((gchar *) (block) + ARENA_HEADER)
+
+/**
+ * @struct arena_taken
+ * A string allocated elsewhere whose release the arena took over.
+ */
+typedef struct _arena_taken arena_taken;
+struct _arena_taken {
+	arena_taken* next;
+	gpointer data;
+};
+
+/**
+ * @struct transient_arena
+ * The bump allocator of one thread for the transient strings of the
+ * action it runs. The first block is kept between actions so a thread
+ * running action after action does not touch the heap for them.
+ */
+typedef struct {
+	arena_block* blocks;	/* the block allocated from first */
+	arena_taken* taken;
+	int depth;		/* caldav_arena_begin not yet ended */
+} transient_arena;
+
+static void arena_release(transient_arena* arena) {
+	arena_block* block;
+	arena_block* keep = NULL;
+	arena_taken* taken;
+
+	for (taken = arena->taken; taken; taken = taken->next)
+		g_free(taken->data);
+	arena->taken = NULL;
+	while ((block = arena->blocks) != NULL) {
+		arena->blocks = block->next;
+		if (! keep && block->size == CALDAV_ARENA_BLOCK)
+			keep = block;
+		else
+			g_free(block);
+	}
+	if (keep) {
+		keep->next = NULL;
+		keep->used = 0;
+		arena->blocks = keep;
+	}
+}
+
+static void arena_free(gpointer data) {
+	transient_arena* arena = (transient_arena *) data;
+
+	arena_release(arena);
+	g_free(arena->blocks);
+	g_free(arena);
+}
+
+static GPrivate thread_arena = G_PRIVATE_INIT(arena_free);
+
+static transient_arena* arena(void) {
+	transient_arena* a = g_private_get(&thread_arena);
+
+	if (! a) {
+		a = g_new0(transient_arena, 1);
+		g_private_set(&thread_arena, a);
+	}
+	return a;
+}
+
+/**
+ * Open a scope for transient allocations on this thread. Scopes nest,
+ * everything allocated is released when the outermost one ends.
+ */
+void caldav_arena_begin(void) {
+	arena()->depth++;
+}
+
+/**
+ * End a scope opened with caldav_arena_begin. Ending the outermost
+ * scope releases every transient allocation of this thread.
+ */
+void caldav_arena_end(void) {
+	transient_arena* a = arena();
+
+	g_return_if_fail(a->depth > 0);
+	if (--a->depth == 0)
+		arena_release(a);
+}
+
+/**
+ * Allocate transient memory, released when the outermost scope of this
+ * thread ends. Never free it.
+ * @param size Number of bytes.
+ * @return Memory aligned for any type.
+ */
+gpointer caldav_arena_alloc(gsize size) {
+	transient_arena* a = arena();
+	transfer_counts* counts = pending();
+	arena_block* block = a->blocks;
+	gpointer data;
+
+	size = ARENA_ROUND(MAX(size, 1));
+	counts->arena_allocs++;
+	counts->arena_bytes += size;
+	if (! block || block->used + size > block->size) {
+		/* a large one gets a block of its own behind the current one */
+		gsize room = (size > CALDAV_ARENA_BLOCK / 4) ? size :
+			CALDAV_ARENA_BLOCK;
+		block = g_malloc(ARENA_HEADER + room);
+		block->size = room;
+		block->used = 0;
+		counts->arena_blocks++;
+		if (room == CALDAV_ARENA_BLOCK || ! a->blocks) {
+			block->next = a->blocks;
+			a->blocks = block;
+		}
+		else {
+			block->next = a->blocks->next;
+			a->blocks->next = block;
+		}
+	}
+	data = ARENA_DATA(block) + block->used;
+	block->used += size;
+	return data;
+}
+
+/**
+ * Copy a string into transient memory.
+ * @param text The string or NULL.
+ * @return The copy or NULL. Never free it.
+ */
+gchar* caldav_arena_strdup(const gchar* text) {
+	gsize len;
+	gchar* copy;
+
+	if (! text)
+		return NULL;
+	len = strlen(text);
+	copy = caldav_arena_alloc(len + 1);
+	memcpy(copy, text, len + 1);
+	return copy;
+}
+
+/**
+ * Format a string into transient memory. @see g_strdup_printf
+ * @param format printf() format.
+ * @return The string. Never free it.
+ */
+gchar* caldav_arena_strdup_printf(const gchar* format, ...) {
+	transient_arena* a = arena();
+	arena_block* block = a->blocks;
+	gchar* text;
+	va_list args;
+	gsize room = 0;
+	gint len;
+
+	/* most strings fit what is left of the current block */
+	if (block && block->used < block->size)
+		room = block->size - block->used;
+	va_start(args, format);
+	len = g_vsnprintf((room) ? ARENA_DATA(block) + block->used : NULL,
+			room, format, args);
+	va_end(args);
+	if (len < 0)
+		return NULL;
+	if ((gsize) len < room) {
+		text = ARENA_DATA(block) + block->used;
+		pending()->arena_allocs++;
+		pending()->arena_bytes += ARENA_ROUND(len + 1);
+		block->used = MIN(block->size, block->used + ARENA_ROUND(len + 1));
+		return text;
+	}
+	text = caldav_arena_alloc(len + 1);
+	va_start(args, format);
+	g_vsnprintf(text, len + 1, format, args);
+	va_end(args);
+	return text;
+}
+
+/**
+ * Hand a string allocated with g_malloc over to the arena, which frees
+ * it when the outermost scope of this thread ends.
+ * @param data The string or NULL.
+ * @return data. Never free it.
+ */
+gpointer caldav_arena_take(gpointer data) {
+	arena_taken* taken;
+
+	if (! data)
+		return NULL;
+	taken = caldav_arena_alloc(sizeof(arena_taken));
+	taken->data = data;
+	taken->next = arena()->taken;
+	arena()->taken = taken;
+	return data;
+}
+
+/**
+ * Make room for at least needed bytes, doubling the allocation so a body
+ * arriving in many parts is only copied a logarithmic number of times.
+ * @param mem A struct MemoryStruct
+ * @param needed Number of bytes needed including the terminating zero
+ * @return FALSE if memory could not be allocated
+ */
+static gboolean memory_reserve(struct MemoryStruct* mem, size_t needed) {
+	size_t capacity;
+	char* memory;
+
+	if (mem->memory && needed <= mem->capacity)
+		return TRUE;
+	capacity = (mem->capacity > CALDAV_BUFFER_MIN) ?
+		mem->capacity : CALDAV_BUFFER_MIN;
+	while (capacity < needed)
+		capacity *= 2;
+	if ((memory = (char *)myrealloc(mem->memory, capacity)) == NULL)
+		return FALSE;
+	mem->memory = memory;
+	mem->capacity = capacity;
+	return TRUE;
+}
+
+/**
+ * Append to a struct MemoryStruct keeping it zero terminated.
+ * @return number of appended bytes, 0 if memory could not be allocated
+ */
+static size_t memory_append(struct MemoryStruct* mem, void* ptr,
+			    size_t realsize) {
+	if (! memory_reserve(mem, mem->size + realsize + 1))
+		return 0;
+	memcpy(&(mem->memory[mem->size]), ptr, realsize);
+	mem->size += realsize;
+	mem->memory[mem->size] = 0;
+	return realsize;
+}
+
+/**
+ * Add the header line just appended to a header buffer to its index. libcurl
+ * hands over one complete line at a time. A status line starts the headers
+ * of a new response, so those of an earlier one (a redirect, an
+ * authentication challenge or 100 Continue) are forgotten.
+ * @param mem The header buffer.
+ * @param offset Where the line starts in mem->memory.
+ * @param len Length of the line.
+ */
+static void index_header(struct MemoryStruct* mem, size_t offset, size_t len) {
+	const char* line = mem->memory + offset;
+	const char* end = line + len;
+	const char* colon;
+	const char* value;
+	header_field* field;
+
+	if (len >= 5 && strncmp(line, "HTTP/", 5) == 0) {
+		mem->fields = 0;
+		return;
+	}
+	/* folded lines are obsolete (RFC7230 3.2.4) and not indexed */
+	if (len == 0 || *line == ' ' || *line == '\t' ||
+			(colon = memchr(line, ':', len)) == NULL ||
+			offset + len > G_MAXUINT32)
+		return;
+	if (mem->fields >= CALDAV_HEADER_FIELDS) {
+		/* the lookups read the rest of the lines themselves */
+		mem->fields = CALDAV_HEADER_FIELDS + 1;
+		return;
+	}
+	for (value = colon + 1; value < end && g_ascii_isspace(*value); value++)
+		;
+	while (end > value && g_ascii_isspace(end[-1]))
+		end--;
+	field = &mem->field[mem->fields++];
+	field->name = offset;
+	field->name_len = colon - line;
+	field->value = value - mem->memory;
+	field->value_len = end - value;
+}
+
+/**
+ * This function is burrowed from the libcurl documentation
+ * @param ptr
+ * @param size
+ * @param nmemb
+ * @param data
+ * @return number of written bytes
+ */
+size_t WriteMemoryCallback(void* ptr, size_t size, size_t nmemb, void* data) {
+	caldav_count_received(size * nmemb);
+	return memory_append((struct MemoryStruct *)data, ptr, size * nmemb);
+}
+
+/**
+ * This function is burrowed from the libcurl documentation
+ * If the buffer has a body attached it is sized from Content-Length.
+ * @param ptr
+ * @param size
+ * @param nmemb
+ * @param data
+ * @return number of written bytes
+ */
+size_t WriteHeaderCallback(void* ptr, size_t size, size_t nmemb, void* data) {
+	size_t realsize = size * nmemb;
+	struct MemoryStruct* mem = (struct MemoryStruct *)data;
+	unsigned long long length;
+	const char* line = (const char *) ptr;
+	size_t offset = mem->size;
+
+	if (mem->body && realsize > 15 &&
+			g_ascii_strncasecmp(line, "Content-Length:", 15) == 0) {
+		length = g_ascii_strtoull(line + 15, NULL, 10);
+		/* only a hint, never trust it with the whole address space */
+		if (length > 0 && length <= CALDAV_BUFFER_HINT_MAX)
+			memory_reserve(mem->body, mem->body->size + length + 1);
+	}
+	if (memory_append(mem, ptr, realsize) != realsize)
+		return 0;
+	index_header(mem, offset, realsize);
+	return realsize;
+}
+
+/**
+ * Feed an upload to libcurl. @see caldav_upload
+ * @param ptr Where to copy the body to
+ * @param size
+ * @param nmemb
+ * @param data The caldav_upload
+ * @return number of bytes copied, 0 at the end of the body
+ */
+size_t ReadMemoryCallback(void* ptr, size_t size, size_t nmemb, void* data) {
+	caldav_upload* upload = (caldav_upload *) data;
+	size_t room = size * nmemb;
+	size_t copied = 0;
+	gsize skip = upload->offset;
+	gsize n;
+	int i;
+
+	for (i = 0; i < upload->parts && copied < room; i++) {
+		if (skip >= upload->length[i]) {
+			skip -= upload->length[i];
+			continue;
+		}
+		n = MIN(upload->length[i] - skip, room - copied);
+		memcpy((char *) ptr + copied, upload->part[i] + skip, n);
+		copied += n;
+		skip = 0;
+	}
+	upload->offset += copied;
+	return copied;
+}
+
+#if LIBCURL_VERSION_NUM >= 0x071305
+/**
+ * Rewind an upload for libcurl to send it again after a redirect or an
+ * authentication challenge.
+ * @param data The caldav_upload
+ * @param offset Where to continue
+ * @param origin Only SEEK_SET is supported
+ * @return CURL_SEEKFUNC_OK or CURL_SEEKFUNC_CANTSEEK
+ */
+int SeekMemoryCallback(void* data, curl_off_t offset, int origin) {
+	caldav_upload* upload = (caldav_upload *) data;
+
+	if (origin != SEEK_SET || offset < 0 ||
+			(gsize) offset > caldav_upload_length(upload))
+		return CURL_SEEKFUNC_CANTSEEK;
+	upload->offset = offset;
+	return CURL_SEEKFUNC_OK;
+}
+#endif
+
+/**
+ * Make an upload of a buffer without copying it.
+ * @param upload The caldav_upload to set up
+ * @param data The calendar object, need not be NUL terminated. Must
+ * outlive the upload.
+ * @param length Bytes of data
+ */
+void caldav_upload_memory(caldav_upload* upload, const gchar* data,
+			  gsize length) {
+	memset(upload, 0, sizeof(caldav_upload));
+	upload->part[0] = data;
+	upload->length[0] = length;
+	upload->parts = 1;
+}
+
+/**
+ * Make an upload of a string without copying it.
+ * @param upload The caldav_upload to set up
+ * @param text The calendar object. Must outlive the upload.
+ */
+void caldav_upload_string(caldav_upload* upload, const gchar* text) {
+	caldav_upload_memory(upload, text, strlen(text));
+	upload->text = text;
+}
+
+/**
+ * Make an upload of what a descriptor holds. Regular files are mapped,
+ * anything else is read to its end.
+ * @param upload The caldav_upload to set up
+ * @param fd An open descriptor. Not closed.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_upload_fd(caldav_upload* upload, int fd, caldav_error* error) {
+	struct stat st;
+	GError* err = NULL;
+	GString* data;
+	gchar buf[CALDAV_BUFFER_MIN * 16];
+	ssize_t n;
+
+	caldav_upload_memory(upload, NULL, 0);
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		if ((upload->map = g_mapped_file_new_from_fd(fd, FALSE, &err)) == NULL) {
+			error->code = -1;
+			error->str = g_strdup(err->message);
+			g_error_free(err);
+			return TRUE;
+		}
+		upload->part[0] = g_mapped_file_get_contents(upload->map);
+		upload->length[0] = g_mapped_file_get_length(upload->map);
+	}
+	else {
+		/* a pipe or a socket can only be read once, keep what it held */
+		data = g_string_sized_new(sizeof(buf));
+		while ((n = read(fd, buf, sizeof(buf))) != 0) {
+			if (n > 0)
+				g_string_append_len(data, buf, n);
+			else if (errno != EINTR) {
+				g_string_free(data, TRUE);
+				error->code = -1;
+				error->str = g_strdup(g_strerror(errno));
+				return TRUE;
+			}
+		}
+		upload->length[0] = data->len;
+		upload->part[0] = upload->data = g_string_free(data, FALSE);
+	}
+	if (upload->length[0] == 0) {
+		caldav_upload_clear(upload);
+		error->code = -1;
+		error->str = g_strdup("No calendar object to send");
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * Make an upload of a file by mapping it.
+ * @param upload The caldav_upload to set up
+ * @param path The file
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_upload_file(caldav_upload* upload, const gchar* path,
+			    caldav_error* error) {
+	GError* err = NULL;
+
+	caldav_upload_memory(upload, NULL, 0);
+	if ((upload->map = g_mapped_file_new(path, FALSE, &err)) == NULL) {
+		error->code = -1;
+		error->str = g_strdup(err->message);
+		g_error_free(err);
+		return TRUE;
+	}
+	upload->part[0] = g_mapped_file_get_contents(upload->map);
+	upload->length[0] = g_mapped_file_get_length(upload->map);
+	if (upload->length[0] == 0) {
+		caldav_upload_clear(upload);
+		error->code = -1;
+		error->str = g_strdup("No calendar object to send");
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * Free what an upload holds. The upload can be set up again.
+ * @param upload The caldav_upload
+ */
+void caldav_upload_clear(caldav_upload* upload) {
+	if (upload->map)
+		g_mapped_file_unref(upload->map);
+	g_free(upload->data);
+	g_free(upload->uid);
+	memset(upload, 0, sizeof(caldav_upload));
+}
+
+/**
+ * Find the upload of a call, wrapping settings->file if it has none.
+ * @param settings @see caldav_settings
+ * @param local Upload to set up for settings->file
+ * @return settings->upload or local
+ */
+caldav_upload* caldav_upload_of(caldav_settings* settings,
+				caldav_upload* local) {
+	if (settings->upload)
+		return settings->upload;
+	caldav_upload_string(local, (settings->file) ? settings->file : "");
+	return local;
+}
+
+/**
+ * @param upload The caldav_upload
+ * @return Bytes of the body
+ */
+gsize caldav_upload_length(const caldav_upload* upload) {
+	gsize length = 0;
+	int i;
+
+	for (i = 0; i < upload->parts; i++)
+		length += upload->length[i];
+	return length;
+}
+
+/**
+ * Find the value of an iCalendar property in an upload.
+ * @see get_ical_property
+ * @param upload The caldav_upload
+ * @param name Property to search for, case insensitive
+ * @return The value or NULL. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_upload_property(const caldav_upload* upload, const gchar* name) {
+	gchar* value = NULL;
+	int i;
+
+	/* parts are split at line boundaries */
+	for (i = 0; i < upload->parts && ! value; i++)
+		value = get_ical_property_len(upload->part[i], upload->length[i], name);
+	return value;
+}
+
+/**
+ * Find the UID of an upload, and where a UID would have to go if there is
+ * none, in one pass. @see caldav_ical_scan
+ * @param upload The caldav_upload, not spliced before
+ * @param end Where to store the start of the first END:VEVENT or
+ * END:VTODO line if there is no UID, NULL otherwise
+ * @return The UID or NULL. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_upload_scan(const caldav_upload* upload, const gchar** end) {
+	g_return_val_if_fail(upload->parts == 1, NULL);
+
+	return caldav_ical_scan(upload->part[0], upload->length[0], end);
+}
+
+/**
+ * Hash an upload for naming it. @see CALDAV_NAMING_MD5
+ * @param upload The caldav_upload, not spliced before
+ * @param naming CALDAV_NAMING_MD5 for MD5 of the whole body, otherwise a
+ * 64 bit FNV-1a of its length and its first CALDAV_NAMING_PREFIX bytes.
+ * @return The hash in hex. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_upload_hash(const caldav_upload* upload, int naming) {
+	gchar md5sum[33];
+	guint64 sum = G_GUINT64_CONSTANT(14695981039346656037);
+	const guchar* data = (const guchar *) upload->part[0];
+	gsize length = upload->length[0];
+	gsize n;
+	gsize i;
+
+	g_return_val_if_fail(upload->parts == 1, NULL);
+
+	if (naming == CALDAV_NAMING_MD5) {
+		caldav_md5_hex_digest_len(md5sum, data, length);
+		return g_strdup(md5sum);
+	}
+	/* objects sharing their start still differ in length mostly */
+	for (n = length; n; n >>= 8) {
+		sum ^= n & 0xff;
+		sum *= G_GUINT64_CONSTANT(1099511628211);
+	}
+	n = MIN(length, CALDAV_NAMING_PREFIX);
+	for (i = 0; i < n; i++) {
+		sum ^= data[i];
+		sum *= G_GUINT64_CONSTANT(1099511628211);
+	}
+	return g_strdup_printf("%016" G_GINT64_MODIFIER "x", sum);
+}
+
+/**
+ * Length of a part without trailing white space.
+ * @param part The part
+ * @param length Bytes of part
+ * @return The shorter length
+ */
+static gsize chomped(const gchar* part, gsize length) {
+	while (length > 0 && g_ascii_isspace(part[length - 1]))
+		length--;
+	return length;
+}
+
+/**
+ * Splice a UID made from hash into an upload. Trailing white space is
+ * left out in any case.
+ * @param upload The caldav_upload, not spliced before
+ * @param end Where the UID goes, NULL to leave the body as it is
+ * @param hash Hash of the upload. @see caldav_upload_hash
+ */
+void caldav_upload_splice_uid(caldav_upload* upload, const gchar* end,
+			      const gchar* hash) {
+	const gchar* object = upload->part[0];
+	gsize length = upload->length[0];
+
+	g_return_if_fail(upload->parts == 1);
+
+	if (! end) {
+		upload->length[0] = chomped(object, length);
+		return;
+	}
+	upload->uid = g_strdup_printf("\r\nUID:libcaldav-%s@tempuri.org\r\n",
+			hash);
+	upload->length[0] = chomped(object, end - object);
+	upload->part[1] = upload->uid;
+	upload->length[1] = strlen(upload->uid);
+	upload->part[2] = end;
+	upload->length[2] = chomped(end, length - (end - object));
+	upload->parts = 3;
+}
+
+/**
+ * Does the upload contain a UID element or not. If not splice one in
+ * ahead of the end of the event or task, made from name. Trailing white
+ * space is left out in any case. @see verify_uid
+ * @param upload The caldav_upload, not spliced before
+ * @param name Used for the UID, NULL to use the MD5 of the body
+ */
+void caldav_upload_verify_uid(caldav_upload* upload, const gchar* name) {
+	const gchar* end;
+	gchar* uid;
+	gchar* made = NULL;
+
+	uid = caldav_upload_scan(upload, &end);
+	if (end && ! name)
+		name = made = caldav_upload_hash(upload, CALDAV_NAMING_MD5);
+	caldav_upload_splice_uid(upload, end, name);
+	g_free(made);
+	g_free(uid);
+}
+
+/**
+ * Name the resource a new object is stored at as settings->naming asks
+ * and give the object a UID if it has none, with a single scan of it.
+ * @param settings @see caldav_settings
+ * @param upload The caldav_upload, not spliced before
+ * @return URL of the resource. Caller is responsible for freeing the
+ * memory.
+ */
+gchar* caldav_upload_resource(caldav_settings* settings,
+			      caldav_upload* upload) {
+	const gchar* end;
+	gchar* uid;
+	gchar* hash = NULL;
+	gchar* name;
+	gchar* collection;
+	gchar* url;
+	int naming = settings->naming;
+
+	uid = caldav_upload_scan(upload, &end);
+	if (naming == CALDAV_NAMING_UID && uid && *uid) {
+		name = g_uri_escape_string(uid, NULL, FALSE);
+	}
+	else {
+		if (naming == CALDAV_NAMING_UID)
+			naming = CALDAV_NAMING_HASH;
+		hash = caldav_upload_hash(upload, naming);
+		name = g_strdup_printf("libcaldav-%s", hash);
+	}
+	caldav_upload_splice_uid(upload, end, hash);
+	collection = rebuild_url(settings, NULL);
+	url = g_strdup_printf("%s%s%s.ics", collection,
+			(g_str_has_suffix(collection, "/")) ? "" : "/", name);
+	g_free(collection);
+	g_free(name);
+	g_free(hash);
+	g_free(uid);
+	return url;
+}
+
+/**
+ * @param upload The caldav_upload
+ * @return A copy of the body as a string. Caller is responsible for
+ * freeing the memory.
+ */
+gchar* caldav_upload_dup(const caldav_upload* upload) {
+	gchar* text;
+	gsize at = 0;
+	int i;
+
+	text = g_malloc(caldav_upload_length(upload) + 1);
+	for (i = 0; i < upload->parts; i++) {
+		memcpy(text + at, upload->part[i], upload->length[i]);
+		at += upload->length[i];
+	}
+	text[at] = '\0';
+	return text;
+}
+
+/**
+ * @param upload The caldav_upload
+ * @return The body as a string, copied to the arena only if it was not
+ * given as one. @see caldav_arena_take
+ */
+const gchar* caldav_upload_text(const caldav_upload* upload) {
+	gchar* text;
+	gsize at = 0;
+	int i;
+
+	if (upload->text && upload->parts == 1 &&
+			upload->text[upload->length[0]] == '\0')
+		return upload->text;
+	text = caldav_arena_alloc(caldav_upload_length(upload) + 1);
+	for (i = 0; i < upload->parts; i++) {
+		memcpy(text + at, upload->part[i], upload->length[i]);
+		at += upload->length[i];
+	}
+	text[at] = '\0';
+	return text;
+}
+
+/**
+ * Initialize caldav settings structure.
+ * @param settings @see caldav_settings
+ */
+void init_caldav_settings(caldav_settings* settings) {
+	settings->username = NULL;
+	settings->password = NULL;
+	settings->url = NULL;
+	settings->file = NULL;
+	settings->upload = NULL;
+	settings->usehttps = FALSE;
+	settings->custom_cacert = NULL;
+	settings->verify_ssl_certificate = TRUE;
+	settings->debug = FALSE;
+	settings->trace_ascii = TRUE;
+	settings->ACTION = UNKNOWN;
+	settings->start = 0;
+	settings->end = 0;
+	settings->capability_ttl = 0;
+	settings->share = NULL;
+	settings->curl = NULL;
+	settings->cache = NULL;
+	settings->cache_ttl = 0;
+	settings->lock = NULL;
+	settings->query = NULL;
+	settings->compression = 0;
+	settings->compress_uploads = 0;
+	settings->naming = CALDAV_NAMING_MD5;
+	settings->http2 = 0;
+	settings->stats = NULL;
+	settings->connect_timeout = 0;
+	settings->timeout = 0;
+	settings->low_speed_time = 0;
+	settings->retries = 0;
+	settings->breaker = 0;
+	settings->hedge = 0;
+	settings->exchange = NULL;
+	settings->exchange_data = NULL;
+	settings->trace = NULL;
+	settings->trace_data = NULL;
+	settings->trace_level = 0;
+	settings->trace_sample = 0;
+	settings->trace_redact = 0;
+	settings->trace_request = 0;
+}
+
+/**
+ * Copy the options of a caller into caldav settings. The one place the
+ * options reach the settings, for the blocking and the async calls alike.
+ * @param settings @see caldav_settings
+ * @param info @see runtime_info. Only the options and the stats are used.
+ */
+void copy_caldav_options(caldav_settings* settings, runtime_info* info) {
+	debug_curl* options;
+
+	if (!info)
+		return;
+	settings->stats = info->stats;
+	if (!(options = info->options))
+		return;
+	settings->debug = (options->debug) ? TRUE : FALSE;
+	settings->trace_ascii = (options->trace_ascii) ? 1 : 0;
+	settings->use_locking = (options->use_locking) ? 1 : 0;
+	settings->verify_ssl_certificate = options->verify_ssl_certificate;
+	g_free(settings->custom_cacert);
+	settings->custom_cacert = g_strdup(options->custom_cacert);
+	settings->capability_ttl = options->capability_ttl;
+	settings->share = (options->share) ? options->share->handle : NULL;
+	settings->cache = options->cache;
+	settings->cache_ttl = options->cache_ttl;
+	settings->lock = options->lock;
+	settings->compression = options->compression;
+	settings->compress_uploads = options->compress_uploads;
+	settings->naming = options->naming;
+	settings->http2 = options->http2;
+	settings->connect_timeout = options->connect_timeout;
+	settings->timeout = options->timeout;
+	settings->low_speed_time = options->low_speed_time;
+	settings->retries = options->retries;
+	settings->breaker = options->breaker;
+	settings->hedge = options->hedge;
+	settings->exchange = options->exchange;
+	settings->exchange_data = options->exchange_data;
+	settings->trace = options->trace;
+	settings->trace_data = options->trace_data;
+	settings->trace_level = options->trace_level;
+	settings->trace_sample = options->trace_sample;
+	settings->trace_redact = options->trace_redact;
+}
+
+/**
+ * Free memory assigned to caldav settings structure.
+ * @param settings @see caldav_settings
+ */
+void free_caldav_settings(caldav_settings* settings) {
+	if (settings->username) {
+		g_free(settings->username);
+		settings->username = NULL;
+	}
+	if (settings->password) {
+		g_free(settings->password);
+		settings->password = NULL;
+	}
+	if (settings->url) {
+		g_free(settings->url);
+		settings->url = NULL;
+	}
+	if (settings->file) {
+		g_free(settings->file);
+		settings->file = NULL;
+	}
+	if (settings->custom_cacert) {
+		g_free(settings->custom_cacert);
+		settings->custom_cacert = NULL;
+	}
+	settings->verify_ssl_certificate = TRUE;
+	settings->usehttps = FALSE;
+	settings->debug = FALSE;
+	settings->trace_ascii = TRUE;
+	settings->ACTION = UNKNOWN;
+	settings->start = 0;
+	settings->end = 0;
+	settings->capability_ttl = 0;
+	settings->share = NULL;
+	settings->curl = NULL;
+	settings->cache = NULL;
+}
+
+static gchar* place_after_hostname(const gchar* start, const gchar* stop) {
+	gchar* newpos = NULL;
+	gchar* pos = (gchar *) stop;
+	gboolean digit = TRUE;
+	
+	if (pos && stop && strcmp(start, pos) != 0) {
+		while (*pos != ':' && strcmp(start, pos) != 0)
+			--pos;
+		if (pos > start) {
+			gchar* tmp = (gchar *) pos + 1;
+			/* is pos++ a port number */
+			while (*tmp != '/' && digit) {
+				if (isdigit(*tmp) != 0) {
+					digit = TRUE;
+					tmp++;
+				}
+				else
+					digit = FALSE;
+			}
+			if (digit) {
+				/* pos was a port number */
+				while (*pos != '@' && strcmp(start, pos) != 0)
+					--pos;
+				if (strcmp(start, pos) != 0)
+					newpos = pos;
+			}
+			else {
+				while (*pos != '@' && pos != stop)
+					pos++;
+				if (pos != stop)
+					newpos = pos;
+			}
+		}
+		else {
+			/* is a username present */
+			gchar* tmp = NULL;
+			while (*pos != '/' && pos != stop) {
+				if (*pos == '@')
+					tmp = pos;
+				pos++;
+			}
+			if (tmp && pos != stop)
+				newpos = tmp;
+		}
+	}
+	return newpos;
+}
+
+/**
+ * Parse URL
+ * @param settings @see caldav_settings
+ * @param url String containing URL to collection
+ */
+void parse_url(caldav_settings* settings, const char* url) {
+	char* start;
+	char* pos;
+	char* end;
+	char* login;
+
+	login = pos = end = start = NULL;
+	if (!url)
+		return;
+	if ((pos = strstr(url, "//")) != NULL) {
+		/* Does the URL use https ?*/
+		if (!g_ascii_strncasecmp(url,"https",5) && settings->usehttps == FALSE) {
+				settings->usehttps=TRUE;
+		}
+		start = g_strdup(&(*(pos + 2)));
+		if ((pos = place_after_hostname(start, strrchr(start, '\0') - 1)) != NULL) {
+			/* username and/or password present */
+			login = g_strndup(start, pos - start);
+			end = pos;
+			if ((pos = strrchr(login, ':')) != NULL) {
+				/* both username and password is present */
+				settings->username = g_strndup(login, pos - login);
+				settings->password = g_strdup(++pos);
+			}
+			else {
+				/* only username present */
+				settings->username = g_strdup(login);
+				settings->password = NULL;
+			}
+			g_free(login);
+			settings->url = g_strdup(++end);
+		}
+		else {
+			/* no username or password present */
+			settings->url = g_strdup(start);
+			settings->username = NULL;
+			settings->password = NULL;
+		}
+		g_free(start);
+	}
+}
+
+/**
+ * Find the next header line of a given name among those a full index of
+ * a header buffer had no room for. They all follow the last one indexed,
+ * as the status line of a later response empties the index.
+ * @param headers Header buffer filled by WriteHeaderCallback
+ * @param header HTTP header to search for, case insensitive
+ * @param at Where to continue, NULL to start after the last line
+ * indexed. Set past the line found.
+ * @param len Where to store the length of the value.
+ * @return The value, not zero terminated, or NULL if there is no more.
+ */
+static const gchar* find_unindexed_header(const struct MemoryStruct* headers,
+					  const char* header,
+					  const gchar** at, gsize* len) {
+	const header_field* last;
+	const gchar* end = headers->memory + headers->size;
+	const gchar* line;
+	const gchar* eol;
+	const gchar* value;
+	gsize name_len = strlen(header);
+
+	if (headers->fields <= CALDAV_HEADER_FIELDS)
+		return NULL;
+	if (! *at) {
+		last = &headers->field[CALDAV_HEADER_FIELDS - 1];
+		*at = headers->memory + last->value + last->value_len;
+		if ((*at = memchr(*at, '\n', end - *at)) == NULL)
+			return NULL;
+		(*at)++;
+	}
+	for (line = *at; line < end; line = eol) {
+		if ((eol = memchr(line, '\n', end - line)) == NULL)
+			eol = end;
+		else
+			eol++;
+		if ((gsize) (eol - line) <= name_len || line[name_len] != ':' ||
+				g_ascii_strncasecmp(line, header, name_len) != 0)
+			continue;
+		for (value = line + name_len + 1;
+				value < eol && g_ascii_isspace(*value); value++)
+			;
+		*len = eol - value;
+		while (*len > 0 && g_ascii_isspace(value[*len - 1]))
+			(*len)--;
+		*at = eol;
+		return value;
+	}
+	*at = end;
+	return NULL;
+}
+
+/**
+ * Find a specific HTTP header of the last response in the index of a
+ * header buffer. Does not allocate.
+ * @param headers Header buffer filled by WriteHeaderCallback
+ * @param header HTTP header to search for, case insensitive
+ * @param len Where to store the length of the value. The value is not
+ * zero terminated.
+ * @return The value of the first such header or NULL
+ */
+const gchar* find_response_header(const struct MemoryStruct* headers,
+				  const char* header, gsize* len) {
+	const header_field* field;
+	const gchar* at = NULL;
+	gsize name_len = strlen(header);
+	int i;
+
+	if (! headers->memory)
+		return NULL;
+	for (i = 0; i < MIN(headers->fields, CALDAV_HEADER_FIELDS); i++) {
+		field = &headers->field[i];
+		if (field->name_len == name_len && g_ascii_strncasecmp(
+				headers->memory + field->name, header, name_len) == 0) {
+			*len = field->value_len;
+			return headers->memory + field->value;
+		}
+	}
+	return find_unindexed_header(headers, header, &at, len);
+}
+
+/**
+ * Find a specific HTTP header from last request
+ * @param header HTTP header to search for
+ * @param headers Header buffer filled by WriteHeaderCallback
+ * @param lowcase Should string be returned in all lower case.
+ * @return The header found or NULL. Repeated headers are joined by ", ".
+ */
+gchar* get_response_header(const char* header,
+			   const struct MemoryStruct* headers,
+			   gboolean lowcase) {
+	const header_field* field;
+	const gchar* at = NULL;
+	const gchar* value;
+	gsize name_len = strlen(header);
+	gsize len;
+	GString* head = NULL;
+	int i;
+
+	if (! headers->memory)
+		return NULL;
+	for (i = 0; i < MIN(headers->fields, CALDAV_HEADER_FIELDS); i++) {
+		field = &headers->field[i];
+		if (field->name_len != name_len || g_ascii_strncasecmp(
+				headers->memory + field->name, header, name_len) != 0)
+			continue;
+		if (head)
+			g_string_append(head, ", ");
+		else
+			head = g_string_sized_new(field->value_len);
+		g_string_append_len(head,
+				headers->memory + field->value, field->value_len);
+	}
+	while ((value = find_unindexed_header(headers, header, &at, &len))) {
+		if (head)
+			g_string_append(head, ", ");
+		else
+			head = g_string_sized_new(len);
+		g_string_append_len(head, value, len);
+	}
+	if (! head)
+		return NULL;
+	if (lowcase)
+		g_string_ascii_down(head);
+	return g_string_free(head, FALSE);
+}
+
+/**
+ * Find the value of an iCalendar property (RFC5545 3.1) in a single pass.
+ * Folded lines are unfolded and property parameters skipped.
+ * @param object Calendar object following ICal format
+ * @param name Property to search for, case insensitive
+ * @return The value of the first such property or NULL. Caller is
+ * responsible for freeing the memory.
+ */
+gchar* get_ical_property(const gchar* object, const gchar* name) {
+	return get_ical_property_len(object, strlen(object), name);
+}
+
+/**
+ * Find the value of an iCalendar property in the first length bytes of
+ * object, which need not be NUL terminated. @see get_ical_property
+ * @param object Calendar object following ICal format
+ * @param length Bytes of object
+ * @param name Property to search for, case insensitive
+ * @return The value of the first such property or NULL. Caller is
+ * responsible for freeing the memory.
+ */
+gchar* get_ical_property_len(const gchar* object, gsize length,
+			     const gchar* name) {
+	const gchar* end = object + length;
+	const gchar* line = object;
+	const gchar* pos;
+	gsize len = strlen(name);
+	gboolean quoted = FALSE;
+	GString* value;
+
+	while (line && line < end) {
+		if ((gsize) (end - line) > len &&
+				g_ascii_strncasecmp(line, name, len) == 0 &&
+				(line[len] == ':' || line[len] == ';'))
+			break;
+		if ((line = memchr(line, '\n', end - line)) != NULL)
+			line++;
+	}
+	if (! line || line >= end)
+		return NULL;
+	/* skip parameters, a quoted parameter value may hold a ':' */
+	for (pos = line + len; pos < end && (quoted || *pos != ':'); pos++) {
+		if (*pos == '"')
+			quoted = !quoted;
+		else if (*pos == '\r' || *pos == '\n')
+			return NULL;
+	}
+	if (pos >= end)
+		return NULL;
+	value = g_string_new(NULL);
+	for (line = ++pos; pos < end; pos++) {
+		if (*pos != '\r' && *pos != '\n')
+			continue;
+		g_string_append_len(value, line, pos - line);
+		if (pos[0] == '\r' && pos + 1 < end && pos[1] == '\n')
+			pos++;
+		/* a line starting with white space continues the previous one */
+		if (pos + 1 >= end || (pos[1] != ' ' && pos[1] != '\t'))
+			break;
+		line = pos + 2;
+		pos++;
+	}
+	if (pos >= end)
+		g_string_append_len(value, line, end - line);
+	g_strstrip(value->str);
+	return g_string_free(value, FALSE);
+}
+
+/**
+ * Find the UID of a calendar object and the end of its first event or
+ * task in a single pass, stopping at the UID.
+ * @param object Calendar object following ICal format
+ * @param length Bytes of object, need not be NUL terminated
+ * @param end Where to store the start of the first END:VEVENT or
+ * END:VTODO line if there is no UID, NULL otherwise
+ * @return The UID or NULL. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_ical_scan(const gchar* object, gsize length,
+			const gchar** end) {
+	const gchar* stop = object + length;
+	const gchar* line = object;
+	gsize left;
+
+	*end = NULL;
+	while (line && line < stop) {
+		left = stop - line;
+		if (left > 3 && g_ascii_strncasecmp(line, "UID", 3) == 0 &&
+				(line[3] == ':' || line[3] == ';')) {
+			*end = NULL;
+			return get_ical_property_len(line, left, "UID");
+		}
+		if (! *end && left >= 9 && line[0] == 'E' &&
+				(strncmp(line, "END:VTODO", 9) == 0 ||
+				 (left >= 10 && strncmp(line, "END:VEVENT", 10) == 0)))
+			*end = line;
+		if ((line = memchr(line, '\n', left)) != NULL)
+			line++;
+	}
+	return NULL;
+}
+
+static const char* VCAL_HEAD =
+"BEGIN:VCALENDAR\r\n"
+"PRODID:-//CalDAV Calendar//NONSGML libcaldav//EN\r\n"
+"VERSION:2.0\r\n";
+static const char* VCAL_FOOT = "END:VCALENDAR";
+
+/**
+ * Find the first occurrence of needle starting before limit. The match
+ * itself may run past limit. Internal function.
+ * @param text Where to start searching
+ * @param limit Matches must start before this point
+ * @param needle String to find
+ * @param len Length of needle
+ * @return pointer to the match or NULL
+ */
+static const char* find_before(const char* text, const char* limit,
+		const char* needle, gsize len) {
+	if (limit <= text)
+		return NULL;
+	return g_strstr_len(text, (limit - text) + len - 1, needle);
+}
+
+/**
+ * Parse response from CalDAV server. Internal function.
+ * The report is walked once with a cursor that only moves forward and
+ * every object found is appended to response, so the cost is linear in
+ * the size of the report.
+ * @param report Response from server
+ * @param element XML element to find
+ * @param type VCalendar element to find
+ * @param recursive Stop after first match or not
+ * @param response GString to append the found objects to
+ * @return TRUE if at least one object was found
+ */
+static gboolean parse_caldav_report_wrap(
+		const char* report, const char* element, const char* type,
+			gboolean recursive, GString* response) {
+	const char* cursor = report;
+	const char* pos;
+	const char* object;
+	const char* end;
+	const char* next;
+	gchar* begin_type;
+	gchar* end_type;
+	gsize begin_len, end_len;
+	gboolean found = FALSE;
+
+	begin_type = g_strconcat("BEGIN:", type, NULL);
+	end_type = g_strconcat("END:", type, NULL);
+	begin_len = strlen(begin_type);
+	end_len = strlen(end_type);
+	while ((pos = strstr(cursor, element)) != NULL) {
+		if ((pos = strchr(pos, '>')) == NULL)
+			break;
+		if ((pos = strstr(pos + 1, begin_type)) == NULL)
+			break;
+		object = pos + begin_len;
+		while (*object && g_ascii_isspace(*object))
+			object++;
+		if ((end = strstr(object, end_type)) == NULL)
+			break;
+		/* an object may hold several components of the same
+		 * type. Extend to the last end marker before the next
+		 * element, but only if there is a next element
+		 */
+		next = strstr(end + 1, element);
+		if (next) {
+			while ((pos = find_before(
+					end + 1, next, end_type, end_len)) != NULL)
+				end = pos;
+		}
+		g_string_append_len(response, begin_type, begin_len);
+		g_string_append_len(response, "\r\n", 2);
+		g_string_append_len(response, object, end - object);
+		g_string_append_len(response, end_type, end_len);
+		g_string_append_len(response, "\r\n", 2);
+		found = TRUE;
+		if (!recursive || (pos = strchr(end, '>')) == NULL)
+			break;
+		cursor = pos + 1;
+	}
+	g_free(begin_type);
+	g_free(end_type);
+	return found;
+}
+
+/**
+ * Parse response from CalDAV server
+ * @param report Response from server
+ * @param element XML element to find
+ * @param type VCalendar element to find
+ * @return the parsed result
+ */
+gchar* parse_caldav_report(char* report, const char* element, const char* type) {
+	GString* response;
+	gint64 since = g_get_monotonic_time();
+
+	if (!report || !element || !type)
+		return NULL;
+	response = g_string_sized_new(strlen(report) + strlen(VCAL_HEAD));
+	g_string_append(response, VCAL_HEAD);
+	/* test for VTIMEZONE.
+	 * Only the first found will be used and this will then
+	 * be the time zone for the entire report
+	 */
+	parse_caldav_report_wrap(report, element, "VTIMEZONE", FALSE, response);
+	if (!parse_caldav_report_wrap(report, element, type, TRUE, response)) {
+		g_string_free(response, TRUE);
+		pending()->parse += g_get_monotonic_time() - since;
+		return NULL;
+	}
+	g_string_append(response, VCAL_FOOT);
+	pending()->parse += g_get_monotonic_time() - since;
+	return g_string_free(response, FALSE);
+}
+
+/**
+ * Find the next element with the given local name, whatever its
+ * namespace prefix.
+ * @param text Where to start searching.
+ * @param end End of the text to search.
+ * @param name Local name of the element.
+ * @param content_end Set to the start of the closing tag.
+ * @param after Set to the first character after the element.
+ * @return The start of the element content or NULL if not found.
+ */
+static const gchar* find_element(const gchar* text, const gchar* end,
+				 const gchar* name, const gchar** content_end,
+				 const gchar** after) {
+	const gchar* pos;
+	const gchar* qname;
+	const gchar* local;
+	const gchar* close;
+	gsize qlen;
+	gsize nlen = strlen(name);
+
+	for (pos = text; pos < end && (pos = memchr(pos, '<', end - pos)); pos++) {
+		if (pos + 1 >= end || pos[1] == '/' || pos[1] == '?' || pos[1] == '!')
+			continue;
+		qname = pos + 1;
+		for (qlen = 0; qname + qlen < end &&
+				! strchr(" \t\r\n/>", qname[qlen]); qlen++)
+			;
+		local = memchr(qname, ':', qlen);
+		local = (local) ? local + 1 : qname;
+		if ((gsize) (qname + qlen - local) != nlen ||
+				strncmp(local, name, nlen) != 0)
+			continue;
+		if ((close = memchr(qname + qlen, '>', end - qname - qlen)) == NULL)
+			return NULL;
+		if (close[-1] == '/') {
+			*content_end = close + 1;
+			*after = close + 1;
+			return close + 1;
+		}
+		for (pos = close + 1; pos < end &&
+				(pos = memchr(pos, '<', end - pos)); pos++) {
+			if (end - pos > 9 && strncmp(pos, "<![CDATA[", 9) == 0) {
+				if ((pos = g_strstr_len(pos, end - pos, "]]>")) == NULL)
+					return NULL;
+				continue;
+			}
+			if (pos[1] == '/' && (gsize) (end - pos) > qlen + 2 &&
+					strncmp(pos + 2, qname, qlen) == 0 &&
+					pos[qlen + 2] == '>') {
+				*content_end = pos;
+				*after = pos + qlen + 3;
+				return close + 1;
+			}
+		}
+		return NULL;
+	}
+	return NULL;
+}
+
+/**
+ * Copy element content replacing XML entities and CDATA sections.
+ * @param text Content of an element.
+ * @param end End of the content.
+ * @return The unescaped text.
+ */
+static gchar* xml_unescape(const gchar* text, const gchar* end) {
+	GString* s = g_string_sized_new(end - text);
+	const gchar* stop;
+	gunichar c;
+
+	while (text < end) {
+		if (*text == '<' && end - text > 9 &&
+				strncmp(text, "<![CDATA[", 9) == 0) {
+			text += 9;
+			stop = g_strstr_len(text, end - text, "]]>");
+			if (! stop)
+				stop = end;
+			g_string_append_len(s, text, stop - text);
+			text = (stop < end) ? stop + 3 : end;
+		}
+		else if (*text == '&' && (stop = memchr(text, ';', end - text))) {
+			if (strncmp(text, "&amp;", 5) == 0)
+				g_string_append_c(s, '&');
+			else if (strncmp(text, "&lt;", 4) == 0)
+				g_string_append_c(s, '<');
+			else if (strncmp(text, "&gt;", 4) == 0)
+				g_string_append_c(s, '>');
+			else if (strncmp(text, "&quot;", 6) == 0)
+				g_string_append_c(s, '"');
+			else if (strncmp(text, "&apos;", 6) == 0)
+				g_string_append_c(s, '\'');
+			else if (text[1] == '#') {
+				c = (text[2] == 'x' || text[2] == 'X') ?
+					strtoul(text + 3, NULL, 16) : strtoul(text + 2, NULL, 10);
+				g_string_append_unichar(s, c);
+			}
+			else
+				g_string_append_len(s, text, stop - text + 1);
+			text = stop + 1;
+		}
+		else
+			g_string_append_c(s, *text++);
+	}
+	return g_string_free(s, FALSE);
+}
+
+/**
+ * Fetch and unescape the first non-empty element with the given local name.
+ * @return The content with surrounding white space removed or NULL.
+ */
+static gchar* element_text(const gchar* text, const gchar* end,
+			   const gchar* name) {
+	const gchar* content;
+	const gchar* content_end;
+	const gchar* after;
+	gchar* value;
+
+	while ((content = find_element(text, end, name, &content_end, &after))) {
+		value = g_strstrip(xml_unescape(content, content_end));
+		if (*value)
+			return value;
+		g_free(value);
+		text = after;
+	}
+	return NULL;
+}
+
+/**
+ * Read the code from a status element ("HTTP/1.1 200 OK").
+ * @return The HTTP status code or 0 if there is none.
+ */
+static long element_status(const gchar* text, const gchar* end) {
+	gchar* status;
+	gchar* code;
+	long value = 0;
+
+	if ((status = element_text(text, end, "status")) != NULL) {
+		if ((code = strchr(status, ' ')) != NULL)
+			value = strtol(code, NULL, 10);
+		g_free(status);
+	}
+	return value;
+}
+
+/**
+ * Build a multistatus_entry from the content of a response element.
+ * @param content Start of the element content.
+ * @param content_end End of the element content.
+ * @return A new multistatus_entry.
+ */
+static multistatus_entry* response_entry(const gchar* content,
+					 const gchar* content_end) {
+	multistatus_entry* entry;
+	const gchar* prop;
+	const gchar* prop_end;
+	const gchar* prop_after;
+	long status;
+
+	entry = g_new0(multistatus_entry, 1);
+	entry->href = element_text(content, content_end, "href");
+	entry->etag = element_text(content, content_end, "getetag");
+	entry->data = element_text(content, content_end, "calendar-data");
+	/* a 2xx propstat wins over the 404 listing unknown properties */
+	prop = content;
+	while ((prop = find_element(prop, content_end, "propstat",
+					&prop_end, &prop_after)) != NULL) {
+		status = element_status(prop, prop_end);
+		if (entry->status == 0 || (status >= 200 && status < 300))
+			entry->status = status;
+		prop = prop_after;
+	}
+	if (entry->status == 0)
+		entry->status = element_status(content, content_end);
+	return entry;
+}
+
+/**
+ * Free a multistatus_entry.
+ * @param entry A multistatus_entry.
+ */
+static void free_entry(multistatus_entry* entry) {
+	g_free(entry->href);
+	g_free(entry->etag);
+	g_free(entry->data);
+	g_free(entry);
+}
+
+/**
+ * Parse a multistatus into its response elements. Namespace prefixes are
+ * ignored and href, getetag and calendar-data are unescaped.
+ * @param report A multistatus response body.
+ * @return A list of multistatus_entry in document order. Free it with
+ * free_multistatus().
+ */
+GSList* parse_multistatus(const gchar* report) {
+	GSList* entries = NULL;
+	const gchar* end;
+	const gchar* text;
+	const gchar* content;
+	const gchar* content_end;
+	const gchar* after;
+	gint64 since = g_get_monotonic_time();
+
+	if (! report)
+		return NULL;
+	end = report + strlen(report);
+	text = report;
+	while ((content = find_element(text, end, "response",
+					&content_end, &after)) != NULL) {
+		entries = g_slist_prepend(entries,
+				response_entry(content, content_end));
+		text = after;
+	}
+	pending()->parse += g_get_monotonic_time() - since;
+	return g_slist_reverse(entries);
+}
+
+/**
+ * Find a property of a response element other than the ones kept in
+ * multistatus_entry. Only usable from a multistatus_handler.
+ * @param entry The multistatus_entry handed to the handler.
+ * @param name Local name of the property.
+ * @return The unescaped content or NULL if not found.
+ */
+gchar* multistatus_entry_text(const multistatus_entry* entry,
+			      const gchar* name) {
+	if (! entry->content)
+		return NULL;
+	return element_text(entry->content, entry->content_end, name);
+}
+
+/**
+ * Create an incremental multistatus parser.
+ * @param handler Function called for every response element.
+ * @param data Passed to handler.
+ * @return A new multistatus_stream. Free it with multistatus_stream_free().
+ */
+multistatus_stream* multistatus_stream_new(multistatus_handler handler,
+					   void* data) {
+	multistatus_stream* stream = g_new0(multistatus_stream, 1);
+
+	stream->buffer = g_string_sized_new(CURL_MAX_WRITE_SIZE);
+	stream->handler = handler;
+	stream->data = data;
+	return stream;
+}
+
+/**
+ * Feed the next part of a multistatus body to the parser. The handler is
+ * called for every response element completed by it.
+ * @param stream A multistatus_stream.
+ * @param text Next part of the body.
+ * @param len Length of text.
+ * @return TRUE if the handler asked to stop, FALSE otherwise.
+ */
+gboolean multistatus_stream_feed(multistatus_stream* stream,
+				 const gchar* text, gsize len) {
+	static const gchar closing[] = "response>";
+	GString* buffer = stream->buffer;
+	const gchar* start;
+	const gchar* end;
+	const gchar* content;
+	const gchar* content_end;
+	const gchar* after;
+	multistatus_entry* entry;
+	gsize from;
+	gint64 since;
+
+	if (stream->stopped)
+		return TRUE;
+	since = g_get_monotonic_time();
+	from = buffer->len;
+	g_string_append_len(buffer, text, len);
+	/* nothing can have completed unless a closing tag arrived. Look
+	 * back far enough to find one split between two parts
+	 */
+	from = (from > sizeof(closing)) ? from - sizeof(closing) : 0;
+	if (! g_strstr_len(buffer->str + from, buffer->len - from, closing)) {
+		pending()->parse += g_get_monotonic_time() - since;
+		return FALSE;
+	}
+	start = buffer->str;
+	end = buffer->str + buffer->len;
+	while (! stream->stopped && (content = find_element(start, end,
+					"response", &content_end, &after)) != NULL) {
+		entry = response_entry(content, content_end);
+		entry->content = content;
+		entry->content_end = content_end;
+		/* the time the handler takes is not parsing */
+		pending()->parse += g_get_monotonic_time() - since;
+		stream->stopped = stream->handler(entry, stream->data);
+		since = g_get_monotonic_time();
+		free_entry(entry);
+		start = after;
+	}
+	g_string_erase(buffer, 0, start - buffer->str);
+	pending()->parse += g_get_monotonic_time() - since;
+	return stream->stopped;
+}
+
+/**
+ * Free a multistatus_stream.
+ * @param stream A multistatus_stream.
+ */
+void multistatus_stream_free(multistatus_stream* stream) {
+	if (! stream)
+		return;
+	g_string_free(stream->buffer, TRUE);
+	g_free(stream);
+}
+
+/**
+ * Fetch the first non-empty element with the given local name from XML,
+ * whatever its namespace prefix.
+ * @param text String
+ * @param name Local name of the element
+ * @return The unescaped content or NULL if not found.
+ */
+gchar* get_element_text(const gchar* text, const gchar* name) {
+	if (! text || ! name)
+		return NULL;
+	return element_text(text, text + strlen(text), name);
+}
+
+/**
+ * Free a list returned by parse_multistatus.
+ * @param entries A list of multistatus_entry.
+ */
+void free_multistatus(GSList* entries) {
+	GSList* item;
+
+	for (item = entries; item; item = g_slist_next(item))
+		free_entry((multistatus_entry *) item->data);
+	g_slist_free(entries);
+}
+
+/**
+ * Write a time_t variable as CalDAV DateTime in UTC.
+ * @param time a specific date and time
+ * @param buf Room for CALDAV_DATETIME_SIZE bytes.
+ * @return buf
+ */
+gchar* format_caldav_datetime(time_t time, gchar* buf) {
+	struct tm current;
+
+	gmtime_r(&time, &current);
+	g_snprintf(buf, CALDAV_DATETIME_SIZE, "%.4d%.2d%.2dT%.2d%.2d%.2dZ",
+		current.tm_year + 1900, current.tm_mon + 1, current.tm_mday,
+		current.tm_hour, current.tm_min, current.tm_sec);
+	return buf;
+}
+
+/**
+ * Convert a time_t variable to CalDAV DateTime
+ * @param time a specific date and time
+ * @return the CalDAV DateTime in UTC
+ */
+gchar* get_caldav_datetime(time_t* time) {
+	gchar datetime[CALDAV_DATETIME_SIZE];
+
+	return g_strdup(format_caldav_datetime(*time, datetime));
+}
+
+/**
+ * Build a query with a time-range element between the two halves of its
+ * template, in transient memory.
+ * @param head The query up to the time-range.
+ * @param start Start of the range.
+ * @param end End of the range.
+ * @param foot The query after the time-range.
+ * @return The query. Never free it.
+ */
+gchar* caldav_range_request(const gchar* head, time_t start, time_t end,
+			    const gchar* foot) {
+	static const gchar open[] = "\r\n<C:time-range start=\"";
+	static const gchar middle[] = "\"\r\n end=\"";
+	static const gchar close[] = "\"/>\r\n";
+	gsize head_len = strlen(head);
+	gsize foot_len = strlen(foot);
+	gchar* request;
+	gchar* pos;
+
+	request = caldav_arena_alloc(head_len + sizeof(open) - 1 +
+			sizeof(middle) - 1 + sizeof(close) - 1 + foot_len +
+			2 * (CALDAV_DATETIME_SIZE - 1) + 1);
+	pos = request;
+	memcpy(pos, head, head_len);
+	pos += head_len;
+	memcpy(pos, open, sizeof(open) - 1);
+	pos += sizeof(open) - 1;
+	format_caldav_datetime(start, pos);
+	pos += CALDAV_DATETIME_SIZE - 1;
+	memcpy(pos, middle, sizeof(middle) - 1);
+	pos += sizeof(middle) - 1;
+	format_caldav_datetime(end, pos);
+	pos += CALDAV_DATETIME_SIZE - 1;
+	memcpy(pos, close, sizeof(close) - 1);
+	pos += sizeof(close) - 1;
+	memcpy(pos, foot, foot_len + 1);
+	return request;
+}
+
+/**
+ * Read a fixed number of decimal digits.
+ * @param text Digits.
+ * @param count Number of digits.
+ * @param value Where to store the number.
+ * @return TRUE if text starts with count digits.
+ */
+static gboolean read_digits(const gchar* text, int count, int* value) {
+	int i;
+
+	*value = 0;
+	for (i = 0; i < count; i++) {
+		if (! g_ascii_isdigit(text[i]))
+			return FALSE;
+		*value = *value * 10 + text[i] - '0';
+	}
+	return TRUE;
+}
+
+/**
+ * Count the days from 1970-01-01 to a date of the proleptic Gregorian
+ * calendar without going through the time zone of the host.
+ * @return Days, negative before 1970.
+ */
+static glong days_from_civil(int year, int month, int day) {
+	glong era;
+	glong yoe;
+	glong doy;
+
+	year -= (month <= 2);
+	era = ((year >= 0) ? year : year - 399) / 400;
+	yoe = year - era * 400;
+	doy = (153 * ((month > 2) ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+/**
+ * Convert a CalDAV DateTime or Date to a time_t. Values ending with Z are
+ * UTC, others are taken as local time.
+ * @param text "20080415T151500Z", "20080415T151500" or "20080415"
+ * @param end NULL or set to the first character after the value.
+ * @return The time or -1 if text does not start with a DateTime.
+ */
+time_t parse_caldav_datetime(const gchar* text, const gchar** end) {
+	struct tm tm;
+	int year, month, day;
+	int hour = 0, minute = 0, second = 0;
+	const gchar* pos = text;
+
+	if (! text || ! read_digits(pos, 4, &year) ||
+			! read_digits(pos + 4, 2, &month) ||
+			! read_digits(pos + 6, 2, &day) ||
+			month < 1 || month > 12 || day < 1 || day > 31)
+		return (time_t) -1;
+	pos += 8;
+	if (*pos == 'T') {
+		if (! read_digits(pos + 1, 2, &hour) ||
+				! read_digits(pos + 3, 2, &minute) ||
+				! read_digits(pos + 5, 2, &second))
+			return (time_t) -1;
+		pos += 7;
+	}
+	if (*pos == 'Z') {
+		if (end)
+			*end = pos + 1;
+		return (time_t) (days_from_civil(year, month, day) * 86400 +
+				hour * 3600 + minute * 60 + second);
+	}
+	if (end)
+		*end = pos;
+	/* floating time is the local time of whoever looks at it */
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = year - 1900;
+	tm.tm_mon = month - 1;
+	tm.tm_mday = day;
+	tm.tm_hour = hour;
+	tm.tm_min = minute;
+	tm.tm_sec = second;
+	tm.tm_isdst = -1;
+	return mktime(&tm);
+}
+
+/**
+ * Convert an ICal duration ("PT1H", "-P1DT2H", "P2W") to seconds.
+ * @param text The duration.
+ * @param end NULL or set to the first character after the value.
+ * @param seconds Where to store the length.
+ * @return TRUE if text starts with a duration, FALSE otherwise.
+ */
+gboolean parse_caldav_duration(const gchar* text, const gchar** end,
+			       glong* seconds) {
+	const gchar* pos = text;
+	gboolean negative = FALSE;
+	gboolean time = FALSE;
+	gboolean any = FALSE;
+	glong total = 0;
+	glong value;
+
+	if (! text)
+		return FALSE;
+	if (*pos == '+' || *pos == '-')
+		negative = (*pos++ == '-');
+	if (*pos++ != 'P')
+		return FALSE;
+	while (*pos) {
+		if (*pos == 'T' && ! time) {
+			time = TRUE;
+			pos++;
+			continue;
+		}
+		if (! g_ascii_isdigit(*pos))
+			break;
+		for (value = 0; g_ascii_isdigit(*pos); pos++)
+			value = value * 10 + *pos - '0';
+		switch (*pos) {
+			case 'W': total += value * 604800; break;
+			case 'D': total += value * 86400; break;
+			case 'H': total += value * 3600; break;
+			case 'M': total += value * 60; break;
+			case 'S': total += value; break;
+			default: return FALSE;
+		}
+		pos++;
+		any = TRUE;
+	}
+	if (! any)
+		return FALSE;
+	if (end)
+		*end = pos;
+	*seconds = (negative) ? -total : total;
+	return TRUE;
+}
+
+/**
+ * Create a random text string, using MD5. @see caldav_md5_hex_digest()
+ * @param text some text to randomize
+ * @return MD5 hash of text
+ */
+gchar* random_file_name(const gchar* text) {
+	gchar md5sum[33];
+
+	caldav_md5_hex_digest(md5sum, (const unsigned char *) text);
+	return g_strdup(md5sum);
+}
+
+/**
+ * Does the event contain a UID element or not. If not add it.
+ * @param object A specific event
+ * @return event, eventually added UID
+ */
+gchar* verify_uid(gchar* object) {
+	caldav_upload upload;
+	gchar* newobj;
+
+	caldav_upload_string(&upload, object);
+	caldav_upload_verify_uid(&upload, NULL);
+	newobj = caldav_upload_dup(&upload);
+	caldav_upload_clear(&upload);
+	return newobj;
+}
+
+/**
+ * Fetch a URL from a XML element
+ * @param text String
+ * @return URL
+ */
+#define ELEM_HREF "href>"
+gchar* get_url(gchar* text) {
+	gchar* pos;
+	gchar* url = NULL;
+
+	if ((pos = strstr(text, ELEM_HREF)) == NULL)
+		return url;
+	pos = &(*(pos + strlen(ELEM_HREF)));
+	url = g_strndup(pos, strlen(pos) - strlen(strchr(pos, '<')));
+	return url;
+}
+
+/**
+ * Fetch any element from XML
+ * @param text String
+ * @param tag The element to look for
+ * @return element
+ */
+gchar* get_tag(const gchar* tag, gchar* text) {
+	gchar *pos;
+	gchar* res = NULL;
+	gchar* the_tag = NULL;
+
+	/*printf("%s\n", text);*/
+	the_tag = g_strdup_printf("<%s>", tag);
+	if ((pos = strstr(text, the_tag)) == NULL) {
+		g_free(the_tag);
+		return res;
+	}
+	pos = &(*(pos + strlen(the_tag)));
+	res = g_strndup(pos, strlen(pos) - strlen(strchr(pos, '<')));
+	g_free(the_tag);
+	return res;	
+}
+
+/**
+ * Fetch the etag element from XML
+ * @param text String
+ * @return etag
+ */
+#define ELEM_ETAG "getetag"
+gchar* get_etag(gchar* text) {
+	gchar* etag = NULL;
+	
+	etag = get_tag(ELEM_ETAG, text);
+	/* Maybe namespace prefixed */
+	if (!etag) {
+		etag = get_tag("D:getetag", text);
+	}
+	return etag;
+}
+
+/**
+ * Fetch host from URL
+ * @param url URL
+ * @return host
+ */
+gchar* get_host(gchar* url) {
+	gchar** buf;
+	gchar* result = NULL;
+
+	buf = g_strsplit(url, "/", 2);
+	if (buf[0]) {
+		result = g_strdup(buf[0]);
+	}
+	g_strfreev(buf);
+	return result;
+}
+
+/**
+ * rebuild a raw URL with https if needed from the settings
+ * @param settings caldav_settings
+ * @param uri URI to use instead of base
+ * @return URL
+ */
+
+gchar* rebuild_url(caldav_settings* settings, gchar* uri){
+    gchar* url = NULL;
+    gchar* mystr = NULL;
+	if (settings->usehttps) {
+		mystr = "https://";
+	} else {
+		mystr = "http://";
+	}
+	if (uri)
+		url = g_strdup_printf("%s%s", mystr, uri);
+	else
+    	url = g_strdup_printf("%s%s", mystr,settings->url);
+
+	return url;
+}
+
+/**
+ * Build the URL of a calendar object resource on the collection's server.
+ * @param settings caldav_settings
+ * @param href Path or URL of the resource
+ * @return URL or NULL if settings has no host. Caller is responsible for
+ * freeing the memory.
+ */
+gchar* object_url(caldav_settings* settings, const gchar* href) {
+	gchar* host;
+	gchar* raw;
+	gchar* url;
+
+	/* only the path is used, the object lives on the collection's server */
+	if (strstr(href, "://")) {
+		href = strchr(strstr(href, "://") + 3, '/');
+		if (! href)
+			href = "/";
+	}
+	if (! settings->url || (host = get_host(settings->url)) == NULL)
+		return NULL;
+	raw = g_strdup_printf("%s%s%s", host, (*href == '/') ? "" : "/", href);
+	url = rebuild_url(settings, raw);
+	g_free(raw);
+	g_free(host);
+	return url;
+}
+
+/**
+ * Build the key identifying the collection referenced by settings in
+ * process-wide caches. Credentials are part of the key since what the
+ * server answers may depend on the authenticated principal.
+ * @param settings @see caldav_settings
+ * @return Key. Caller is responsible for freeing the memory.
+ */
+gchar* collection_key(caldav_settings* settings) {
+	return g_strdup_printf("%s@%s%s",
+			(settings->username) ? settings->username : "",
+			(settings->usehttps) ? "https://" : "http://",
+			(settings->url) ? settings->url : "");
+}
+
+static gpointer curl_global_setup(gpointer data) {
+	curl_global_init(CURL_GLOBAL_ALL);
+	return NULL;
+}
+
+/**
+ * Initialize libcurl exactly once for the whole process. Safe to call
+ * from any thread before creating a CURL handle.
+ */
+void init_curl_global(void) {
+	static GOnce once = G_ONCE_INIT;
+
+	g_once(&once, curl_global_setup, NULL);
+}
+
+static gpointer headers_setup(gpointer data) {
+	static const char* xml = "Content-Type: application/xml; charset=\"utf-8\"";
+	static const char* depth[] = {
+		"Depth: 0", "Depth: 1", "Depth: infinity", NULL, NULL
+	};
+	struct curl_slist** lists = (struct curl_slist **) data;
+	int i;
+
+	for (i = 0; i < CALDAV_HEADERS_COUNT; i++) {
+		lists[i] = curl_slist_append(NULL, (i == CALDAV_HEADERS_CALENDAR) ?
+				"Content-Type: text/calendar; charset=\"utf-8\"" : xml);
+		if (depth[i])
+			lists[i] = curl_slist_append(lists[i], depth[i]);
+		lists[i] = curl_slist_append(lists[i], "Expect:");
+		lists[i] = curl_slist_append(lists[i], "Transfer-Encoding:");
+	}
+	return lists;
+}
+
+/**
+ * Fetch the header list every request of a kind sends. The lists are
+ * built once and also turn off Expect and chunked uploads.
+ * @param kind Which list.
+ * @return The list. Never free or change it.
+ */
+struct curl_slist* caldav_headers(CALDAV_HEADERS kind) {
+	static struct curl_slist* lists[CALDAV_HEADERS_COUNT];
+	static GOnce once = G_ONCE_INIT;
+
+	g_return_val_if_fail(kind >= 0 && kind < CALDAV_HEADERS_COUNT, NULL);
+
+	g_once(&once, headers_setup, lists);
+	return lists[kind];
+}
+
+/**
+ * Append a buffer to a trace as offsets followed by hex and text, or as
+ * text only. Adapted from the libcurl documentation.
+ * @param out String to append to.
+ * @param text Heading of the buffer.
  * @param ptr
  * @param size
  * @param nohex
  */
-void dump(const char* text, FILE* stream, char* ptr, size_t size, char nohex) {
+static void dump(GString* out, const char* text, const char* ptr,
+		size_t size, char nohex) {
 	size_t i;
 	size_t c;
 
@@ -49,16 +2150,17 @@ void dump(const char* text, FILE* stream, char* ptr, size_t size, char nohex) {
 	if(nohex)
 		/* without the hex output, we can fit more on screen */
 		width = 0x40;
-	fprintf(stream, "%s, %zd bytes (0x%zx)\n", text, size, size);
+	g_string_append_printf(out, "%s, %zd bytes (0x%zx)\n", text, size, size);
 	for(i=0; i<size; i+= width) {
-		fprintf(stream, "%04zx: ", i);
+		g_string_append_printf(out, "%04zx: ", i);
 		if(!nohex) {
 			/* hex not disabled, show it */
 			for(c = 0; c < width; c++) {
 				if(i+c < size)
-					fprintf(stream, "%02x ", ptr[i+c]);
+					g_string_append_printf(out, "%02x ",
+						(unsigned char) ptr[i+c]);
 				else
-					fputs("   ", stream);
+					g_string_append(out, "   ");
 			}
 		}
 		for(c = 0; (c < width) && (i+c < size); c++) {
@@ -67,663 +2169,932 @@ void dump(const char* text, FILE* stream, char* ptr, size_t size, char nohex) {
 				i+=(c+2-width);
 				break;
 			}
-			fprintf(stream, "%c",(ptr[i+c]>=0x20) && (ptr[i+c]<0x80)?ptr[i+c]:'.');
+			g_string_append_c(out,
+				(ptr[i+c]>=0x20) && (ptr[i+c]<0x80)?ptr[i+c]:'.');
 			/* check again for 0D0A, to avoid an extra \n if it's at width */
 			if (nohex && (i+c+2 < size) && ptr[i+c+1]==0x0D && ptr[i+c+2]==0x0A) {
 				i+=(c+3-width);
 				break;
 			}
 		}
-		fputc('\n', stream); /* newline */
+		g_string_append_c(out, '\n'); /* newline */
 	}
-	fflush(stream);
 }
 
+G_LOCK_DEFINE_STATIC(trace);
+static gint trace_count = 0;
+
 /**
- * This function is burrowed from the libcurl documentation
+ * Default trace sink. Each event is formatted first and written with a
+ * single call so events of concurrent requests do not interleave.
+ * @param trace The event.
+ * @param nohex Leave out the hex columns.
+ */
+static void trace_stderr(const caldav_trace* trace, char nohex) {
+	GString* out = g_string_sized_new(trace->size * 4 + 64);
+	const char* text;
+
+	switch (trace->level) {
+		case CALDAV_TRACE_INFO:
+			g_string_append(out, "== Info: ");
+			g_string_append_len(out, trace->data, trace->size);
+			break;
+		case CALDAV_TRACE_HEADERS:
+			text = (trace->outgoing) ? "=> Send header" : "<= Recv header";
+			dump(out, text, trace->data, trace->size, nohex);
+			break;
+		case CALDAV_TRACE_DATA:
+			text = (trace->outgoing) ? "=> Send data" : "<= Recv data";
+			dump(out, text, trace->data, trace->size, nohex);
+			break;
+		default:
+			text = (trace->outgoing) ?
+				"=> Send SSL data" : "<= Recv SSL data";
+			dump(out, text, trace->data, trace->size, nohex);
+			break;
+	}
+	G_LOCK(trace);
+	fwrite(out->str, 1, out->len, stderr);
+	fflush(stderr);
+	G_UNLOCK(trace);
+	g_string_free(out, TRUE);
+}
+
+/**
+ * Headers which must not show up in a redacted trace.
+ */
+static const char* SECRET_HEADERS[] = {
+	"Authorization:", "Proxy-Authorization:", "Cookie:", "Set-Cookie:", NULL
+};
+
+/**
+ * Copy a block of headers with the values of SECRET_HEADERS replaced.
+ * @param data Header lines as seen by libcurl.
+ * @param size
+ * @return The redacted copy. Caller is responsible for freeing the memory.
+ */
+static GString* redact_headers(const char* data, size_t size) {
+	GString* out = g_string_sized_new(size);
+	const char* end = data + size;
+	const char* line = data;
+
+	while (line < end) {
+		const char* next = memchr(line, '\n', end - line);
+		const char* eol;
+		int i;
+
+		next = (next) ? next + 1 : end;
+		for (eol = next; eol > line &&
+				(eol[-1] == '\n' || eol[-1] == '\r'); eol--)
+			;
+		for (i = 0; SECRET_HEADERS[i]; i++) {
+			size_t len = strlen(SECRET_HEADERS[i]);
+			if ((size_t) (eol - line) >= len &&
+				g_ascii_strncasecmp(line, SECRET_HEADERS[i], len) == 0)
+				break;
+		}
+		if (SECRET_HEADERS[i]) {
+			g_string_append_len(out, line, strlen(SECRET_HEADERS[i]));
+			g_string_append(out, " [redacted]");
+			g_string_append_len(out, eol, next - eol);
+		}
+		else
+			g_string_append_len(out, line, next - line);
+		line = next;
+	}
+	return out;
+}
+
+/**
+ * CURLOPT_DEBUGFUNCTION of traced requests. Hands every event at or below
+ * the trace level to settings->trace, or to stderr if there is none.
  * @param handle
  * @param type
  * @param data
  * @param size
- * @param userp
- * @return
+ * @param userp caldav_settings of the request.
+ * @return 0
  */
-int my_trace(CURL* handle, curl_infotype type, char* data, size_t size, void* userp) {
-	struct config_data* config = (struct config_data *)userp;
-	const char* text;
+static int trace_curl(CURL* handle, curl_infotype type, char* data,
+		size_t size, void* userp) {
+	caldav_settings* settings = (caldav_settings *) userp;
+	caldav_trace trace;
+	GString* redacted = NULL;
 	(void)handle; /* prevent compiler warning */
 
 	switch (type) {
 		case CURLINFO_TEXT:
-			fprintf(stderr, "== Info: %s", data);
-		default: /* in case a new one is introduced to shock us */
-			return 0;
-		case CURLINFO_HEADER_OUT:
-			text = "=> Send header";
-			break;
-		case CURLINFO_DATA_OUT:
-			text = "=> Send data";
-			break;
-		case CURLINFO_SSL_DATA_OUT:
-			text = "=> Send SSL data";
+			trace.level = CALDAV_TRACE_INFO;
+			trace.outgoing = 0;
 			break;
+		case CURLINFO_HEADER_OUT:
 		case CURLINFO_HEADER_IN:
-			text = "<= Recv header";
+			trace.level = CALDAV_TRACE_HEADERS;
+			trace.outgoing = (type == CURLINFO_HEADER_OUT);
 			break;
+		case CURLINFO_DATA_OUT:
 		case CURLINFO_DATA_IN:
-			text = "<= Recv data";
+			trace.level = CALDAV_TRACE_DATA;
+			trace.outgoing = (type == CURLINFO_DATA_OUT);
 			break;
+		case CURLINFO_SSL_DATA_OUT:
 		case CURLINFO_SSL_DATA_IN:
-			text = "<= Recv SSL data";
+			trace.level = CALDAV_TRACE_SSL;
+			trace.outgoing = (type == CURLINFO_SSL_DATA_OUT);
 			break;
+		default: /* in case a new one is introduced to shock us */
+			return 0;
+	}
+	if (trace.level > ((settings->trace_level > 0) ?
+				settings->trace_level : CALDAV_TRACE_DATA))
+		return 0;
+	if (settings->trace_redact) {
+		if (trace.level == CALDAV_TRACE_HEADERS)
+			redacted = redact_headers(data, size);
+		else if (trace.level > CALDAV_TRACE_HEADERS) {
+			redacted = g_string_new(NULL);
+			g_string_printf(redacted, "[%zu bytes]", size);
+		}
 	}
-	dump(text, stderr, data, size, config->trace_ascii);
+	trace.data = (redacted) ? redacted->str : data;
+	trace.size = (redacted) ? redacted->len : size;
+	trace.action = settings->ACTION;
+	trace.request = settings->trace_request;
+	if (settings->trace)
+		settings->trace(&trace, settings->trace_data);
+	else
+		trace_stderr(&trace, settings->trace_ascii);
+	if (redacted)
+		g_string_free(redacted, TRUE);
 	return 0;
 }
 
 /**
- * This function is burrowed from the libcurl documentation
- * @param ptr
- * @param size
- * @return void* to memory region
+ * Turn on the trace for a request if tracing is asked for and the
+ * request is among those sampled.
+ * @param setting caldav_settings of the request. Must outlive the
+ * request. @see release_curl
+ * @param curl
  */
-static void* myrealloc(void* ptr, size_t size) {
-/* There might be a realloc() out there that doesn't like reallocing
- * NULL pointers, so we take care of it here
- * */
-	if(ptr)
-		return realloc(ptr, size);
-	else
-		return malloc(size);
+static void trace_setup(caldav_settings* setting, CURL* curl) {
+	guint count;
+
+	if (!setting->debug && !setting->trace)
+		return;
+	count = (guint) g_atomic_int_add(&trace_count, 1);
+	if (setting->trace_sample > 1 &&
+			count % (guint) setting->trace_sample != 0)
+		return;
+	setting->trace_request = count + 1;
+	curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, trace_curl);
+	curl_easy_setopt(curl, CURLOPT_DEBUGDATA, setting);
+	curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
 }
 
 /**
- * This function is burrowed from the libcurl documentation
- * @param ptr
- * @param size
- * @param nmemb
- * @param data
- * @return number of written bytes
+ * Prepare a curl connection. If the settings carries a session handle
+ * the handle is reset and reused instead of creating a new one.
+ * @param settings caldav_settings
+ * @return CURL
  */
-size_t WriteMemoryCallback(void* ptr, size_t size, size_t nmemb, void* data) {
-	size_t realsize = size * nmemb;
-	struct MemoryStruct* mem = (struct MemoryStruct *)data;
-	mem->memory = (char *)myrealloc(mem->memory, mem->size + realsize + 1);
-	
-	if (mem->memory) {
-		memcpy(&(mem->memory[mem->size]), ptr, realsize);
-		mem->size += realsize;
-		mem->memory[mem->size] = 0;
+CURL* get_curl(caldav_settings* setting) {
+	CURL* curl;
+
+	if (setting->curl)
+		curl = setting->curl;
+	else {
+		init_curl_global();
+		curl = curl_easy_init();
 	}
-	return realsize;
+	if (curl)
+		reset_curl(setting, curl);
+	return (curl) ? curl : NULL;
 }
 
 /**
- * This function is burrowed from the libcurl documentation
- * @param ptr
- * @param size
- * @param nmemb
- * @param data
- * @return number of written bytes
+ * Clear every option of a handle obtained from get_curl and set the
+ * common ones again, so the next request of an operation starts from a
+ * known state whatever the requests before it left behind.
+ * @param settings caldav_settings
+ * @param curl CURL
  */
-size_t WriteHeaderCallback(void* ptr, size_t size, size_t nmemb, void* data) {
-	size_t realsize = size * nmemb;
-	struct MemoryStruct* mem = (struct MemoryStruct *)data;
-	mem->memory = (char *)myrealloc(mem->memory, mem->size + realsize + 1);
-	
-	if (mem->memory) {
-		memcpy(&(mem->memory[mem->size]), ptr, realsize);
-		mem->size += realsize;
-		mem->memory[mem->size] = 0;
+void reset_curl(caldav_settings* setting, CURL* curl) {
+	gchar* userpwd = NULL;
+	gchar* url = NULL;
+
+	/* keeps the open connection, DNS and TLS session caches */
+	curl_easy_reset(curl);
+	/* signals are process wide, never use them from a library */
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
+	if (setting->share) {
+		curl_easy_setopt(curl, CURLOPT_SHARE, setting->share);
+		/* the pool is shared, room for every thread's connection */
+		curl_easy_setopt(curl, CURLOPT_MAXCONNECTS,
+				(long) CALDAV_SHARE_MAXCONNECTS);
 	}
-	return realsize;
+	if (setting->username) {
+		if (setting->password)
+			userpwd = g_strdup_printf("%s:%s",
+				setting->username, setting->password);
+		else
+			userpwd = g_strdup_printf("%s",	setting->username);
+		curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
+		g_free(userpwd);
+	}
+	if (setting->verify_ssl_certificate)
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2);
+	else {
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+	}
+	if (setting->custom_cacert)
+		curl_easy_setopt(curl, CURLOPT_CAINFO, setting->custom_cacert);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, __CALDAV_USERAGENT);
+	/* multistatus bodies with calendar data compress very well */
+	if (setting->compression >= 0) {
+#if LIBCURL_VERSION_NUM >= 0x071506
+		curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+#else
+		curl_easy_setopt(curl, CURLOPT_ENCODING, "");
+#endif
+	}
+#if LIBCURL_VERSION_NUM >= 0x072f00
+	/* ALPN picks HTTP/2 where TLS is used, plain HTTP stays 1.1 */
+	curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (setting->http2 < 0) ?
+			CURL_HTTP_VERSION_1_1 : CURL_HTTP_VERSION_2TLS);
+#endif
+	/* a stuck server must not hold the calling thread forever */
+	if (setting->connect_timeout >= 0)
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT,
+			(long) ((setting->connect_timeout > 0) ?
+				setting->connect_timeout : CALDAV_CONNECT_TIMEOUT));
+	if (setting->timeout > 0)
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long) setting->timeout);
+	if (setting->low_speed_time >= 0) {
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT,
+			(long) CALDAV_LOW_SPEED_LIMIT);
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME,
+			(long) ((setting->low_speed_time > 0) ?
+				setting->low_speed_time : CALDAV_LOW_SPEED_TIME));
+	}
+	trace_setup(setting, curl);
+	url = rebuild_url(setting, NULL);
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	g_free(url);
 }
 
-/*
-size_t ReadMemoryCallback(void* ptr, size_t size, size_t nmemb, void* data){
-	struct MemoryStruct* mem = (struct MemoryStruct *)data;
+/**
+ * Release a curl connection obtained from get_curl. A session handle is
+ * kept open for the next request with its trace turned off, since the
+ * settings traced to may be gone before the handle is. Any other handle
+ * is cleaned up.
+ * @param settings caldav_settings
+ * @param curl CURL
+ */
+void release_curl(caldav_settings* setting, CURL* curl) {
+	if (! curl)
+		return;
+	if (curl != setting->curl)
+		curl_easy_cleanup(curl);
+	else if (setting->debug || setting->trace) {
+		curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, NULL);
+		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, NULL);
+	}
+}
+
+/**
+ * Count response body bytes after content decoding. Called by the write
+ * callbacks for every part they are handed.
+ * @param len Number of bytes.
+ */
+void caldav_count_received(gsize len) {
+	pending()->received += len;
+}
+
+#if LIBCURL_VERSION_NUM >= 0x073d00
+static long long exchange_time(CURL* curl, CURLINFO info) {
+	curl_off_t t = 0;
+
+	curl_easy_getinfo(curl, info, &t);
+	return (long long) t;
+}
+#define EXCHANGE_TIME(curl, name) exchange_time(curl, CURLINFO_##name##_TIME_T)
+#else
+static long long exchange_time(CURL* curl, CURLINFO info) {
+	double t = 0;
 
-	memcpy(ptr, mem->memory, mem->size);
-	return mem->size;
+	curl_easy_getinfo(curl, info, &t);
+	return (long long) (t * 1000000);
 }
-*/
+#define EXCHANGE_TIME(curl, name) exchange_time(curl, CURLINFO_##name##_TIME)
+#endif
 
 /**
- * Initialize caldav settings structure.
- * @param settings @see caldav_settings
+ * Read the timing and traffic of a finished transfer from its handle.
+ * @param curl The handle of the finished transfer.
+ * @param res The libcurl result of the transfer.
+ * @param exchange Where to store them.
  */
-void init_caldav_settings(caldav_settings* settings) {
-	settings->username = NULL;
-	settings->password = NULL;
-	settings->url = NULL;
-	settings->file = NULL;
-	settings->usehttps = FALSE;
-	settings->custom_cacert = NULL;
-	settings->verify_ssl_certificate = TRUE;
-	settings->debug = FALSE;
-	settings->trace_ascii = TRUE;
-	settings->ACTION = UNKNOWN;
-	settings->start = 0;
-	settings->end = 0;
+static void exchange_read(CURL* curl, CURLcode res, caldav_exchange* exchange) {
+	long connects = 0;
+#if LIBCURL_VERSION_NUM >= 0x073700
+	curl_off_t up = 0;
+	curl_off_t down = 0;
+
+	curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &up);
+	curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &down);
+#else
+	double up = 0;
+	double down = 0;
+
+	curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD, &up);
+	curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &down);
+#endif
+	memset(exchange, 0, sizeof(caldav_exchange));
+#if LIBCURL_VERSION_NUM >= 0x074800
+	curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_METHOD, &exchange->method);
+#endif
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &exchange->status);
+	exchange->result = res;
+	exchange->dns = EXCHANGE_TIME(curl, NAMELOOKUP);
+	exchange->connect = EXCHANGE_TIME(curl, CONNECT);
+	exchange->tls = EXCHANGE_TIME(curl, APPCONNECT);
+	exchange->ttfb = EXCHANGE_TIME(curl, STARTTRANSFER);
+	exchange->total = EXCHANGE_TIME(curl, TOTAL);
+	exchange->sent = (long long) up;
+	exchange->received = (long long) down;
+	/* a transfer which opened no connection used one already open */
+	curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+	exchange->reused = (res == CURLE_OK && connects == 0);
 }
 
 /**
- * Free memory assigned to caldav settings structure.
- * @param settings @see caldav_settings
+ * Pick the latency histogram bucket of an exchange time.
+ * @param total Microseconds.
+ * @return Index into caldav_action_stats.latency.
  */
-void free_caldav_settings(caldav_settings* settings) {
-	if (settings->username) {
-		g_free(settings->username);
-		settings->username = NULL;
-	}
-	if (settings->password) {
-		g_free(settings->password);
-		settings->password = NULL;
-	}
-	if (settings->url) {
-		g_free(settings->url);
-		settings->url = NULL;
-	}
-	if (settings->file) {
-		g_free(settings->file);
-		settings->file = NULL;
-	}
-	if (settings->custom_cacert) {
-		g_free(settings->custom_cacert);
-		settings->custom_cacert = NULL;
-	}
-	settings->verify_ssl_certificate = TRUE;
-	settings->usehttps = FALSE;
-	settings->debug = FALSE;
-	settings->trace_ascii = TRUE;
-	settings->ACTION = UNKNOWN;
-	settings->start = 0;
-	settings->end = 0;
+static int latency_bucket(long long total) {
+	long long ms = total / 1000;
+	int bucket = 0;
+
+	while (bucket < CALDAV_LATENCY_BUCKETS - 1 && ms >= (1LL << bucket))
+		bucket++;
+	return bucket;
 }
 
-static gchar* place_after_hostname(const gchar* start, const gchar* stop) {
-	gchar* newpos = NULL;
-	gchar* pos = (gchar *) stop;
-	gboolean digit = TRUE;
-	
-	if (pos && stop && strcmp(start, pos) != 0) {
-		while (*pos != ':' && strcmp(start, pos) != 0)
-			--pos;
-		if (pos > start) {
-			gchar* tmp = (gchar *) pos + 1;
-			/* is pos++ a port number */
-			while (*tmp != '/' && digit) {
-				if (isdigit(*tmp) != 0) {
-					digit = TRUE;
-					tmp++;
-				}
-				else
-					digit = FALSE;
-			}
-			if (digit) {
-				/* pos was a port number */
-				while (*pos != '@' && strcmp(start, pos) != 0)
-					--pos;
-				if (strcmp(start, pos) != 0)
-					newpos = pos;
-			}
-			else {
-				while (*pos != '@' && pos != stop)
-					pos++;
-				if (pos != stop)
-					newpos = pos;
-			}
-		}
-		else {
-			/* is a username present */
-			gchar* tmp = NULL;
-			while (*pos != '/' && pos != stop) {
-				if (*pos == '@')
-					tmp = pos;
-				pos++;
-			}
-			if (tmp && pos != stop)
-				newpos = tmp;
-		}
+/**
+ * The totals of the action of settings. @see caldav_action_stats
+ * @param settings caldav_settings with stats.
+ * @return The totals.
+ */
+static caldav_action_stats* action_stats(caldav_settings* settings) {
+	int action = settings->ACTION;
+
+	if (action < 0 || action >= CALDAV_ACTIONS)
+		action = UNKNOWN;
+	return &settings->stats->actions[action];
+}
+
+/**
+ * Add a finished transfer to settings->stats and report it to
+ * settings->exchange. The bytes on the wire are read from the handle and
+ * the decoded ones from what the write callbacks of this thread counted
+ * since the last call, as are the time spent parsing and the transient
+ * allocations.
+ * @param settings caldav_settings
+ * @param curl The handle of the finished transfer.
+ * @param res The libcurl result of the transfer.
+ */
+void caldav_account(caldav_settings* settings, CURL* curl, CURLcode res) {
+	transfer_counts* counts = pending();
+	caldav_stats* stats = settings->stats;
+	caldav_action_stats* action;
+	caldav_exchange exchange;
+
+	exchange_read(curl, res, &exchange);
+	exchange.action = settings->ACTION;
+	exchange.parse = counts->parse;
+	if (stats) {
+		G_LOCK(stats);
+		stats->requests++;
+		stats->sent_wire += exchange.sent;
+		stats->sent += exchange.sent + counts->packed;
+		stats->received_wire += exchange.received;
+		stats->received += counts->received;
+		action = action_stats(settings);
+		action->requests++;
+		if (res != CURLE_OK || exchange.status >= 400)
+			action->failures++;
+		action->sent += exchange.sent;
+		action->received += exchange.received;
+		action->total += exchange.total;
+		action->parse += counts->parse;
+		action->latency[latency_bucket(exchange.total)]++;
+		action->arena_allocs += counts->arena_allocs;
+		action->arena_bytes += counts->arena_bytes;
+		action->arena_blocks += counts->arena_blocks;
+		G_UNLOCK(stats);
 	}
-	return newpos;
+	counts->received = 0;
+	counts->packed = 0;
+	counts->parse = 0;
+	counts->arena_allocs = 0;
+	counts->arena_bytes = 0;
+	counts->arena_blocks = 0;
+	if (settings->exchange)
+		settings->exchange(&exchange, settings->exchange_data);
 }
 
 /**
- * Parse URL
- * @param settings @see caldav_settings
- * @param url String containing URL to collection
+ * Add the time this thread spent parsing and its transient allocations
+ * since the last call to caldav_account to the totals of the action of
+ * settings. Call after parsing a response which was collected first.
+ * @param settings caldav_settings
  */
-void parse_url(caldav_settings* settings, const char* url) {
-	char* start;
-	char* pos;
-	char* end;
-	char* login;
+void caldav_account_parse(caldav_settings* settings) {
+	transfer_counts* counts = pending();
+	caldav_action_stats* action;
 
-	login = pos = end = start = NULL;
-	if (!url)
-		return;
-	if ((pos = strstr(url, "//")) != NULL) {
-		/* Does the URL use https ?*/
-		if (!g_ascii_strncasecmp(url,"https",5) && settings->usehttps == FALSE) {
-				settings->usehttps=TRUE;
-		}
-		start = g_strdup(&(*(pos + 2)));
-		if ((pos = place_after_hostname(start, strrchr(start, '\0') - 1)) != NULL) {
-			/* username and/or password present */
-			login = g_strndup(start, pos - start);
-			end = pos;
-			if ((pos = strrchr(login, ':')) != NULL) {
-				/* both username and password is present */
-				settings->username = g_strndup(login, pos - login);
-				settings->password = g_strdup(++pos);
-			}
-			else {
-				/* only username present */
-				settings->username = g_strdup(login);
-				settings->password = NULL;
-			}
-			g_free(login);
-			settings->url = g_strdup(++end);
-		}
-		else {
-			/* no username or password present */
-			settings->url = g_strdup(start);
-			settings->username = NULL;
-			settings->password = NULL;
-		}
-		g_free(start);
+	if (settings->stats) {
+		G_LOCK(stats);
+		action = action_stats(settings);
+		action->parse += counts->parse;
+		action->arena_allocs += counts->arena_allocs;
+		action->arena_bytes += counts->arena_bytes;
+		action->arena_blocks += counts->arena_blocks;
+		G_UNLOCK(stats);
 	}
+	counts->parse = 0;
+	counts->arena_allocs = 0;
+	counts->arena_bytes = 0;
+	counts->arena_blocks = 0;
 }
 
 /**
- * Find a specific HTTP header from last request
- * @param header HTTP header to search for
- * @param headers String of HTTP headers from last request
- * @param lowcase Should string be returned in all lower case.
- * @return The header found or NULL
- */
-#define MAX_TOKENS 2
-gchar* get_response_header(
-		const char* header, gchar* headers, gboolean lowcase) {
-	gchar* line;
-	gchar* head = NULL;
-	gchar* oldhead = NULL;
-	gchar** buf;
-	gchar* header_list;
-	gchar* saveptr;
-
-	header_list = g_strdup(headers);
-	line = strtok_r(header_list, "\r\n", &saveptr);
-	if (line != NULL) {
-		do  {
-			buf = g_strsplit(line, ":", MAX_TOKENS);
-			if (buf[1] != NULL) {
-				if (g_ascii_strcasecmp(buf[0], header) == 0) {
-					if (head) {
-						if (strcmp(head, buf[1]) != 0) {
-							oldhead = head;
-							head = g_strconcat(head, ", ", buf[1], NULL);
-							g_free(oldhead);
-						}
-					}
-					else
-						head = g_strdup(buf[1]);
-					if (head)
-						g_strstrip(head);
-				}
-			}
-			g_strfreev(buf);
-		} while ((line = strtok_r(NULL, "\r\n", &saveptr)) != NULL);
-	}
-	g_free(header_list);
-	if (head)
-		return (lowcase) ? g_ascii_strdown(head, -1) : head;
-	else
+ * @struct host_breaker
+ * The circuit breaker of one host.
+ */
+typedef struct {
+	int failures;
+	time_t open_until;
+} host_breaker;
+
+static GHashTable* breakers = NULL;
+G_LOCK_DEFINE_STATIC(breakers);
+
+static gchar* breaker_key(caldav_settings* settings) {
+	gchar* host;
+	gchar* key;
+
+	host = get_host((settings->url) ? settings->url : "");
+	key = g_strdup_printf("%s%s", (settings->usehttps) ? "https://" : "http://",
+			(host) ? host : "");
+	g_free(host);
+	return key;
+}
+
+/**
+ * Ask the circuit breaker of the host of a request whether it may be
+ * sent. Once the breaker opened only one request tries the host after
+ * CALDAV_BREAKER_OPEN seconds, its outcome closes or reopens it.
+ * @param settings caldav_settings
+ * @return NULL if the request may go, otherwise a message why not.
+ */
+gchar* caldav_breaker_check(caldav_settings* settings) {
+	host_breaker* breaker;
+	gchar* key;
+	gchar* refused = NULL;
+	time_t now;
+
+	if (settings->breaker < 0)
 		return NULL;
+	key = breaker_key(settings);
+	G_LOCK(breakers);
+	breaker = (breakers) ? g_hash_table_lookup(breakers, key) : NULL;
+	if (breaker && breaker->open_until) {
+		now = time(NULL);
+		if (now < breaker->open_until)
+			refused = g_strdup_printf(
+				"%s failed %d times in a row, not retried for %ld seconds",
+				key, breaker->failures, (long) (breaker->open_until - now));
+		else
+			/* let this request try, hold back the others meanwhile */
+			breaker->open_until = now + CALDAV_BREAKER_OPEN;
+	}
+	G_UNLOCK(breakers);
+	g_free(key);
+	return refused;
 }
 
-static const char* VCAL_HEAD =
-"BEGIN:VCALENDAR\r\n"
-"PRODID:-//CalDAV Calendar//NONSGML libcaldav//EN\r\n"
-"VERSION:2.0\r\n";
-static const char* VCAL_FOOT = "END:VCALENDAR";
+/**
+ * Test whether a host failed a request, as opposed to refusing it.
+ * @param res The libcurl result.
+ * @param code The HTTP status or 0 (zero) if none was received.
+ * @return TRUE for a 503, a connection which failed or timed out.
+ */
+static gboolean host_failed(CURLcode res, long code) {
+	switch (res) {
+		case CURLE_OK: return (code == 503);
+		case CURLE_COULDNT_CONNECT:
+		case CURLE_OPERATION_TIMEDOUT:
+		case CURLE_GOT_NOTHING:
+		case CURLE_SEND_ERROR:
+		case CURLE_RECV_ERROR: return TRUE;
+		default: return FALSE;
+	}
+}
 
 /**
- * Parse response from CalDAV server. Internal function.
- * @param report Response from server
- * @param element XML element to find
- * @param type VCalendar element to find
- * @param wrap Is this the final parsing or just a part
- * @param recursive Stop after first match or not
- * @return the parsed result
+ * Tell the circuit breaker of the host of a request how it went. A 503
+ * or a connection which failed or timed out counts as a failure.
+ * @param settings caldav_settings
+ * @param res The libcurl result.
+ * @param code The HTTP status or 0 (zero) if none was received.
  */
-static gchar* parse_caldav_report_wrap(
-		char* report, const char* element, const char* type,
-			gboolean wrap, gboolean recursive) {
-	char* pos;
-	char* start;
-	char* object;
-	char* tmp_report;
-	char* tmp;
-	gchar* response;
-	gchar* begin_type;
-	gchar* end_type;
-	gboolean keep_going = TRUE;
-
-	begin_type = g_strdup_printf("BEGIN:%s", type);
-	end_type = g_strdup_printf("END:%s", type);
-	pos = start = object = response = NULL;
-	tmp_report = g_strdup(report);
-	while ((pos = strstr(tmp_report, element)) != NULL && keep_going) {
-		pos = strchr(pos, '>');
-		if (!pos) {
-			break;
-		}
-		pos = &(*(pos + 1));
-		pos = strstr(pos, begin_type);
-		if (!pos) {
-			break;
-		}
-		object = &(*(pos + strlen(begin_type)));
-		object = g_strchug(object);
-		start = g_strdup(object);
-		if ((pos = strstr(start, end_type)) == NULL) {
-			g_free(start);
-			break;
-		}
-		char end_not_found = 1;
-		while (end_not_found == 1) {
-			if (strstr(pos+1, end_type) < strstr(pos+1, element)) {
-				if (strstr(pos+1, end_type) != NULL) {
-					pos = strstr(pos+1, end_type);
-				}
-				else {
-					end_not_found = 0;
-				}
-			}
-			else {
-				end_not_found = 0;
-			}
-		}
-		object = g_strndup(start, strlen(start) - strlen(pos));
-		if (response) {
-			tmp = g_strdup(response);
-			g_free(response);
-			response = g_strdup_printf("%s%s\r\n%s%s\r\n",
-				tmp, begin_type, object, end_type);
-			g_free(tmp);
-		}
-		else {
-			if (wrap)
-				response = g_strdup_printf("%s%s\r\n%s%s\r\n",
-					VCAL_HEAD, begin_type, object, end_type);
-			else
-				response = g_strdup_printf("%s\r\n%s%s\r\n",
-					begin_type, object, end_type);
-		}
-		if (recursive) {
-			pos = strchr(pos, '>');
-			g_free(tmp_report);
-			tmp_report = g_strdup(&(*(pos + 1)));
+void caldav_breaker_record(caldav_settings* settings,
+			   CURLcode res,
+			   long code) {
+	host_breaker* breaker;
+	gboolean failed = host_failed(res, code);
+	gchar* key;
+	int failures;
+
+	if (settings->breaker < 0)
+		return;
+	failures = (settings->breaker > 0) ?
+		settings->breaker : CALDAV_BREAKER_FAILURES;
+	key = breaker_key(settings);
+	G_LOCK(breakers);
+	if (! breakers)
+		breakers = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, g_free);
+	breaker = g_hash_table_lookup(breakers, key);
+	if (! breaker && failed) {
+		breaker = g_new0(host_breaker, 1);
+		g_hash_table_insert(breakers, key, breaker);
+		key = NULL;
+	}
+	if (breaker) {
+		if (failed) {
+			if (++breaker->failures >= failures)
+				breaker->open_until = time(NULL) + CALDAV_BREAKER_OPEN;
 		}
 		else {
-			keep_going = FALSE;
+			breaker->failures = 0;
+			breaker->open_until = 0;
 		}
-		g_free(start);
-		g_free(object);
 	}
-	g_free(tmp_report);
-	g_free(begin_type);
-	g_free(end_type);
-	if (wrap)
-		if (response) {
-			object = g_strdup(response);
-			g_free(response);
-			response = g_strdup_printf("%s%s", object, VCAL_FOOT);
-			g_free(object);
-		}
-	return response;
+	G_UNLOCK(breakers);
+	g_free(key);
 }
 
 /**
- * Parse response from CalDAV server
- * @param report Response from server
- * @param element XML element to find
- * @param type VCalendar element to find
- * @return the parsed result
+ * Test whether a request failed in a way which may pass when repeated.
+ * @param res The libcurl result.
+ * @param code The HTTP status or 0 (zero) if none was received.
+ * @return TRUE for a 503, 429 or a connection failing before an answer.
  */
-gchar* parse_caldav_report(char* report, const char* element, const char* type) {
-	gchar* response = NULL;
-	gchar* timezone = NULL;
-	gchar* temp = NULL;
-
-	if (!report || !element || !type)
-		return NULL;
-	/* test for VTIMEZONE.
-	 * Only the first found will be used and this will then
-	 * be the time zone for the entire report
-	 */
-	timezone = parse_caldav_report_wrap(
-			report, element, "VTIMEZONE", FALSE, FALSE);
-	if (timezone) {
-			response = g_strdup_printf("%s%s", VCAL_HEAD, timezone);
-			g_free(timezone);
-			temp = parse_caldav_report_wrap(report, element, type, FALSE, TRUE);
-			if (temp) {
-				gchar* tmp = g_strdup(response);
-				g_free(response);
-				response = g_strdup_printf("%s%s%s", tmp, temp, VCAL_FOOT);
-				g_free(tmp);
-				g_free(temp);
-			}
-			else {
-				g_free(response);
-				return NULL;
-			}
-	}
-	else
-		response = parse_caldav_report_wrap(report, element, type, TRUE, TRUE);
-	return response;
+gboolean caldav_transient(CURLcode res, long code) {
+	if (res == CURLE_OK)
+		return (code == 503 || code == 429);
+	/* once a status arrived parts of the body may have been used */
+	return (code == 0 && host_failed(res, code));
 }
 
 /**
- * Convert a time_t variable to CalDAV DateTime
- * @param time a specific date and time
- * @return the CalDAV DateTime
+ * Milliseconds to wait before repeating a request.
+ * @param attempt How many times it was repeated already.
+ * @param retry_after Seconds the server asked for or 0 (zero).
+ * @return Milliseconds or -1 if the server asked for more than
+ * CALDAV_RETRY_AFTER_MAX.
  */
-gchar* get_caldav_datetime(time_t* time) {
-	struct tm *current;
-	gchar* datetime;
+long caldav_backoff(int attempt, long retry_after) {
+	long cap;
 
-	current = localtime(time);
-	datetime = g_strdup_printf("%d%.2d%.2dT%.2d%.2d%.2dZ",
-		current->tm_year + 1900, current->tm_mon + 1, current->tm_mday,
-		current->tm_hour, current->tm_min, current->tm_sec);
-	return datetime;
+	if (retry_after > CALDAV_RETRY_AFTER_MAX)
+		return -1;
+	/* spread clients which were all told the same */
+	if (retry_after > 0)
+		return retry_after * 1000 + g_random_int_range(0, CALDAV_RETRY_BASE);
+	cap = (long) CALDAV_RETRY_BASE << MIN(attempt, 16);
+	if (cap > CALDAV_RETRY_CAP)
+		cap = CALDAV_RETRY_CAP;
+	/* full jitter, between nothing and the exponential cap */
+	return g_random_int_range(0, cap + 1);
 }
 
 /**
- * Create a random text string, using MD5. @see caldav_md5_hex_digest()
- * @param text some text to randomize
- * @return MD5 hash of text
+ * Get the Retry-After of the last response on curl.
+ * @param curl CURL
+ * @return Seconds or 0 (zero) if none was sent.
  */
-gchar* random_file_name(gchar* text) {
-	unsigned char* name;
-	gchar md5sum[33];
+long caldav_retry_after(CURL* curl) {
+#if LIBCURL_VERSION_NUM >= 0x074200
+	curl_off_t after = 0;
 
-	name = (unsigned char *) g_strdup(text);
-	caldav_md5_hex_digest(md5sum, name);
-	g_free(name);
-	return g_strdup(md5sum);
+	if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &after) == CURLE_OK &&
+			after > 0)
+		return (long) after;
+#endif
+	return 0;
 }
 
 /**
- * Does the event contain a UID element or not. If not add it.
- * @param object A specific event
- * @return event, eventually added UID
+ * Get the Retry-After of the last failed request made by this thread.
+ * @return Seconds or 0 (zero) if none was sent.
  */
-gchar* verify_uid(gchar* object) {
-	gchar* uid;
-	gchar* newobj;
-	gchar* pos;
+long caldav_last_retry_after(void) {
+	return pending()->retry_after;
+}
 
-	newobj = g_strdup(object);
-	uid = get_response_header("uid", object, TRUE);
-	if (!uid) {
-		object = g_strdup(newobj);
-		g_free(newobj);
-		pos = strstr(object, "END:VEVENT");
-		newobj = g_strndup(object, strlen(object) - strlen(pos));
-		newobj = g_strchomp(newobj);
-		uid = random_file_name(object);
-		gchar*tmp = g_strdup(newobj);
-		g_free(newobj);
-		newobj = g_strdup_printf("%s\r\nUID:libcaldav-%s@tempuri.org\r\n%s",
-					tmp, uid, pos);
-		g_free(uid);
-		g_free(tmp);
-		g_free(object);
+/**
+ * Map a failed transfer to an error code. @see caldav_error
+ * @param res The libcurl result.
+ * @return -4 if no connection could be made, -5 if the request timed
+ * out, -1 otherwise.
+ */
+long caldav_transfer_code(CURLcode res) {
+	switch (res) {
+		case CURLE_COULDNT_CONNECT: return -4;
+		case CURLE_OPERATION_TIMEDOUT: return -5;
+		default: return -1;
 	}
-	else
-		g_free(uid);
-	/*uid = g_strdup(newobj);
-	g_free(newobj);*/
-	g_strchomp(newobj);
-	/*g_free(uid);*/
-	return newobj;
 }
 
 /**
- * Fetch a URL from a XML element
- * @param text String
- * @return URL
+ * Perform a transfer and add it to settings->stats. Use instead of
+ * curl_easy_perform. A host whose circuit breaker is open is not asked.
+ * @param settings caldav_settings
+ * @param curl CURL
+ * @param error_buf The CURLOPT_ERRORBUFFER of curl. Holds the reason when
+ * the request was refused.
+ * @return The result of curl_easy_perform, CURLE_COULDNT_CONNECT if the
+ * request was refused.
  */
-#define ELEM_HREF "href>"
-gchar* get_url(gchar* text) {
-	gchar* pos;
-	gchar* url = NULL;
+CURLcode caldav_perform(caldav_settings* settings,
+			CURL* curl,
+			char* error_buf) {
+	transfer_counts* counts = pending();
+	CURLcode res;
+	gchar* refused;
+	long code = 0;
 
-	if ((pos = strstr(text, ELEM_HREF)) == NULL)
-		return url;
-	pos = &(*(pos + strlen(ELEM_HREF)));
-	url = g_strndup(pos, strlen(pos) - strlen(strchr(pos, '<')));
-	return url;
+	counts->retry_after = 0;
+	refused = caldav_breaker_check(settings);
+	counts->refused = (refused != NULL);
+	if (refused) {
+		g_strlcpy(error_buf, refused, CURL_ERROR_SIZE);
+		g_free(refused);
+		return CURLE_COULDNT_CONNECT;
+	}
+	res = curl_easy_perform(curl);
+	caldav_account(settings, curl, res);
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+	caldav_breaker_record(settings, res, code);
+	if (code == 503 || code == 429)
+		counts->retry_after = caldav_retry_after(curl);
+	return res;
 }
 
 /**
- * Fetch any element from XML
- * @param text String
- * @param tag The element to look for
- * @return element
+ * Empty a buffer keeping its memory for the next response.
+ * @param mem A struct MemoryStruct
  */
-gchar* get_tag(const gchar* tag, gchar* text) {
-	gchar *pos;
-	gchar* res = NULL;
-	gchar* the_tag = NULL;
+static void memory_clear(struct MemoryStruct* mem) {
+	mem->size = 0;
+	mem->fields = 0;
+	if (mem->memory)
+		mem->memory[0] = 0;
+}
 
-	/*printf("%s\n", text);*/
-	the_tag = g_strdup_printf("<%s>", tag);
-	if ((pos = strstr(text, the_tag)) == NULL) {
-		g_free(the_tag);
-		return res;
+/**
+ * Perform an idempotent request, an OPTIONS, PROPFIND, REPORT or GET,
+ * repeating it after a 503, 429 or a connection which failed before any
+ * answer. Waits honor Retry-After and otherwise grow exponentially with
+ * jitter. The buffers are emptied before every repetition.
+ * @param settings caldav_settings
+ * @param curl CURL
+ * @param headers The header buffer, its body is emptied along with it.
+ * Responses fed to a stream instead must be ignored unless successful.
+ * @param error_buf The CURLOPT_ERRORBUFFER of curl.
+ * @return The result of the last curl_easy_perform.
+ */
+CURLcode caldav_perform_read(caldav_settings* settings,
+			     CURL* curl,
+			     struct MemoryStruct* headers,
+			     char* error_buf) {
+	CURLcode res;
+	long code;
+	long wait;
+	int retries;
+	int attempt;
+
+	retries = (settings->retries > 0) ? settings->retries :
+		(settings->retries < 0) ? 0 : CALDAV_RETRIES;
+	for (attempt = 0; ; attempt++) {
+		res = caldav_perform(settings, curl, error_buf);
+		if (attempt >= retries || pending()->refused)
+			break;
+		code = 0;
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		if (! caldav_transient(res, code))
+			break;
+		wait = caldav_backoff(attempt, caldav_last_retry_after());
+		if (wait < 0)
+			break;
+		g_usleep(wait * 1000);
+		memory_clear(headers);
+		if (headers->body)
+			memory_clear(headers->body);
 	}
-	pos = &(*(pos + strlen(the_tag)));
-	res = g_strndup(pos, strlen(pos) - strlen(strchr(pos, '<')));
-	g_free(the_tag);
-	return res;	
+	return res;
 }
 
 /**
- * Fetch the etag element from XML
- * @param text String
- * @return etag
+ * Compress a request body with gzip.
+ * @param body The body, its parts are compressed one after the other.
+ * @param len Length of body.
+ * @param packed_len Where to store the length of the result.
+ * @return The compressed body or NULL if it could not be made smaller.
  */
-#define ELEM_ETAG "getetag"
-gchar* get_etag(gchar* text) {
-	gchar* etag = NULL;
-	
-	etag = get_tag(ELEM_ETAG, text);
-	/* Maybe namespace prefixed */
-	if (!etag) {
-		etag = get_tag("D:getetag", text);
+static gchar* gzip_body(const caldav_upload* body, gsize len,
+			gsize* packed_len) {
+	z_stream z;
+	gchar* packed;
+	gsize size;
+	int i;
+
+	memset(&z, 0, sizeof(z));
+	/* adding 16 to the window bits asks for a gzip wrapper */
+	if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+				Z_DEFAULT_STRATEGY) != Z_OK)
+		return NULL;
+	size = deflateBound(&z, len);
+	packed = g_malloc(size);
+	z.next_out = (Bytef *) packed;
+	z.avail_out = size;
+	for (i = 0; i < body->parts; i++) {
+		z.next_in = (Bytef *) body->part[i];
+		z.avail_in = body->length[i];
+		if (deflate(&z, (i == body->parts - 1) ? Z_FINISH : Z_NO_FLUSH) !=
+				((i == body->parts - 1) ? Z_STREAM_END : Z_OK))
+			break;
 	}
-	return etag;
+	if (i < body->parts || z.total_out >= len) {
+		deflateEnd(&z);
+		g_free(packed);
+		return NULL;
+	}
+	*packed_len = z.total_out;
+	deflateEnd(&z);
+	return packed;
 }
 
 /**
- * Fetch host from URL
- * @param url URL
- * @return host
+ * Compress the body of a PUT if it has at least
+ * settings->compress_uploads bytes and the server lists gzip in the
+ * Accept-Encoding of its OPTIONS answer.
+ * @param settings caldav_settings
+ * @param body The body.
+ * @param packed_len Where to store the length of the result.
+ * @return The gzip compressed body or NULL if it goes as it is. Caller
+ * is responsible for freeing the memory.
  */
-gchar* get_host(gchar* url) {
-	gchar** buf;
-	gchar* result = NULL;
+gchar* caldav_upload_pack(caldav_settings* settings,
+			  const caldav_upload* body,
+			  gsize* packed_len) {
+	gchar* packed;
+	gsize len = caldav_upload_length(body);
 
-	buf = g_strsplit(url, "/", 2);
-	if (buf[0]) {
-		result = g_strdup(buf[0]);
-	}
-	g_strfreev(buf);
-	return result;
+	if (settings->compress_uploads <= 0 ||
+			len < (gsize) settings->compress_uploads ||
+			! caldav_capabilities_accept(settings, "gzip"))
+		return NULL;
+	packed = gzip_body(body, len, packed_len);
+	if (packed)
+		pending()->packed += len - *packed_len;
+	return packed;
 }
 
 /**
- * rebuild a raw URL with https if needed from the settings
+ * Send body as the request of a PUT already set up on curl. Bodies of at
+ * least settings->compress_uploads bytes go gzip compressed to servers
+ * which list gzip in the Accept-Encoding of their OPTIONS answer. A
+ * server refusing it with 415 gets the body again as it is (RFC7694).
  * @param settings caldav_settings
- * @param uri URI to use instead of base
- * @return URL
+ * @param curl CURL with the request set up apart from the body.
+ * @param body The body. One part is sent as it is, more are read by
+ * libcurl one after the other.
+ * @param http_header The list set as CURLOPT_HTTPHEADER.
+ * @param error_buf The CURLOPT_ERRORBUFFER of curl.
+ * @return The result of curl_easy_perform.
  */
+CURLcode caldav_put(caldav_settings* settings,
+		    CURL* curl,
+		    caldav_upload* body,
+		    struct curl_slist* http_header,
+		    char* error_buf) {
+	struct curl_slist* packed_header = NULL;
+	struct curl_slist* item;
+	gchar* packed = NULL;
+	gsize len = caldav_upload_length(body);
+	gsize packed_len = 0;
+	CURLcode res;
+	long code = 0;
 
-gchar* rebuild_url(caldav_settings* settings, gchar* uri){
-    gchar* url = NULL;
-    gchar* mystr = NULL;
-	if (settings->usehttps) {
-		mystr = "https://";
-	} else {
-		mystr = "http://";
+	packed = caldav_upload_pack(settings, body, &packed_len);
+	if (packed) {
+		for (item = http_header; item; item = item->next)
+			packed_header = curl_slist_append(packed_header, item->data);
+		packed_header = curl_slist_append(packed_header,
+				"Content-Encoding: gzip");
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, packed_header);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, packed);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) packed_len);
+		res = caldav_perform(settings, curl, error_buf);
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+		curl_slist_free_all(packed_header);
+		g_free(packed);
+		if (res == CURLE_OK)
+			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		if (code != 415)
+			return res;
+		caldav_capabilities_refuse(settings, "gzip");
 	}
-	if (uri)
-		url = g_strdup_printf("%s%s", mystr, uri);
-	else
-    	url = g_strdup_printf("%s%s", mystr,settings->url);
+	if (body->parts == 1) {
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->part[0]);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) len);
+		return caldav_perform(settings, curl, error_buf);
+	}
+	/* a spliced body is read part by part instead of joined */
+	body->offset = 0;
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+	curl_easy_setopt(curl, CURLOPT_POST, 1L);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) len);
+	curl_easy_setopt(curl, CURLOPT_READFUNCTION, ReadMemoryCallback);
+	curl_easy_setopt(curl, CURLOPT_READDATA, (void *) body);
+#if LIBCURL_VERSION_NUM >= 0x071305
+	curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, SeekMemoryCallback);
+	curl_easy_setopt(curl, CURLOPT_SEEKDATA, (void *) body);
+#endif
+	return caldav_perform(settings, curl, error_buf);
+}
 
-	return url;
+/**
+ * Copy a caldav_stats while no transfer is added to it.
+ * @param from The counters or NULL.
+ * @param to Where to store the copy. Zero if from is NULL.
+ */
+void caldav_stats_read(const caldav_stats* from, caldav_stats* to) {
+	if (! from) {
+		memset(to, 0, sizeof(caldav_stats));
+		return;
+	}
+	G_LOCK(stats);
+	*to = *from;
+	G_UNLOCK(stats);
 }
 
 /**
- * Prepare a curl connection
- * @param settings caldav_settings
- * @return CURL
+ * Set a caldav_stats to zero while no transfer is added to it.
+ * @param stats The counters or NULL.
  */
-CURL* get_curl(caldav_settings* setting) {
-	CURL* curl;
-	gchar* userpwd = NULL;
-	gchar* url = NULL;
+void caldav_stats_clear(caldav_stats* stats) {
+	if (! stats)
+		return;
+	G_LOCK(stats);
+	memset(stats, 0, sizeof(caldav_stats));
+	G_UNLOCK(stats);
+}
 
-	curl = curl_easy_init();
-	if (curl) {
-		if (setting->username) {
-			if (setting->password)
-				userpwd = g_strdup_printf("%s:%s",
-					setting->username, setting->password);
-			else
-				userpwd = g_strdup_printf("%s",	setting->username);
-			curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
-			g_free(userpwd);
-		}
-		if (setting->verify_ssl_certificate)
-			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2);
-		else {
-			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
-			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+/**
+ * Map the error left behind by a failed call to a CALDAV_RESPONSE.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return FORBIDDEN, CONFLICT, LOCKED, NOTIMPLEMENTED or UNAVAILABLE
+ */
+CALDAV_RESPONSE caldav_error_response(caldav_error* error) {
+	CALDAV_RESPONSE caldav_response;
+
+	if (error->code > 0) {
+		switch (error->code) {
+			case 403: caldav_response = FORBIDDEN; break;
+			case 409: caldav_response = CONFLICT; break;
+			case 423: caldav_response = LOCKED; break;
+			case 429: caldav_response = UNAVAILABLE; break;
+			case 501: caldav_response = NOTIMPLEMENTED; break;
+			case 503: caldav_response = UNAVAILABLE; break;
+			default: caldav_response = CONFLICT; break;
 		}
-		if (setting->custom_cacert)
-			curl_easy_setopt(curl, CURLOPT_CAINFO, setting->custom_cacert);
-		curl_easy_setopt(curl, CURLOPT_USERAGENT, __CALDAV_USERAGENT);
-		url = rebuild_url(setting, NULL);
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-		g_free(url);
 	}
-	return (curl) ? curl : NULL;
+	else if (error->code == -4 || error->code == -5 ||
+			error->code == -429 || error->code == -503) {
+		/* no connection, timed out or an OPTIONS answered busy */
+		caldav_response = UNAVAILABLE;
+	}
+	else {
+		/* fall-back to conflicting state */
+		caldav_response = CONFLICT;
+	}
+	return caldav_response;
 }
@@ -31,6 +31,12 @@
  */
 typedef struct _CALDAV_SETTINGS caldav_settings;
 
+/**
+ * @typedef struct _caldav_upload caldav_upload
+ * A pointer to a struct _caldav_upload
+ */
+typedef struct _caldav_upload caldav_upload;
+
 /**
  * @struct _CALDAV_SETTINGS
  * A struct used to exchange all user input between various parts
@@ -41,6 +47,7 @@ struct _CALDAV_SETTINGS {
 	gchar* password;
 	gchar* url;
 	gchar* file;
+	caldav_upload* upload;
 	gboolean usehttps;
 	gboolean verify_ssl_certificate;
 	gchar* custom_cacert;
@@ -50,6 +57,101 @@ struct _CALDAV_SETTINGS {
 	CALDAV_ACTION ACTION;
 	time_t start;
 	time_t end;
+	int capability_ttl;
+	CURLSH* share;
+	CURL* curl;
+	caldav_cache* cache;
+	int cache_ttl;
+	caldav_lock* lock;
+	const caldav_query* query;
+	int compression;
+	int compress_uploads;
+	int naming;
+	int http2;
+	caldav_stats* stats;
+	int connect_timeout;
+	int timeout;
+	int low_speed_time;
+	int retries;
+	int breaker;
+	int hedge;
+	caldav_exchange_callback exchange;
+	void* exchange_data;
+	caldav_trace_callback trace;
+	void* trace_data;
+	int trace_level;
+	int trace_sample;
+	int trace_redact;
+	unsigned long trace_request;
+};
+
+/** Number of idle connections kept in a caldav_share */
+#ifndef CALDAV_SHARE_MAXCONNECTS
+#define CALDAV_SHARE_MAXCONNECTS 32
+#endif
+
+/** Seconds to wait for a connection by default */
+#ifndef CALDAV_CONNECT_TIMEOUT
+#define CALDAV_CONNECT_TIMEOUT 30
+#endif
+
+/** Bytes a second below which a transfer counts as stalled */
+#ifndef CALDAV_LOW_SPEED_LIMIT
+#define CALDAV_LOW_SPEED_LIMIT 1
+#endif
+
+/** Seconds a transfer may stall by default */
+#ifndef CALDAV_LOW_SPEED_TIME
+#define CALDAV_LOW_SPEED_TIME 60
+#endif
+
+/** Times an idempotent request is repeated by default */
+#ifndef CALDAV_RETRIES
+#define CALDAV_RETRIES 2
+#endif
+
+/** Milliseconds the first repetition waits at most, doubled for each */
+#ifndef CALDAV_RETRY_BASE
+#define CALDAV_RETRY_BASE 250
+#endif
+
+/** Milliseconds a repetition waits at most */
+#ifndef CALDAV_RETRY_CAP
+#define CALDAV_RETRY_CAP 8000
+#endif
+
+/** Longest Retry-After in seconds waited for instead of giving up */
+#ifndef CALDAV_RETRY_AFTER_MAX
+#define CALDAV_RETRY_AFTER_MAX 30
+#endif
+
+/** Failures in a row after which a host is refused by default */
+#ifndef CALDAV_BREAKER_FAILURES
+#define CALDAV_BREAKER_FAILURES 5
+#endif
+
+/** Seconds a host is refused before one request may try it again */
+#ifndef CALDAV_BREAKER_OPEN
+#define CALDAV_BREAKER_OPEN 30
+#endif
+
+/**
+ * @struct _caldav_share
+ * A libcurl share handle and the locks guarding each kind of shared data.
+ */
+struct _caldav_share {
+	CURLSH* handle;
+	GMutex locks[CURL_LOCK_DATA_LAST];
+};
+
+/**
+ * @struct _caldav_session
+ * A struct holding a parsed collection URL and a persistent libcurl handle.
+ * All requests made through a session reuse the same keep-alive connection.
+ */
+struct _caldav_session {
+	caldav_settings settings;
+	runtime_info* info;
 };
 
 /**
@@ -58,42 +160,131 @@ struct _CALDAV_SETTINGS {
  */
 typedef struct MemoryStruct memory_ptr;
 
+#ifndef CALDAV_BUFFER_MIN
+#define CALDAV_BUFFER_MIN 1024
+#endif
+
+#ifndef CALDAV_BUFFER_HINT_MAX
+#define CALDAV_BUFFER_HINT_MAX (64 * 1024 * 1024)
+#endif
+
+/** Bytes of the blocks transient strings are allocated from */
+#ifndef CALDAV_ARENA_BLOCK
+#define CALDAV_ARENA_BLOCK 4096
+#endif
+
+/** Bytes hashed to name a new object with CALDAV_NAMING_HASH */
+#ifndef CALDAV_NAMING_PREFIX
+#define CALDAV_NAMING_PREFIX 4096
+#endif
+
+/** Number of response headers indexed in a header buffer */
+#ifndef CALDAV_HEADER_FIELDS
+#define CALDAV_HEADER_FIELDS 64
+#endif
+
+/** Bytes of a CalDAV DateTime written by format_caldav_datetime */
+#define CALDAV_DATETIME_SIZE 17
+
+/**
+ * @enum CALDAV_HEADERS the request header lists shared by the whole
+ * process. @see caldav_headers
+ */
+typedef enum {
+	CALDAV_HEADERS_DEPTH_0,		/* XML body, Depth: 0 */
+	CALDAV_HEADERS_DEPTH_1,		/* XML body, Depth: 1 */
+	CALDAV_HEADERS_DEPTH_INFINITY,	/* XML body, Depth: infinity */
+	CALDAV_HEADERS_XML,		/* XML body without Depth */
+	CALDAV_HEADERS_CALENDAR,	/* iCalendar body */
+	CALDAV_HEADERS_COUNT
+} CALDAV_HEADERS;
+
+/**
+ * @struct header_field
+ * Offsets of the name and the value of one response header in the
+ * memory of a header buffer.
+ */
+typedef struct {
+	guint32 name;
+	guint32 name_len;
+	guint32 value;
+	guint32 value_len;
+} header_field;
+
 /**
  * @struct MemoryStruct
- * Used to hold messages between the CalDAV server and the library
+ * Used to hold messages between the CalDAV server and the library.
+ * memory grows geometrically; capacity is the number of bytes allocated.
+ * A header buffer may point body at the buffer receiving the body, which
+ * is then sized from Content-Length before the body arrives.
+ * A header buffer indexes the headers of the last response received in
+ * field as they arrive; fields is the number of entries in use, or
+ * CALDAV_HEADER_FIELDS + 1 once a header found the index full.
  */
 struct MemoryStruct {
 	char *memory;
 	size_t size;
+	size_t capacity;
+	struct MemoryStruct* body;
+	header_field field[CALDAV_HEADER_FIELDS];
+	int fields;
 };
 
-/** @struct config_data
- * Used to exchange user options to the library
+/** Parts an upload is sent as */
+#define CALDAV_UPLOAD_PARTS 3
+
+/**
+ * @struct _caldav_upload
+ * A calendar object to send which need not be a string: the caller's
+ * buffer, a mapped file or what was read from a descriptor. The body is
+ * the concatenation of part, so a UID can be spliced in without
+ * rebuilding the object. offset is the number of bytes already read by
+ * libcurl.
  */
-struct config_data {
-	char trace_ascii;
+struct _caldav_upload {
+	const gchar* part[CALDAV_UPLOAD_PARTS];
+	gsize length[CALDAV_UPLOAD_PARTS];
+	int parts;
+	gsize offset;
+	const gchar* text;	/* the object if the caller gave a string */
+	GMappedFile* map;	/* holds part 0 of a mapped file */
+	gchar* data;		/* holds part 0 when read from a descriptor */
+	gchar* uid;			/* holds the UID line spliced in */
 };
 
 /**
- * This function is burrowed from the libcurl documentation
- * @param text
- * @param stream
- * @param ptr
- * @param size
- * @param nohex
+ * @struct multistatus_entry
+ * One response element of a WebDAV multistatus (RFC4918 13).
  */
-void dump(const char* text, FILE* stream, char* ptr, size_t size, char nohex);
+typedef struct {
+	gchar* href;
+	gchar* etag;
+	gchar* data;
+	long status;
+	const gchar* content; /* the raw response element while a
+			       * multistatus_handler runs, NULL otherwise */
+	const gchar* content_end;
+} multistatus_entry;
 
 /**
- * This function is burrowed from the libcurl documentation
- * @param handle
- * @param type
- * @param data
- * @param size
- * @param userp
- * @return
+ * @typedef multistatus_handler
+ * Called by a multistatus_stream for every complete response element.
+ * The entry is freed when the handler returns.
+ * @return TRUE to stop parsing.
+ */
+typedef gboolean (*multistatus_handler)(multistatus_entry* entry, void* data);
+
+/**
+ * @struct multistatus_stream
+ * Incremental multistatus parser fed with a response body as it arrives.
+ * Only the tail not yet parsed is kept in buffer.
  */
-int my_trace(CURL* handle, curl_infotype type, char* data, size_t size, void* userp);
+typedef struct {
+	GString* buffer;
+	multistatus_handler handler;
+	void* data;
+	gboolean stopped;
+} multistatus_stream;
 
 /**
  * This function is burrowed from the libcurl documentation
@@ -113,7 +304,157 @@ size_t WriteMemoryCallback(void* ptr, size_t size, size_t nmemb, void* data);
  */
 size_t WriteHeaderCallback(void* ptr, size_t size, size_t nmemb, void* data);
 
-/*size_t ReadMemoryCallback(void* ptr, size_t size, size_t nmemb, void* data);*/
+/**
+ * Feed an upload to libcurl. @see caldav_upload
+ * @param ptr Where to copy the body to
+ * @param size
+ * @param nmemb
+ * @param data The caldav_upload
+ * @return number of bytes copied, 0 at the end of the body
+ */
+size_t ReadMemoryCallback(void* ptr, size_t size, size_t nmemb, void* data);
+
+#if LIBCURL_VERSION_NUM >= 0x071305
+/**
+ * Rewind an upload for libcurl to send it again after a redirect or an
+ * authentication challenge.
+ * @param data The caldav_upload
+ * @param offset Where to continue
+ * @param origin Only SEEK_SET is supported
+ * @return CURL_SEEKFUNC_OK or CURL_SEEKFUNC_CANTSEEK
+ */
+int SeekMemoryCallback(void* data, curl_off_t offset, int origin);
+#endif
+
+/**
+ * Make an upload of a string without copying it.
+ * @param upload The caldav_upload to set up
+ * @param text The calendar object. Must outlive the upload.
+ */
+void caldav_upload_string(caldav_upload* upload, const gchar* text);
+
+/**
+ * Make an upload of a buffer without copying it.
+ * @param upload The caldav_upload to set up
+ * @param data The calendar object, need not be NUL terminated. Must
+ * outlive the upload.
+ * @param length Bytes of data
+ */
+void caldav_upload_memory(caldav_upload* upload, const gchar* data,
+			  gsize length);
+
+/**
+ * Make an upload of what a descriptor holds. Regular files are mapped,
+ * anything else is read to its end.
+ * @param upload The caldav_upload to set up
+ * @param fd An open descriptor. Not closed.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_upload_fd(caldav_upload* upload, int fd, caldav_error* error);
+
+/**
+ * Make an upload of a file by mapping it.
+ * @param upload The caldav_upload to set up
+ * @param path The file
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_upload_file(caldav_upload* upload, const gchar* path,
+			    caldav_error* error);
+
+/**
+ * Free what an upload holds. The upload can be set up again.
+ * @param upload The caldav_upload
+ */
+void caldav_upload_clear(caldav_upload* upload);
+
+/**
+ * Find the upload of a call, wrapping settings->file if it has none.
+ * @param settings @see caldav_settings
+ * @param local Upload to set up for settings->file
+ * @return settings->upload or local
+ */
+caldav_upload* caldav_upload_of(caldav_settings* settings,
+				caldav_upload* local);
+
+/**
+ * @param upload The caldav_upload
+ * @return Bytes of the body
+ */
+gsize caldav_upload_length(const caldav_upload* upload);
+
+/**
+ * Find the value of an iCalendar property in an upload.
+ * @see get_ical_property
+ * @param upload The caldav_upload
+ * @param name Property to search for, case insensitive
+ * @return The value or NULL. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_upload_property(const caldav_upload* upload, const gchar* name);
+
+/**
+ * Find the UID of an upload, and where a UID would have to go if there is
+ * none, in one pass. @see caldav_ical_scan
+ * @param upload The caldav_upload, not spliced before
+ * @param end Where to store the start of the first END:VEVENT or
+ * END:VTODO line if there is no UID, NULL otherwise
+ * @return The UID or NULL. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_upload_scan(const caldav_upload* upload, const gchar** end);
+
+/**
+ * Hash an upload for naming it. @see CALDAV_NAMING_MD5
+ * @param upload The caldav_upload, not spliced before
+ * @param naming CALDAV_NAMING_MD5 for MD5 of the whole body, otherwise a
+ * 64 bit FNV-1a of its length and its first CALDAV_NAMING_PREFIX bytes.
+ * @return The hash in hex. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_upload_hash(const caldav_upload* upload, int naming);
+
+/**
+ * Splice a UID made from hash into an upload. Trailing white space is
+ * left out in any case.
+ * @param upload The caldav_upload, not spliced before
+ * @param end Where the UID goes, NULL to leave the body as it is
+ * @param hash Hash of the upload. @see caldav_upload_hash
+ */
+void caldav_upload_splice_uid(caldav_upload* upload, const gchar* end,
+			      const gchar* hash);
+
+/**
+ * Does the upload contain a UID element or not. If not splice one in
+ * ahead of the end of the event or task, made from name. Trailing white
+ * space is left out in any case. @see verify_uid
+ * @param upload The caldav_upload, not spliced before
+ * @param name Used for the UID, NULL to use the MD5 of the body
+ */
+void caldav_upload_verify_uid(caldav_upload* upload, const gchar* name);
+
+/**
+ * Name the resource a new object is stored at as settings->naming asks
+ * and give the object a UID if it has none, with a single scan of it.
+ * @param settings @see caldav_settings
+ * @param upload The caldav_upload, not spliced before
+ * @return URL of the resource. Caller is responsible for freeing the
+ * memory.
+ */
+gchar* caldav_upload_resource(caldav_settings* settings,
+			      caldav_upload* upload);
+
+/**
+ * @param upload The caldav_upload
+ * @return The body as a string, copied to the arena only if it was not
+ * given as one. @see caldav_arena_take
+ */
+const gchar* caldav_upload_text(const caldav_upload* upload);
+
+/**
+ * @param upload The caldav_upload
+ * @return A copy of the body as a string. Caller is responsible for
+ * freeing the memory.
+ */
+gchar* caldav_upload_dup(const caldav_upload* upload);
 
 /**
  * Initialize caldav settings structure.
@@ -121,6 +462,14 @@ size_t WriteHeaderCallback(void* ptr, size_t size, size_t nmemb, void* data);
  */
 void init_caldav_settings(caldav_settings* settings);
 
+/**
+ * Copy the options of a caller into caldav settings. The one place the
+ * options reach the settings, for the blocking and the async calls alike.
+ * @param settings @see caldav_settings
+ * @param info @see runtime_info. Only the options and the stats are used.
+ */
+void copy_caldav_options(caldav_settings* settings, runtime_info* info);
+
 /**
  * Free momory assigned to caldav settings structure.
  * @param settings @see caldav_settings
@@ -134,15 +483,62 @@ void free_caldav_settings(caldav_settings* settings);
  */
 void parse_url(caldav_settings* settings, const char* url);
 
+/**
+ * Find a specific HTTP header of the last response in the index of a
+ * header buffer. Does not allocate.
+ * @param headers Header buffer filled by WriteHeaderCallback
+ * @param header HTTP header to search for, case insensitive
+ * @param len Where to store the length of the value. The value is not
+ * zero terminated.
+ * @return The value of the first such header or NULL
+ */
+const gchar* find_response_header(const struct MemoryStruct* headers,
+				  const char* header, gsize* len);
+
 /**
  * Find a specific HTTP header from last request
  * @param header HTTP header to search for
- * @param headers String of HTTP headers from last request
+ * @param headers Header buffer filled by WriteHeaderCallback
  * @param lowcase Should string be returned in all lower case.
- * @return The header found or NULL
+ * @return The header found or NULL. Repeated headers are joined by ", ".
+ */
+gchar* get_response_header(const char* header,
+			   const struct MemoryStruct* headers,
+			   gboolean lowcase);
+
+/**
+ * Find the value of an iCalendar property (RFC5545 3.1) in a single pass.
+ * Folded lines are unfolded and property parameters skipped.
+ * @param object Calendar object following ICal format
+ * @param name Property to search for, case insensitive
+ * @return The value of the first such property or NULL. Caller is
+ * responsible for freeing the memory.
  */
-gchar* get_response_header(
-		const char* header, gchar* headers, gboolean lowcase);
+gchar* get_ical_property(const gchar* object, const gchar* name);
+
+/**
+ * Find the value of an iCalendar property in the first length bytes of
+ * object, which need not be NUL terminated. @see get_ical_property
+ * @param object Calendar object following ICal format
+ * @param length Bytes of object
+ * @param name Property to search for, case insensitive
+ * @return The value of the first such property or NULL. Caller is
+ * responsible for freeing the memory.
+ */
+gchar* get_ical_property_len(const gchar* object, gsize length,
+			     const gchar* name);
+
+/**
+ * Find the UID of a calendar object and the end of its first event or
+ * task in a single pass, stopping at the UID.
+ * @param object Calendar object following ICal format
+ * @param length Bytes of object, need not be NUL terminated
+ * @param end Where to store the start of the first END:VEVENT or
+ * END:VTODO line if there is no UID, NULL otherwise
+ * @return The UID or NULL. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_ical_scan(const gchar* object, gsize length,
+			const gchar** end);
 
 /**
  * Parse response from CalDAV server
@@ -153,19 +549,118 @@ gchar* get_response_header(
  */
 gchar* parse_caldav_report(char* report, const char* element, const char* type);
 
+/**
+ * Parse a multistatus into its response elements. Namespace prefixes are
+ * ignored and href, getetag and calendar-data are unescaped.
+ * @param report A multistatus response body.
+ * @return A list of multistatus_entry in document order. Free it with
+ * free_multistatus().
+ */
+GSList* parse_multistatus(const gchar* report);
+
+/**
+ * Fetch the first non-empty element with the given local name from XML,
+ * whatever its namespace prefix.
+ * @param text String
+ * @param name Local name of the element
+ * @return The unescaped content or NULL if not found.
+ */
+gchar* get_element_text(const gchar* text, const gchar* name);
+
+/**
+ * Find a property of a response element other than the ones kept in
+ * multistatus_entry. Only usable from a multistatus_handler.
+ * @param entry The multistatus_entry handed to the handler.
+ * @param name Local name of the property.
+ * @return The unescaped content or NULL if not found.
+ */
+gchar* multistatus_entry_text(const multistatus_entry* entry,
+			      const gchar* name);
+
+/**
+ * Create an incremental multistatus parser.
+ * @param handler Function called for every response element.
+ * @param data Passed to handler.
+ * @return A new multistatus_stream. Free it with multistatus_stream_free().
+ */
+multistatus_stream* multistatus_stream_new(multistatus_handler handler,
+					   void* data);
+
+/**
+ * Feed the next part of a multistatus body to the parser. The handler is
+ * called for every response element completed by it.
+ * @param stream A multistatus_stream.
+ * @param text Next part of the body.
+ * @param len Length of text.
+ * @return TRUE if the handler asked to stop, FALSE otherwise.
+ */
+gboolean multistatus_stream_feed(multistatus_stream* stream,
+				 const gchar* text, gsize len);
+
+/**
+ * Free a multistatus_stream.
+ * @param stream A multistatus_stream.
+ */
+void multistatus_stream_free(multistatus_stream* stream);
+
+/**
+ * Free a list returned by parse_multistatus.
+ * @param entries A list of multistatus_entry.
+ */
+void free_multistatus(GSList* entries);
+
+/**
+ * Write a time_t variable as CalDAV DateTime in UTC.
+ * @param time a specific date and time
+ * @param buf Room for CALDAV_DATETIME_SIZE bytes.
+ * @return buf
+ */
+gchar* format_caldav_datetime(time_t time, gchar* buf);
+
 /**
  * Convert a time_t variable to CalDAV DateTime
  * @param time a specific date and time
- * @return the CalDAV DateTime
+ * @return the CalDAV DateTime in UTC
  */
 gchar* get_caldav_datetime(time_t* time);
 
+/**
+ * Build a query with a time-range element between the two halves of its
+ * template, in transient memory.
+ * @param head The query up to the time-range.
+ * @param start Start of the range.
+ * @param end End of the range.
+ * @param foot The query after the time-range.
+ * @return The query. Never free it.
+ */
+gchar* caldav_range_request(const gchar* head, time_t start, time_t end,
+			    const gchar* foot);
+
+/**
+ * Convert a CalDAV DateTime or Date to a time_t. Values ending with Z are
+ * UTC, others are taken as local time.
+ * @param text "20080415T151500Z", "20080415T151500" or "20080415"
+ * @param end NULL or set to the first character after the value.
+ * @return The time or -1 if text does not start with a DateTime.
+ */
+time_t parse_caldav_datetime(const gchar* text, const gchar** end);
+
+/**
+ * Convert an ICal duration ("PT1H", "-P1DT2H", "P2W") to seconds.
+ * @param text The duration.
+ * @param end NULL or set to the first character after the value.
+ * @param seconds Where to store the length.
+ * @return TRUE if text starts with a duration, FALSE otherwise.
+ */
+gboolean parse_caldav_duration(const gchar* text, const gchar** end,
+			       glong* seconds);
+
 /**
  * Create a random text string, using MD5. @see caldav_md5_hex_digest()
  * @param text some text to randomize
  * @return MD5 hash of text
  */
-gchar* random_file_name(gchar* text);
+gchar* random_file_name(const gchar* text);
 
 /**
  * Does the event contain a UID element or not. If not add it.
@@ -212,10 +707,273 @@ gchar* get_tag(const gchar* tag, gchar* text);
 gchar* rebuild_url(caldav_settings* setting, gchar* uri);
 
 /**
- * Prepare a curl connection
+ * Build the URL of a calendar object resource on the collection's server.
+ * @param settings caldav_settings
+ * @param href Path or URL of the resource
+ * @return URL or NULL if settings has no host. Caller is responsible for
+ * freeing the memory.
+ */
+gchar* object_url(caldav_settings* settings, const gchar* href);
+
+/**
+ * Build the key identifying the collection referenced by settings in
+ * process-wide caches. Credentials are part of the key since what the
+ * server answers may depend on the authenticated principal.
+ * @param settings @see caldav_settings
+ * @return Key. Caller is responsible for freeing the memory.
+ */
+gchar* collection_key(caldav_settings* settings);
+
+/**
+ * Initialize libcurl exactly once for the whole process. Safe to call
+ * from any thread before creating a CURL handle.
+ */
+void init_curl_global(void);
+
+/**
+ * Fetch the header list every request of a kind sends. The lists are
+ * built once and also turn off Expect and chunked uploads.
+ * @param kind Which list.
+ * @return The list. Never free or change it.
+ */
+struct curl_slist* caldav_headers(CALDAV_HEADERS kind);
+
+/**
+ * Prepare a curl connection. If the settings carries a session handle
+ * the handle is reset and reused instead of creating a new one.
  * @param settings caldav_settings
  * @return CURL
  */
 CURL* get_curl(caldav_settings* setting);
 
+/**
+ * Clear every option of a handle obtained from get_curl and set the
+ * common ones again, so the next request of an operation starts from a
+ * known state whatever the requests before it left behind.
+ * @param settings caldav_settings
+ * @param curl CURL
+ */
+void reset_curl(caldav_settings* setting, CURL* curl);
+
+/**
+ * Release a curl connection obtained from get_curl. A session handle is
+ * kept open for the next request with its trace turned off, since the
+ * settings traced to may be gone before the handle is. Any other handle
+ * is cleaned up.
+ * @param settings caldav_settings
+ * @param curl CURL
+ */
+void release_curl(caldav_settings* setting, CURL* curl);
+
+/**
+ * Count response body bytes after content decoding. Called by the write
+ * callbacks for every part they are handed.
+ * @param len Number of bytes.
+ */
+void caldav_count_received(gsize len);
+
+/**
+ * Open a scope for transient allocations on this thread. Scopes nest,
+ * everything allocated is released when the outermost one ends.
+ */
+void caldav_arena_begin(void);
+
+/**
+ * End a scope opened with caldav_arena_begin. Ending the outermost
+ * scope releases every transient allocation of this thread.
+ */
+void caldav_arena_end(void);
+
+/**
+ * Allocate transient memory, released when the outermost scope of this
+ * thread ends. Never free it.
+ * @param size Number of bytes.
+ * @return Memory aligned for any type.
+ */
+gpointer caldav_arena_alloc(gsize size);
+
+/**
+ * Copy a string into transient memory.
+ * @param text The string or NULL.
+ * @return The copy or NULL. Never free it.
+ */
+gchar* caldav_arena_strdup(const gchar* text);
+
+/**
+ * Format a string into transient memory. @see g_strdup_printf
+ * @param format printf() format.
+ * @return The string. Never free it.
+ */
+gchar* caldav_arena_strdup_printf(const gchar* format, ...) G_GNUC_PRINTF(1, 2);
+
+/**
+ * Hand a string allocated with g_malloc over to the arena, which frees
+ * it when the outermost scope of this thread ends.
+ * @param data The string or NULL.
+ * @return data. Never free it.
+ */
+gpointer caldav_arena_take(gpointer data);
+
+/**
+ * Add a finished transfer to settings->stats and report it to
+ * settings->exchange. The bytes on the wire are read from the handle and
+ * the decoded ones from what the write callbacks of this thread counted
+ * since the last call, as are the time spent parsing and the transient
+ * allocations.
+ * @param settings caldav_settings
+ * @param curl The handle of the finished transfer.
+ * @param res The libcurl result of the transfer.
+ */
+void caldav_account(caldav_settings* settings, CURL* curl, CURLcode res);
+
+/**
+ * Add the time this thread spent parsing and its transient allocations
+ * since the last call to caldav_account to the totals of the action of
+ * settings. Call after parsing a response which was collected first.
+ * @param settings caldav_settings
+ */
+void caldav_account_parse(caldav_settings* settings);
+
+/**
+ * Perform a transfer and add it to settings->stats. Use instead of
+ * curl_easy_perform. A host whose circuit breaker is open is not asked.
+ * @param settings caldav_settings
+ * @param curl CURL
+ * @param error_buf The CURLOPT_ERRORBUFFER of curl. Holds the reason when
+ * the request was refused.
+ * @return The result of curl_easy_perform, CURLE_COULDNT_CONNECT if the
+ * request was refused.
+ */
+CURLcode caldav_perform(caldav_settings* settings,
+			CURL* curl,
+			char* error_buf);
+
+/**
+ * Perform an idempotent request, an OPTIONS, PROPFIND, REPORT or GET,
+ * repeating it after a 503, 429 or a connection which failed before any
+ * answer. Waits honor Retry-After and otherwise grow exponentially with
+ * jitter. The buffers are emptied before every repetition.
+ * @param settings caldav_settings
+ * @param curl CURL
+ * @param headers The header buffer, its body is emptied along with it.
+ * Responses fed to a stream instead must be ignored unless successful.
+ * @param error_buf The CURLOPT_ERRORBUFFER of curl.
+ * @return The result of the last curl_easy_perform.
+ */
+CURLcode caldav_perform_read(caldav_settings* settings,
+			     CURL* curl,
+			     struct MemoryStruct* headers,
+			     char* error_buf);
+
+/**
+ * Test whether a request failed in a way which may pass when repeated.
+ * @param res The libcurl result.
+ * @param code The HTTP status or 0 (zero) if none was received.
+ * @return TRUE for a 503, 429 or a connection failing before an answer.
+ */
+gboolean caldav_transient(CURLcode res, long code);
+
+/**
+ * Milliseconds to wait before repeating a request.
+ * @param attempt How many times it was repeated already.
+ * @param retry_after Seconds the server asked for or 0 (zero).
+ * @return Milliseconds or -1 if the server asked for more than
+ * CALDAV_RETRY_AFTER_MAX.
+ */
+long caldav_backoff(int attempt, long retry_after);
+
+/**
+ * Get the Retry-After of the last response on curl.
+ * @param curl CURL
+ * @return Seconds or 0 (zero) if none was sent.
+ */
+long caldav_retry_after(CURL* curl);
+
+/**
+ * Get the Retry-After of the last failed request made by this thread.
+ * @return Seconds or 0 (zero) if none was sent.
+ */
+long caldav_last_retry_after(void);
+
+/**
+ * Ask the circuit breaker of the host of a request whether it may be
+ * sent. Once the breaker opened only one request tries the host after
+ * CALDAV_BREAKER_OPEN seconds, its outcome closes or reopens it.
+ * @param settings caldav_settings
+ * @return NULL if the request may go, otherwise a message why not.
+ */
+gchar* caldav_breaker_check(caldav_settings* settings);
+
+/**
+ * Tell the circuit breaker of the host of a request how it went. A 503
+ * or a connection which failed or timed out counts as a failure.
+ * @param settings caldav_settings
+ * @param res The libcurl result.
+ * @param code The HTTP status or 0 (zero) if none was received.
+ */
+void caldav_breaker_record(caldav_settings* settings,
+			   CURLcode res,
+			   long code);
+
+/**
+ * Map a failed transfer to an error code. @see caldav_error
+ * @param res The libcurl result.
+ * @return -4 if no connection could be made, -5 if the request timed
+ * out, -1 otherwise.
+ */
+long caldav_transfer_code(CURLcode res);
+
+/**
+ * Compress the body of a PUT if it has at least
+ * settings->compress_uploads bytes and the server lists gzip in the
+ * Accept-Encoding of its OPTIONS answer.
+ * @param settings caldav_settings
+ * @param body The body.
+ * @param packed_len Where to store the length of the result.
+ * @return The gzip compressed body or NULL if it goes as it is. Caller
+ * is responsible for freeing the memory.
+ */
+gchar* caldav_upload_pack(caldav_settings* settings,
+			  const caldav_upload* body,
+			  gsize* packed_len);
+
+/**
+ * Send body as the request of a PUT already set up on curl. Bodies of at
+ * least settings->compress_uploads bytes go gzip compressed to servers
+ * which list gzip in the Accept-Encoding of their OPTIONS answer. A
+ * server refusing it with 415 gets the body again as it is (RFC7694).
+ * @param settings caldav_settings
+ * @param curl CURL with the request set up apart from the body.
+ * @param body The body. One part is sent as it is, more are read by
+ * libcurl one after the other.
+ * @param http_header The list set as CURLOPT_HTTPHEADER.
+ * @param error_buf The CURLOPT_ERRORBUFFER of curl.
+ * @return The result of curl_easy_perform.
+ */
+CURLcode caldav_put(caldav_settings* settings,
+		    CURL* curl,
+		    caldav_upload* body,
+		    struct curl_slist* http_header,
+		    char* error_buf);
+
+/**
+ * Copy a caldav_stats while no transfer is added to it.
+ * @param from The counters or NULL.
+ * @param to Where to store the copy. Zero if from is NULL.
+ */
+void caldav_stats_read(const caldav_stats* from, caldav_stats* to);
+
+/**
+ * Set a caldav_stats to zero while no transfer is added to it.
+ * @param stats The counters or NULL.
+ */
+void caldav_stats_clear(caldav_stats* stats);
+
+/**
+ * Map the error left behind by a failed call to a CALDAV_RESPONSE.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return FORBIDDEN, CONFLICT, LOCKED, NOTIMPLEMENTED or UNAVAILABLE
+ */
+CALDAV_RESPONSE caldav_error_response(caldav_error* error);
+
 #endif
@@ -30,6 +30,11 @@
 #include "get-display-name.h"
 #include "options-caldav-server.h"
 #include "get-freebusy-report.h"
+#include "get-multiget-report.h"
+#include "sync-caldav-collection.h"
+#include "caldav-cache.h"
+#include "lock-caldav-object.h"
+#include "caldav-query.h"
 #include <curl/curl.h>
 #include <glib.h>
 #include <stdio.h>
@@ -62,7 +67,12 @@ static void init_runtime(runtime_info* info) {
 static gboolean test_caldav_enabled(CURL* curl,
 				    caldav_settings* settings,
 				    caldav_error* error) {
-	return caldav_getoptions(curl, settings, NULL, error, TRUE);
+	gboolean enabled;
+
+	caldav_arena_begin();
+	enabled = caldav_getoptions(curl, settings, NULL, error, TRUE);
+	caldav_arena_end();
+	return enabled;
 }
 
 /* 
@@ -77,91 +87,1234 @@ static gboolean make_caldav_call(caldav_settings* settings,
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	curl = get_curl(settings);
-	if (!curl) {
-		info->error->str = g_strdup("Could not initialize libcurl");
-		g_free(settings->file);
-		settings->file = NULL;
-		return TRUE;
-	}
-	if (!test_caldav_enabled(curl, settings, info->error)) {
-		g_free(settings->file);
-		settings->file = NULL;
-		curl_easy_cleanup(curl);
-		return TRUE;
+	/* a handle, and its setup, is only needed when the probe goes out */
+	if (!caldav_capabilities_lookup(settings, NULL)) {
+		curl = get_curl(settings);
+		if (!curl) {
+			info->error->str =
+				g_strdup("Could not initialize libcurl");
+			g_free(settings->file);
+			settings->file = NULL;
+			return TRUE;
+		}
+		if (!test_caldav_enabled(curl, settings, info->error)) {
+			g_free(settings->file);
+			settings->file = NULL;
+			release_curl(settings, curl);
+			return TRUE;
+		}
+		release_curl(settings, curl);
 	}
-	curl_easy_cleanup(curl);
+	/* transient strings of the action are released in one go */
+	caldav_arena_begin();
 	switch (settings->ACTION) {
-		case GETALL: result = caldav_getall(settings, info->error); break;
-		case GET: result = caldav_getrange(settings, info->error); break;
-		case GETALLTASKS: result = caldav_tasks_getall(settings, info->error); break;
-		case GETTASKS: result = caldav_tasks_getrange(settings, info->error); break;
+		case GETALL:
+			result = (settings->cache) ?
+				caldav_cache_getall(settings, info->error) :
+				caldav_getall(settings, info->error);
+			break;
+		case GET:
+			result = (settings->cache && settings->cache_ttl >= 0) ?
+				caldav_cache_getrange(settings, info->error) :
+				caldav_getrange(settings, info->error);
+			break;
+		case GETALLTASKS:
+			result = (settings->cache) ?
+				caldav_cache_getall(settings, info->error) :
+				caldav_tasks_getall(settings, info->error);
+			break;
+		case GETTASKS:
+			result = (settings->cache && settings->cache_ttl >= 0) ?
+				caldav_cache_getrange(settings, info->error) :
+				caldav_tasks_getrange(settings, info->error);
+			break;
 		case ADD: result = caldav_add(settings, info->error); break;
 		case DELETE: result = caldav_delete(settings, info->error); break;
 		case MODIFY: result = caldav_modify(settings, info->error); break;
 		case DELETETASKS: result = caldav_tasks_delete(settings, info->error); break;
 		case MODIFYTASKS: result = caldav_tasks_modify(settings, info->error); break;
 		case GETCALNAME: result = caldav_getname(settings, info->error); break;
-		case FREEBUSY: result = caldav_freebusy(settings, info->error); break;
+		case FREEBUSY:
+			result = (settings->cache && settings->cache_ttl >= 0) ?
+				caldav_cache_getrange(settings, info->error) :
+				caldav_freebusy(settings, info->error);
+			break;
 		default: break;
 	}
+	caldav_arena_end();
+	/* the server no longer allows what it advertised */
+	if (result && (info->error->code == 405 || info->error->code == 501))
+		caldav_invalidate_capabilities(settings);
 	return result;
 }
 
 /**
- * Function for adding a new event.
- * @param object Appointment following ICal format (RFC2445). Receiver is
- * responsible for freeing the memory.
+ * Clear the error from a previous call before making a new one.
+ * @param error A pointer to caldav_error. @see caldav_error
+ */
+static void reset_error(caldav_error* error) {
+	if (error->str) {
+		g_free(error->str);
+		error->str = NULL;
+	}
+	error->code = 0;
+	error->retry_after = 0;
+}
+
+/**
+ * Map the error of a failed call to a CALDAV_RESPONSE. When the server
+ * is unavailable the wait it asked for is stored in the error.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return FORBIDDEN, CONFLICT, LOCKED, NOTIMPLEMENTED or UNAVAILABLE
+ */
+static CALDAV_RESPONSE error_response(caldav_error* error) {
+	CALDAV_RESPONSE caldav_response;
+
+	caldav_response = caldav_error_response(error);
+	if (caldav_response == UNAVAILABLE)
+		error->retry_after = caldav_last_retry_after();
+	return caldav_response;
+}
+
+/**
+ * Send an upload with ADD, MODIFY or MODIFYTASKS on the session's
+ * persistent connection. The caller resets the error.
+ * @param session An open session. @see caldav_session_open
+ * @param action The CALDAV_ACTION to perform.
+ * @param upload The calendar object. Cleared when done.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+static CALDAV_RESPONSE session_upload(caldav_session* session,
+				      CALDAV_ACTION action,
+				      caldav_upload* upload) {
+	caldav_settings settings;
+	gboolean res;
+
+	settings = session->settings;
+	settings.file = NULL;
+	settings.upload = upload;
+	settings.ACTION = action;
+	settings.start = 0;
+	settings.end = 0;
+	res = make_caldav_call(&settings, session->info);
+	g_free(settings.file);
+	caldav_upload_clear(upload);
+	if (res)
+		return error_response(session->info->error);
+	return OK;
+}
+
+/**
+ * Run one CalDAV action on the session's persistent connection.
+ * @param session An open session. @see caldav_session_open
+ * @param action The CALDAV_ACTION to perform.
+ * @param object Calendar object to send or NULL.
+ * @param start Start of time range for range queries.
+ * @param end End of time range for range queries.
+ * @param result Where to store the response or NULL.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+static CALDAV_RESPONSE session_call(caldav_session* session,
+				    CALDAV_ACTION action,
+				    const char* object,
+				    time_t start,
+				    time_t end,
+				    response* result) {
+	caldav_settings settings;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+
+	reset_error(session->info->error);
+	if (object && (action == ADD || action == MODIFY ||
+				action == MODIFYTASKS)) {
+		caldav_upload upload;
+
+		/* sent straight from the caller's string */
+		caldav_upload_string(&upload, object);
+		return session_upload(session, action, &upload);
+	}
+	/* strings are owned by the session, only file belongs to this call */
+	settings = session->settings;
+	settings.file = (object) ? g_strdup(object) : NULL;
+	settings.ACTION = action;
+	settings.start = start;
+	settings.end = end;
+	gboolean res = make_caldav_call(&settings, session->info);
+	if (res) {
+		if (result) {
+			result->msg = NULL;
+			result->len = 0;
+		}
+		caldav_response = error_response(session->info->error);
+	}
+	else {
+		/* hand the result over instead of copying it */
+		if (result) {
+			result->msg = settings.file;
+			result->len = (settings.file) ? strlen(settings.file) : 0;
+			settings.file = NULL;
+		}
+		caldav_response = OK;
+	}
+	g_free(settings.file);
+	return caldav_response;
+}
+
+/**
+ * Check that the collection of settings is CalDAV enabled, using the
+ * cached server capabilities when possible.
+ * @param settings An instance of caldav_settings. @see caldav_settings
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE if the collection is CalDAV enabled.
+ */
+static gboolean collection_enabled(caldav_settings* settings,
+				   caldav_error* error) {
+	CURL* curl;
+	gboolean res;
+
+	curl = get_curl(settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return FALSE;
+	}
+	res = test_caldav_enabled(curl, settings, error);
+	release_curl(settings, curl);
+	return res;
+}
+
+/**
+ * Run one report action on the session's persistent connection, either
+ * streaming the objects found to a callback or collecting them.
+ * @param session An open session. @see caldav_session_open
+ * @param action GETALL, GET, GETALLTASKS or GETTASKS.
+ * @param start Start of time range for range queries.
+ * @param end End of time range for range queries.
+ * @param query NULL or a calendar-query to run instead of the report
+ * for action.
+ * @param callback Function called for every calendar object resource.
+ * @param user_data Passed to callback.
+ * @param objects Where to collect the objects instead of calling
+ * callback or NULL.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+static CALDAV_RESPONSE session_report(caldav_session* session,
+				      CALDAV_ACTION action,
+				      time_t start,
+				      time_t end,
+				      const caldav_query* query,
+				      caldav_object_callback callback,
+				      void* user_data,
+				      caldav_objects* objects) {
+	caldav_settings settings;
+	caldav_error* error;
+	gboolean res;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(callback != NULL || objects != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	settings = session->settings;
+	settings.file = NULL;
+	settings.ACTION = action;
+	settings.start = start;
+	settings.end = end;
+	settings.query = query;
+	if (objects) {
+		objects->objects = NULL;
+		objects->count = 0;
+	}
+	if (!collection_enabled(&settings, error))
+		return error_response(error);
+	caldav_arena_begin();
+	if (objects)
+		res = caldav_report_objects(&settings, objects, error);
+	else
+		res = caldav_report_foreach(&settings, callback, user_data, error);
+	caldav_arena_end();
+	if (res) {
+		if (error->code == 405 || error->code == 501)
+			caldav_invalidate_capabilities(&settings);
+		return error_response(error);
+	}
+	return OK;
+}
+
+/**
+ * Function for opening a session to a CalDAV collection.
  * @param URL Defines CalDAV resource. Receiver is responsible for freeing
  * the memory. [http://][username[:password]@]host[:port]/url-path.
  * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return An open session or NULL in case of error.
+ */
+caldav_session* caldav_session_open(const char* URL, runtime_info* info) {
+	caldav_session* session;
+	CURL* curl;
+
+	g_return_val_if_fail(info != NULL, NULL);
+
+	init_runtime(info);
+	init_curl_global();
+	curl = curl_easy_init();
+	if (!curl) {
+		info->error->code = -1;
+		info->error->str = g_strdup("Could not initialize libcurl");
+		return NULL;
+	}
+	session = g_new0(caldav_session, 1);
+	session->info = info;
+	init_caldav_settings(&session->settings);
+	copy_caldav_options(&session->settings, info);
+	parse_url(&session->settings, URL);
+	session->settings.curl = curl;
+	return session;
+}
+
+/**
+ * Function for closing a session and its connection.
+ * @param session Address to a pointer to a caldav_session. @see
+ * caldav_session_open
+ */
+void caldav_session_close(caldav_session** session) {
+	caldav_session* s;
+
+	if (*session) {
+		s = *session;
+		if (s->settings.curl)
+			curl_easy_cleanup(s->settings.curl);
+		s->settings.curl = NULL;
+		free_caldav_settings(&s->settings);
+		g_free(s);
+		*session = s = NULL;
+	}
+}
+
+/**
+ * Function for adding a new event using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Appointment following ICal format (RFC2445).
  * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
  */
-CALDAV_RESPONSE caldav_add_object(const char* object,
-				  const char* URL,
-				  runtime_info* info) {
+CALDAV_RESPONSE caldav_session_add(caldav_session* session,
+				   const char* object) {
+	return session_call(session, ADD, object, 0, 0, NULL);
+}
+
+/**
+ * Function for deleting an event using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_delete(caldav_session* session,
+				      const char* object) {
+	return session_call(session, DELETE, object, 0, 0, NULL);
+}
+
+/**
+ * Function for modifying an event using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify(caldav_session* session,
+				      const char* object) {
+	return session_call(session, MODIFY, object, 0, 0, NULL);
+}
+
+/**
+ * Prepare an upload from a buffer, a descriptor or a file and send it.
+ * @param session An open session. @see caldav_session_open
+ * @param action ADD or MODIFY.
+ * @param data The buffer or NULL.
+ * @param length Bytes of data.
+ * @param fd The descriptor if data and path are NULL.
+ * @param path The file or NULL.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+static CALDAV_RESPONSE session_send(caldav_session* session,
+				    CALDAV_ACTION action,
+				    const char* data,
+				    size_t length,
+				    int fd,
+				    const char* path) {
+	caldav_upload upload;
+	gboolean failed = FALSE;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+
+	reset_error(session->info->error);
+	if (data)
+		caldav_upload_memory(&upload, data, length);
+	else if (path)
+		failed = caldav_upload_file(&upload, path, session->info->error);
+	else
+		failed = caldav_upload_fd(&upload, fd, session->info->error);
+	if (failed)
+		return error_response(session->info->error);
+	return session_upload(session, action, &upload);
+}
+
+/**
+ * Function for adding a new event held in a buffer using an open session.
+ * The buffer is sent as it is, a missing UID is sent along with it.
+ * @param session An open session. @see caldav_session_open
+ * @param data Appointment following ICal format (RFC2445). Need not be
+ * NUL terminated.
+ * @param length Bytes of data.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_add_buffer(caldav_session* session,
+					  const char* data,
+					  size_t length) {
+	g_return_val_if_fail(data != NULL, CONFLICT);
+
+	return session_send(session, ADD, data, length, -1, NULL);
+}
+
+/**
+ * Function for adding a new event read from a descriptor using an open
+ * session. Regular files are mapped instead of read.
+ * @param session An open session. @see caldav_session_open
+ * @param fd Descriptor holding an appointment following ICal format
+ * (RFC2445). Not closed.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_add_fd(caldav_session* session, int fd) {
+	return session_send(session, ADD, NULL, 0, fd, NULL);
+}
+
+/**
+ * Function for adding a new event stored in a file using an open session.
+ * The file is mapped, not read.
+ * @param session An open session. @see caldav_session_open
+ * @param path File holding an appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_add_file(caldav_session* session,
+					const char* path) {
+	g_return_val_if_fail(path != NULL, CONFLICT);
+
+	return session_send(session, ADD, NULL, 0, -1, path);
+}
+
+/**
+ * Function for modifying an event held in a buffer using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param data Appointment following ICal format (RFC2445). Need not be
+ * NUL terminated.
+ * @param length Bytes of data.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify_buffer(caldav_session* session,
+					     const char* data,
+					     size_t length) {
+	g_return_val_if_fail(data != NULL, CONFLICT);
+
+	return session_send(session, MODIFY, data, length, -1, NULL);
+}
+
+/**
+ * Function for modifying an event read from a descriptor using an open
+ * session. Regular files are mapped instead of read.
+ * @param session An open session. @see caldav_session_open
+ * @param fd Descriptor holding an appointment following ICal format
+ * (RFC2445). Not closed.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify_fd(caldav_session* session, int fd) {
+	return session_send(session, MODIFY, NULL, 0, fd, NULL);
+}
+
+/**
+ * Function for modifying an event stored in a file using an open session.
+ * The file is mapped, not read.
+ * @param session An open session. @see caldav_session_open
+ * @param path File holding an appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify_file(caldav_session* session,
+					   const char* path) {
+	g_return_val_if_fail(path != NULL, CONFLICT);
+
+	return session_send(session, MODIFY, NULL, 0, -1, path);
+}
+
+/**
+ * Function for getting a collection of events determined by time range
+ * using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get(caldav_session* session,
+				   response* result,
+				   time_t start,
+				   time_t end) {
+	return session_call(session, GET, NULL, start, end, result);
+}
+
+/**
+ * Function for getting all events from the collection using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_getall(caldav_session* session,
+				      response* result) {
+	return session_call(session, GETALL, NULL, 0, 0, result);
+}
+
+/**
+ * Function for getting calendar objects by href using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored. Clear it with caldav_free_objects().
+ * @param hrefs Array of paths or URLs of calendar object resources.
+ * @param count Number of hrefs.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_multiget(caldav_session* session,
+					caldav_objects* result,
+					const char** hrefs,
+					int count) {
+	CURL* curl;
+	caldav_settings settings;
+	caldav_error* error;
+	gboolean res;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(result != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	result->objects = NULL;
+	result->count = 0;
+	if (count <= 0)
+		return OK;
+	settings = session->settings;
+	curl = get_curl(&settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return CONFLICT;
+	}
+	res = test_caldav_enabled(curl, &settings, error);
+	release_curl(&settings, curl);
+	if (!res)
+		return error_response(error);
+	caldav_arena_begin();
+	res = caldav_multiget(&settings, hrefs, count,
+			session->info->options->multiget_chunk, result, error);
+	caldav_arena_end();
+	if (res) {
+		caldav_free_objects(result);
+		if (error->code == 405 || error->code == 501)
+			caldav_invalidate_capabilities(&settings);
+		return error_response(error);
+	}
+	return OK;
+}
+
+/**
+ * Function for getting all events from the collection together with the
+ * href and ETag of each using an open session. @see caldav_getall_objects
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored sorted by href. Clear it with caldav_free_objects().
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_getall_objects(caldav_session* session,
+					      caldav_objects* result) {
+	return session_report(session, GETALL, 0, 0, NULL, NULL, NULL, result);
+}
+
+/**
+ * Function for getting all tasks from the collection together with the
+ * href and ETag of each using an open session. @see caldav_getall_objects
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored sorted by href. Clear it with caldav_free_objects().
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_getall_objects(caldav_session* session,
+						    caldav_objects* result) {
+	return session_report(session, GETALLTASKS, 0, 0, NULL, NULL, NULL, result);
+}
+
+/**
+ * Function for replacing an object already read from the server using an
+ * open session. @see caldav_modify_by_href
+ * @param session An open session. @see caldav_session_open
+ * @param object href, etag of the stored version and the new data.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify_by_href(caldav_session* session,
+					      caldav_object* object) {
+	caldav_settings settings;
+	caldav_error* error;
+	gboolean res;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(object != NULL && object->href != NULL &&
+			object->data != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	settings = session->settings;
+	/* only read, the object stays the caller's */
+	settings.file = object->data;
+	settings.ACTION = MODIFY;
+	if (!collection_enabled(&settings, error))
+		return error_response(error);
+	caldav_arena_begin();
+	res = caldav_modify_href(&settings, object->href, &object->etag, error);
+	caldav_arena_end();
+	if (res)
+		return error_response(error);
+	return OK;
+}
+
+/**
+ * Function for deleting an object already read from the server using an
+ * open session. @see caldav_delete_by_href
+ * @param session An open session. @see caldav_session_open
+ * @param object href and etag of the stored version.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_delete_by_href(caldav_session* session,
+					      const caldav_object* object) {
 	caldav_settings settings;
+	caldav_error* error;
+	gboolean res;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(object != NULL && object->href != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	settings = session->settings;
+	settings.file = NULL;
+	settings.ACTION = DELETE;
+	if (!collection_enabled(&settings, error))
+		return error_response(error);
+	caldav_arena_begin();
+	res = caldav_delete_href(&settings, object->href, object->etag, error);
+	caldav_arena_end();
+	if (res)
+		return error_response(error);
+	return OK;
+}
+
+/**
+ * Function for taking a lock using an open session. @see
+ * caldav_lock_acquire
+ * @param session An open session. @see caldav_session_open
+ * @param lock Where to store the lock.
+ * @param href Path of the object to lock or NULL for the collection.
+ * @param timeout Seconds to ask for. 0 (zero) uses the default.
+ * @return Ok, FORBIDDEN, CONFLICT, LOCKED or NOTIMPLEMENTED.
+ * @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_lock_acquire(caldav_session* session,
+					    caldav_lock** lock,
+					    const char* href,
+					    int timeout) {
+	caldav_error* error;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(lock != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	caldav_arena_begin();
+	*lock = caldav_lock_href(&session->settings, href, timeout, error);
+	caldav_arena_end();
+	if (! *lock)
+		return error_response(error);
+	return OK;
+}
+
+/**
+ * Function for refreshing a lock using an open session. @see
+ * caldav_lock_refresh
+ * @param session An open session. @see caldav_session_open
+ * @param lock The lock. timeout and expires are updated.
+ * @param timeout Seconds to ask for. 0 (zero) asks for the same again.
+ * @return Ok, FORBIDDEN, CONFLICT or LOCKED. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_lock_refresh(caldav_session* session,
+					    caldav_lock* lock,
+					    int timeout) {
+	caldav_error* error;
+	gboolean res;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(lock != NULL && lock->token != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	caldav_arena_begin();
+	res = caldav_relock_href(&session->settings, lock, timeout, error);
+	caldav_arena_end();
+	if (res)
+		return error_response(error);
+	return OK;
+}
+
+/**
+ * Function for releasing and freeing a lock using an open session. If
+ * the session writes under the lock it stops doing so. @see
+ * caldav_lock_release
+ * @param session An open session. @see caldav_session_open
+ * @param lock Address to a pointer to a caldav_lock.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_lock_release(caldav_session* session,
+					    caldav_lock** lock) {
+	caldav_error* error;
+	CALDAV_RESPONSE caldav_response = OK;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(lock != NULL && *lock != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	if (session->settings.lock == *lock)
+		session->settings.lock = NULL;
+	caldav_arena_begin();
+	if (caldav_unlock_href(&session->settings, *lock, error))
+		caldav_response = error_response(error);
+	caldav_arena_end();
+	caldav_free_lock(lock);
+	return caldav_response;
+}
+
+/**
+ * Function for running a calendar-query using an open session and
+ * handing every object to a callback. @see caldav_query_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param query A caldav_query.
+ * @param callback Function called for every calendar object resource.
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_query_foreach(caldav_session* session,
+					     const caldav_query* query,
+					     caldav_object_callback callback,
+					     void* user_data) {
+	g_return_val_if_fail(query != NULL, CONFLICT);
+
+	return session_report(session, GETALL, 0, 0, query,
+			callback, user_data, NULL);
+}
+
+/**
+ * Function for running a calendar-query using an open session and
+ * returning the objects. @see caldav_query_objects
+ * @param session An open session. @see caldav_session_open
+ * @param query A caldav_query.
+ * @param result A pointer to caldav_objects where the objects are stored.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_query_objects(caldav_session* session,
+					     const caldav_query* query,
+					     caldav_objects* result) {
+	g_return_val_if_fail(query != NULL, CONFLICT);
+
+	return session_report(session, GETALL, 0, 0, query, NULL, NULL, result);
+}
+
+/**
+ * Function for making every following write through a session submit
+ * the token of a lock instead of taking a lock of its own.
+ * @param session An open session. @see caldav_session_open
+ * @param lock A lock which must outlive its use by the session, or NULL
+ * to have writes take locks of their own again.
+ */
+void caldav_session_set_lock(caldav_session* session, caldav_lock* lock) {
+	g_return_if_fail(session != NULL);
+
+	session->settings.lock = lock;
+}
+
+/**
+ * Function for getting the changes to the collection since an earlier
+ * synchronization using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param changes A pointer to a caldav_changes where the changes are to be
+ * stored. Clear it with caldav_free_changes().
+ * @param token The token from the previous synchronization or NULL.
+ * @param known NULL or the objects the caller has, sorted by href.
+ * @see caldav_sync_object
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_sync(caldav_session* session,
+				    caldav_changes* changes,
+				    const char* token,
+				    const caldav_objects* known) {
+	caldav_settings settings;
+	caldav_error* error;
+	gboolean res;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(changes != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	settings = session->settings;
+	caldav_arena_begin();
+	res = caldav_sync(&settings, token, known, changes, error);
+	caldav_arena_end();
+	if (res) {
+		caldav_free_changes(changes);
+		return error_response(error);
+	}
+	return OK;
+}
+
+/**
+ * Function for listing the href and ETag of every object in the
+ * collection using an open session. @see caldav_getall_etags
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to a caldav_etags where the entries are to be
+ * stored sorted by href. Clear it with caldav_free_etags().
+ * @param props 0 or CALDAV_ETAG_MODIFIED and/or CALDAV_ETAG_SIZE.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_getall_etags(caldav_session* session,
+					    caldav_etags* result,
+					    int props) {
+	caldav_settings settings;
+	caldav_error* error;
+	gboolean res;
+
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(result != NULL, CONFLICT);
+
+	error = session->info->error;
+	reset_error(error);
+	settings = session->settings;
+	caldav_arena_begin();
+	res = caldav_propfind_etags(&settings, props, result, error);
+	caldav_arena_end();
+	if (res) {
+		caldav_free_etags(result);
+		return error_response(error);
+	}
+	return OK;
+}
+
+/**
+ * Function for deleting a task using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Task following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_delete(caldav_session* session,
+					    const char* object) {
+	return session_call(session, DELETETASKS, object, 0, 0, NULL);
+}
+
+/**
+ * Function for modifying a task using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Task following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_modify(caldav_session* session,
+					    const char* object) {
+	return session_call(session, MODIFYTASKS, object, 0, 0, NULL);
+}
+
+/**
+ * Function for getting a collection of tasks determined by time range
+ * using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_get(caldav_session* session,
+					 response* result,
+					 time_t start,
+					 time_t end) {
+	return session_call(session, GETTASKS, NULL, start, end, result);
+}
+
+/**
+ * Function for getting all tasks from the collection using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_getall(caldav_session* session,
+					    response* result) {
+	return session_call(session, GETALLTASKS, NULL, 0, 0, result);
+}
+
+/**
+ * Function for streaming all events from the collection using an open
+ * session. @see caldav_getall_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_getall_foreach(caldav_session* session,
+					      caldav_object_callback callback,
+					      void* user_data) {
+	return session_report(session, GETALL, 0, 0, NULL, callback, user_data, NULL);
+}
+
+/**
+ * Function for streaming a collection of events determined by time range
+ * using an open session. @see caldav_getall_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get_foreach(caldav_session* session,
+					   time_t start,
+					   time_t end,
+					   caldav_object_callback callback,
+					   void* user_data) {
+	return session_report(session, GET, start, end, NULL, callback, user_data, NULL);
+}
+
+/**
+ * Function for streaming all tasks from the collection using an open
+ * session. @see caldav_getall_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_getall_foreach(caldav_session* session,
+					    caldav_object_callback callback,
+					    void* user_data) {
+	return session_report(session, GETALLTASKS, 0, 0, NULL, callback, user_data, NULL);
+}
+
+/**
+ * Function for streaming a collection of tasks determined by time range
+ * using an open session. @see caldav_getall_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_get_foreach(caldav_session* session,
+						 time_t start,
+						 time_t end,
+						 caldav_object_callback callback,
+						 void* user_data) {
+	return session_report(session, GETTASKS, start, end, NULL, callback, user_data, NULL);
+}
+
+/**
+ * Function for getting the stored display name for the collection using
+ * an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get_displayname(caldav_session* session,
+					       response* result) {
+	return session_call(session, GETCALNAME, NULL, 0, 0, result);
+}
+
+/**
+ * Function for getting free/busy information using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @param start time_t variable specifying start and end for range. Both
+ * are included in range.
+ * @param end time_t variable specifying start and end for range. Both
+ * are included in range.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get_freebusy(caldav_session* session,
+					    response* result,
+					    time_t start,
+					    time_t end) {
+	return session_call(session, FREEBUSY, NULL, start, end, result);
+}
+
+/**
+ * Start every attendee of an availability query off as not answered for.
+ * @param result Array of count caldav_availability.
+ * @param attendees Array of count calendar user addresses.
+ * @param count Number of attendees.
+ */
+static void availability_init(caldav_availability* result,
+			      const char** attendees,
+			      int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		result[i].attendee = g_strdup(attendees[i]);
+		result[i].status = CONFLICT;
+		result[i].request_status = NULL;
+		result[i].busy = NULL;
+		result[i].count = 0;
+	}
+}
+
+/**
+ * caldav_fanout_callback reading the VFREEBUSY of one calendar as soon
+ * as it arrives.
+ */
+static void availability_read(int index,
+			      CALDAV_RESPONSE status,
+			      response* result,
+			      caldav_error* error,
+			      void* user_data) {
+	caldav_availability** asked = (caldav_availability **) user_data;
+
+	asked[index]->status = status;
+	if (status == OK) {
+		g_free(asked[index]->request_status);
+		asked[index]->request_status = NULL;
+		caldav_busy_parse(result->msg, asked[index]);
+	}
+}
+
+/**
+ * Ask the calendars of the attendees not answered for yet with
+ * free-busy-query REPORTs, all at the same time.
+ * @param result Array of count caldav_availability.
+ * @param calendars NULL or an array of count calendar collection URLs.
+ * @param count Number of attendees.
+ * @param start Start of time range.
+ * @param end End of time range.
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ */
+static void availability_fanout(caldav_availability* result,
+				const char** calendars,
+				int count,
+				time_t start,
+				time_t end,
+				runtime_info* info) {
+	caldav_availability** asked;
+	const char** URLs;
+	int n = 0;
+	int i;
+
+	if (! calendars)
+		return;
+	asked = g_new(caldav_availability*, count);
+	URLs = g_new(const char*, count);
+	for (i = 0; i < count; i++) {
+		if (result[i].status == OK || ! calendars[i])
+			continue;
+		asked[n] = &result[i];
+		URLs[n++] = calendars[i];
+	}
+	if (n > 0)
+		caldav_fanout(FREEBUSY, URLs, n, start, end, NULL, NULL, NULL,
+				availability_read, asked, info);
+	g_free(URLs);
+	g_free(asked);
+}
+
+/**
+ * @param result Array of count caldav_availability.
+ * @param count Number of attendees.
+ * @return OK or the status of the first attendee not answered for.
+ */
+static CALDAV_RESPONSE availability_status(caldav_availability* result,
+					   int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (result[i].status != OK)
+			return result[i].status;
+	}
+	return OK;
+}
+
+/**
+ * Function for getting the busy periods of many attendees using a session
+ * opened on the scheduling outbox of organizer. @see caldav_get_availability
+ * @param session An open session. @see caldav_session_open
+ * @param result An array of count caldav_availability, one per attendee.
+ * Clear it with caldav_free_availability().
+ * @param organizer Calendar user address of the user asking.
+ * @param attendees Array of count calendar user addresses.
+ * @param calendars NULL or an array of count calendar collection URLs to
+ * ask when the outbox cannot.
+ * @param count Number of attendees.
+ * @param start Start of time range.
+ * @param end End of time range.
+ * @return OK if every attendee was answered for, otherwise the status of
+ * the first one which was not. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get_availability(caldav_session* session,
+						caldav_availability* result,
+						const char* organizer,
+						const char** attendees,
+						const char** calendars,
+						int count,
+						time_t start,
+						time_t end) {
+	caldav_settings settings;
+	caldav_error* error;
 	CALDAV_RESPONSE caldav_response;
+	gboolean res;
+	int i;
 
-	g_return_val_if_fail(info != NULL, TRUE);
+	g_return_val_if_fail(session != NULL, CONFLICT);
+	g_return_val_if_fail(result != NULL || count <= 0, CONFLICT);
 
-	init_runtime(info);
-	init_caldav_settings(&settings);
-	settings.file = g_strdup(object);
-	settings.ACTION = ADD;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
+	error = session->info->error;
+	reset_error(error);
+	if (count <= 0)
+		return OK;
+	availability_init(result, attendees, count);
+	settings = session->settings;
+	settings.file = NULL;
+	settings.ACTION = FREEBUSY;
+	settings.start = start;
+	settings.end = end;
+	if (organizer && collection_enabled(&settings, error)) {
+		caldav_arena_begin();
+		res = caldav_schedule_freebusy(&settings, organizer, attendees,
+				count, result, error);
+		caldav_arena_end();
+		if (res && (error->code == 405 || error->code == 501))
+			caldav_invalidate_capabilities(&settings);
+		/* only a server without scheduling is worth asking again */
+		if (res && error->code != 403 && error->code != 404 &&
+				error->code != 405 && error->code != 501) {
+			caldav_response = error_response(error);
+			for (i = 0; i < count; i++)
+				result[i].status = caldav_response;
+			return caldav_response;
+		}
+	}
+	/* the probe or the outbox may have failed, the fallback answers */
+	reset_error(error);
+	availability_fanout(result, calendars, count, start, end,
+			session->info);
+	return availability_status(result, count);
+}
+
+/**
+ * Function to test wether the session's calendar resource is CalDAV
+ * enabled or not.
+ * @param session An open session. @see caldav_session_open
+ * @result 0 (zero) means no CalDAV support, otherwise CalDAV support
+ * detechted.
+ */
+int caldav_session_enabled_resource(caldav_session* session) {
+	CURL* curl;
+	caldav_settings settings;
+	caldav_error* error;
+
+	g_return_val_if_fail(session != NULL, 0);
+
+	error = session->info->error;
+	reset_error(error);
+	settings = session->settings;
+	curl = get_curl(&settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return 0;
+	}
+
+	gboolean res = test_caldav_enabled(curl, &settings, error);
+	release_curl(&settings, curl);
+	return (res && (error->code == 0 || error->code == 200)) ? 1 : 0;
+}
+
+/**
+ * Function to call to get a list of supported CalDAV options for the
+ * session's server.
+ * @param session An open session. @see caldav_session_open
+ * @result A list of available options or NULL in case of any error.
+ */
+char** caldav_session_get_server_options(caldav_session* session) {
+	CURL* curl;
+	caldav_settings settings;
+	response server_options;
+	gchar** option_list = NULL;
+	gchar** tmp;
+	gboolean res = FALSE;
+
+	g_return_val_if_fail(session != NULL, NULL);
+
+	reset_error(session->info->error);
+	settings = session->settings;
+	curl = get_curl(&settings);
+	if (!curl) {
+		session->info->error->code = -1;
+		session->info->error->str = g_strdup("Could not initialize libcurl");
+		return NULL;
+	}
+
+	server_options.msg = NULL;
+	caldav_arena_begin();
+	res = caldav_getoptions(curl, &settings, &server_options,
+			session->info->error, FALSE);
+	caldav_arena_end();
 	if (res) {
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
+		if (server_options.msg) {
+			option_list = g_strsplit(server_options.msg, ", ", 0);
+			tmp = &(*(option_list));
+			while (*tmp) {
+				g_strstrip(*tmp++);
 			}
+			g_free(server_options.msg);
 		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
-		}
-	}
-	else {
-		caldav_response = OK;
 	}
-	free_caldav_settings(&settings);
+	release_curl(&settings, curl);
+	return (option_list) ? option_list : NULL;
+}
+
+/**
+ * Function for adding a new event.
+ * @param object Appointment following ICal format (RFC2445). Receiver is
+ * responsible for freeing the memory.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_add_object(const char* object,
+				  const char* URL,
+				  runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, TRUE);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_add(session, object);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
@@ -177,48 +1330,15 @@ CALDAV_RESPONSE caldav_add_object(const char* object,
 CALDAV_RESPONSE caldav_delete_object(const char* object,
 				     const char* URL,
 				     runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	init_caldav_settings(&settings);
-	settings.file = g_strdup(object);
-	settings.ACTION = DELETE;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
-		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
-		}
-	}
-	else {
-		caldav_response = OK;
-	}
-	free_caldav_settings(&settings);
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_delete(session, object);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
@@ -234,48 +1354,15 @@ CALDAV_RESPONSE caldav_delete_object(const char* object,
 CALDAV_RESPONSE caldav_modify_object(const char* object,
 				     const char* URL,
 				     runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	init_caldav_settings(&settings);
-	settings.file = g_strdup(object);
-	settings.ACTION = MODIFY;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
-		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
-		}
-	}
-	else {
-		caldav_response = OK;
-	}
-	free_caldav_settings(&settings);
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_modify(session, object);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
@@ -297,55 +1384,20 @@ CALDAV_RESPONSE caldav_get_object(response *result,
 				  time_t end,
 				  const char* URL,
 				  runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	if (!result) {
-		result = malloc(sizeof(response *));
-		memset(result, '\0', sizeof(response *));
-	}
-	init_caldav_settings(&settings);
-	settings.ACTION = GET;
-	settings.start = start;
-	settings.end = end;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		result->msg = NULL;
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
-		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		if (result) {
+			result->msg = NULL;
+			result->len = 0;
 		}
+		return CONFLICT;
 	}
-	else {
-		result->msg = g_strdup(settings.file);
-		caldav_response = OK;
-	}
-	free_caldav_settings(&settings);
+	caldav_response = caldav_session_get(session, result, start, end);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
@@ -361,59 +1413,514 @@ CALDAV_RESPONSE caldav_get_object(response *result,
 CALDAV_RESPONSE caldav_getall_object(response* result,
 				     const char* URL,
 				     runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	if (!result) {
-		result = malloc(sizeof(response *));
-		memset(result, '\0', sizeof(response *));
-	}
-	init_caldav_settings(&settings);
-	settings.ACTION = GETALL;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		result->msg = NULL;
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
-		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		if (result) {
+			result->msg = NULL;
+			result->len = 0;
 		}
+		return CONFLICT;
 	}
-	else {
-		result->msg = g_strdup(settings.file);
-		caldav_response = OK;
+	caldav_response = caldav_session_getall(session, result);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for getting calendar objects by href (RFC4791 7.9). The hrefs
+ * are requested in REPORTs of debug_curl.multiget_chunk hrefs each.
+ * Hrefs unknown to the server are left out of the result.
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored. Clear it with caldav_free_objects().
+ * @param hrefs Array of paths or URLs of calendar object resources.
+ * @param count Number of hrefs.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_multiget_object(caldav_objects* result,
+				       const char** hrefs,
+				       int count,
+				       const char* URL,
+				       runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+	g_return_val_if_fail(result != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		result->objects = NULL;
+		result->count = 0;
+		return CONFLICT;
+	}
+	caldav_response = caldav_session_multiget(session, result, hrefs, count);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for getting all events from the collection together with the
+ * href and ETag of each, ready for caldav_modify_by_href() and
+ * caldav_delete_by_href().
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored sorted by href. Clear it with caldav_free_objects().
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_getall_objects(caldav_objects* result,
+				      const char* URL,
+				      runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+	g_return_val_if_fail(result != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		result->objects = NULL;
+		result->count = 0;
+		return CONFLICT;
+	}
+	caldav_response = caldav_session_getall_objects(session, result);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for listing the href and ETag of every object in the
+ * collection without fetching the objects. Only getetag is asked for
+ * in a PROPFIND of depth 1, which makes this the cheap way of finding
+ * out what changed before fetching with caldav_multiget_object().
+ * @param result A pointer to a caldav_etags where the entries are to be
+ * stored sorted by href. Clear it with caldav_free_etags().
+ * @param props 0 or CALDAV_ETAG_MODIFIED and/or CALDAV_ETAG_SIZE for
+ * also asking for getlastmodified and getcontentlength.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_getall_etags(caldav_etags* result,
+				    int props,
+				    const char* URL,
+				    runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+	g_return_val_if_fail(result != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		result->etags = NULL;
+		result->count = 0;
+		return CONFLICT;
+	}
+	caldav_response = caldav_session_getall_etags(session, result, props);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for getting all tasks from the collection together with the
+ * href and ETag of each. @see caldav_getall_objects
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored sorted by href. Clear it with caldav_free_objects().
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_tasks_getall_objects(caldav_objects* result,
+					    const char* URL,
+					    runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+	g_return_val_if_fail(result != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		result->objects = NULL;
+		result->count = 0;
+		return CONFLICT;
+	}
+	caldav_response = caldav_session_tasks_getall_objects(session, result);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for replacing an object already read from the server. The PUT
+ * goes straight to object->href and only succeeds if the stored object
+ * still has object->etag (If-Match), so no search is needed first.
+ * CONFLICT with error code 412 means it was changed by someone else.
+ * @param object href, etag of the stored version and the new data.
+ * On success etag is replaced by the new ETag, or NULL if the server did
+ * not send one. A NULL etag makes the write unconditional.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_modify_by_href(caldav_object* object,
+				      const char* URL,
+				      runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_modify_by_href(session, object);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for deleting an object already read from the server. The
+ * DELETE goes straight to object->href and only succeeds if the stored
+ * object still has object->etag (If-Match). @see caldav_modify_by_href
+ * @param object href and etag of the stored version. data is not used.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_delete_by_href(const caldav_object* object,
+				      const char* URL,
+				      runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_delete_by_href(session, object);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for taking an exclusive write lock on an object or on the
+ * whole collection. The lock is kept until it is released or times out,
+ * so any number of writes can be made under it. Pass it to writes in
+ * debug_curl.lock or with caldav_session_set_lock(). Writes then submit
+ * its token instead of taking and releasing a lock of their own.
+ * @param lock Where to store the lock. Release it with
+ * caldav_lock_release() or free it with caldav_free_lock().
+ * @param href Path of the object to lock or NULL to lock the collection
+ * and every object in it.
+ * @param timeout Seconds to ask for. 0 (zero) uses the default. The
+ * server may grant another timeout. @see caldav_lock
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, CONFLICT, LOCKED or NOTIMPLEMENTED.
+ * @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_lock_acquire(caldav_lock** lock,
+				    const char* href,
+				    int timeout,
+				    const char* URL,
+				    runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_lock_acquire(
+			session, lock, href, timeout);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for refreshing a lock before it times out.
+ * @param lock The lock. timeout and expires are updated.
+ * @param timeout Seconds to ask for. 0 (zero) asks for the current
+ * timeout again.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, CONFLICT or LOCKED. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_lock_refresh(caldav_lock* lock,
+				    int timeout,
+				    const char* URL,
+				    runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_lock_refresh(session, lock, timeout);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for releasing a lock. The lock is freed even if the server
+ * refused to release it, in which case it lasts until it times out.
+ * debug_curl.lock is reset to NULL if it is the lock.
+ * @param lock Address to a pointer to a caldav_lock.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_lock_release(caldav_lock** lock,
+				    const char* URL,
+				    runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if (info->options && lock && info->options->lock == *lock)
+		info->options->lock = NULL;
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_lock_release(session, lock);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for running a calendar-query and handing every object
+ * matching it to a callback as soon as it has been received.
+ * @param query A caldav_query.
+ * @param callback Function called for every calendar object resource.
+ * data only holds what was selected. @see caldav_query_select
+ * @param user_data Passed to callback.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_query_foreach(const caldav_query* query,
+				     caldav_object_callback callback,
+				     void* user_data,
+				     const char* URL,
+				     runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_query_foreach(
+			session, query, callback, user_data);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for running a calendar-query and returning the objects
+ * matching it with their href and ETag.
+ * @param result A pointer to caldav_objects where the objects are stored
+ * sorted by href. Free them with caldav_free_objects().
+ * @param query A caldav_query.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_query_objects(caldav_objects* result,
+				     const caldav_query* query,
+				     const char* URL,
+				     runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_query_objects(session, query, result);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for freeing a lock without releasing it on the server.
+ * @param lock Address to a pointer to a caldav_lock.
+ */
+void caldav_free_lock(caldav_lock** lock) {
+	if (! lock || ! *lock)
+		return;
+	g_free((*lock)->href);
+	g_free((*lock)->token);
+	g_free(*lock);
+	*lock = NULL;
+}
+
+/**
+ * Function for getting the changes to a collection since an earlier
+ * synchronization. Uses sync-collection (RFC6578) and falls back to
+ * comparing the collection CTag and the ETags of its objects on servers
+ * without it.
+ * @param changes A pointer to a caldav_changes where the changes are to be
+ * stored. Clear it with caldav_free_changes().
+ * @param token The token from the previous synchronization or NULL for
+ * the first one.
+ * @param known NULL or the objects the caller has, sorted by href. Only
+ * href and etag are used. Objects whose ETag did not change are left
+ * out and deletions can be detected when the server restarts the
+ * synchronization.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_sync_object(caldav_changes* changes,
+				   const char* token,
+				   const caldav_objects* known,
+				   const char* URL,
+				   runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+	g_return_val_if_fail(changes != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		memset(changes, 0, sizeof(caldav_changes));
+		return CONFLICT;
+	}
+	caldav_response = caldav_session_sync(session, changes, token, known);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for freeing the changes stored in a caldav_changes. The
+ * struct itself belongs to the caller.
+ * @param changes A pointer to a caldav_changes.
+ */
+void caldav_free_changes(caldav_changes* changes) {
+	caldav_objects changed;
+
+	if (! changes)
+		return;
+	changed.objects = changes->changed;
+	changed.count = changes->changed_count;
+	caldav_free_objects(&changed);
+	g_strfreev(changes->deleted);
+	g_free(changes->token);
+	memset(changes, 0, sizeof(caldav_changes));
+}
+
+static int compare_href(const void* key, const void* object) {
+	return strcmp((const char *) key, ((const caldav_object *) object)->href);
+}
+
+/**
+ * Function for looking up an object by href.
+ * @param objects The result of a call returning caldav_objects.
+ * @param href Path of the resource.
+ * @return The object or NULL if href is not in objects.
+ */
+const caldav_object* caldav_objects_lookup(const caldav_objects* objects,
+					   const char* href) {
+	g_return_val_if_fail(objects != NULL, NULL);
+	g_return_val_if_fail(href != NULL, NULL);
+
+	if (objects->count == 0)
+		return NULL;
+	return bsearch(href, objects->objects, objects->count,
+			sizeof(caldav_object), compare_href);
+}
+
+/**
+ * Function for freeing the objects stored in a caldav_objects. The
+ * struct itself belongs to the caller.
+ * @param objects A pointer to a caldav_objects.
+ */
+void caldav_free_objects(caldav_objects* objects) {
+	int i;
+
+	if (! objects)
+		return;
+	for (i = 0; i < objects->count; i++) {
+		g_free(objects->objects[i].href);
+		g_free(objects->objects[i].etag);
+		g_free(objects->objects[i].data);
+	}
+	g_free(objects->objects);
+	objects->objects = NULL;
+	objects->count = 0;
+}
+
+static int compare_etag_href(const void* key, const void* etag) {
+	return strcmp((const char *) key, ((const caldav_etag *) etag)->href);
+}
+
+/**
+ * Function for looking up an entity tag by href.
+ * @param etags The result of caldav_getall_etags().
+ * @param href Path of the resource.
+ * @return The entry or NULL if href is not in etags.
+ */
+const caldav_etag* caldav_etags_lookup(const caldav_etags* etags,
+				       const char* href) {
+	g_return_val_if_fail(etags != NULL, NULL);
+	g_return_val_if_fail(href != NULL, NULL);
+
+	if (etags->count == 0)
+		return NULL;
+	return bsearch(href, etags->etags, etags->count,
+			sizeof(caldav_etag), compare_etag_href);
+}
+
+/**
+ * Function for freeing the entries stored in a caldav_etags. The
+ * struct itself belongs to the caller.
+ * @param etags A pointer to a caldav_etags.
+ */
+void caldav_free_etags(caldav_etags* etags) {
+	int i;
+
+	if (! etags)
+		return;
+	for (i = 0; i < etags->count; i++) {
+		g_free(etags->etags[i].href);
+		g_free(etags->etags[i].etag);
 	}
-	free_caldav_settings(&settings);
-	return caldav_response;
+	g_free(etags->etags);
+	etags->etags = NULL;
+	etags->count = 0;
 }
 
 /**
  * Function for deleting a task.
- * @param object Appointment following ICal format (RFC2445). Receiver is
+ * @param object Task following ICal format (RFC2445). Receiver is
  * responsible for freeing the memory.
  * @param URL Defines CalDAV resource. Receiver is responsible for freeing
  * the memory. [http://][username[:password]@]host[:port]/url-path.
@@ -423,54 +1930,21 @@ CALDAV_RESPONSE caldav_getall_object(response* result,
 CALDAV_RESPONSE caldav_tasks_delete_object(const char* object,
 				     const char* URL,
 				     runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	init_caldav_settings(&settings);
-	settings.file = g_strdup(object);
-	settings.ACTION = DELETETASKS;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
-		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
-		}
-	}
-	else {
-		caldav_response = OK;
-	}
-	free_caldav_settings(&settings);
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_tasks_delete(session, object);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
 /**
  * Function for modifying a task.
- * @param object Appointment following ICal format (RFC2445). Receiver is
+ * @param object Task following ICal format (RFC2445). Receiver is
  * responsible for freeing the memory.
  * @param URL Defines CalDAV resource. Receiver is responsible for freeing
  * the memory. [http://][username[:password]@]host[:port]/url-path.
@@ -480,48 +1954,15 @@ CALDAV_RESPONSE caldav_tasks_delete_object(const char* object,
 CALDAV_RESPONSE caldav_tasks_modify_object(const char* object,
 				     const char* URL,
 				     runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	init_caldav_settings(&settings);
-	settings.file = g_strdup(object);
-	settings.ACTION = MODIFYTASKS;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
-		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
-		}
-	}
-	else {
-		caldav_response = OK;
-	}
-	free_caldav_settings(&settings);
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_tasks_modify(session, object);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
@@ -543,55 +1984,20 @@ CALDAV_RESPONSE caldav_tasks_get_object(response *result,
 				  time_t end,
 				  const char* URL,
 				  runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	if (!result) {
-		result = malloc(sizeof(response *));
-		memset(result, '\0', sizeof(response *));
-	}
-	init_caldav_settings(&settings);
-	settings.ACTION = GETTASKS;
-	settings.start = start;
-	settings.end = end;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		result->msg = NULL;
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
-		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		if (result) {
+			result->msg = NULL;
+			result->len = 0;
 		}
+		return CONFLICT;
 	}
-	else {
-		result->msg = g_strdup(settings.file);
-		caldav_response = OK;
-	}
-	free_caldav_settings(&settings);
+	caldav_response = caldav_session_tasks_get(session, result, start, end);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
@@ -607,53 +2013,145 @@ CALDAV_RESPONSE caldav_tasks_get_object(response *result,
 CALDAV_RESPONSE caldav_tasks_getall_object(response* result,
 				     const char* URL,
 				     runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	if (!result) {
-		result = malloc(sizeof(response *));
-		memset(result, '\0', sizeof(response *));
-	}
-	init_caldav_settings(&settings);
-	settings.ACTION = GETALLTASKS;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		result->msg = NULL;
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		if (result) {
+			result->msg = NULL;
+			result->len = 0;
 		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
-		}
-	}
-	else {
-		result->msg = g_strdup(settings.file);
-		caldav_response = OK;
+		return CONFLICT;
 	}
-	free_caldav_settings(&settings);
+	caldav_response = caldav_session_tasks_getall(session, result);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for streaming all events from the collection. The response is
+ * parsed while it arrives and every object is handed to callback, so
+ * memory use is bounded by the largest object instead of the collection.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_getall_foreach(const char* URL,
+				      runtime_info* info,
+				      caldav_object_callback callback,
+				      void* user_data) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_getall_foreach(session,
+			callback, user_data);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for streaming a collection of events determined by time range.
+ * @see caldav_getall_foreach
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_get_foreach(time_t start,
+				   time_t end,
+				   const char* URL,
+				   runtime_info* info,
+				   caldav_object_callback callback,
+				   void* user_data) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_get_foreach(session, start, end,
+			callback, user_data);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for streaming all tasks from the collection.
+ * @see caldav_getall_foreach
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_tasks_getall_foreach(const char* URL,
+					    runtime_info* info,
+					    caldav_object_callback callback,
+					    void* user_data) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_tasks_getall_foreach(session,
+			callback, user_data);
+	caldav_session_close(&session);
+	return caldav_response;
+}
+
+/**
+ * Function for streaming a collection of tasks determined by time range.
+ * @see caldav_getall_foreach
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_tasks_get_foreach(time_t start,
+					 time_t end,
+					 const char* URL,
+					 runtime_info* info,
+					 caldav_object_callback callback,
+					 void* user_data) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return CONFLICT;
+	caldav_response = caldav_session_tasks_get_foreach(session, start,
+			end, callback, user_data);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
@@ -669,53 +2167,20 @@ CALDAV_RESPONSE caldav_tasks_getall_object(response* result,
 CALDAV_RESPONSE caldav_get_displayname(response* result,
 				       const char* URL,
 				       runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	if (!result) {
-		result = malloc(sizeof(response *));
-		memset(result, '\0', sizeof(response *));
-	}
-	init_caldav_settings(&settings);
-	settings.ACTION = GETCALNAME;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		result->msg = NULL;
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
-		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		if (result) {
+			result->msg = NULL;
+			result->len = 0;
 		}
+		return CONFLICT;
 	}
-	else {
-		result->msg = g_strdup(settings.file);
-		caldav_response = OK;
-	}
-	free_caldav_settings(&settings);
+	caldav_response = caldav_session_get_displayname(session, result);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
@@ -728,42 +2193,16 @@ CALDAV_RESPONSE caldav_get_displayname(response* result,
  * detechted.
  */
 int caldav_enabled_resource(const char* URL, runtime_info* info) {
-	CURL* curl;
-	caldav_settings settings;
-	struct config_data data;
+	caldav_session* session;
+	int enabled;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	init_caldav_settings(&settings);
-
-	parse_url(&settings, URL);
-	curl = get_curl(&settings);
-	if (!curl) {
-		info->error->code = -1;
-		info->error->str = g_strdup("Could not initialize libcurl");
-		settings.file = NULL;
+	if ((session = caldav_session_open(URL, info)) == NULL)
 		return TRUE;
-	}
-
-	if (info->options->trace_ascii)
-		data.trace_ascii = 1;
-	else
-		data.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-
-	if (info->options->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	gboolean res = test_caldav_enabled(curl, &settings, info->error);
-	free_caldav_settings(&settings);
-	curl_easy_cleanup(curl);
-	return (res && (info->error->code == 0 || info->error->code == 200)) ? 1 : 0;
+	enabled = caldav_session_enabled_resource(session);
+	caldav_session_close(&session);
+	return enabled;
 }
 
 /**
@@ -784,58 +2223,102 @@ CALDAV_RESPONSE caldav_get_freebusy(response *result,
 				  time_t end,
 				  const char* URL,
 				  runtime_info* info) {
-	caldav_settings settings;
+	caldav_session* session;
 	CALDAV_RESPONSE caldav_response;
 
 	g_return_val_if_fail(info != NULL, TRUE);
 
-	init_runtime(info);
-	if (!result) {
-		result = malloc(sizeof(response *));
-		memset(result, '\0', sizeof(response *));
-	}
-	init_caldav_settings(&settings);
-	settings.ACTION = FREEBUSY;
-	settings.start = start;
-	settings.end = end;
-	if (info->options->debug)
-		settings.debug = TRUE;
-	else
-		settings.debug = FALSE;
-	if (info->options->trace_ascii)
-		settings.trace_ascii = 1;
-	else
-		settings.trace_ascii = 0;
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
-	parse_url(&settings, URL);
-	gboolean res = make_caldav_call(&settings, info);
-	if (res) {
-		result->msg = NULL;
-		if (info->error->code > 0) {
-			switch (info->error->code) {
-				case 403: caldav_response = FORBIDDEN; break;
-				case 409: caldav_response = CONFLICT; break;
-				case 423: caldav_response = LOCKED; break;
-				case 501: caldav_response = NOTIMPLEMENTED; break;
-				default: caldav_response = CONFLICT; break;
-			}
+	if ((session = caldav_session_open(URL, info)) == NULL) {
+		if (result) {
+			result->msg = NULL;
+			result->len = 0;
 		}
-		else {
-			/* fall-back to conflicting state */
-			caldav_response = CONFLICT;
-		}
-	}
-	else {
-		result->msg = g_strdup(settings.file);
-		caldav_response = OK;
+		return CONFLICT;
 	}
-	free_caldav_settings(&settings);
+	caldav_response = caldav_session_get_freebusy(session, result, start, end);
+	caldav_session_close(&session);
 	return caldav_response;
 }
 
+/**
+ * Function for getting the busy periods of many attendees at once. All
+ * attendees are asked for in one VFREEBUSY request POSTed to a scheduling
+ * outbox (RFC6638). Attendees the outbox cannot answer for, or all of them
+ * if there is no outbox or the server does not support scheduling, are
+ * looked up with free-busy-query REPORTs on their calendars, at most
+ * debug_curl.max_fanout at the same time.
+ * @param result An array of count caldav_availability, one per attendee.
+ * Clear it with caldav_free_availability().
+ * @param organizer Calendar user address of the user asking
+ * ("mailto:me@example.com").
+ * @param attendees Array of count calendar user addresses. A bare e-mail
+ * address is taken as a mailto: URI.
+ * @param calendars NULL or an array of count calendar collection URLs,
+ * one per attendee, to ask when the outbox cannot. An element may be
+ * NULL. Each carries its own credentials:
+ * [http://][username[:password]@]host[:port]/url-path.
+ * @param count Number of attendees.
+ * @param start Start of time range.
+ * @param end End of time range.
+ * @param URL NULL or the scheduling outbox of organizer.
+ * [http://][username[:password]@]host[:port]/url-path. See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return OK if every attendee was answered for, otherwise the status of
+ * the first one which was not. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_get_availability(caldav_availability* result,
+					const char* organizer,
+					const char** attendees,
+					const char** calendars,
+					int count,
+					time_t start,
+					time_t end,
+					const char* URL,
+					runtime_info* info) {
+	caldav_session* session;
+	CALDAV_RESPONSE caldav_response;
+
+	g_return_val_if_fail(info != NULL, CONFLICT);
+	g_return_val_if_fail(result != NULL || count <= 0, CONFLICT);
+
+	if (URL && (session = caldav_session_open(URL, info)) != NULL) {
+		caldav_response = caldav_session_get_availability(session, result,
+				organizer, attendees, calendars, count, start, end);
+		caldav_session_close(&session);
+		return caldav_response;
+	}
+	init_runtime(info);
+	reset_error(info->error);
+	if (count <= 0)
+		return OK;
+	availability_init(result, attendees, count);
+	availability_fanout(result, calendars, count, start, end, info);
+	return availability_status(result, count);
+}
+
+/**
+ * Function for freeing the content of an array of caldav_availability
+ * filled by caldav_get_availability(). The array itself belongs to the
+ * caller.
+ * @param result An array of caldav_availability.
+ * @param count Number of elements.
+ */
+void caldav_free_availability(caldav_availability* result, int count) {
+	int i;
+
+	if (! result)
+		return;
+	for (i = 0; i < count; i++) {
+		g_free(result[i].attendee);
+		g_free(result[i].request_status);
+		g_free(result[i].busy);
+		result[i].attendee = NULL;
+		result[i].request_status = NULL;
+		result[i].busy = NULL;
+		result[i].count = 0;
+	}
+}
+
 /**
  * Function which supports sending various options inside the library.
  * @param curl_options A struct debug_curl. See debug_curl.
@@ -881,45 +2364,99 @@ void caldav_free_error(caldav_error* lib_error) {
  * @result A list of available options or NULL in case of any error.
  */
 char** caldav_get_server_options(const char* URL, runtime_info* info) {
-	CURL* curl;
-	caldav_settings settings;
-	response server_options;
-	gchar** option_list = NULL;
-	gchar** tmp;
-	gboolean res = FALSE;
+	caldav_session* session;
+	gchar** option_list;
 
 	g_return_val_if_fail(info != NULL, NULL);
 
-	init_runtime(info);
-	tmp = option_list = NULL;
-	init_caldav_settings(&settings);
+	if ((session = caldav_session_open(URL, info)) == NULL)
+		return NULL;
+	option_list = caldav_session_get_server_options(session);
+	caldav_session_close(&session);
+	return option_list;
+}
+
+/**
+ * Function for forgetting cached capabilities (DAV classes and allowed
+ * methods) so the next call asks the server again.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738). If NULL all cached capabilities are forgotten.
+ */
+void caldav_flush_server_options(const char* URL) {
+	caldav_settings settings;
 
+	if (! URL) {
+		caldav_invalidate_capabilities(NULL);
+		return;
+	}
+	init_caldav_settings(&settings);
 	parse_url(&settings, URL);
-	curl = get_curl(&settings);
-	if (!curl) {
-		info->error->code = -1;
-		info->error->str = g_strdup("Could not initialize libcurl");
-		settings.file = NULL;
+	caldav_invalidate_capabilities(&settings);
+	free_caldav_settings(&settings);
+}
+
+static void share_lock(CURL* curl, curl_lock_data data,
+		       curl_lock_access access, void* userptr) {
+	caldav_share* share = (caldav_share *) userptr;
+
+	g_mutex_lock(&share->locks[data]);
+}
+
+static void share_unlock(CURL* curl, curl_lock_data data, void* userptr) {
+	caldav_share* share = (caldav_share *) userptr;
+
+	g_mutex_unlock(&share->locks[data]);
+}
+
+/**
+ * Function for creating a cache which lets sessions in different threads
+ * reuse DNS results, TLS sessions and open connections. Assign it to
+ * debug_curl.share before opening the sessions.
+ * @return A new caldav_share or NULL in case of error.
+ */
+caldav_share* caldav_share_new(void) {
+	caldav_share* share;
+	int i;
+
+	init_curl_global();
+	share = g_new0(caldav_share, 1);
+	share->handle = curl_share_init();
+	if (! share->handle) {
+		g_free(share);
 		return NULL;
 	}
-	if (info->options->use_locking)
-		settings.use_locking = 1;
-	else
-		settings.use_locking = 0;
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		g_mutex_init(&share->locks[i]);
+	curl_share_setopt(share->handle, CURLSHOPT_LOCKFUNC, share_lock);
+	curl_share_setopt(share->handle, CURLSHOPT_UNLOCKFUNC, share_unlock);
+	curl_share_setopt(share->handle, CURLSHOPT_USERDATA, share);
+	curl_share_setopt(share->handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share->handle,
+			CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+	curl_share_setopt(share->handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+	return share;
+}
 
-	res = caldav_getoptions(curl, &settings, &server_options, info->error, FALSE);
-	if (res) {
-		if (server_options.msg) {
-			option_list = g_strsplit(server_options.msg, ", ", 0);
-			tmp = &(*(option_list));
-			while (*tmp) {
-				g_strstrip(*tmp++);
-			}
-		}
+/**
+ * Function for freeing a caldav_share. Every session using the share
+ * must be closed first.
+ * @param share Address to a pointer to a caldav_share.
+ */
+void caldav_share_free(caldav_share** share) {
+	caldav_share* s;
+	int i;
+
+	if (*share) {
+		s = *share;
+		curl_share_cleanup(s->handle);
+		for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+			g_mutex_clear(&s->locks[i]);
+		g_free(s);
+		*share = s = NULL;
 	}
-	free_caldav_settings(&settings);
-	curl_easy_cleanup(curl);
-	return (option_list) ? option_list : NULL;
 }
 
 /**
@@ -932,6 +2469,7 @@ runtime_info* caldav_get_runtime_info() {
 	rt_info = g_new0(runtime_info, 1);
 	rt_info->error = g_new0(caldav_error, 1);
 	rt_info->options = g_new0(debug_curl, 1);
+	rt_info->stats = g_new0(caldav_stats, 1);
 	
 	return rt_info;
 }
@@ -959,11 +2497,37 @@ void caldav_free_runtime_info(runtime_info** info) {
 		    g_free(ri->options);
 		    ri->options = NULL;
 		}
+		g_free(ri->stats);
+		ri->stats = NULL;
 		g_free(ri);
 		*info = ri = NULL;
     }
 }
 
+/**
+ * Function for reading the traffic and timing counted for a runtime_info.
+ * Safe to call while other threads make calls with it.
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param stats A pointer to a caldav_stats receiving a copy.
+ */
+void caldav_get_stats(runtime_info* info, caldav_stats* stats) {
+	g_return_if_fail(info != NULL);
+	g_return_if_fail(stats != NULL);
+
+	caldav_stats_read(info->stats, stats);
+}
+
+/**
+ * Function for setting the traffic and timing counted for a runtime_info
+ * to zero.
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ */
+void caldav_reset_stats(runtime_info* info) {
+	g_return_if_fail(info != NULL);
+
+	caldav_stats_clear(info->stats);
+}
+
 /**
  * Function for getting an initialized response structure
  * @return response. @see _response
@@ -44,6 +44,178 @@
 #define __CALDAV_H__
 
 #include <time.h>
+#include <sys/select.h>
+
+/**
+ * @typedef struct _caldav_share caldav_share
+ * An opaque cache of DNS results, TLS sessions and connections which
+ * can be shared by sessions in any number of threads.
+ * @see caldav_share_new
+ */
+typedef struct _caldav_share caldav_share;
+
+/**
+ * @typedef struct _caldav_cache caldav_cache
+ * An opaque on-disk cache of calendar objects and their ETags.
+ * @see caldav_cache_open
+ */
+typedef struct _caldav_cache caldav_cache;
+
+/**
+ * @typedef struct _caldav_lock caldav_lock
+ * Pointer to a _caldav_lock structure
+ * @see caldav_lock_acquire
+ */
+typedef struct _caldav_lock caldav_lock;
+
+/**
+ * @enum CALDAV_ACTION specifies supported CalDAV actions.
+ * UNKNOWN. An unknown action.
+ * ADD. Add a CalDAV calendar object.
+ * DELETE. Delete a CalDAV calendar object.
+ * MODIFY. Modify a CalDAV calendar object.
+ * GET. Get one or more CalDAV calendar object(s).
+ * GETALL. Get all CalDAV calendar objects.
+ */
+typedef enum {
+	UNKNOWN,
+	ADD,
+	DELETE,
+	FREEBUSY,
+	MODIFY,
+	GET,
+	GETALL,
+	GETCALNAME,
+	ISCALDAV,
+	OPTIONS,
+	DELETETASKS,
+	MODIFYTASKS,
+	GETTASKS,
+	GETALLTASKS,
+} CALDAV_ACTION;
+
+/** Number of CALDAV_ACTION values, the size of caldav_stats.actions */
+#define CALDAV_ACTIONS (GETALLTASKS + 1)
+
+/**
+ * Number of latency histogram buckets. Bucket 0 counts exchanges taking
+ * less than 1 millisecond, bucket i those taking from 2^(i-1) up to 2^i
+ * milliseconds and the last one all slower ones.
+ */
+#define CALDAV_LATENCY_BUCKETS 16
+
+/**
+ * @typedef struct caldav_exchange
+ * Timing and traffic of one HTTP exchange. Times are microseconds from
+ * the start of the exchange, the way libcurl measures them.
+ * @see caldav_exchange_callback
+ */
+typedef struct {
+	const char* method; /** @var const char* method
+						 * The HTTP method or NULL with libcurl before 7.72
+						 */
+	CALDAV_ACTION action; /** @var CALDAV_ACTION action
+						   * The action the exchange is part of
+						   */
+	long status; /** @var long status
+				  * HTTP status or 0 (zero) if no answer arrived
+				  */
+	int result; /** @var int result
+				 * The libcurl result, 0 (zero) on success
+				 */
+	long long dns; /** @var long long dns
+					* Until the host name was resolved
+					*/
+	long long connect; /** @var long long connect
+						* Until the TCP connection was made
+						*/
+	long long tls; /** @var long long tls
+					* Until the TLS handshake was done, 0 on http
+					*/
+	long long ttfb; /** @var long long ttfb
+					 * Until the first response byte arrived
+					 */
+	long long total; /** @var long long total
+					  * Until the exchange was complete
+					  */
+	long long sent; /** @var long long sent
+					 * Request body bytes as sent
+					 */
+	long long received; /** @var long long received
+						 * Response body bytes as received
+						 */
+	int reused; /** @var int reused
+				 * 1 if an open connection was reused, 0 otherwise
+				 */
+	long long parse; /** @var long long parse
+					  * Microseconds spent parsing the response while it
+					  * arrived. Parsing after the exchange only shows in
+					  * caldav_action_stats.parse
+					  */
+} caldav_exchange;
+
+/**
+ * @typedef caldav_exchange_callback
+ * Called after every HTTP exchange, from the thread which made it.
+ * @param exchange The exchange. Only valid during the call.
+ * @param user_data The exchange_data of the debug_curl.
+ */
+typedef void (*caldav_exchange_callback)(const caldav_exchange* exchange,
+					 void* user_data);
+
+/**
+ * Trace levels. A trace_level lets through its own events and those of
+ * the levels below it.
+ */
+#define CALDAV_TRACE_INFO	1	/* libcurl's informational text */
+#define CALDAV_TRACE_HEADERS	2	/* plus request and response headers */
+#define CALDAV_TRACE_DATA	3	/* plus request and response bodies */
+#define CALDAV_TRACE_SSL	4	/* plus raw TLS records */
+
+/**
+ * Ways of naming the resource a new object is stored at.
+ */
+#define CALDAV_NAMING_MD5	0	/* libcaldav-<MD5 of the object>.ics */
+#define CALDAV_NAMING_UID	1	/* <UID, percent-encoded>.ics */
+#define CALDAV_NAMING_HASH	2	/* libcaldav-<hash of its start>.ics */
+
+/**
+ * @typedef struct caldav_trace
+ * One event of the protocol trace, handed over as the whole buffer
+ * libcurl saw instead of byte by byte.
+ * @see caldav_trace_callback
+ */
+typedef struct {
+	int level; /** @var int level
+				* One of CALDAV_TRACE_INFO to CALDAV_TRACE_SSL
+				*/
+	int outgoing; /** @var int outgoing
+				   * 1 for data sent to the server, 0 otherwise
+				   */
+	const char* data; /** @var const char* data
+					   * The event, not 0 terminated. Redacted if
+					   * trace_redact is set
+					   */
+	size_t size; /** @var size_t size
+				  * Bytes in data
+				  */
+	CALDAV_ACTION action; /** @var CALDAV_ACTION action
+						   * The action the event is part of
+						   */
+	unsigned long request; /** @var unsigned long request
+							* Number of the traced request, the same for
+							* all its events
+							*/
+} caldav_trace;
+
+/**
+ * @typedef caldav_trace_callback
+ * Called for every traced event, from the thread making the request.
+ * @param trace The event. Only valid during the call.
+ * @param user_data The trace_data of the debug_curl.
+ */
+typedef void (*caldav_trace_callback)(const caldav_trace* trace,
+				      void* user_data);
 
 /* For debug purposes */
 /**
@@ -60,6 +232,129 @@ typedef struct {
   int		verify_ssl_certificate;
   int		use_locking;
   char*		custom_cacert; 
+  int		capability_ttl; /** @var int capability_ttl
+						  * Seconds to trust a cached OPTIONS answer.
+						  * 0 uses the default, < 0 disables the cache
+						  */
+  caldav_share*	share;	/** @var caldav_share* share
+						  * NULL or a cache shared with other sessions.
+						  * Must outlive every session using it
+						  */
+  int		max_connections; /** @var int max_connections
+						  * Parallel connections per host for batch calls.
+						  * 0 uses the default
+						  */
+  int		max_streams; /** @var int max_streams
+						  * Requests in flight per connection for batch
+						  * calls, multiplexed as HTTP/2 streams where the
+						  * server allows. 0 uses the default
+						  */
+  int		max_fanout; /** @var int max_fanout
+						  * Collections fetched at the same time by
+						  * caldav_fanout(). 0 uses the default
+						  */
+  int		http2;	/** @var int http2
+						  * Negotiate HTTP/2 with ALPN on https and fall back
+						  * to HTTP/1.1 keep-alive. 0 uses the default which
+						  * is on, < 0 sticks to HTTP/1.1
+						  */
+  int		multiget_chunk; /** @var int multiget_chunk
+						  * Number of hrefs asked for per multiget REPORT.
+						  * 0 uses the default
+						  */
+  caldav_cache*	cache;	/** @var caldav_cache* cache
+						  * NULL or a cache revalidated instead of fetching
+						  * whole collections. Must outlive every session
+						  * using it
+						  */
+  caldav_lock*	lock;	/** @var caldav_lock* lock
+						  * NULL or a lock held by the caller. Writes send
+						  * its token instead of taking a LOCK of their own
+						  */
+  int		compression; /** @var int compression
+						  * Ask for responses compressed with any encoding
+						  * libcurl decodes. 0 uses the default which is
+						  * on, < 0 disables it
+						  */
+  int		compress_uploads; /** @var int compress_uploads
+						  * PUT bodies of at least this many bytes are sent
+						  * gzip compressed to servers listing gzip in the
+						  * Accept-Encoding of their OPTIONS answer. 0 never
+						  */
+  int		naming; /** @var int naming
+						  * How new objects are named, one of
+						  * CALDAV_NAMING_MD5 to CALDAV_NAMING_HASH. 0 hashes
+						  * the whole object. An object without a UID gets
+						  * one made from the hash, CALDAV_NAMING_UID then
+						  * falls back to CALDAV_NAMING_HASH
+						  */
+  int		connect_timeout; /** @var int connect_timeout
+						  * Seconds to wait for a connection. 0 uses the
+						  * default, < 0 leaves it to libcurl
+						  */
+  int		timeout; /** @var int timeout
+						  * Seconds a request may take as a whole. 0 never
+						  * times out
+						  */
+  int		low_speed_time; /** @var int low_speed_time
+						  * Seconds a transfer may stall below
+						  * CALDAV_LOW_SPEED_LIMIT bytes a second. 0 uses
+						  * the default, < 0 waits forever
+						  */
+  int		retries; /** @var int retries
+						  * Times an OPTIONS, PROPFIND, REPORT or GET is
+						  * repeated after a 503, 429 or a connection which
+						  * failed before any answer. 0 uses the default,
+						  * < 0 never repeats
+						  */
+  int		breaker; /** @var int breaker
+						  * Failures in a row after which requests to a host
+						  * are refused for CALDAV_BREAKER_OPEN seconds. 0
+						  * uses the default, < 0 never refuses
+						  */
+  int		hedge;	/** @var int hedge
+						  * Milliseconds after which a read of the
+						  * asynchronous, batch and fan-out calls still
+						  * running, and slower than 95% of the reads before
+						  * it, is sent a second time. The first answer wins.
+						  * 0 never
+						  */
+  caldav_exchange_callback exchange; /** @var caldav_exchange_callback exchange
+						  * NULL or called after every HTTP exchange
+						  */
+  void*		exchange_data; /** @var void* exchange_data
+						  * Passed to exchange
+						  */
+  caldav_trace_callback trace; /** @var caldav_trace_callback trace
+						  * NULL to write the trace to stderr while debug is
+						  * set, otherwise called with every traced event
+						  * whether debug is set or not
+						  */
+  void*		trace_data; /** @var void* trace_data
+						  * Passed to trace
+						  */
+  int		trace_level; /** @var int trace_level
+						  * Highest CALDAV_TRACE_* level traced. 0 uses
+						  * CALDAV_TRACE_DATA
+						  */
+  int		trace_sample; /** @var int trace_sample
+						  * Trace one request in this many. 0 or 1 traces
+						  * every request
+						  */
+  int		trace_redact; /** @var int trace_redact
+						  * 1 replaces credentials and cookies in headers
+						  * and the content of bodies by their size
+						  */
+  int		cache_ttl; /** @var int cache_ttl
+						  * Time-range reads and free/busy queries with a
+						  * cache attached synchronize the collection, one
+						  * sync-token or CTag request when nothing
+						  * changed, and answer from the cache. A positive
+						  * value skips that for as many seconds after a
+						  * synchronization, hiding changes made meanwhile
+						  * by others or by writes answered without an
+						  * ETag. < 0 sends such reads to the server
+						  */
 } debug_curl;
 
 /**
@@ -80,8 +375,81 @@ struct _caldav_error {
 	char* str; /** @var char* str
 				* For storing human readable error message
 				*/
+	long retry_after; /** @var long retry_after
+				* Seconds the server asked to wait before trying
+				* again or 0 (zero). Set along with UNAVAILABLE
+				*/
 };
 
+/**
+ * @typedef struct caldav_action_stats
+ * Totals of the HTTP exchanges made for one CALDAV_ACTION. Exchanges of
+ * calls without an action of their own count as UNKNOWN.
+ */
+typedef struct {
+	long long requests; /** @var long long requests
+						 * Number of HTTP exchanges
+						 */
+	long long failures; /** @var long long failures
+						 * Exchanges which failed or were answered with
+						 * a status of 400 or above
+						 */
+	long long sent; /** @var long long sent
+					 * Request body bytes as sent
+					 */
+	long long received; /** @var long long received
+						 * Response body bytes as received
+						 */
+	long long total; /** @var long long total
+					  * Microseconds spent in exchanges
+					  */
+	long long parse; /** @var long long parse
+					  * Microseconds spent parsing responses
+					  */
+	long long latency[CALDAV_LATENCY_BUCKETS]; /** @var long long latency
+					  * Histogram of the exchange times.
+					  * @see CALDAV_LATENCY_BUCKETS
+					  */
+	long long arena_allocs; /** @var long long arena_allocs
+							 * Transient strings allocated from the
+							 * per-thread arena
+							 */
+	long long arena_bytes; /** @var long long arena_bytes
+							* Bytes of those strings
+							*/
+	long long arena_blocks; /** @var long long arena_blocks
+							 * Blocks the arena took from the heap for
+							 * them
+							 */
+} caldav_action_stats;
+
+/**
+ * @typedef struct caldav_stats
+ * A struct counting the traffic and timing of every call made with a
+ * runtime_info
+ * @see caldav_get_stats
+ */
+typedef struct {
+	long long requests; /** @var long long requests
+						 * Number of HTTP exchanges
+						 */
+	long long sent; /** @var long long sent
+					 * Request body bytes before compression
+					 */
+	long long sent_wire; /** @var long long sent_wire
+						  * Request body bytes as sent
+						  */
+	long long received; /** @var long long received
+						 * Response body bytes after decoding
+						 */
+	long long received_wire; /** @var long long received_wire
+							  * Response body bytes as received
+							  */
+	caldav_action_stats actions[CALDAV_ACTIONS]; /** @var actions
+							  * Totals per CALDAV_ACTION
+							  */
+} caldav_stats;
+
 /**
  * @typedef struct runtime_info
  * Pointer to a runtime structure holding debug and error information
@@ -89,6 +457,7 @@ struct _caldav_error {
 typedef struct {
     caldav_error*   error;
     debug_curl*	    options;
+    caldav_stats*   stats;
 } runtime_info;
 
 /* CalDAV is defined in RFC4791 */
@@ -108,33 +477,179 @@ struct _response {
 	char* msg; /** @var char* msg
 				* String for storing response
 				*/
+	size_t len; /** @var size_t len
+				 * Length of msg in bytes without the terminating zero
+				 */
 };
 
 /**
- * @enum CALDAV_ACTION specifies supported CalDAV actions.
- * UNKNOWN. An unknown action.
- * ADD. Add a CalDAV calendar object.
- * DELETE. Delete a CalDAV calendar object.
- * MODIFY. Modify a CalDAV calendar object.
- * GET. Get one or more CalDAV calendar object(s).
- * GETALL. Get all CalDAV calendar objects.
+ * @typedef struct _caldav_object caldav_object
+ * Pointer to a _caldav_object structure
  */
-typedef enum {
-	UNKNOWN,
-	ADD,
-	DELETE,
-	FREEBUSY,
-	MODIFY,
-	GET,
-	GETALL,
-	GETCALNAME,
-	ISCALDAV,
-	OPTIONS,
-	DELETETASKS,
-	MODIFYTASKS,
-	GETTASKS,
-	GETALLTASKS,
-} CALDAV_ACTION;
+typedef struct _caldav_object caldav_object;
+
+/**
+ * @struct _caldav_object
+ * A calendar object resource as stored on the server
+ */
+struct _caldav_object {
+	char* href; /** @var char* href
+				 * Path of the resource on the server
+				 */
+	char* etag; /** @var char* etag
+				 * Entity tag of the stored version
+				 */
+	char* data; /** @var char* data
+				 * The calendar object following ICal format (RFC2445)
+				 */
+};
+
+/**
+ * @typedef struct _caldav_objects caldav_objects
+ * Pointer to a _caldav_objects structure
+ */
+typedef struct _caldav_objects caldav_objects;
+
+/**
+ * @struct _caldav_objects
+ * A struct used for returning calendar objects sorted by href.
+ * @see caldav_objects_lookup
+ */
+struct _caldav_objects {
+	caldav_object* objects; /** @var caldav_object* objects
+							 * Array of count objects
+							 */
+	int count; /** @var int count
+				* Number of objects
+				*/
+};
+
+/**
+ * @typedef struct _caldav_etag caldav_etag
+ * Pointer to a _caldav_etag structure
+ */
+typedef struct _caldav_etag caldav_etag;
+
+/**
+ * @struct _caldav_etag
+ * The href and entity tag of a calendar object resource without its
+ * content. @see caldav_getall_etags
+ */
+struct _caldav_etag {
+	char* href; /** @var char* href
+				 * Path of the resource on the server
+				 */
+	char* etag; /** @var char* etag
+				 * Entity tag of the stored version
+				 */
+	time_t modified; /** @var time_t modified
+					  * Last modification. 0 unless asked for
+					  * with CALDAV_ETAG_MODIFIED or unknown
+					  */
+	long size; /** @var long size
+				* Length of the resource. -1 unless asked for with
+				* CALDAV_ETAG_SIZE or unknown
+				*/
+};
+
+/**
+ * @typedef struct _caldav_etags caldav_etags
+ * Pointer to a _caldav_etags structure
+ */
+typedef struct _caldav_etags caldav_etags;
+
+/**
+ * @struct _caldav_etags
+ * A struct used for returning the entity tags of a collection sorted by
+ * href. @see caldav_etags_lookup
+ */
+struct _caldav_etags {
+	caldav_etag* etags; /** @var caldav_etag* etags
+						 * Array of count entries
+						 */
+	int count; /** @var int count
+				* Number of entries
+				*/
+};
+
+/** Also ask caldav_getall_etags for getlastmodified */
+#define CALDAV_ETAG_MODIFIED 1
+/** Also ask caldav_getall_etags for getcontentlength */
+#define CALDAV_ETAG_SIZE 2
+
+/**
+ * @typedef struct _caldav_changes caldav_changes
+ * Pointer to a _caldav_changes structure
+ */
+typedef struct _caldav_changes caldav_changes;
+
+/**
+ * @struct _caldav_changes
+ * A struct used for returning the changes to a collection since an
+ * earlier synchronization. @see caldav_sync_object
+ */
+struct _caldav_changes {
+	caldav_object* changed; /** @var caldav_object* changed
+							 * New or changed objects sorted by href. Only
+							 * href and etag are set
+							 */
+	int changed_count; /** @var int changed_count
+						* Number of changed objects
+						*/
+	char** deleted; /** @var char** deleted
+					 * NULL terminated list of hrefs of deleted objects
+					 */
+	int deleted_count; /** @var int deleted_count
+						* Number of deleted hrefs
+						*/
+	char* token; /** @var char* token
+				  * Token to pass to the next synchronization
+				  */
+	int full; /** @var int full
+			   * 1 if changed lists every object in the collection and
+			   * objects missing from it must be considered deleted
+			   */
+	int partial; /** @var int partial
+				  * 1 if the server had more changes than were asked
+				  * for. token is the old one and nothing may be
+				  * taken as deleted for not being listed
+				  */
+};
+
+/**
+ * @struct _caldav_lock
+ * An exclusive write lock (RFC4918) held on a calendar object resource or
+ * on a whole collection until it is released or times out.
+ */
+struct _caldav_lock {
+	char* href; /** @var char* href
+				 * Path of the locked resource or collection
+				 */
+	char* token; /** @var char* token
+				  * The Lock-Token including the angle brackets
+				  */
+	int timeout; /** @var int timeout
+				  * Seconds granted by the server. 0 if infinite
+				  */
+	time_t expires; /** @var time_t expires
+					 * When the lock runs out unless refreshed.
+					 * 0 if never
+					 */
+};
+
+/**
+ * @typedef struct _caldav_query caldav_query
+ * An opaque calendar-query (RFC4791 7.8) letting the server filter the
+ * objects and trim what is returned of them. @see caldav_query_new
+ */
+typedef struct _caldav_query caldav_query;
+
+/**
+ * @typedef struct _caldav_filter caldav_filter
+ * An opaque comp-filter, prop-filter or param-filter of a caldav_query.
+ * Filters belong to their query. @see caldav_query_filter
+ */
+typedef struct _caldav_filter caldav_filter;
 
 /**
  * @enum CALDAV_RESPONSE specifies CalDAV error states.
@@ -143,15 +658,130 @@ typedef enum {
  * CONFLICT (HTTP 409). Conflict between current state of CalDAV collection
  * and request. Client must solve the conflict and then resend request.
  * LOCKED (HTTP 423). Locking failed.
+ * UNAVAILABLE (HTTP 503, 429). Server busy, down or not answering in time.
+ * Repeat the request later.
  */
 typedef enum {
 	OK,
 	FORBIDDEN,
 	CONFLICT,
 	LOCKED,
-	NOTIMPLEMENTED
+	NOTIMPLEMENTED,
+	UNAVAILABLE
 } CALDAV_RESPONSE;
 
+/** FBTYPE=BUSY, also used for types not known to the library */
+#define CALDAV_BUSY 0
+/** FBTYPE=BUSY-UNAVAILABLE */
+#define CALDAV_BUSY_UNAVAILABLE 1
+/** FBTYPE=BUSY-TENTATIVE */
+#define CALDAV_BUSY_TENTATIVE 2
+
+/**
+ * @typedef struct _caldav_busy caldav_busy
+ * Pointer to a _caldav_busy structure
+ */
+typedef struct _caldav_busy caldav_busy;
+
+/**
+ * @struct _caldav_busy
+ * A period a calendar user is not free. Periods marked free are left out.
+ */
+struct _caldav_busy {
+	time_t start; /** @var time_t start
+				   * Start of the period
+				   */
+	time_t end; /** @var time_t end
+				 * End of the period, not included
+				 */
+	int type; /** @var int type
+			   * CALDAV_BUSY, CALDAV_BUSY_UNAVAILABLE or
+			   * CALDAV_BUSY_TENTATIVE
+			   */
+};
+
+/**
+ * @typedef struct _caldav_availability caldav_availability
+ * Pointer to a _caldav_availability structure
+ */
+typedef struct _caldav_availability caldav_availability;
+
+/**
+ * @struct _caldav_availability
+ * The busy periods of one attendee. @see caldav_get_availability
+ */
+struct _caldav_availability {
+	char* attendee; /** @var char* attendee
+					 * Calendar user address as asked for
+					 */
+	CALDAV_RESPONSE status; /** @var CALDAV_RESPONSE status
+							 * OK if busy lists every period the
+							 * attendee is not free
+							 */
+	char* request_status; /** @var char* request_status
+						   * REQUEST-STATUS the scheduling outbox
+						   * answered for the attendee ("2.0;Success")
+						   * or NULL if its calendar was asked
+						   */
+	caldav_busy* busy; /** @var caldav_busy* busy
+						* Array of count periods sorted by start
+						*/
+	int count; /** @var int count
+				* Number of periods
+				*/
+};
+
+
+/**
+ * @typedef struct _caldav_session caldav_session
+ * An opaque handle to a CalDAV collection. A session keeps one libcurl
+ * handle, and with it the open connection, between calls. A session
+ * must only be used by one thread at a time.
+ * @see caldav_session_open
+ */
+typedef struct _caldav_session caldav_session;
+
+/**
+ * @typedef struct _caldav_async caldav_async
+ * An opaque engine running any number of CalDAV operations from one
+ * thread without blocking. @see caldav_async_new
+ */
+typedef struct _caldav_async caldav_async;
+
+/**
+ * @typedef caldav_async_callback
+ * Called once for every operation started with caldav_async_submit().
+ * result and error are owned by the library and only valid during the
+ * call. The callback may keep result->msg by setting it to NULL. It may
+ * start new operations but must not free the engine.
+ */
+typedef void (*caldav_async_callback)(CALDAV_RESPONSE status,
+				      response* result,
+				      caldav_error* error,
+				      void* user_data);
+
+/**
+ * @typedef caldav_fanout_callback
+ * Called by caldav_fanout() once for every collection as soon as it is
+ * done. index is the position of the collection in the URLs passed. The
+ * rest is as for caldav_async_callback.
+ */
+typedef void (*caldav_fanout_callback)(int index,
+				       CALDAV_RESPONSE status,
+				       response* result,
+				       caldav_error* error,
+				       void* user_data);
+
+/**
+ * @typedef caldav_object_callback
+ * Called by the streaming getters once for every calendar object resource
+ * as soon as it has been received. object and its strings are owned by
+ * the library and only valid during the call. data is the complete
+ * VCALENDAR stored at href, including its own VTIMEZONE.
+ * Return 0 (zero) to continue or anything else to stop the transfer.
+ */
+typedef int (*caldav_object_callback)(const caldav_object* object,
+				      void* user_data);
 
 #ifndef __CALDAV_USERAGENT
 #define __CALDAV_USERAGENT "libcurl-agent/0.1"
@@ -292,6 +922,83 @@ CALDAV_RESPONSE caldav_tasks_getall_object(response* result,
 				     const char* URL,
 				     runtime_info* info);
 
+/**
+ * Function for streaming all events from the collection. The response is
+ * parsed while it arrives and every object is handed to callback, so
+ * memory use is bounded by the largest object instead of the collection.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_getall_foreach(const char* URL,
+				      runtime_info* info,
+				      caldav_object_callback callback,
+				      void* user_data);
+
+/**
+ * Function for streaming a collection of events determined by time range.
+ * @see caldav_getall_foreach
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_get_foreach(time_t start,
+				   time_t end,
+				   const char* URL,
+				   runtime_info* info,
+				   caldav_object_callback callback,
+				   void* user_data);
+
+/**
+ * Function for streaming all tasks from the collection.
+ * @see caldav_getall_foreach
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_tasks_getall_foreach(const char* URL,
+					    runtime_info* info,
+					    caldav_object_callback callback,
+					    void* user_data);
+
+/**
+ * Function for streaming a collection of tasks determined by time range.
+ * @see caldav_getall_foreach
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_tasks_get_foreach(time_t start,
+					 time_t end,
+					 const char* URL,
+					 runtime_info* info,
+					 caldav_object_callback callback,
+					 void* user_data);
+
 /**
  * Function for getting the stored display name for the collection.
  * @param result A pointer to struct _response where the result is to stored.
@@ -336,60 +1043,1213 @@ CALDAV_RESPONSE caldav_get_freebusy(response *result,
 				  					const char* URL,
 				  					runtime_info* info);
 
-/** 
- * @deprecated Always returns an initialized empty caldav_error
- * Function to call in case of errors.
- * Caller provides a pointer to a local caldav_error structure.
- * Caldav_get_error will initialize pointer if NULL.
- * Caller is responsible for freeing returned memory.
- * After the first call the internal error buffer is reset.
- * @param lib_error A pointer to a struct _caldav_error. @see _caldav_error
- * @return An initialized caldav_error pointer to memory where error
- * messages can be found from the last call to the library.
+/**
+ * Function for getting the busy periods of many attendees at once. All
+ * attendees are asked for in one VFREEBUSY request POSTed to a scheduling
+ * outbox (RFC6638). Attendees the outbox cannot answer for, or all of them
+ * if there is no outbox or the server does not support scheduling, are
+ * looked up with free-busy-query REPORTs on their calendars, at most
+ * debug_curl.max_fanout at the same time.
+ * @param result An array of count caldav_availability, one per attendee.
+ * Clear it with caldav_free_availability().
+ * @param organizer Calendar user address of the user asking
+ * ("mailto:me@example.com").
+ * @param attendees Array of count calendar user addresses. A bare e-mail
+ * address is taken as a mailto: URI.
+ * @param calendars NULL or an array of count calendar collection URLs,
+ * one per attendee, to ask when the outbox cannot. An element may be
+ * NULL. Each carries its own credentials:
+ * [http://][username[:password]@]host[:port]/url-path.
+ * @param count Number of attendees.
+ * @param start Start of time range.
+ * @param end End of time range.
+ * @param URL NULL or the scheduling outbox of organizer.
+ * [http://][username[:password]@]host[:port]/url-path. See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return OK if every attendee was answered for, otherwise the status of
+ * the first one which was not. @see CALDAV_RESPONSE
  */
-caldav_error* caldav_get_error(caldav_error* lib_error);
+CALDAV_RESPONSE caldav_get_availability(caldav_availability* result,
+					const char* organizer,
+					const char** attendees,
+					const char** calendars,
+					int count,
+					time_t start,
+					time_t end,
+					const char* URL,
+					runtime_info* info);
 
-/** 
- * Function for freeing memory for a previous initialization of a
- * caldav_error. @see caldav_get_error()
- * Caller provides a pointer to a local caldav_error structure.
- * @param lib_error A pointer to a struct _caldav_error. @see _caldav_error
+/**
+ * Function for freeing the content of an array of caldav_availability
+ * filled by caldav_get_availability(). The array itself belongs to the
+ * caller.
+ * @param result An array of caldav_availability.
+ * @param count Number of elements.
  */
-void caldav_free_error(caldav_error* lib_error);
-
-/* Setting various options in library */
+void caldav_free_availability(caldav_availability* result, int count);
 
 /**
- * @deprecated Does nothing
- * Function which supports sending various options inside the library.
- * @param curl_options A struct debug_curl. See debug_curl.
+ * Function for getting calendar objects by href (RFC4791 7.9). The hrefs
+ * are requested in REPORTs of debug_curl.multiget_chunk hrefs each.
+ * Hrefs unknown to the server are left out of the result.
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored. Clear it with caldav_free_objects().
+ * @param hrefs Array of paths or URLs of calendar object resources.
+ * @param count Number of hrefs.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
  */
-void caldav_set_options(debug_curl curl_options);
+CALDAV_RESPONSE caldav_multiget_object(caldav_objects* result,
+				       const char** hrefs,
+				       int count,
+				       const char* URL,
+				       runtime_info* info);
 
 /**
- * Function to call to get a list of supported CalDAV options for a server
- * @param URL Defines CalDAV resource. Receiver is responsible for
- * freeing the memory. [http://][username[:password]@]host[:port]/url-path.
+ * Function for getting all events from the collection together with the
+ * href and ETag of each, ready for caldav_modify_by_href() and
+ * caldav_delete_by_href().
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored sorted by href. Clear it with caldav_free_objects().
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
  * See (RFC1738).
  * @param info Pointer to a runtime_info structure. @see runtime_info
- * @result A list of available options or NULL in case of any error.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
  */
-char** caldav_get_server_options(const char* URL, runtime_info* info);
+CALDAV_RESPONSE caldav_getall_objects(caldav_objects* result,
+				      const char* URL,
+				      runtime_info* info);
 
 /**
- * Function for getting an initialized runtime_info structure
- * @return runtime_info. @see runtime_info
+ * Function for listing the href and ETag of every object in the
+ * collection without fetching the objects. Only getetag is asked for
+ * in a PROPFIND of depth 1, which makes this the cheap way of finding
+ * out what changed before fetching with caldav_multiget_object().
+ * @param result A pointer to a caldav_etags where the entries are to be
+ * stored sorted by href. Clear it with caldav_free_etags().
+ * @param props 0 or CALDAV_ETAG_MODIFIED and/or CALDAV_ETAG_SIZE for
+ * also asking for getlastmodified and getcontentlength.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
  */
-runtime_info* caldav_get_runtime_info();
+CALDAV_RESPONSE caldav_getall_etags(caldav_etags* result,
+				    int props,
+				    const char* URL,
+				    runtime_info* info);
 
 /**
- * Function for freeing memory for a previous initialization of an info
+ * Function for getting all tasks from the collection together with the
+ * href and ETag of each. @see caldav_getall_objects
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored sorted by href. Clear it with caldav_free_objects().
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_tasks_getall_objects(caldav_objects* result,
+					    const char* URL,
+					    runtime_info* info);
+
+/**
+ * Function for replacing an object already read from the server. The PUT
+ * goes straight to object->href and only succeeds if the stored object
+ * still has object->etag (If-Match), so no search is needed first.
+ * CONFLICT with error code 412 means it was changed by someone else.
+ * @param object href, etag of the stored version and the new data.
+ * On success etag is replaced by the new ETag, or NULL if the server did
+ * not send one. A NULL etag makes the write unconditional.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_modify_by_href(caldav_object* object,
+				      const char* URL,
+				      runtime_info* info);
+
+/**
+ * Function for deleting an object already read from the server. The
+ * DELETE goes straight to object->href and only succeeds if the stored
+ * object still has object->etag (If-Match). @see caldav_modify_by_href
+ * @param object href and etag of the stored version. data is not used.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_delete_by_href(const caldav_object* object,
+				      const char* URL,
+				      runtime_info* info);
+
+/**
+ * Function for taking an exclusive write lock on an object or on the
+ * whole collection. The lock is kept until it is released or times out,
+ * so any number of writes can be made under it. Pass it to writes in
+ * debug_curl.lock or with caldav_session_set_lock(). Writes then submit
+ * its token instead of taking and releasing a lock of their own.
+ * @param lock Where to store the lock. Release it with
+ * caldav_lock_release() or free it with caldav_free_lock().
+ * @param href Path of the object to lock or NULL to lock the collection
+ * and every object in it.
+ * @param timeout Seconds to ask for. 0 (zero) uses the default. The
+ * server may grant another timeout. @see caldav_lock
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, CONFLICT, LOCKED or NOTIMPLEMENTED.
+ * @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_lock_acquire(caldav_lock** lock,
+				    const char* href,
+				    int timeout,
+				    const char* URL,
+				    runtime_info* info);
+
+/**
+ * Function for refreshing a lock before it times out.
+ * @param lock The lock. timeout and expires are updated.
+ * @param timeout Seconds to ask for. 0 (zero) asks for the current
+ * timeout again.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, CONFLICT or LOCKED. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_lock_refresh(caldav_lock* lock,
+				    int timeout,
+				    const char* URL,
+				    runtime_info* info);
+
+/**
+ * Function for releasing a lock. The lock is freed even if the server
+ * refused to release it, in which case it lasts until it times out.
+ * debug_curl.lock is reset to NULL if it is the lock.
+ * @param lock Address to a pointer to a caldav_lock.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_lock_release(caldav_lock** lock,
+				    const char* URL,
+				    runtime_info* info);
+
+/**
+ * Function for freeing a lock without releasing it on the server.
+ * @param lock Address to a pointer to a caldav_lock.
+ */
+void caldav_free_lock(caldav_lock** lock);
+
+/**
+ * Function for creating a calendar-query. Without further filters it
+ * matches every object holding a component.
+ * @param component The component to search for, e.g. VEVENT or VTODO,
+ * or NULL to match every object.
+ * @return A new query. Free it with caldav_query_free().
+ */
+caldav_query* caldav_query_new(const char* component);
+
+/**
+ * Function for freeing a query and all its filters.
+ * @param query Address to a pointer to a caldav_query.
+ */
+void caldav_query_free(caldav_query** query);
+
+/**
+ * Function for getting the comp-filter of the component searched for.
+ * @param query A caldav_query.
+ * @return The filter, owned by the query.
+ */
+caldav_filter* caldav_query_filter(caldav_query* query);
+
+/**
+ * Function for adding a comp-filter matching objects with a component
+ * inside the component of filter, e.g. a VALARM in a VEVENT.
+ * @param filter A comp-filter.
+ * @param name Name of the component.
+ * @return The new filter, owned by the query.
+ */
+caldav_filter* caldav_filter_comp(caldav_filter* filter, const char* name);
+
+/**
+ * Function for adding a prop-filter matching components with a property.
+ * @param filter A comp-filter.
+ * @param name Name of the property, e.g. UID or CATEGORIES.
+ * @return The new filter, owned by the query.
+ */
+caldav_filter* caldav_filter_prop(caldav_filter* filter, const char* name);
+
+/**
+ * Function for adding a param-filter matching properties with a
+ * parameter.
+ * @param filter A prop-filter.
+ * @param name Name of the parameter, e.g. PARTSTAT.
+ * @return The new filter, owned by the query.
+ */
+caldav_filter* caldav_filter_param(caldav_filter* filter, const char* name);
+
+/**
+ * Function for making a comp-filter or prop-filter only match if it
+ * overlaps a time range.
+ * @param filter A comp-filter or prop-filter.
+ * @param start Start of the range or 0 (zero) for open.
+ * @param end End of the range or 0 (zero) for open.
+ */
+void caldav_filter_time_range(caldav_filter* filter, time_t start, time_t end);
+
+/**
+ * Function for making a prop-filter or param-filter only match if its
+ * value contains a text.
+ * @param filter A prop-filter or param-filter.
+ * @param text The text to search for.
+ * @param collation NULL for the server's default, "i;ascii-casemap",
+ * or "i;octet".
+ * @param negate Non zero to match values not containing text.
+ */
+void caldav_filter_text_match(caldav_filter* filter, const char* text,
+			      const char* collation, int negate);
+
+/**
+ * Function for making a filter only match if the component, property or
+ * parameter is missing. Other tests of the filter are ignored.
+ * @param filter Any filter.
+ */
+void caldav_filter_not_defined(caldav_filter* filter);
+
+/**
+ * Function for asking only for some components and properties instead
+ * of whole objects. Call once for every property wanted. Components not
+ * selected are left out of the objects returned.
+ * @param query A caldav_query.
+ * @param component Name of the component, e.g. VEVENT. VCALENDAR selects
+ * properties of the calendar object itself.
+ * @param property Name of the property, or NULL for the whole component.
+ */
+void caldav_query_select(caldav_query* query, const char* component,
+			 const char* property);
+
+/**
+ * Function for having the server expand recurring components into the
+ * instances overlapping a time range (RFC4791 9.6.5).
+ * @param query A caldav_query.
+ * @param start Start of the range.
+ * @param end End of the range.
+ */
+void caldav_query_expand(caldav_query* query, time_t start, time_t end);
+
+/**
+ * Function for having the server leave out overridden instances of
+ * recurring components outside a time range (RFC4791 9.6.6).
+ * @param query A caldav_query.
+ * @param start Start of the range.
+ * @param end End of the range.
+ */
+void caldav_query_limit_recurrence_set(caldav_query* query,
+				       time_t start, time_t end);
+
+/**
+ * Function for asking for no more than a number of objects. CalDAV has
+ * no way to ask the server for a limit, the transfer is stopped once
+ * that many objects have arrived.
+ * @param query A caldav_query.
+ * @param nresults The number of objects or 0 (zero) for no limit.
+ */
+void caldav_query_limit(caldav_query* query, int nresults);
+
+/**
+ * Function for running a calendar-query and handing every object
+ * matching it to a callback as soon as it has been received.
+ * @param query A caldav_query.
+ * @param callback Function called for every calendar object resource.
+ * data only holds what was selected. @see caldav_query_select
+ * @param user_data Passed to callback.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_query_foreach(const caldav_query* query,
+				     caldav_object_callback callback,
+				     void* user_data,
+				     const char* URL,
+				     runtime_info* info);
+
+/**
+ * Function for running a calendar-query and returning the objects
+ * matching it with their href and ETag.
+ * @param result A pointer to caldav_objects where the objects are stored
+ * sorted by href. Free them with caldav_free_objects().
+ * @param query A caldav_query.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_query_objects(caldav_objects* result,
+				     const caldav_query* query,
+				     const char* URL,
+				     runtime_info* info);
+
+/**
+ * Function for getting the changes to a collection since an earlier
+ * synchronization. Uses sync-collection (RFC6578) and falls back to
+ * comparing the collection CTag and the ETags of its objects on servers
+ * without it.
+ * @param changes A pointer to a caldav_changes where the changes are to be
+ * stored. Clear it with caldav_free_changes().
+ * @param token The token from the previous synchronization or NULL for
+ * the first one.
+ * @param known NULL or the objects the caller has, sorted by href. Only
+ * href and etag are used. Objects whose ETag did not change are left
+ * out and deletions can be detected when the server restarts the
+ * synchronization.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE. Ok with
+ * changes->partial set and a 507 in info->error if the server was still
+ * truncating its answer when libcaldav stopped asking.
+ */
+CALDAV_RESPONSE caldav_sync_object(caldav_changes* changes,
+				   const char* token,
+				   const caldav_objects* known,
+				   const char* URL,
+				   runtime_info* info);
+
+/**
+ * Function for freeing the changes stored in a caldav_changes. The
+ * struct itself belongs to the caller.
+ * @param changes A pointer to a caldav_changes.
+ */
+void caldav_free_changes(caldav_changes* changes);
+
+/**
+ * Function for looking up an object by href.
+ * @param objects The result of a call returning caldav_objects.
+ * @param href Path of the resource.
+ * @return The object or NULL if href is not in objects.
+ */
+const caldav_object* caldav_objects_lookup(const caldav_objects* objects,
+					   const char* href);
+
+/**
+ * Function for freeing the objects stored in a caldav_objects. The
+ * struct itself belongs to the caller.
+ * @param objects A pointer to a caldav_objects.
+ */
+void caldav_free_objects(caldav_objects* objects);
+
+/**
+ * Function for looking up an entity tag by href.
+ * @param etags The result of caldav_getall_etags().
+ * @param href Path of the resource.
+ * @return The entry or NULL if href is not in etags.
+ */
+const caldav_etag* caldav_etags_lookup(const caldav_etags* etags,
+				       const char* href);
+
+/**
+ * Function for freeing the entries stored in a caldav_etags. The
+ * struct itself belongs to the caller.
+ * @param etags A pointer to a caldav_etags.
+ */
+void caldav_free_etags(caldav_etags* etags);
+
+/**
+ * Function for opening a session to a CalDAV collection.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return An open session or NULL in case of error.
+ */
+caldav_session* caldav_session_open(const char* URL, runtime_info* info);
+
+/**
+ * Function for closing a session and its connection.
+ * @param session Address to a pointer to a caldav_session. @see
+ * caldav_session_open
+ */
+void caldav_session_close(caldav_session** session);
+
+/**
+ * Function for adding a new event using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_add(caldav_session* session,
+				   const char* object);
+
+/**
+ * Function for deleting an event using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_delete(caldav_session* session,
+				      const char* object);
+
+/**
+ * Function for modifying an event using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify(caldav_session* session,
+				      const char* object);
+
+/**
+ * Function for adding a new event held in a buffer using an open session.
+ * The buffer is sent as it is, a missing UID is sent along with it.
+ * @param session An open session. @see caldav_session_open
+ * @param data Appointment following ICal format (RFC2445). Need not be
+ * NUL terminated.
+ * @param length Bytes of data.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_add_buffer(caldav_session* session,
+					  const char* data,
+					  size_t length);
+
+/**
+ * Function for adding a new event read from a descriptor using an open
+ * session. Regular files are mapped instead of read.
+ * @param session An open session. @see caldav_session_open
+ * @param fd Descriptor holding an appointment following ICal format
+ * (RFC2445). Not closed.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_add_fd(caldav_session* session, int fd);
+
+/**
+ * Function for adding a new event stored in a file using an open session.
+ * The file is mapped, not read.
+ * @param session An open session. @see caldav_session_open
+ * @param path File holding an appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_add_file(caldav_session* session,
+					const char* path);
+
+/**
+ * Function for modifying an event held in a buffer using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param data Appointment following ICal format (RFC2445). Need not be
+ * NUL terminated.
+ * @param length Bytes of data.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify_buffer(caldav_session* session,
+					     const char* data,
+					     size_t length);
+
+/**
+ * Function for modifying an event read from a descriptor using an open
+ * session. Regular files are mapped instead of read.
+ * @param session An open session. @see caldav_session_open
+ * @param fd Descriptor holding an appointment following ICal format
+ * (RFC2445). Not closed.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify_fd(caldav_session* session, int fd);
+
+/**
+ * Function for modifying an event stored in a file using an open session.
+ * The file is mapped, not read.
+ * @param session An open session. @see caldav_session_open
+ * @param path File holding an appointment following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify_file(caldav_session* session,
+					   const char* path);
+
+/**
+ * Function for getting a collection of events determined by time range
+ * using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get(caldav_session* session,
+				   response* result,
+				   time_t start,
+				   time_t end);
+
+/**
+ * Function for getting all events from the collection using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_getall(caldav_session* session,
+				      response* result);
+
+/**
+ * Function for getting calendar objects by href using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored. Clear it with caldav_free_objects().
+ * @param hrefs Array of paths or URLs of calendar object resources.
+ * @param count Number of hrefs.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_multiget(caldav_session* session,
+					caldav_objects* result,
+					const char** hrefs,
+					int count);
+
+/**
+ * Function for getting all events from the collection together with the
+ * href and ETag of each using an open session. @see caldav_getall_objects
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored sorted by href. Clear it with caldav_free_objects().
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_getall_objects(caldav_session* session,
+					      caldav_objects* result);
+
+/**
+ * Function for listing the href and ETag of every object in the
+ * collection using an open session. @see caldav_getall_etags
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to a caldav_etags where the entries are to be
+ * stored sorted by href. Clear it with caldav_free_etags().
+ * @param props 0 or CALDAV_ETAG_MODIFIED and/or CALDAV_ETAG_SIZE.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_getall_etags(caldav_session* session,
+					    caldav_etags* result,
+					    int props);
+
+/**
+ * Function for getting all tasks from the collection together with the
+ * href and ETag of each using an open session. @see caldav_getall_objects
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to a caldav_objects where the objects are to be
+ * stored sorted by href. Clear it with caldav_free_objects().
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_getall_objects(caldav_session* session,
+						    caldav_objects* result);
+
+/**
+ * Function for replacing an object already read from the server using an
+ * open session. @see caldav_modify_by_href
+ * @param session An open session. @see caldav_session_open
+ * @param object href, etag of the stored version and the new data.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_modify_by_href(caldav_session* session,
+					      caldav_object* object);
+
+/**
+ * Function for deleting an object already read from the server using an
+ * open session. @see caldav_delete_by_href
+ * @param session An open session. @see caldav_session_open
+ * @param object href and etag of the stored version.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_delete_by_href(caldav_session* session,
+					      const caldav_object* object);
+
+/**
+ * Function for taking a lock using an open session. @see
+ * caldav_lock_acquire
+ * @param session An open session. @see caldav_session_open
+ * @param lock Where to store the lock.
+ * @param href Path of the object to lock or NULL for the collection.
+ * @param timeout Seconds to ask for. 0 (zero) uses the default.
+ * @return Ok, FORBIDDEN, CONFLICT, LOCKED or NOTIMPLEMENTED.
+ * @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_lock_acquire(caldav_session* session,
+					    caldav_lock** lock,
+					    const char* href,
+					    int timeout);
+
+/**
+ * Function for refreshing a lock using an open session. @see
+ * caldav_lock_refresh
+ * @param session An open session. @see caldav_session_open
+ * @param lock The lock. timeout and expires are updated.
+ * @param timeout Seconds to ask for. 0 (zero) asks for the same again.
+ * @return Ok, FORBIDDEN, CONFLICT or LOCKED. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_lock_refresh(caldav_session* session,
+					    caldav_lock* lock,
+					    int timeout);
+
+/**
+ * Function for releasing and freeing a lock using an open session. If
+ * the session writes under the lock it stops doing so. @see
+ * caldav_lock_release
+ * @param session An open session. @see caldav_session_open
+ * @param lock Address to a pointer to a caldav_lock.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_lock_release(caldav_session* session,
+					    caldav_lock** lock);
+
+/**
+ * Function for making every following write through a session submit
+ * the token of a lock instead of taking a lock of its own.
+ * @param session An open session. @see caldav_session_open
+ * @param lock A lock which must outlive its use by the session, or NULL
+ * to have writes take locks of their own again.
+ */
+void caldav_session_set_lock(caldav_session* session, caldav_lock* lock);
+
+/**
+ * Function for running a calendar-query using an open session and
+ * handing every object to a callback. @see caldav_query_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param query A caldav_query.
+ * @param callback Function called for every calendar object resource.
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_query_foreach(caldav_session* session,
+					     const caldav_query* query,
+					     caldav_object_callback callback,
+					     void* user_data);
+
+/**
+ * Function for running a calendar-query using an open session and
+ * returning the objects. @see caldav_query_objects
+ * @param session An open session. @see caldav_session_open
+ * @param query A caldav_query.
+ * @param result A pointer to caldav_objects where the objects are stored.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_query_objects(caldav_session* session,
+					     const caldav_query* query,
+					     caldav_objects* result);
+
+/**
+ * Function for getting the changes to the collection since an earlier
+ * synchronization using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param changes A pointer to a caldav_changes where the changes are to be
+ * stored. Clear it with caldav_free_changes().
+ * @param token The token from the previous synchronization or NULL.
+ * @param known NULL or the objects the caller has, sorted by href.
+ * @see caldav_sync_object
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_sync(caldav_session* session,
+				    caldav_changes* changes,
+				    const char* token,
+				    const caldav_objects* known);
+
+/**
+ * Function for deleting a task using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Task following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_delete(caldav_session* session,
+					    const char* object);
+
+/**
+ * Function for modifying a task using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param object Task following ICal format (RFC2445).
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_modify(caldav_session* session,
+					    const char* object);
+
+/**
+ * Function for getting a collection of tasks determined by time range
+ * using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_get(caldav_session* session,
+					 response* result,
+					 time_t start,
+					 time_t end);
+
+/**
+ * Function for getting all tasks from the collection using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_getall(caldav_session* session,
+					    response* result);
+
+/**
+ * Function for streaming all events from the collection using an open
+ * session. @see caldav_getall_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_getall_foreach(caldav_session* session,
+					      caldav_object_callback callback,
+					      void* user_data);
+
+/**
+ * Function for streaming a collection of events determined by time range
+ * using an open session. @see caldav_getall_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get_foreach(caldav_session* session,
+					   time_t start,
+					   time_t end,
+					   caldav_object_callback callback,
+					   void* user_data);
+
+/**
+ * Function for streaming all tasks from the collection using an open
+ * session. @see caldav_getall_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_getall_foreach(caldav_session* session,
+					    caldav_object_callback callback,
+					    void* user_data);
+
+/**
+ * Function for streaming a collection of tasks determined by time range
+ * using an open session. @see caldav_getall_foreach
+ * @param session An open session. @see caldav_session_open
+ * @param start time_t variable specifying start for range. Included in search.
+ * @param end time_t variable specifying end for range. Included in search.
+ * @param callback Function called for every calendar object resource.
+ * @see caldav_object_callback
+ * @param user_data Passed to callback.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_tasks_get_foreach(caldav_session* session,
+						 time_t start,
+						 time_t end,
+						 caldav_object_callback callback,
+						 void* user_data);
+
+/**
+ * Function for getting the stored display name for the collection using
+ * an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get_displayname(caldav_session* session,
+					       response* result);
+
+/**
+ * Function for getting free/busy information using an open session.
+ * @param session An open session. @see caldav_session_open
+ * @param result A pointer to struct _response where the result is to stored.
+ * @see response. Caller is responsible for freeing the memory.
+ * @param start time_t variable specifying start and end for range. Both
+ * are included in range.
+ * @param end time_t variable specifying start and end for range. Both
+ * are included in range.
+ * @return Ok, FORBIDDEN, or CONFLICT. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get_freebusy(caldav_session* session,
+					    response* result,
+					    time_t start,
+					    time_t end);
+
+/**
+ * Function for getting the busy periods of many attendees using a session
+ * opened on the scheduling outbox of organizer. @see caldav_get_availability
+ * @param session An open session. @see caldav_session_open
+ * @param result An array of count caldav_availability, one per attendee.
+ * Clear it with caldav_free_availability().
+ * @param organizer Calendar user address of the user asking.
+ * @param attendees Array of count calendar user addresses.
+ * @param calendars NULL or an array of count calendar collection URLs to
+ * ask when the outbox cannot.
+ * @param count Number of attendees.
+ * @param start Start of time range.
+ * @param end End of time range.
+ * @return OK if every attendee was answered for, otherwise the status of
+ * the first one which was not. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_session_get_availability(caldav_session* session,
+						caldav_availability* result,
+						const char* organizer,
+						const char** attendees,
+						const char** calendars,
+						int count,
+						time_t start,
+						time_t end);
+
+/**
+ * Function to test wether the session's calendar resource is CalDAV
+ * enabled or not.
+ * @param session An open session. @see caldav_session_open
+ * @result 0 (zero) means no CalDAV support, otherwise CalDAV support
+ * detechted.
+ */
+int caldav_session_enabled_resource(caldav_session* session);
+
+/**
+ * Function to call to get a list of supported CalDAV options for the
+ * session's server.
+ * @param session An open session. @see caldav_session_open
+ * @result A list of available options or NULL in case of any error.
+ */
+char** caldav_session_get_server_options(caldav_session* session);
+
+/**
+ * Function for forgetting cached capabilities (DAV classes and allowed
+ * methods) so the next call asks the server again.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738). If NULL all cached capabilities are forgotten.
+ */
+void caldav_flush_server_options(const char* URL);
+
+/**
+ * Function for creating a cache which lets sessions in different threads
+ * reuse DNS results, TLS sessions and open connections. Assign it to
+ * debug_curl.share before opening the sessions.
+ * @return A new caldav_share or NULL in case of error.
+ */
+caldav_share* caldav_share_new(void);
+
+/**
+ * Function for freeing a caldav_share. Every session using the share
+ * must be closed first.
+ * @param share Address to a pointer to a caldav_share.
+ */
+void caldav_share_free(caldav_share** share);
+
+/**
+ * Function for opening an on-disk object cache. The file is created if
+ * it does not exist. When set in debug_curl.cache, sessions fetching
+ * all events or tasks only download objects whose ETag changed, and
+ * writes update the cache from the ETag the server answers with.
+ * Time-range reads and free/busy queries are answered from the cached
+ * objects unless debug_curl.cache_ttl is negative.
+ * The cache can be shared by any number of sessions and threads, but a
+ * file can only be open once at a time.
+ * @param path Name of the cache file.
+ * @return A new cache or NULL if the file could not be opened or is
+ * already in use.
+ */
+caldav_cache* caldav_cache_open(const char* path);
+
+/**
+ * Function for closing a cache, compacting the file first if most of it
+ * holds replaced objects.
+ * @param cache Address to a pointer to a caldav_cache.
+ */
+void caldav_cache_close(caldav_cache** cache);
+
+/**
+ * Function for creating an engine running CalDAV operations without
+ * blocking. An engine must only be used from one thread.
+ * @return A new caldav_async or NULL in case of error.
+ */
+caldav_async* caldav_async_new(void);
+
+/**
+ * Function for freeing an engine. Operations still in flight are
+ * abandoned without calling their callbacks.
+ * @param async Address to a pointer to a caldav_async.
+ */
+void caldav_async_free(caldav_async** async);
+
+/**
+ * Function for limiting the connections an engine opens. Operations
+ * beyond the limits wait in the engine until a request finishes.
+ * @param async A caldav_async. @see caldav_async_new
+ * @param connections Connections per host. 0 (zero) for no limit.
+ * @param streams Requests multiplexed over one HTTP/2 connection. 0 (zero)
+ * leaves it to libcurl and the server.
+ */
+void caldav_async_limit(caldav_async* async, int connections, int streams);
+
+/**
+ * Function for starting a CalDAV operation without blocking.
+ * @param async A caldav_async. @see caldav_async_new
+ * @param action The CALDAV_ACTION to perform.
+ * @param object Calendar object for ADD, MODIFY, DELETE, MODIFYTASKS and
+ * DELETETASKS, otherwise NULL. Copied.
+ * @param start Start of time range for GET, GETTASKS and FREEBUSY.
+ * @param end End of time range for GET, GETTASKS and FREEBUSY.
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure or NULL. Only the options
+ * are used, they are copied. @see runtime_info
+ * @param callback Called from caldav_async_perform() when the operation
+ * is finished. ISCALDAV succeeds once the URL is known to be a CalDAV
+ * collection, OPTIONS returns its Allow header in result->msg.
+ * @param user_data Passed to callback.
+ * @return 0 (zero) if the operation was started, -1 otherwise.
+ */
+int caldav_async_submit(caldav_async* async,
+			CALDAV_ACTION action,
+			const char* object,
+			time_t start,
+			time_t end,
+			const char* URL,
+			runtime_info* info,
+			caldav_async_callback callback,
+			void* user_data);
+
+/**
+ * Function for making progress on all operations. Call it whenever one
+ * of the descriptors from caldav_async_fdset() is ready or the timeout
+ * from caldav_async_timeout() expired. Callbacks of finished operations
+ * are called from here.
+ * @param async A caldav_async. @see caldav_async_new
+ * @return The number of operations still in flight.
+ */
+int caldav_async_perform(caldav_async* async);
+
+/**
+ * Function for getting the descriptors the engine waits for.
+ * @param async A caldav_async. @see caldav_async_new
+ * @param read_fd_set Descriptors to watch for reading.
+ * @param write_fd_set Descriptors to watch for writing.
+ * @param exc_fd_set Descriptors to watch for exceptions.
+ * @param max_fd Set to the highest descriptor added or -1 if none.
+ * @return 0 (zero) on success, -1 otherwise.
+ */
+int caldav_async_fdset(caldav_async* async,
+		       fd_set* read_fd_set,
+		       fd_set* write_fd_set,
+		       fd_set* exc_fd_set,
+		       int* max_fd);
+
+/**
+ * Function for getting how long the engine may wait before
+ * caldav_async_perform() must be called again.
+ * @param async A caldav_async. @see caldav_async_new
+ * @return Milliseconds, 0 (zero) to call it now or -1 if nothing is
+ * in flight.
+ */
+long caldav_async_timeout(caldav_async* async);
+
+/**
+ * Function for letting a GLib main loop drive the engine. Afterwards
+ * callbacks are called from the main loop and caldav_async_perform()
+ * need not be called by hand.
+ * @param async A caldav_async. @see caldav_async_new
+ * @param context The GMainContext to attach to or NULL for the default
+ * context.
+ * @return The id of the GSource.
+ */
+unsigned int caldav_async_attach(caldav_async* async, void* context);
+
+/**
+ * Function for adding many events concurrently. At most
+ * debug_curl.max_streams requests are in flight on each of at most
+ * debug_curl.max_connections connections, multiplexed over HTTP/2 where
+ * the server supports it.
+ * @param objects Array of appointments following ICal format (RFC2445).
+ * @param count Number of objects.
+ * @param results NULL or an array of count responses, one per object.
+ * @param errors NULL or an array of count caldav_error, one per object.
+ * Clear it with caldav_free_errors().
+ * @param URL Defines CalDAV resource. Receiver is responsible for freeing
+ * the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @return OK if every object was added, otherwise the response for the
+ * first object which failed. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_add_objects(const char** objects,
+				   int count,
+				   CALDAV_RESPONSE* results,
+				   caldav_error* errors,
+				   const char* URL,
+				   runtime_info* info);
+
+/**
+ * Function for modifying many events concurrently.
+ * @see caldav_add_objects
+ */
+CALDAV_RESPONSE caldav_modify_objects(const char** objects,
+				      int count,
+				      CALDAV_RESPONSE* results,
+				      caldav_error* errors,
+				      const char* URL,
+				      runtime_info* info);
+
+/**
+ * Function for deleting many events concurrently.
+ * @see caldav_add_objects
+ */
+CALDAV_RESPONSE caldav_delete_objects(const char** objects,
+				      int count,
+				      CALDAV_RESPONSE* results,
+				      caldav_error* errors,
+				      const char* URL,
+				      runtime_info* info);
+
+/**
+ * Function for running the same report on many collections at once. At
+ * most debug_curl.max_fanout collections are fetched at the same time and
+ * debug_curl.max_connections and debug_curl.max_streams bound what goes
+ * to each host. Completions are handed to callback in the order they
+ * arrive so a slow server only delays its own collections.
+ * @param action GETALL, GET, GETALLTASKS, GETTASKS, FREEBUSY or
+ * GETCALNAME.
+ * @param URLs Array of count collections. Each carries its own
+ * credentials: [http://][username[:password]@]host[:port]/url-path.
+ * @param count Number of collections.
+ * @param start Start of time range for GET, GETTASKS and FREEBUSY.
+ * @param end End of time range for GET, GETTASKS and FREEBUSY.
+ * @param statuses NULL or an array of count responses, one per collection.
+ * @param results NULL or an array of count response receiving what each
+ * collection returned unless callback kept it. Clear it with
+ * caldav_free_results().
+ * @param errors NULL or an array of count caldav_error, one per
+ * collection. Clear it with caldav_free_errors().
+ * @param callback NULL or called once per collection as soon as it is
+ * done. It may keep result->msg by setting it to NULL.
+ * @param user_data Passed to callback.
+ * @param info Pointer to a runtime_info structure. Only the options are
+ * used. @see runtime_info
+ * @return OK if every collection answered, otherwise the response for
+ * the first one which failed. @see CALDAV_RESPONSE
+ */
+CALDAV_RESPONSE caldav_fanout(CALDAV_ACTION action,
+			      const char** URLs,
+			      int count,
+			      time_t start,
+			      time_t end,
+			      CALDAV_RESPONSE* statuses,
+			      response* results,
+			      caldav_error* errors,
+			      caldav_fanout_callback callback,
+			      void* user_data,
+			      runtime_info* info);
+
+/**
+ * Function for freeing the messages in an array of caldav_error filled
+ * by one of the batch calls. The array itself belongs to the caller.
+ * @param errors An array of caldav_error.
+ * @param count Number of elements.
+ */
+void caldav_free_errors(caldav_error* errors, int count);
+
+/**
+ * Function for freeing the messages in an array of response filled by
+ * caldav_fanout(). The array itself belongs to the caller.
+ * @param results An array of response.
+ * @param count Number of elements.
+ */
+void caldav_free_results(response* results, int count);
+
+/** 
+ * @deprecated Always returns an initialized empty caldav_error
+ * Function to call in case of errors.
+ * Caller provides a pointer to a local caldav_error structure.
+ * Caldav_get_error will initialize pointer if NULL.
+ * Caller is responsible for freeing returned memory.
+ * After the first call the internal error buffer is reset.
+ * @param lib_error A pointer to a struct _caldav_error. @see _caldav_error
+ * @return An initialized caldav_error pointer to memory where error
+ * messages can be found from the last call to the library.
+ */
+caldav_error* caldav_get_error(caldav_error* lib_error);
+
+/** 
+ * Function for freeing memory for a previous initialization of a
+ * caldav_error. @see caldav_get_error()
+ * Caller provides a pointer to a local caldav_error structure.
+ * @param lib_error A pointer to a struct _caldav_error. @see _caldav_error
+ */
+void caldav_free_error(caldav_error* lib_error);
+
+/* Setting various options in library */
+
+/**
+ * @deprecated Does nothing
+ * Function which supports sending various options inside the library.
+ * @param curl_options A struct debug_curl. See debug_curl.
+ */
+void caldav_set_options(debug_curl curl_options);
+
+/**
+ * Function to call to get a list of supported CalDAV options for a server
+ * @param URL Defines CalDAV resource. Receiver is responsible for
+ * freeing the memory. [http://][username[:password]@]host[:port]/url-path.
+ * See (RFC1738).
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @result A list of available options or NULL in case of any error.
+ */
+char** caldav_get_server_options(const char* URL, runtime_info* info);
+
+/**
+ * Function for getting an initialized runtime_info structure
+ * @return runtime_info. @see runtime_info
+ */
+runtime_info* caldav_get_runtime_info();
+
+/**
+ * Function for freeing memory for a previous initialization of an info
  * structure
  * @param info Address to a pointer to a runtime_info structure. @see 
  * runtime_info
  */
 void caldav_free_runtime_info(runtime_info** info);
 
+/**
+ * Function for reading the traffic and timing counted for a runtime_info.
+ * Safe to call while other threads make calls with it.
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ * @param stats A pointer to a caldav_stats receiving a copy.
+ */
+void caldav_get_stats(runtime_info* info, caldav_stats* stats);
+
+/**
+ * Function for setting the traffic and timing counted for a runtime_info
+ * to zero.
+ * @param info Pointer to a runtime_info structure. @see runtime_info
+ */
+void caldav_reset_stats(runtime_info* info);
+
 /**
  * Function for getting an initialized response structure
  * @return response. @see _response
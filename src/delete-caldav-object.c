@@ -22,6 +22,7 @@
 
 #include "delete-caldav-object.h"
 #include "lock-caldav-object.h"
+#include "caldav-cache.h"
 #include <glib.h>
 #include <curl/curl.h>
 #include <stdio.h>
@@ -82,7 +83,6 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
 	struct curl_slist *http_header = NULL;
@@ -94,8 +94,14 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -106,14 +112,8 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: infinity");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_INFINITY));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -123,27 +123,20 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	gchar* file = g_strdup(settings->file);
-	if ((uid = get_response_header("uid", file, FALSE)) == NULL) {
-		g_free(file);
+	uid = caldav_arena_take(get_ical_property(settings->file, "UID"));
+	if (uid == NULL) {
 		error->code = 1;
 		error->str = g_strdup("Error: Missing required UID for object");
+		release_curl(settings, curl);
 		return TRUE;
 	}
-	g_free(file);
 	/*
 	 * ICalendar server does not support collation
 	 * <C:text-match collation=\"i;ascii-casemap\">%s</C:text-match>
 	 */
-	search = g_strdup_printf(
+	search = caldav_arena_strdup_printf(
 		"%s\r\n<C:text-match>%s</C:text-match>\r\n%s",
 		search_head, uid, search_tail);
-	g_free(uid);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, search);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(search));
@@ -151,12 +144,9 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
-	g_free(search);
-	curl_slist_free_all(http_header);
-	http_header = NULL;
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -174,46 +164,31 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 			/* enable uploading */
 			gchar* url = NULL;
 			gchar* etag = NULL;
-			url = get_url(chunk.memory);
+			url = caldav_arena_take(get_url(chunk.memory));
 			if (url) {
-				etag = get_etag(chunk.memory);
+				etag = caldav_arena_take(get_etag(chunk.memory));
 				if (etag) {
-					gchar* host = get_host(settings->url);
-					if (host) {
-						file = g_strdup(url);
-						g_free(url);
-						url = g_strdup_printf("%s%s", host, file);
-						g_free(file);
-						g_free(host);
-					}
-					else {
-						g_free(etag);
-						g_free(url);
-						url = NULL;
-					}
+					gchar* host = caldav_arena_take(get_host(settings->url));
+					url = (host) ?
+						caldav_arena_strdup_printf("%s%s", host, url) : NULL;
 				}
-				else {
-					g_free(url);
+				else
 					url = NULL;
-				}
 			}
 			if (url) {
 				int lock = 0;
+				long del_code = 0;
 				caldav_error lock_error;
 
-				file = g_strdup(etag);
-				g_free(etag);
-				etag = g_strdup_printf("If-Match: %s", file);
-				g_free(file);
-				http_header = curl_slist_append(http_header, etag);
-				g_free(etag);
+				http_header = curl_slist_append(http_header,
+					caldav_arena_strdup_printf("If-Match: %s", etag));
 				http_header = curl_slist_append(http_header,
 					"Content-Type: text/calendar; charset=\"utf-8\"");
 				http_header = curl_slist_append(http_header, "Expect:");
 				http_header = curl_slist_append(
 								http_header, "Transfer-Encoding:");
-				http_header = curl_slist_append(http_header, "Connection: close");
-				if (settings->use_locking)
+				http_header = caldav_lock_header(settings, http_header);
+				if (settings->use_locking && ! settings->lock)
 					LOCKSUPPORT = caldav_lock_support(settings, &lock_error);
 				else
 					LOCKSUPPORT = FALSE;
@@ -221,7 +196,7 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 					lock_token = caldav_lock_object(url, settings, &lock_error);
 					if (lock_token) {
 						http_header = curl_slist_append(
-							http_header, g_strdup_printf(
+							http_header, caldav_arena_strdup_printf(
 									"If: (%s)", lock_token));
 					}
 					/*
@@ -242,21 +217,29 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 					}
 				}
 				if (! LOCKSUPPORT || (LOCKSUPPORT && lock_token && lock_error.code != 423)) {
+					/* start from the common options whatever LOCK left set */
+					reset_curl(settings, curl);
+					curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+					curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+					curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+					curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+					curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
 					curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
-					curl_easy_setopt(curl, CURLOPT_URL, rebuild_url(settings, url));
-					curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
-					curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, 0);
+					curl_easy_setopt(curl, CURLOPT_URL, caldav_arena_take(
+								rebuild_url(settings, url)));
 					curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
 					curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 					curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 					curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-					res = curl_easy_perform(curl);
+					res = caldav_perform(settings, curl, error_buf);
+					curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &del_code);
+					if (res == 0 && del_code >= 200 && del_code < 300)
+						caldav_cache_written(settings, url, NULL, NULL);
 					if (LOCKSUPPORT && lock_token) {
 						caldav_unlock_object(
 								lock_token, url, settings, &lock_error);
 					}
 				}
-				g_free(url);
 				g_free(lock_token);
 				if (res != 0 || lock < 0) {
 					/* Is this a lock_error don't change error*/
@@ -273,11 +256,8 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 					settings->file = NULL;
 				}
 				else {
-					long code;
-					res = curl_easy_getinfo(
-								curl, CURLINFO_RESPONSE_CODE, &code);
-					if (code != 204) {
-						error->code = code;
+					if (del_code < 200 || del_code >= 300) {
+						error->code = del_code;
 						error->str = g_strdup(chunk.memory);
 						result = TRUE;
 					}
@@ -298,7 +278,7 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error) {
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
 
@@ -312,7 +292,6 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
 	struct curl_slist *http_header = NULL;
@@ -324,8 +303,14 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -336,14 +321,8 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: infinity");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_INFINITY));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -353,27 +332,20 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	gchar* file = g_strdup(settings->file);
-	if ((uid = get_response_header("uid", file, FALSE)) == NULL) {
-		g_free(file);
+	uid = caldav_arena_take(get_ical_property(settings->file, "UID"));
+	if (uid == NULL) {
 		error->code = 1;
 		error->str = g_strdup("Error: Missing required UID for object");
+		release_curl(settings, curl);
 		return TRUE;
 	}
-	g_free(file);
 	/*
 	 * ICalendar server does not support collation
 	 * <C:text-match collation=\"i;ascii-casemap\">%s</C:text-match>
 	 */
-	search = g_strdup_printf(
+	search = caldav_arena_strdup_printf(
 		"%s\r\n<C:text-match>%s</C:text-match>\r\n%s",
 		search_tasks_head, uid, search_tail);
-	g_free(uid);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, search);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(search));
@@ -381,12 +353,9 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
-	g_free(search);
-	curl_slist_free_all(http_header);
-	http_header = NULL;
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -404,46 +373,31 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 			/* enable uploading */
 			gchar* url = NULL;
 			gchar* etag = NULL;
-			url = get_url(chunk.memory);
+			url = caldav_arena_take(get_url(chunk.memory));
 			if (url) {
-				etag = get_etag(chunk.memory);
+				etag = caldav_arena_take(get_etag(chunk.memory));
 				if (etag) {
-					gchar* host = get_host(settings->url);
-					if (host) {
-						file = g_strdup(url);
-						g_free(url);
-						url = g_strdup_printf("%s%s", host, file);
-						g_free(file);
-						g_free(host);
-					}
-					else {
-						g_free(etag);
-						g_free(url);
-						url = NULL;
-					}
+					gchar* host = caldav_arena_take(get_host(settings->url));
+					url = (host) ?
+						caldav_arena_strdup_printf("%s%s", host, url) : NULL;
 				}
-				else {
-					g_free(url);
+				else
 					url = NULL;
-				}
 			}
 			if (url) {
 				int lock = 0;
+				long del_code = 0;
 				caldav_error lock_error;
 
-				file = g_strdup(etag);
-				g_free(etag);
-				etag = g_strdup_printf("If-Match: %s", file);
-				g_free(file);
-				http_header = curl_slist_append(http_header, etag);
-				g_free(etag);
+				http_header = curl_slist_append(http_header,
+					caldav_arena_strdup_printf("If-Match: %s", etag));
 				http_header = curl_slist_append(http_header,
 					"Content-Type: text/calendar; charset=\"utf-8\"");
 				http_header = curl_slist_append(http_header, "Expect:");
 				http_header = curl_slist_append(
 								http_header, "Transfer-Encoding:");
-				http_header = curl_slist_append(http_header, "Connection: close");
-				if (settings->use_locking)
+				http_header = caldav_lock_header(settings, http_header);
+				if (settings->use_locking && ! settings->lock)
 					LOCKSUPPORT = caldav_lock_support(settings, &lock_error);
 				else
 					LOCKSUPPORT = FALSE;
@@ -451,7 +405,7 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 					lock_token = caldav_lock_object(url, settings, &lock_error);
 					if (lock_token) {
 						http_header = curl_slist_append(
-							http_header, g_strdup_printf(
+							http_header, caldav_arena_strdup_printf(
 									"If: (%s)", lock_token));
 					}
 					/*
@@ -472,21 +426,29 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 					}
 				}
 				if (! LOCKSUPPORT || (LOCKSUPPORT && lock_token && lock_error.code != 423)) {
+					/* start from the common options whatever LOCK left set */
+					reset_curl(settings, curl);
+					curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+					curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+					curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+					curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+					curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
 					curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
-					curl_easy_setopt(curl, CURLOPT_URL, rebuild_url(settings, url));
-					curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
-					curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, 0);
+					curl_easy_setopt(curl, CURLOPT_URL, caldav_arena_take(
+								rebuild_url(settings, url)));
 					curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
 					curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 					curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 					curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-					res = curl_easy_perform(curl);
+					res = caldav_perform(settings, curl, error_buf);
+					curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &del_code);
+					if (res == 0 && del_code >= 200 && del_code < 300)
+						caldav_cache_written(settings, url, NULL, NULL);
 					if (LOCKSUPPORT && lock_token) {
 						caldav_unlock_object(
 								lock_token, url, settings, &lock_error);
 					}
 				}
-				g_free(url);
 				g_free(lock_token);
 				if (res != 0 || lock < 0) {
 					/* Is this a lock_error don't change error*/
@@ -503,11 +465,8 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 					settings->file = NULL;
 				}
 				else {
-					long code;
-					res = curl_easy_getinfo(
-								curl, CURLINFO_RESPONSE_CODE, &code);
-					if (code != 204) {
-						error->code = code;
+					if (del_code < 200 || del_code >= 300) {
+						error->code = del_code;
 						error->str = g_strdup(chunk.memory);
 						result = TRUE;
 					}
@@ -528,6 +487,100 @@ gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error) {
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
+	return result;
+}
+
+/**
+ * Function for deleting the object stored at href without searching for
+ * it first. The request is made conditional on the ETag instead of
+ * taking a LOCK.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param href Path or URL of the calendar object resource.
+ * @param etag ETag the stored object must still have or NULL for an
+ * unconditional delete.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_delete_href(caldav_settings* settings, const gchar* href,
+			    const gchar* etag, caldav_error* error) {
+	CURL* curl;
+	CURLcode res = 0;
+	char error_buf[CURL_ERROR_SIZE];
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	struct curl_slist *http_header = NULL;
+	gchar* url;
+	gboolean result = FALSE;
+
+	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
+	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
+
+	if ((url = caldav_arena_take(object_url(settings, href))) == NULL) {
+		error->code = -1;
+		error->str = g_strdup("Could not build URL for object");
+		return TRUE;
+	}
+	curl = get_curl(settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return TRUE;
+	}
+
+	if (etag)
+		http_header = curl_slist_append(http_header,
+				caldav_arena_strdup_printf("If-Match: %s", etag));
+	http_header = curl_slist_append(http_header, "Expect:");
+	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
+	http_header = caldav_lock_header(settings, http_header);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+	/* we pass our 'chunk' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+	/* we pass our 'headers' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+	res = caldav_perform(settings, curl, error_buf);
+	if (res != 0) {
+		error->code = caldav_transfer_code(res);
+		error->str = g_strdup_printf("%s", error_buf);
+		result = TRUE;
+	}
+	else {
+		long code;
+		res = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		/* 412 means the object changed since it was read */
+		if (code < 200 || code >= 300) {
+			error->code = code;
+			error->str = g_strdup((chunk.memory) ? chunk.memory : headers.memory);
+			result = TRUE;
+		}
+		else {
+			caldav_cache_written(settings, url, NULL, NULL);
+		}
+	}
+	if (chunk.memory)
+		free(chunk.memory);
+	if (headers.memory)
+		free(headers.memory);
+	curl_slist_free_all(http_header);
+	release_curl(settings, curl);
 	return result;
 }
@@ -39,5 +39,19 @@ gboolean caldav_delete(caldav_settings* settings, caldav_error* error);
  */
 gboolean caldav_tasks_delete(caldav_settings* settings, caldav_error* error);
 
+/**
+ * Function for deleting the object stored at href without searching for
+ * it first. The request is made conditional on the ETag instead of
+ * taking a LOCK.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param href Path or URL of the calendar object resource.
+ * @param etag ETag the stored object must still have or NULL for an
+ * unconditional delete.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_delete_href(caldav_settings* settings, const gchar* href,
+			    const gchar* etag, caldav_error* error);
+
 #endif
 
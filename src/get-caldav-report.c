@@ -22,6 +22,8 @@
 #endif
 
 #include "get-caldav-report.h"
+#include "get-multiget-report.h"
+#include "caldav-query.h"
 #include <glib.h>
 #include <curl/curl.h>
 #include <stdio.h>
@@ -121,16 +123,20 @@ gboolean caldav_getall(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
-	struct curl_slist *http_header = NULL;
 	gboolean result = FALSE;
 	
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -141,13 +147,8 @@ gboolean caldav_getall(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: 1");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -159,20 +160,14 @@ gboolean caldav_getall(caldav_settings* settings, caldav_error* error) {
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, getall_request);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(getall_request));
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
 	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "REPORT");
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -190,16 +185,15 @@ gboolean caldav_getall(caldav_settings* settings, caldav_error* error) {
 			gchar* report;
 			report = parse_caldav_report(
 						chunk.memory, "calendar-data", "VEVENT");
-			settings->file = g_strdup(report);
-			g_free(report);
+			caldav_account_parse(settings);
+			settings->file = report;
 		}
 	}
 	if (chunk.memory)
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_slist_free_all(http_header);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
 
@@ -213,17 +207,21 @@ gboolean caldav_getrange(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE + 1];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
-	struct curl_slist *http_header = NULL;
 	gboolean result = FALSE;
 	gchar* request = NULL;
 
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -234,14 +232,8 @@ gboolean caldav_getrange(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: 1");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -251,15 +243,8 @@ gboolean caldav_getrange(caldav_settings* settings, caldav_error* error) {
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	request = g_strdup_printf(
-		"%s\r\n<C:time-range start=\"%s\"\r\n end=\"%s\"/>\r\n%s",
-			getrange_request_head, get_caldav_datetime(&settings->start),
-			get_caldav_datetime(&settings->end), getrange_request_foot);
+	request = caldav_range_request(getrange_request_head,
+			settings->start, settings->end, getrange_request_foot);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(request));
@@ -267,9 +252,9 @@ gboolean caldav_getrange(caldav_settings* settings, caldav_error* error) {
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -278,16 +263,14 @@ gboolean caldav_getrange(caldav_settings* settings, caldav_error* error) {
 	else {
 		gchar* report;
 		report = parse_caldav_report(chunk.memory, "calendar-data", "VEVENT");
-		settings->file = g_strdup(report);
-		g_free(report);
+		caldav_account_parse(settings);
+		settings->file = report;
 	}
-	g_free(request);
 	if (chunk.memory)
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_slist_free_all(http_header);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
 
@@ -301,16 +284,20 @@ gboolean caldav_tasks_getall(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
-	struct curl_slist *http_header = NULL;
 	gboolean result = FALSE;
 	
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -321,13 +308,8 @@ gboolean caldav_tasks_getall(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: 1");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -339,20 +321,14 @@ gboolean caldav_tasks_getall(caldav_settings* settings, caldav_error* error) {
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, getall_tasks_request);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(getall_tasks_request));
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
 	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "REPORT");
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -370,16 +346,15 @@ gboolean caldav_tasks_getall(caldav_settings* settings, caldav_error* error) {
 			gchar* report;
 			report = parse_caldav_report(
 						chunk.memory, "calendar-data", "VTODO");
-			settings->file = g_strdup(report);
-			g_free(report);
+			caldav_account_parse(settings);
+			settings->file = report;
 		}
 	}
 	if (chunk.memory)
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_slist_free_all(http_header);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
 
@@ -393,17 +368,21 @@ gboolean caldav_tasks_getrange(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE + 1];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
-	struct curl_slist *http_header = NULL;
 	gboolean result = FALSE;
 	gchar* request = NULL;
 
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -414,14 +393,8 @@ gboolean caldav_tasks_getrange(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: 1");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -431,15 +404,8 @@ gboolean caldav_tasks_getrange(caldav_settings* settings, caldav_error* error) {
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	request = g_strdup_printf(
-		"%s\r\n<C:time-range start=\"%s\"\r\n end=\"%s\"/>\r\n%s",
-			getrange_tasks_request_head, get_caldav_datetime(&settings->start),
-			get_caldav_datetime(&settings->end), getrange_request_foot);
+	request = caldav_range_request(getrange_tasks_request_head,
+			settings->start, settings->end, getrange_request_foot);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(request));
@@ -447,9 +413,9 @@ gboolean caldav_tasks_getrange(caldav_settings* settings, caldav_error* error) {
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -458,15 +424,261 @@ gboolean caldav_tasks_getrange(caldav_settings* settings, caldav_error* error) {
 	else {
 		gchar* report;
 		report = parse_caldav_report(chunk.memory, "calendar-data", "VTODO");
-		settings->file = g_strdup(report);
-		g_free(report);
+		caldav_account_parse(settings);
+		settings->file = report;
 	}
-	g_free(request);
 	if (chunk.memory)
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_slist_free_all(http_header);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
+
+/**
+ * Function for building the REPORT request for GETALL, GET, GETALLTASKS
+ * and GETTASKS, or for settings->query if it is set.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @return The request or NULL if ACTION is not a report. Caller is
+ * responsible for freeing the memory.
+ */
+gchar* caldav_report_request(caldav_settings* settings) {
+	gchar* request = NULL;
+
+	if (settings->query)
+		return caldav_query_request(settings->query);
+	switch (settings->ACTION) {
+		case GETALL:
+			request = g_strdup(getall_request);
+			break;
+		case GETALLTASKS:
+			request = g_strdup(getall_tasks_request);
+			break;
+		case GET:
+		case GETTASKS:
+			caldav_arena_begin();
+			request = g_strdup(caldav_range_request(
+				(settings->ACTION == GET) ?
+					getrange_request_head : getrange_tasks_request_head,
+				settings->start, settings->end, getrange_request_foot));
+			caldav_arena_end();
+			break;
+		default: break;
+	}
+	return request;
+}
+
+/**
+ * @struct report_stream
+ * Passed between the libcurl write callback and the multistatus parser
+ */
+struct report_stream {
+	CURL* curl;
+	multistatus_stream* parser;
+	caldav_object_callback callback;
+	void* user_data;
+	GSList* entries;
+	int remaining;
+};
+
+/**
+ * Test whether a response element describes a calendar object resource
+ * which was returned. Internal function.
+ */
+static gboolean report_object(multistatus_entry* entry) {
+	return entry->href && entry->data && (entry->status == 0 ||
+			(entry->status >= 200 && entry->status < 300));
+}
+
+/**
+ * Hand one response element to the user's callback. Internal function.
+ * @return TRUE if the callback asked to stop or the number of objects
+ * asked for has been received.
+ */
+static gboolean report_entry(multistatus_entry* entry, void* data) {
+	struct report_stream* stream = (struct report_stream *) data;
+	caldav_object object;
+
+	if (! report_object(entry))
+		return FALSE;
+	object.href = entry->href;
+	object.etag = entry->etag;
+	object.data = entry->data;
+	if (stream->callback(&object, stream->user_data) != 0)
+		return TRUE;
+	return (stream->remaining > 0 && --stream->remaining == 0);
+}
+
+/**
+ * Keep one response element for caldav_report_objects. Internal function.
+ * @return TRUE once the number of objects asked for has been received.
+ */
+static gboolean report_collect(multistatus_entry* entry, void* data) {
+	struct report_stream* stream = (struct report_stream *) data;
+	multistatus_entry* kept;
+
+	if (! report_object(entry))
+		return FALSE;
+	/* the parser frees the entry, keep its strings */
+	kept = g_new(multistatus_entry, 1);
+	*kept = *entry;
+	kept->content = kept->content_end = NULL;
+	entry->href = entry->etag = entry->data = NULL;
+	stream->entries = g_slist_prepend(stream->entries, kept);
+	return (stream->remaining > 0 && --stream->remaining == 0);
+}
+
+/**
+ * libcurl write callback feeding the multistatus parser. Bodies of
+ * anything but the final 207 (redirects, authentication) are dropped.
+ * Internal function.
+ */
+static size_t ReportStreamCallback(void* ptr, size_t size, size_t nmemb,
+				   void* data) {
+	struct report_stream* stream = (struct report_stream *) data;
+	size_t realsize = size * nmemb;
+	long code = 0;
+
+	caldav_count_received(realsize);
+	curl_easy_getinfo(stream->curl, CURLINFO_RESPONSE_CODE, &code);
+	if (code != 207)
+		return realsize;
+	if (multistatus_stream_feed(stream->parser, (const gchar *) ptr, realsize))
+		return 0;
+	return realsize;
+}
+
+/**
+ * Run the REPORT for GETALL, GET, GETALLTASKS, GETTASKS or a query
+ * feeding the response to a multistatus parser while it arrives.
+ * Internal function.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param handler Called for every response element.
+ * @param stream Passed to handler. curl and parser are set here.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise. A handler stopping
+ * the transfer is not an error.
+ */
+static gboolean report_run(caldav_settings* settings,
+			   multistatus_handler handler,
+			   struct report_stream* stream,
+			   caldav_error* error) {
+	CURL* curl;
+	CURLcode res = 0;
+	char error_buf[CURL_ERROR_SIZE];
+	struct MemoryStruct headers;
+	gboolean result = FALSE;
+	gchar* request;
+
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = NULL;
+
+	request = caldav_arena_take(caldav_report_request(settings));
+	if (request == NULL) {
+		error->code = -1;
+		error->str = g_strdup("Action is not a report");
+		return TRUE;
+	}
+	curl = get_curl(settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return TRUE;
+	}
+	stream->curl = curl;
+	stream->parser = multistatus_stream_new(handler, stream);
+
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
+	/* parse the body while it arrives */
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ReportStreamCallback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)stream);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+	/* we pass our 'headers' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(request));
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "REPORT");
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
+	/* a callback stopping the transfer shows as a write error */
+	if (res != 0 && !(res == CURLE_WRITE_ERROR && stream->parser->stopped)) {
+		error->code = caldav_transfer_code(res);
+		error->str = g_strdup_printf("%s", error_buf);
+		result = TRUE;
+	}
+	else {
+		long code;
+		res = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		if (code != 207) {
+			error->code = code;
+			error->str = g_strdup(headers.memory);
+			result = TRUE;
+		}
+	}
+	multistatus_stream_free(stream->parser);
+	if (headers.memory)
+		free(headers.memory);
+	release_curl(settings, curl);
+	return result;
+}
+
+/**
+ * Function for running the REPORT for GETALL, GET, GETALLTASKS,
+ * GETTASKS or settings->query and handing every calendar object resource to a callback as
+ * soon as it has been received. The response body is never kept in full.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param callback Function called for every calendar object resource.
+ * @param user_data Passed to callback.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise. A callback stopping
+ * the transfer is not an error.
+ */
+gboolean caldav_report_foreach(caldav_settings* settings,
+			       caldav_object_callback callback,
+			       void* user_data,
+			       caldav_error* error) {
+	struct report_stream stream;
+
+	stream.callback = callback;
+	stream.user_data = user_data;
+	stream.entries = NULL;
+	stream.remaining = (settings->query) ? settings->query->nresults : 0;
+	return report_run(settings, report_entry, &stream, error);
+}
+
+/**
+ * Function for running the REPORT for GETALL, GET, GETALLTASKS,
+ * GETTASKS or settings->query and returning the calendar object resources with their href
+ * and ETag.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param result A pointer to caldav_objects where the objects are stored
+ * sorted by href.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_report_objects(caldav_settings* settings,
+			       caldav_objects* result,
+			       caldav_error* error) {
+	struct report_stream stream;
+	gboolean res;
+
+	stream.callback = NULL;
+	stream.user_data = NULL;
+	stream.entries = NULL;
+	stream.remaining = (settings->query) ? settings->query->nresults : 0;
+	result->objects = NULL;
+	result->count = 0;
+	res = report_run(settings, report_collect, &stream, error);
+	if (! res)
+		caldav_objects_take(stream.entries, result);
+	free_multistatus(stream.entries);
+	return res;
+}
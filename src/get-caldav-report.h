@@ -56,4 +56,43 @@ gboolean caldav_tasks_getall(caldav_settings* settings, caldav_error* error);
  */
 gboolean caldav_tasks_getrange(caldav_settings* settings, caldav_error* error);
 
+/**
+ * Function for building the REPORT request for GETALL, GET, GETALLTASKS
+ * and GETTASKS.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @return The request or NULL if ACTION is not a report. Caller is
+ * responsible for freeing the memory.
+ */
+gchar* caldav_report_request(caldav_settings* settings);
+
+/**
+ * Function for running the REPORT for GETALL, GET, GETALLTASKS,
+ * GETTASKS or settings->query and handing every calendar object resource to a callback as
+ * soon as it has been received. The response body is never kept in full.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param callback Function called for every calendar object resource.
+ * @param user_data Passed to callback.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise. A callback stopping
+ * the transfer is not an error.
+ */
+gboolean caldav_report_foreach(caldav_settings* settings,
+			       caldav_object_callback callback,
+			       void* user_data,
+			       caldav_error* error);
+
+/**
+ * Function for running the REPORT for GETALL, GET, GETALLTASKS,
+ * GETTASKS or settings->query and returning the calendar object resources with their href
+ * and ETag.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param result A pointer to caldav_objects where the objects are stored
+ * sorted by href.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_report_objects(caldav_settings* settings,
+			       caldav_objects* result,
+			       caldav_error* error);
+
 #endif
@@ -51,16 +51,20 @@ gboolean caldav_getname(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
-	struct curl_slist *http_header = NULL;
 	gboolean result = FALSE;
 	
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -71,13 +75,8 @@ gboolean caldav_getname(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: 0");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_0));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -89,20 +88,14 @@ gboolean caldav_getname(caldav_settings* settings, caldav_error* error) {
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, getname_request);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(getname_request));
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
 	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PROPFIND");
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -123,17 +116,21 @@ gboolean caldav_getname(caldav_settings* settings, caldav_error* error) {
 			if (!displayname) {
 				displayname = get_tag("D:displayname", chunk.memory);
 			}
-			settings->file = (displayname) ? 
-					g_strdup(displayname) : g_strdup("");
-			g_free(displayname);
+			settings->file = (displayname) ? displayname : g_strdup("");
 		}
 	}
 	if (chunk.memory)
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_slist_free_all(http_header);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
 
+/**
+ * Function for getting the PROPFIND request for the display name.
+ * @return The request. Owned by the library.
+ */
+const char* caldav_getname_request(void) {
+	return getname_request;
+}
@@ -30,5 +30,11 @@
  */
 gboolean caldav_getname(caldav_settings* settings, caldav_error* error);
 
+/**
+ * Function for getting the PROPFIND request for the display name.
+ * @return The request. Owned by the library.
+ */
+const char* caldav_getname_request(void);
+
 #endif
 
@@ -25,6 +25,7 @@
 #include <glib.h>
 #include <curl/curl.h>
 #include <string.h>
+#include <time.h>
 
 /**
  * A static literal string containing the first part of the calendar query.
@@ -51,17 +52,21 @@ gboolean caldav_freebusy(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE + 1];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
-	struct curl_slist *http_header = NULL;
 	gboolean result = FALSE;
 	gchar* request = NULL;
 
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -72,14 +77,8 @@ gboolean caldav_freebusy(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: 1");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -89,15 +88,8 @@ gboolean caldav_freebusy(caldav_settings* settings, caldav_error* error) {
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	request = g_strdup_printf(
-		"%s\r\n<C:time-range start=\"%s\"\r\n end=\"%s\"/>\r\n%s",
-			getrange_request_head, get_caldav_datetime(&settings->start),
-			get_caldav_datetime(&settings->end), getrange_request_foot);
+	request = caldav_range_request(getrange_request_head,
+			settings->start, settings->end, getrange_request_foot);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(request));
@@ -105,9 +97,9 @@ gboolean caldav_freebusy(caldav_settings* settings, caldav_error* error) {
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -129,12 +121,417 @@ gboolean caldav_freebusy(caldav_settings* settings, caldav_error* error) {
 			/*g_free(report);*/
 		}
 	}
-	g_free(request);
 	if (chunk.memory)
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_slist_free_all(http_header);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
+
+/**
+ * Function for building the free-busy-query REPORT request.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_freebusy_request(caldav_settings* settings) {
+	gchar* request;
+
+	caldav_arena_begin();
+	request = g_strdup(caldav_range_request(getrange_request_head,
+			settings->start, settings->end, getrange_request_foot));
+	caldav_arena_end();
+	return request;
+}
+
+/**
+ * A static literal string containing the first part of the VFREEBUSY
+ * request. The time range, organizer and attendees are added at runtime.
+ */
+static const char* schedule_request_head =
+"BEGIN:VCALENDAR\r\n"
+"PRODID:-//CalDAV Calendar//NONSGML libcaldav//EN\r\n"
+"VERSION:2.0\r\n"
+"METHOD:REQUEST\r\n"
+"BEGIN:VFREEBUSY\r\n";
+
+/**
+ * A static literal string containing the last part of the VFREEBUSY request
+ */
+static const char* schedule_request_foot =
+"END:VFREEBUSY\r\n"
+"END:VCALENDAR\r\n";
+
+/**
+ * Append a calendar user address property folded at 75 octets
+ * (RFC5545 3.1). A bare e-mail address is sent as a mailto: URI.
+ * @param request The request being built.
+ * @param name Name of the property.
+ * @param address Calendar user address.
+ */
+static void append_address(GString* request, const gchar* name,
+			   const gchar* address) {
+	gsize line = request->len;
+	const gchar* pos;
+
+	g_string_append_printf(request, "%s:%s%s", name,
+			(strchr(address, ':')) ? "" : "mailto:", address);
+	while (request->len - line > 75) {
+		/* never split a UTF-8 sequence */
+		for (pos = request->str + line + 75; (*pos & 0xc0) == 0x80; pos--)
+			;
+		line = pos - request->str;
+		g_string_insert(request, line, "\r\n ");
+		line += 2;
+	}
+	g_string_append(request, "\r\n");
+}
+
+/**
+ * Function for building the VFREEBUSY request POSTed to a scheduling
+ * outbox (RFC6638 5.3).
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param organizer Calendar user address of the user asking.
+ * @param attendees Array of count calendar user addresses.
+ * @param count Number of attendees.
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_schedule_request(caldav_settings* settings,
+			       const gchar* organizer,
+			       const gchar** attendees,
+			       int count) {
+	GString* request;
+	gchar start[CALDAV_DATETIME_SIZE];
+	gchar end[CALDAV_DATETIME_SIZE];
+	gchar stamp[CALDAV_DATETIME_SIZE];
+	gchar* seed;
+	gchar* uid;
+	time_t now = time(NULL);
+	int i;
+
+	format_caldav_datetime(settings->start, start);
+	format_caldav_datetime(settings->end, end);
+	format_caldav_datetime(now, stamp);
+	seed = g_strdup_printf("%s%" G_GINT64_FORMAT "%d",
+			organizer, g_get_monotonic_time(), count);
+	uid = random_file_name(seed);
+	request = g_string_new(schedule_request_head);
+	g_string_append_printf(request,
+			"UID:%s\r\nDTSTAMP:%s\r\nDTSTART:%s\r\nDTEND:%s\r\n",
+			uid, stamp, start, end);
+	append_address(request, "ORGANIZER", organizer);
+	for (i = 0; i < count; i++)
+		append_address(request, "ATTENDEE", attendees[i]);
+	g_string_append(request, schedule_request_foot);
+	g_free(seed);
+	g_free(uid);
+	return g_string_free(request, FALSE);
+}
+
+/**
+ * The key an attendee is looked up by in a schedule-response. Schemes
+ * and e-mail addresses compare without regard to case.
+ * @param address Calendar user address.
+ * @return The key. Caller is responsible for freeing the memory.
+ */
+static gchar* address_key(const gchar* address) {
+	gchar* uri;
+	gchar* key;
+
+	uri = (strchr(address, ':')) ? g_strdup(address) :
+		g_strconcat("mailto:", address, NULL);
+	key = g_ascii_strdown(uri, -1);
+	g_free(uri);
+	return key;
+}
+
+/**
+ * Map the REQUEST-STATUS of a recipient (RFC5545 3.8.8.3) to a
+ * CALDAV_RESPONSE.
+ * @param status "2.0;Success" or NULL if there was none.
+ * @return OK, FORBIDDEN, NOTIMPLEMENTED, UNAVAILABLE or CONFLICT.
+ */
+static CALDAV_RESPONSE schedule_status(const gchar* status) {
+	if (! status)
+		return CONFLICT;
+	if (status[0] == '2')
+		return OK;
+	if (strncmp(status, "3.7", 3) == 0 || strncmp(status, "3.8", 3) == 0)
+		return FORBIDDEN;
+	if (strncmp(status, "5.3", 3) == 0)
+		return NOTIMPLEMENTED;
+	if (status[0] == '5')
+		return UNAVAILABLE;
+	return CONFLICT;
+}
+
+/**
+ * Attendees of a caldav_schedule_freebusy() by the key of their address.
+ */
+typedef struct {
+	GHashTable* index;
+	caldav_availability* result;
+} schedule_reply;
+
+/**
+ * multistatus_handler for the response elements of a schedule-response,
+ * one per recipient.
+ */
+static gboolean schedule_response(multistatus_entry* entry, void* data) {
+	schedule_reply* reply = (schedule_reply *) data;
+	caldav_availability* availability;
+	gpointer found;
+	gchar* key;
+
+	if (! entry->href)
+		return FALSE;
+	key = address_key(entry->href);
+	found = g_hash_table_lookup(reply->index, key);
+	g_free(key);
+	if (! found)
+		return FALSE;
+	availability = &reply->result[GPOINTER_TO_INT(found) - 1];
+	g_free(availability->request_status);
+	availability->request_status =
+		multistatus_entry_text(entry, "request-status");
+	availability->status = schedule_status(availability->request_status);
+	if (availability->status == OK)
+		caldav_busy_parse(entry->data, availability);
+	return FALSE;
+}
+
+/**
+ * Function for getting the busy periods of many attendees in one POST to
+ * the scheduling outbox of settings. Attendees the outbox answers for get
+ * their request_status, status and busy periods filled in, the others are
+ * left as they are.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param organizer Calendar user address of the user asking.
+ * @param attendees Array of count calendar user addresses.
+ * @param count Number of attendees.
+ * @param result Array of count caldav_availability.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_schedule_freebusy(caldav_settings* settings,
+				  const gchar* organizer,
+				  const gchar** attendees,
+				  int count,
+				  caldav_availability* result,
+				  caldav_error* error) {
+	CURL* curl;
+	CURLcode res = 0;
+	char error_buf[CURL_ERROR_SIZE + 1];
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	gboolean failed = FALSE;
+	gchar* request = NULL;
+	schedule_reply reply;
+	multistatus_stream* stream;
+	int i;
+
+	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
+	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
+
+	curl = get_curl(settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return TRUE;
+	}
+
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_CALENDAR));
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+	/* we pass our 'chunk' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION,	WriteHeaderCallback);
+	/* we pass our 'headers' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
+	request = caldav_arena_take(caldav_schedule_request(settings,
+				organizer, attendees, count));
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
+	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(request));
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
+	if (res != 0) {
+		error->code = caldav_transfer_code(res);
+		error->str = g_strdup_printf("%s", error_buf);
+		failed = TRUE;
+	}
+	else {
+		long code;
+		res = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		if (code != 200) {
+			error->code = code;
+			error->str = g_strdup(headers.memory);
+			failed = TRUE;
+		}
+		else if (chunk.memory) {
+			reply.result = result;
+			reply.index = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, NULL);
+			for (i = 0; i < count; i++)
+				g_hash_table_insert(reply.index, address_key(attendees[i]),
+						GINT_TO_POINTER(i + 1));
+			stream = multistatus_stream_new(schedule_response, &reply);
+			multistatus_stream_feed(stream, chunk.memory, chunk.size);
+			multistatus_stream_free(stream);
+			g_hash_table_destroy(reply.index);
+		}
+	}
+	if (chunk.memory)
+		free(chunk.memory);
+	if (headers.memory)
+		free(headers.memory);
+	release_curl(settings, curl);
+	return failed;
+}
+
+/**
+ * Order busy periods by start, then by end.
+ */
+static gint compare_busy(gconstpointer a, gconstpointer b) {
+	const caldav_busy* x = (const caldav_busy *) a;
+	const caldav_busy* y = (const caldav_busy *) b;
+
+	if (x->start != y->start)
+		return (x->start < y->start) ? -1 : 1;
+	if (x->end != y->end)
+		return (x->end < y->end) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Read the FBTYPE parameter of a FREEBUSY property (RFC5545 3.2.9).
+ * @param params The parameters, starting after the property name.
+ * @param value The colon ending them.
+ * @return CALDAV_BUSY, CALDAV_BUSY_UNAVAILABLE, CALDAV_BUSY_TENTATIVE or
+ * -1 for FREE.
+ */
+static int busy_type(const gchar* params, const gchar* value) {
+	const gchar* stop;
+	gsize len;
+
+	for (; params < value; params++) {
+		if (*params != ';' || g_ascii_strncasecmp(params + 1, "FBTYPE=", 7))
+			continue;
+		params += 8;
+		for (stop = params; stop < value && *stop != ';'; stop++)
+			;
+		len = stop - params;
+		if (len == 4 && g_ascii_strncasecmp(params, "FREE", 4) == 0)
+			return -1;
+		if (len == 16 &&
+				g_ascii_strncasecmp(params, "BUSY-UNAVAILABLE", 16) == 0)
+			return CALDAV_BUSY_UNAVAILABLE;
+		if (len == 14 &&
+				g_ascii_strncasecmp(params, "BUSY-TENTATIVE", 14) == 0)
+			return CALDAV_BUSY_TENTATIVE;
+		/* unknown types count as BUSY */
+		return CALDAV_BUSY;
+	}
+	return CALDAV_BUSY;
+}
+
+/**
+ * Add the periods of an unfolded FREEBUSY property. Periods are an
+ * explicit start and end or a start and a duration, separated by commas.
+ * @param periods GArray of caldav_busy.
+ * @param line The property.
+ */
+static void busy_periods(GArray* periods, const gchar* line) {
+	caldav_busy period;
+	const gchar* value;
+	const gchar* pos;
+	gboolean quoted = FALSE;
+	glong seconds;
+
+	for (value = line + 8; *value && (quoted || *value != ':'); value++) {
+		if (*value == '"')
+			quoted = ! quoted;
+	}
+	if (! *value || (period.type = busy_type(line + 8, value)) < 0)
+		return;
+	for (pos = value + 1; *pos; pos++) {
+		if ((period.start = parse_caldav_datetime(pos, &pos)) == -1 ||
+				*pos++ != '/')
+			return;
+		if (*pos == 'P' || *pos == '+' || *pos == '-') {
+			if (! parse_caldav_duration(pos, &pos, &seconds))
+				return;
+			period.end = period.start + seconds;
+		}
+		else if ((period.end = parse_caldav_datetime(pos, &pos)) == -1)
+			return;
+		if (period.end > period.start)
+			g_array_append_val(periods, period);
+		if (*pos != ',')
+			return;
+	}
+}
+
+/**
+ * Function for reading the FREEBUSY properties of a VFREEBUSY into busy
+ * periods sorted by start. Periods already in result are replaced.
+ * @param object The calendar object following ICal format (RFC2445).
+ * @param result Where to store the periods. @see caldav_availability
+ */
+void caldav_busy_parse(const gchar* object, caldav_availability* result) {
+	GArray* periods;
+	GString* line;
+	const gchar* pos;
+	const gchar* eol;
+	gboolean keep = FALSE;
+	gsize len;
+
+	g_free(result->busy);
+	result->busy = NULL;
+	result->count = 0;
+	if (! object)
+		return;
+	periods = g_array_new(FALSE, FALSE, sizeof(caldav_busy));
+	line = g_string_new(NULL);
+	for (pos = object; *pos; pos = eol) {
+		if ((eol = strchr(pos, '\n')) != NULL)
+			eol++;
+		else
+			eol = pos + strlen(pos);
+		for (len = eol - pos; len && (pos[len - 1] == '\n' ||
+					pos[len - 1] == '\r'); len--)
+			;
+		if (*pos == ' ' || *pos == '\t') {
+			/* folded, only FREEBUSY properties are kept */
+			if (keep && len)
+				g_string_append_len(line, pos + 1, len - 1);
+			continue;
+		}
+		if (keep)
+			busy_periods(periods, line->str);
+		keep = g_ascii_strncasecmp(pos, "FREEBUSY", 8) == 0 &&
+			(pos[8] == ';' || pos[8] == ':');
+		if (keep) {
+			g_string_truncate(line, 0);
+			g_string_append_len(line, pos, len);
+		}
+	}
+	if (keep)
+		busy_periods(periods, line->str);
+	g_string_free(line, TRUE);
+	g_array_sort(periods, compare_busy);
+	result->count = periods->len;
+	result->busy = (caldav_busy *) g_array_free(periods, periods->len == 0);
+}
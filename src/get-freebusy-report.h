@@ -32,4 +32,53 @@
  */
 gboolean caldav_freebusy(caldav_settings* settings, caldav_error* error);
 
+/**
+ * Function for building the free-busy-query REPORT request.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_freebusy_request(caldav_settings* settings);
+
+/**
+ * Function for building the VFREEBUSY request POSTed to a scheduling
+ * outbox (RFC6638 5.3).
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param organizer Calendar user address of the user asking.
+ * @param attendees Array of count calendar user addresses.
+ * @param count Number of attendees.
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_schedule_request(caldav_settings* settings,
+			       const gchar* organizer,
+			       const gchar** attendees,
+			       int count);
+
+/**
+ * Function for getting the busy periods of many attendees in one POST to
+ * the scheduling outbox of settings. Attendees the outbox answers for get
+ * their request_status, status and busy periods filled in, the others are
+ * left as they are.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param organizer Calendar user address of the user asking.
+ * @param attendees Array of count calendar user addresses.
+ * @param count Number of attendees.
+ * @param result Array of count caldav_availability.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_schedule_freebusy(caldav_settings* settings,
+				  const gchar* organizer,
+				  const gchar** attendees,
+				  int count,
+				  caldav_availability* result,
+				  caldav_error* error);
+
+/**
+ * Function for reading the FREEBUSY properties of a VFREEBUSY into busy
+ * periods sorted by start. Periods already in result are replaced.
+ * @param object The calendar object following ICal format (RFC2445).
+ * @param result Where to store the periods. @see caldav_availability
+ */
+void caldav_busy_parse(const gchar* object, caldav_availability* result);
+
 #endif
@@ -0,0 +1,242 @@
+/* vim: set textwidth=80 tabstop=4 smarttab: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "get-multiget-report.h"
+#include <glib.h>
+#include <curl/curl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * A static literal string containing the first part of the multiget
+ * request. The hrefs to fetch are added at runtime.
+ */
+static const char* multiget_request_head =
+"<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+"<C:calendar-multiget xmlns:D=\"DAV:\""
+"                 xmlns:C=\"urn:ietf:params:xml:ns:caldav\">"
+" <D:prop>"
+"   <D:getetag/>"
+"   <C:calendar-data/>"
+" </D:prop>";
+
+/**
+ * A static literal string containing the last part of the multiget request
+ */
+static const char* multiget_request_foot =
+"</C:calendar-multiget>\r\n";
+
+/**
+ * Function for building one calendar-multiget REPORT request.
+ * @param hrefs Array of paths or URLs of calendar object resources.
+ * @param count Number of hrefs.
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_multiget_request(const gchar** hrefs, int count) {
+	GString* request;
+	const gchar* path;
+	gchar* escaped;
+	int i;
+
+	request = g_string_new(multiget_request_head);
+	for (i = 0; i < count; i++) {
+		path = hrefs[i];
+		/* the server wants the path, not the whole URL */
+		if (strstr(path, "://")) {
+			path = strchr(strstr(path, "://") + 3, '/');
+			if (! path)
+				path = "/";
+		}
+		escaped = g_markup_escape_text(path, -1);
+		g_string_append_printf(request, " <D:href>%s</D:href>", escaped);
+		g_free(escaped);
+	}
+	g_string_append(request, multiget_request_foot);
+	return g_string_free(request, FALSE);
+}
+
+static int compare_objects(const void* a, const void* b) {
+	return strcmp(((const caldav_object *) a)->href,
+			((const caldav_object *) b)->href);
+}
+
+/**
+ * Function for turning parsed multistatus entries carrying calendar data
+ * into caldav_objects sorted by href. Entries without data are skipped.
+ * @param entries A list of multistatus_entry. The strings are moved.
+ * @param result A pointer to caldav_objects. Existing objects are kept.
+ */
+void caldav_objects_take(GSList* entries, caldav_objects* result) {
+	GSList* item;
+	multistatus_entry* entry;
+	caldav_object* object;
+	int i, n = 0;
+
+	for (item = entries; item; item = g_slist_next(item)) {
+		entry = (multistatus_entry *) item->data;
+		if (entry->href && entry->data)
+			n++;
+	}
+	if (n == 0)
+		return;
+	result->objects = g_renew(caldav_object, result->objects,
+			result->count + n);
+	for (item = entries; item; item = g_slist_next(item)) {
+		entry = (multistatus_entry *) item->data;
+		if (! entry->href || ! entry->data)
+			continue;
+		object = &result->objects[result->count++];
+		object->href = entry->href;
+		object->etag = entry->etag;
+		object->data = entry->data;
+		entry->href = entry->etag = entry->data = NULL;
+	}
+	qsort(result->objects, result->count, sizeof(caldav_object),
+			compare_objects);
+	/* an href asked for twice is only returned once */
+	for (i = n = 1; i < result->count; i++) {
+		if (strcmp(result->objects[i].href, result->objects[n - 1].href)) {
+			result->objects[n++] = result->objects[i];
+			continue;
+		}
+		g_free(result->objects[i].href);
+		g_free(result->objects[i].etag);
+		g_free(result->objects[i].data);
+	}
+	result->count = n;
+}
+
+/**
+ * Send one calendar-multiget REPORT.
+ * @param curl A prepared handle. @see get_curl
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param request The REPORT body.
+ * @param result A pointer to caldav_objects receiving the objects.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+static gboolean multiget_chunk(CURL* curl,
+			       caldav_settings* settings,
+			       const gchar* request,
+			       caldav_objects* result,
+			       caldav_error* error) {
+	CURLcode res = 0;
+	char error_buf[CURL_ERROR_SIZE];
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	gboolean failed = FALSE;
+	GSList* entries;
+	long code;
+
+	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
+	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
+
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(request));
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "REPORT");
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
+	if (res != 0) {
+		error->code = caldav_transfer_code(res);
+		error->str = g_strdup_printf("%s", error_buf);
+		failed = TRUE;
+	}
+	else {
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		if (code != 207) {
+			error->code = code;
+			error->str = g_strdup(headers.memory);
+			failed = TRUE;
+		}
+		else {
+			entries = parse_multistatus(chunk.memory);
+			caldav_account_parse(settings);
+			caldav_objects_take(entries, result);
+			free_multistatus(entries);
+		}
+	}
+	if (chunk.memory)
+		free(chunk.memory);
+	if (headers.memory)
+		free(headers.memory);
+	return failed;
+}
+
+/**
+ * Function for getting calendar objects by href using calendar-multiget
+ * REPORTs (RFC4791 7.9).
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param hrefs Array of paths or URLs of calendar object resources.
+ * @param count Number of hrefs.
+ * @param chunk Number of hrefs per REPORT. 0 uses CALDAV_MULTIGET_CHUNK.
+ * @param result A pointer to caldav_objects receiving the objects.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_multiget(caldav_settings* settings,
+			 const gchar** hrefs,
+			 int count,
+			 int chunk,
+			 caldav_objects* result,
+			 caldav_error* error) {
+	CURL* curl;
+	gchar* request;
+	gboolean failed = FALSE;
+	int i, n;
+
+	if (chunk <= 0)
+		chunk = CALDAV_MULTIGET_CHUNK;
+	for (i = 0; i < count && ! failed; i += n) {
+		n = MIN(chunk, count - i);
+		curl = get_curl(settings);
+		if (!curl) {
+			error->code = -1;
+			error->str = g_strdup("Could not initialize libcurl");
+			return TRUE;
+		}
+		request = caldav_multiget_request(&hrefs[i], n);
+		failed = multiget_chunk(curl, settings, request, result, error);
+		g_free(request);
+		release_curl(settings, curl);
+	}
+	return failed;
+}
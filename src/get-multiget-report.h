@@ -0,0 +1,66 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GET_MULTIGET_REPORT_H__
+#define __GET_MULTIGET_REPORT_H__
+
+#include "caldav-utils.h"
+#include "caldav.h"
+#include <glib.h>
+
+/** Number of hrefs asked for per REPORT by default */
+#ifndef CALDAV_MULTIGET_CHUNK
+#define CALDAV_MULTIGET_CHUNK 100
+#endif
+
+/**
+ * Function for getting calendar objects by href using calendar-multiget
+ * REPORTs (RFC4791 7.9).
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param hrefs Array of paths or URLs of calendar object resources.
+ * @param count Number of hrefs.
+ * @param chunk Number of hrefs per REPORT. 0 uses CALDAV_MULTIGET_CHUNK.
+ * @param result A pointer to caldav_objects receiving the objects.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_multiget(caldav_settings* settings,
+			 const gchar** hrefs,
+			 int count,
+			 int chunk,
+			 caldav_objects* result,
+			 caldav_error* error);
+
+/**
+ * Function for building one calendar-multiget REPORT request.
+ * @param hrefs Array of paths or URLs of calendar object resources.
+ * @param count Number of hrefs.
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_multiget_request(const gchar** hrefs, int count);
+
+/**
+ * Function for turning parsed multistatus entries carrying calendar data
+ * into caldav_objects sorted by href. Entries without data are skipped.
+ * @param entries A list of multistatus_entry. The strings are moved.
+ * @param result A pointer to caldav_objects. Existing objects are kept.
+ */
+void caldav_objects_take(GSList* entries, caldav_objects* result);
+
+#endif
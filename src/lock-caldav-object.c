@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /**
  * A static literal string containing the lock query.
@@ -38,6 +39,115 @@ static char* lock_query =
 "  <D:locktype><D:write/></D:locktype>"
 "</D:lockinfo>";
 
+/**
+ * Send one LOCK or UNLOCK request for an explicit lock.
+ * @param settings @see caldav_settings
+ * @param url Full URL of the resource.
+ * @param method LOCK or UNLOCK.
+ * @param http_header Request headers. Freed by this function.
+ * @param body Request body or NULL for none.
+ * @param chunk Where to store the response body.
+ * @param headers Where to store the response headers.
+ * @param code Where to store the HTTP status.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+static gboolean lock_send(caldav_settings* settings, const gchar* url,
+			  const gchar* method, struct curl_slist* http_header,
+			  const char* body, struct MemoryStruct* chunk,
+			  struct MemoryStruct* headers, long* code,
+			  caldav_error* error) {
+	CURL* curl;
+	CURLcode res = 0;
+	char error_buf[CURL_ERROR_SIZE];
+
+	curl = get_curl(settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		curl_slist_free_all(http_header);
+		return TRUE;
+	}
+	http_header = curl_slist_append(http_header, "Expect:");
+	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+	/* we pass our 'chunk' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)chunk);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+	/* we pass our 'headers' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)headers);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	if (body) {
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(body));
+	}
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+	res = caldav_perform(settings, curl, error_buf);
+	curl_slist_free_all(http_header);
+	if (res != 0) {
+		error->code = caldav_transfer_code(res);
+		error->str = g_strdup_printf("%s", error_buf);
+	}
+	else {
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, code);
+	}
+	release_curl(settings, curl);
+	return (res != 0);
+}
+
+/**
+ * Store the error of a refused LOCK request.
+ * @param code The HTTP status.
+ * @param chunk The response body.
+ * @param error A pointer to caldav_error. @see caldav_error
+ */
+static void lock_refused(long code, struct MemoryStruct* chunk,
+			 caldav_error* error) {
+	gchar* status = (chunk->memory) ? get_tag("status", chunk->memory) : NULL;
+
+	if (status && strstr(status, "423") != NULL) {
+		error->code = 423;
+		error->str = g_strdup(status);
+	}
+	else {
+		error->code = code;
+		error->str = g_strdup((chunk->memory) ? chunk->memory : "");
+	}
+	g_free(status);
+}
+
+/**
+ * Read the timeout granted in a LOCK response (RFC4918 section 10.7).
+ * Servers not reporting one are assumed to have granted what was asked.
+ * @param lock The lock to update.
+ * @param body The response body or NULL.
+ * @param timeout The timeout asked for in seconds.
+ */
+static void lock_granted(caldav_lock* lock, gchar* body, int timeout) {
+	gchar* granted = NULL;
+
+	if (body) {
+		granted = get_tag("D:timeout", body);
+		if (!granted)
+			granted = get_tag("timeout", body);
+	}
+	if (granted && g_ascii_strcasecmp(g_strstrip(granted), "Infinite") == 0)
+		lock->timeout = 0;
+	else if (granted && g_ascii_strncasecmp(granted, "Second-", 7) == 0)
+		lock->timeout = atoi(granted + 7);
+	else
+		lock->timeout = timeout;
+	lock->expires = (lock->timeout > 0) ? time(NULL) + lock->timeout : 0;
+	g_free(granted);
+}
+
 /**
  * Function which requests a lock on a calendar resource
  * @param URI The resource to request lock on.
@@ -50,7 +160,6 @@ gchar* caldav_lock_object(
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
 	struct curl_slist *http_header = NULL;
@@ -61,8 +170,14 @@ gchar* caldav_lock_object(
 		return lock_token;
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -78,7 +193,6 @@ gchar* caldav_lock_object(
 	http_header = curl_slist_append(http_header, "Timeout: Second-300");
 	http_header = curl_slist_append(http_header, "Expect:");
 	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	data.trace_ascii = settings->trace_ascii;
 	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
@@ -89,18 +203,9 @@ gchar* caldav_lock_object(
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	if (settings->usehttps) {
-		url = g_strdup_printf("https://%s", URI);
-	} else {
-		url = g_strdup_printf("http://%s", URI);
-	}
+	url = caldav_arena_strdup_printf("%s%s",
+			(settings->usehttps) ? "https://" : "http://", URI);
 	curl_easy_setopt(curl, CURLOPT_URL, url);
-	g_free(url);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, lock_query);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(lock_query));
@@ -108,10 +213,10 @@ gchar* caldav_lock_object(
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform(settings, curl, error_buf);
 	curl_slist_free_all(http_header);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -133,14 +238,14 @@ gchar* caldav_lock_object(
 		}
 		else {
 			lock_token = get_response_header(
-						"Lock-Token", headers.memory, FALSE);
+						"Lock-Token", &headers, FALSE);
 		}
 	}
 	if (chunk.memory)
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return lock_token;
 }
 
@@ -157,7 +262,6 @@ gboolean caldav_unlock_object(gchar* lock_token, gchar* URI,
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
 	struct curl_slist *http_header = NULL;
@@ -168,8 +272,14 @@ gboolean caldav_unlock_object(gchar* lock_token, gchar* URI,
 		return result;
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -180,11 +290,10 @@ gboolean caldav_unlock_object(gchar* lock_token, gchar* URI,
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header, 
-			g_strdup_printf("Lock-Token: %s", lock_token));
+	http_header = curl_slist_append(http_header,
+			caldav_arena_strdup_printf("Lock-Token: %s", lock_token));
 	http_header = curl_slist_append(http_header, "Expect:");
 	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	data.trace_ascii = settings->trace_ascii;
 	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
@@ -195,27 +304,18 @@ gboolean caldav_unlock_object(gchar* lock_token, gchar* URI,
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	if (settings->usehttps) {
-		url = g_strdup_printf("https://%s", URI);
-	} else {
-		url = g_strdup_printf("http://%s", URI);
-	}
+	url = caldav_arena_strdup_printf("%s%s",
+			(settings->usehttps) ? "https://" : "http://", URI);
 	curl_easy_setopt(curl, CURLOPT_URL, url);
-	g_free(url);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "UNLOCK");
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform(settings, curl, error_buf);
 	curl_slist_free_all(http_header);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -235,7 +335,7 @@ gboolean caldav_unlock_object(gchar* lock_token, gchar* URI,
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
 
@@ -243,50 +343,260 @@ gboolean caldav_unlock_object(gchar* lock_token, gchar* URI,
  * Function to test whether the server supports locking or not. Searching
  * for PROP LOCK. If LOCK is present then according to RFC4791 PROP UNLOCK
  * must also be present.
+ * The Allow header of a fresh cached OPTIONS answer is used when there
+ * is one, so only the first lock of a collection costs a round trip.
  * @param settings @see caldav_settings
  * @param error A pointer to caldav_error. @see caldav_error
  * @return True if locking is supported by the server. False otherwise
  */
 gboolean caldav_lock_support(caldav_settings* settings, caldav_error* error) {
 	gboolean found = FALSE;
-	gchar* url = NULL;
-	gchar* mystr = NULL;
-	runtime_info* info;
-	
-	info = caldav_get_runtime_info();
-	info->options->verify_ssl_certificate = settings->verify_ssl_certificate;
-	info->options->custom_cacert = g_strdup(settings->custom_cacert);
-	if (settings->usehttps) {
-		mystr =  g_strdup("https://");
-	} else {
-		mystr =  g_strdup("http://");
+	CURL* curl = NULL;
+	response server_options;
+	gchar** options;
+	gchar** tmp;
+	caldav_error options_error;
+
+	memset(&options_error, 0, sizeof(caldav_error));
+	server_options.msg = NULL;
+	/* every LOCK and UNLOCK asks, answer from the cached Allow */
+	if (! caldav_capabilities_lookup(settings, &server_options.msg)) {
+		curl = get_curl(settings);
+		if (!curl) {
+			error->code = -1;
+			error->str = g_strdup("Could not initialize libcurl");
+			return FALSE;
+		}
+		/* ask on the caller's handle so a session keeps its connection */
+		caldav_getoptions(curl, settings, &server_options,
+				&options_error, FALSE);
 	}
-	
+	if (server_options.msg) {
+		options = g_strsplit(server_options.msg, ",", 0);
+		for (tmp = options; *tmp; tmp++) {
+			if (strcmp(g_strstrip(*tmp), "LOCK") == 0) {
+				found = TRUE;
+				break;
+			}
+		}
+		g_strfreev(options);
+	}
+	g_free(server_options.msg);
+	g_free(options_error.str);
+	if (curl)
+		release_curl(settings, curl);
+	return found;
+}
+
+/**
+ * Function for getting the LOCK request body.
+ * @return The request. Owned by the library.
+ */
+const char* caldav_lock_request(void) {
+	return lock_query;
+}
+
+/**
+ * Function for taking an exclusive write lock which is kept until it is
+ * released, so several writes can share one LOCK and UNLOCK.
+ * @param settings @see caldav_settings
+ * @param href Path or URL of the resource to lock, or NULL to lock the
+ * whole collection.
+ * @param timeout Seconds to ask for. 0 uses CALDAV_LOCK_TIMEOUT.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return The lock or NULL in case of error. Free it with caldav_free_lock.
+ */
+caldav_lock* caldav_lock_href(caldav_settings* settings, const gchar* href,
+			      int timeout, caldav_error* error) {
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	struct curl_slist *http_header = NULL;
+	caldav_lock* lock = NULL;
+	gchar* token;
+	gchar* url;
+	long code = 0;
+	gboolean collection = (href == NULL);
 
-	if (settings->username && settings->password) {
-		url = g_strdup_printf("%s%s:%s@%s",
-				mystr, settings->username, settings->password, settings->url);
+	if (!href) {
+		/* the collection itself, with every object in it */
+		href = (settings->url) ? strchr(settings->url, '/') : NULL;
+		if (!href)
+			href = "/";
 	}
-	else if (settings->username) {
-		url = g_strdup_printf("%s%s@%s", 
-				mystr, settings->username, settings->url);
+	if ((url = object_url(settings, href)) == NULL) {
+		error->code = -1;
+		error->str = g_strdup("Could not build URL for object");
+		return NULL;
 	}
-	else {
-		url = g_strdup_printf("%s%s", mystr, settings->url);
+	if (timeout <= 0)
+		timeout = CALDAV_LOCK_TIMEOUT;
+	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
+	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
+
+	http_header = curl_slist_append(http_header,
+			"Content-Type: application/xml; charset=\"utf-8\"");
+	http_header = curl_slist_append(http_header,
+			caldav_arena_strdup_printf("Timeout: Second-%d", timeout));
+	http_header = curl_slist_append(http_header,
+			(collection || href[strlen(href) - 1] == '/') ?
+			"Depth: infinity" : "Depth: 0");
+	if (! lock_send(settings, url, "LOCK", http_header, lock_query,
+			&chunk, &headers, &code, error)) {
+		token = (code == 200) ?
+			get_response_header("Lock-Token", &headers, FALSE) :
+			NULL;
+		if (token) {
+			lock = g_new0(caldav_lock, 1);
+			lock->href = g_strdup(href);
+			lock->token = token;
+			lock_granted(lock, chunk.memory, timeout);
+		}
+		else if (code == 200) {
+			error->code = -1;
+			error->str = g_strdup("No Lock-Token in LOCK response");
+		}
+		else {
+			lock_refused(code, &chunk, error);
+		}
 	}
-	gchar** options = caldav_get_server_options(url, info);
 	g_free(url);
-	gchar** tmp = options;
-	caldav_free_runtime_info(&info);
-	while (*options) {
-		if (strcmp(*options++, "LOCK") == 0) {
-			found = TRUE;
-			break;
+	if (chunk.memory)
+		free(chunk.memory);
+	if (headers.memory)
+		free(headers.memory);
+	return lock;
+}
+
+/**
+ * Function for refreshing a lock before it times out (RFC4918 section
+ * 9.10.2).
+ * @param settings @see caldav_settings
+ * @param lock The lock to refresh. timeout and expires are updated.
+ * @param timeout Seconds to ask for. 0 asks for the current timeout again.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_relock_href(caldav_settings* settings, caldav_lock* lock,
+			    int timeout, caldav_error* error) {
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	struct curl_slist *http_header = NULL;
+	gboolean result = TRUE;
+	gchar* url;
+	long code = 0;
+
+	if ((url = object_url(settings, lock->href)) == NULL) {
+		error->code = -1;
+		error->str = g_strdup("Could not build URL for object");
+		return TRUE;
+	}
+	if (timeout <= 0)
+		timeout = (lock->timeout > 0) ? lock->timeout : CALDAV_LOCK_TIMEOUT;
+	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
+	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
+
+	http_header = curl_slist_append(http_header,
+			caldav_arena_strdup_printf("If: (%s)", lock->token));
+	http_header = curl_slist_append(http_header,
+			caldav_arena_strdup_printf("Timeout: Second-%d", timeout));
+	/* a refresh has no body */
+	if (! lock_send(settings, url, "LOCK", http_header, NULL,
+			&chunk, &headers, &code, error)) {
+		if (code == 200) {
+			lock_granted(lock, chunk.memory, timeout);
+			result = FALSE;
+		}
+		else {
+			lock_refused(code, &chunk, error);
 		}
 	}
-	g_strfreev(tmp);			
-	g_free(mystr);
-	return found;
+	g_free(url);
+	if (chunk.memory)
+		free(chunk.memory);
+	if (headers.memory)
+		free(headers.memory);
+	return result;
 }
 
+/**
+ * Function for releasing a lock taken with caldav_lock_href.
+ * @param settings @see caldav_settings
+ * @param lock The lock to release.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_unlock_href(caldav_settings* settings, caldav_lock* lock,
+			    caldav_error* error) {
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	struct curl_slist *http_header = NULL;
+	gboolean result = TRUE;
+	gchar* url;
+	long code = 0;
+
+	if ((url = object_url(settings, lock->href)) == NULL) {
+		error->code = -1;
+		error->str = g_strdup("Could not build URL for object");
+		return TRUE;
+	}
+	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
+	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
+
+	http_header = curl_slist_append(http_header,
+			caldav_arena_strdup_printf("Lock-Token: %s", lock->token));
+	if (! lock_send(settings, url, "UNLOCK", http_header, NULL,
+			&chunk, &headers, &code, error)) {
+		if (code == 204 || code == 200) {
+			result = FALSE;
+		}
+		else {
+			error->code = code;
+			error->str = g_strdup((chunk.memory) ? chunk.memory : "");
+		}
+	}
+	g_free(url);
+	if (chunk.memory)
+		free(chunk.memory);
+	if (headers.memory)
+		free(headers.memory);
+	return result;
+}
 
+/**
+ * Function for adding the If header submitting the token of the lock held
+ * through settings, if any, to a write request.
+ * @param settings @see caldav_settings
+ * @param http_header The request headers.
+ * @return The request headers.
+ */
+struct curl_slist* caldav_lock_header(caldav_settings* settings,
+				      struct curl_slist* http_header) {
+	if (! settings->lock || ! settings->lock->token)
+		return http_header;
+	return curl_slist_append(http_header,
+			caldav_arena_strdup_printf("If: (%s)", settings->lock->token));
+}
@@ -23,6 +23,11 @@
 #include "caldav-utils.h"
 #include "caldav.h"
 
+/** Seconds asked for when taking a lock without a timeout */
+#ifndef CALDAV_LOCK_TIMEOUT
+#define CALDAV_LOCK_TIMEOUT 300
+#endif
+
 /**
  * Function which requests a lock on a calendar resource
  * @param URI The resource to request lock on.
@@ -52,4 +57,55 @@ gboolean caldav_unlock_object(gchar* lock_token, gchar* URI,
  */
 gboolean caldav_lock_support(caldav_settings* settings, caldav_error* error);
 
+/**
+ * Function for getting the LOCK request body.
+ * @return The request. Owned by the library.
+ */
+const char* caldav_lock_request(void);
+
+/**
+ * Function for taking an exclusive write lock which is kept until it is
+ * released, so several writes can share one LOCK and UNLOCK.
+ * @param settings @see caldav_settings
+ * @param href Path or URL of the resource to lock, or NULL to lock the
+ * whole collection.
+ * @param timeout Seconds to ask for. 0 uses CALDAV_LOCK_TIMEOUT.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return The lock or NULL in case of error. Free it with caldav_free_lock.
+ */
+caldav_lock* caldav_lock_href(caldav_settings* settings, const gchar* href,
+			      int timeout, caldav_error* error);
+
+/**
+ * Function for refreshing a lock before it times out (RFC4918 section
+ * 9.10.2).
+ * @param settings @see caldav_settings
+ * @param lock The lock to refresh. timeout and expires are updated.
+ * @param timeout Seconds to ask for. 0 asks for the current timeout again.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_relock_href(caldav_settings* settings, caldav_lock* lock,
+			    int timeout, caldav_error* error);
+
+/**
+ * Function for releasing a lock taken with caldav_lock_href.
+ * @param settings @see caldav_settings
+ * @param lock The lock to release.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_unlock_href(caldav_settings* settings, caldav_lock* lock,
+			    caldav_error* error);
+
+/**
+ * Function for adding the If header submitting the token of the lock held
+ * through settings, if any, to a write request.
+ * @param settings @see caldav_settings
+ * @param http_header The request headers.
+ * @return The request headers.
+ */
+struct curl_slist* caldav_lock_header(caldav_settings* settings,
+				      struct curl_slist* http_header);
+
 #endif
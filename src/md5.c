@@ -435,6 +435,20 @@ void caldav_md5_hex_digest(char *hexdigest, const unsigned char *s) {
 	md5_hex_digest(hexdigest, s);
 }
 
+void caldav_md5_hex_digest_len(char *hexdigest, const unsigned char *s,
+                               size_t len) {
+	int i;
+	MD5_CONTEXT context;
+	unsigned char digest[16];
+
+	md5_init(&context);
+	md5_update(&context, s, len);
+	md5_final(digest, &context);
+
+	for (i = 0; i < 16; i++)
+		sprintf(hexdigest + 2 * i, "%02x", digest[i]);
+}
+
 void caldav_md5_hex_hmac(char *hexdigest,
                   const unsigned char* text, int text_len,
                   const unsigned char* key, int key_len) {
@@ -44,6 +44,9 @@ typedef struct {  /* Hmm, should be private */
 
 void caldav_md5_hex_digest(char *hexdigest, const unsigned char *s);
 
+void caldav_md5_hex_digest_len(char *hexdigest, const unsigned char *s,
+                               size_t len);
+
 void caldav_md5_hex_hmac(char *hexdigest,
                   const unsigned char* text, int text_len,
                   const unsigned char* key, int key_len);
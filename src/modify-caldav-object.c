@@ -23,6 +23,7 @@
 
 #include "modify-caldav-object.h"
 #include "lock-caldav-object.h"
+#include "caldav-cache.h"
 #include <glib.h>
 #include <curl/curl.h>
 #include <stdio.h>
@@ -83,7 +84,6 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
 	struct curl_slist *http_header = NULL;
@@ -92,11 +92,19 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 	gboolean result = FALSE;
 	gboolean LOCKSUPPORT = FALSE;
 	gchar* lock_token = NULL;
+	caldav_upload local;
+	caldav_upload* body = caldav_upload_of(settings, &local);
 
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -107,14 +115,8 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: 1");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -124,27 +126,20 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	gchar* file = g_strdup(settings->file);
-	if ((uid = get_response_header("uid", file, FALSE)) == NULL) {
-		g_free(file);
+	uid = caldav_arena_take(caldav_upload_property(body, "UID"));
+	if (uid == NULL) {
 		error->code = 1;
 		error->str = g_strdup("Error: Missing required UID for object");
+		release_curl(settings, curl);
 		return TRUE;
 	}
-	g_free(file);
 	/*
 	 * collation is not supported by ICalendar.
 	 * <C:text-match collation=\"i;ascii-casemap\">%s</C:text-match>
 	 */
-	search = g_strdup_printf(
+	search = caldav_arena_strdup_printf(
 		"%s\r\n<C:text-match>%s</C:text-match>\r\n%s",
 		search_head, uid, search_tail);
-	g_free(uid);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, search);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(search));
@@ -152,12 +147,9 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
-	curl_slist_free_all(http_header);
-	http_header = NULL;
-	g_free(search);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -175,45 +167,30 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 			/* enable uploading */
 			gchar* url = NULL;
 			gchar* etag = NULL;
-			url = get_url(chunk.memory);
+			url = caldav_arena_take(get_url(chunk.memory));
 			if (url) {
-				etag = get_etag(chunk.memory);
+				etag = caldav_arena_take(get_etag(chunk.memory));
 				if (etag) {
-					gchar* host = get_host(settings->url);
-					if (host) {
-						file = g_strdup(url);
-						g_free(url);
-						url = g_strdup_printf("%s%s", host, file);
-						g_free(file);
-						g_free(host);
-					}
-					else {
-						g_free(etag);
-						g_free(url);
-						url = NULL;
-					}
+					gchar* host = caldav_arena_take(get_host(settings->url));
+					url = (host) ?
+						caldav_arena_strdup_printf("%s%s", host, url) : NULL;
 				}
-				else {
-					g_free(url);
+				else
 					url = NULL;
-				}
 				if (url) {
 					int lock = 0;
+					long put_code = 0;
 					caldav_error lock_error;
 	
-					file = g_strdup(etag);
-					g_free(etag);
-					etag = g_strdup_printf("If-Match: %s", file);
-					g_free(file);
-					http_header = curl_slist_append(http_header, etag);
-					g_free(etag);
+					http_header = curl_slist_append(http_header,
+						caldav_arena_strdup_printf("If-Match: %s", etag));
 					http_header = curl_slist_append(http_header,
 						"Content-Type: text/calendar; charset=\"utf-8\"");
 					http_header = curl_slist_append(http_header, "Expect:");
 					http_header = curl_slist_append(
 									http_header, "Transfer-Encoding:");
-					http_header = curl_slist_append(http_header, "Connection: close");
-					if (settings->use_locking)
+					http_header = caldav_lock_header(settings, http_header);
+					if (settings->use_locking && ! settings->lock)
 						LOCKSUPPORT = caldav_lock_support(settings, &lock_error);
 					else
 						LOCKSUPPORT = FALSE;
@@ -221,7 +198,7 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 						lock_token = caldav_lock_object(url, settings, &lock_error);
 						if (lock_token) {
 							http_header = curl_slist_append(
-								http_header, g_strdup_printf(
+								http_header, caldav_arena_strdup_printf(
 										"If: (%s)", lock_token));
 						}
 						/*
@@ -242,22 +219,39 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 						}
 					}
 					if (! LOCKSUPPORT || (LOCKSUPPORT && lock_token && lock_error.code != 423)) {
+						/* start from the common options whatever LOCK left set */
+						reset_curl(settings, curl);
+						curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+						curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+						curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+						/* only the headers of the PUT carry the new ETag */
+						if (headers.memory)
+							free(headers.memory);
+						headers.memory = NULL;
+						headers.size = 0;
+						headers.capacity = 0;
+						headers.fields = 0;
+						curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+						curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
 						curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
-						curl_easy_setopt(curl, CURLOPT_URL, rebuild_url(settings, url));
-						curl_easy_setopt(curl, CURLOPT_POSTFIELDS, settings->file);
-						curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, 
-									strlen(settings->file));
+						curl_easy_setopt(curl, CURLOPT_URL, caldav_arena_take(
+									rebuild_url(settings, url)));
 						curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 						curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 						curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
 						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-						res = curl_easy_perform(curl);
+						res = caldav_put(settings, curl, body,
+								http_header, error_buf);
+						curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &put_code);
+						if (res == 0 && put_code >= 200 && put_code < 300 &&
+								settings->cache)
+							caldav_cache_written(settings, url,
+									&headers, caldav_upload_text(body));
 						if (LOCKSUPPORT && lock_token) {
 							caldav_unlock_object(
 									lock_token, url, settings, &lock_error);
 						}
 					}
-					g_free(url);
 					g_free(lock_token);
 					if (res != 0 || lock < 0) {
 						/* Is this a lock_error don't change error*/
@@ -274,11 +268,8 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 						settings->file = NULL;
 					}
 					else {
-						long code;
-						res = curl_easy_getinfo(
-									curl, CURLINFO_RESPONSE_CODE, &code);
-						if (code != 204) {
-							error->code = code;
+						if (put_code < 200 || put_code >= 300) {
+							error->code = put_code;
 							error->str = g_strdup(chunk.memory);
 							result = TRUE;
 						}
@@ -309,7 +300,7 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error) {
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
 
@@ -323,7 +314,6 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 	CURL* curl;
 	CURLcode res = 0;
 	char error_buf[CURL_ERROR_SIZE];
-	struct config_data data;
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
 	struct curl_slist *http_header = NULL;
@@ -332,11 +322,19 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 	gboolean result = FALSE;
 	gboolean LOCKSUPPORT = FALSE;
 	gchar* lock_token = NULL;
+	caldav_upload local;
+	caldav_upload* body = caldav_upload_of(settings, &local);
 
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	curl = get_curl(settings);
 	if (!curl) {
@@ -347,14 +345,8 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 		return TRUE;
 	}
 
-	http_header = curl_slist_append(http_header,
-			"Content-Type: application/xml; charset=\"utf-8\"");
-	http_header = curl_slist_append(http_header, "Depth: 1");
-	http_header = curl_slist_append(http_header, "Expect:");
-	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
-	http_header = curl_slist_append(http_header, "Connection: close");
-	data.trace_ascii = settings->trace_ascii;
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
 	/* we pass our 'chunk' struct to the callback function */
@@ -364,27 +356,20 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 	/* we pass our 'headers' struct to the callback function */
 	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
-	if (settings->debug) {
-		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, my_trace);
-		curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &data);
-		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-	}
-	gchar* file = g_strdup(settings->file);
-	if ((uid = get_response_header("uid", file, FALSE)) == NULL) {
-		g_free(file);
+	uid = caldav_arena_take(caldav_upload_property(body, "UID"));
+	if (uid == NULL) {
 		error->code = 1;
 		error->str = g_strdup("Error: Missing required UID for object");
+		release_curl(settings, curl);
 		return TRUE;
 	}
-	g_free(file);
 	/*
 	 * collation is not supported by ICalendar.
 	 * <C:text-match collation=\"i;ascii-casemap\">%s</C:text-match>
 	 */
-	search = g_strdup_printf(
+	search = caldav_arena_strdup_printf(
 		"%s\r\n<C:text-match>%s</C:text-match>\r\n%s",
 		search_tasks_head, uid, search_tail);
-	g_free(uid);
 	/* enable uploading */
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, search);
 	curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, strlen(search));
@@ -392,12 +377,9 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
-	curl_slist_free_all(http_header);
-	http_header = NULL;
-	g_free(search);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res != 0) {
-		error->code = -1;
+		error->code = caldav_transfer_code(res);
 		error->str = g_strdup_printf("%s", error_buf);
 		g_free(settings->file);
 		settings->file = NULL;
@@ -415,45 +397,30 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 			/* enable uploading */
 			gchar* url = NULL;
 			gchar* etag = NULL;
-			url = get_url(chunk.memory);
+			url = caldav_arena_take(get_url(chunk.memory));
 			if (url) {
-				etag = get_etag(chunk.memory);
+				etag = caldav_arena_take(get_etag(chunk.memory));
 				if (etag) {
-					gchar* host = get_host(settings->url);
-					if (host) {
-						file = g_strdup(url);
-						g_free(url);
-						url = g_strdup_printf("%s%s", host, file);
-						g_free(file);
-						g_free(host);
-					}
-					else {
-						g_free(etag);
-						g_free(url);
-						url = NULL;
-					}
+					gchar* host = caldav_arena_take(get_host(settings->url));
+					url = (host) ?
+						caldav_arena_strdup_printf("%s%s", host, url) : NULL;
 				}
-				else {
-					g_free(url);
+				else
 					url = NULL;
-				}
 				if (url) {
 					int lock = 0;
+					long put_code = 0;
 					caldav_error lock_error;
 	
-					file = g_strdup(etag);
-					g_free(etag);
-					etag = g_strdup_printf("If-Match: %s", file);
-					g_free(file);
-					http_header = curl_slist_append(http_header, etag);
-					g_free(etag);
+					http_header = curl_slist_append(http_header,
+						caldav_arena_strdup_printf("If-Match: %s", etag));
 					http_header = curl_slist_append(http_header,
 						"Content-Type: text/calendar; charset=\"utf-8\"");
 					http_header = curl_slist_append(http_header, "Expect:");
 					http_header = curl_slist_append(
 									http_header, "Transfer-Encoding:");
-					http_header = curl_slist_append(http_header, "Connection: close");
-					if (settings->use_locking)
+					http_header = caldav_lock_header(settings, http_header);
+					if (settings->use_locking && ! settings->lock)
 						LOCKSUPPORT = caldav_lock_support(settings, &lock_error);
 					else
 						LOCKSUPPORT = FALSE;
@@ -461,7 +428,7 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 						lock_token = caldav_lock_object(url, settings, &lock_error);
 						if (lock_token) {
 							http_header = curl_slist_append(
-								http_header, g_strdup_printf(
+								http_header, caldav_arena_strdup_printf(
 										"If: (%s)", lock_token));
 						}
 						/*
@@ -482,22 +449,39 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 						}
 					}
 					if (! LOCKSUPPORT || (LOCKSUPPORT && lock_token && lock_error.code != 423)) {
+						/* start from the common options whatever LOCK left set */
+						reset_curl(settings, curl);
+						curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+						curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+						curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+						/* only the headers of the PUT carry the new ETag */
+						if (headers.memory)
+							free(headers.memory);
+						headers.memory = NULL;
+						headers.size = 0;
+						headers.capacity = 0;
+						headers.fields = 0;
+						curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+						curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
 						curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
-						curl_easy_setopt(curl, CURLOPT_URL, rebuild_url(settings, url));
-						curl_easy_setopt(curl, CURLOPT_POSTFIELDS, settings->file);
-						curl_easy_setopt (curl, CURLOPT_POSTFIELDSIZE, 
-									strlen(settings->file));
+						curl_easy_setopt(curl, CURLOPT_URL, caldav_arena_take(
+									rebuild_url(settings, url)));
 						curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 						curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 						curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
 						curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-						res = curl_easy_perform(curl);
+						res = caldav_put(settings, curl, body,
+								http_header, error_buf);
+						curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &put_code);
+						if (res == 0 && put_code >= 200 && put_code < 300 &&
+								settings->cache)
+							caldav_cache_written(settings, url,
+									&headers, caldav_upload_text(body));
 						if (LOCKSUPPORT && lock_token) {
 							caldav_unlock_object(
 									lock_token, url, settings, &lock_error);
 						}
 					}
-					g_free(url);
 					g_free(lock_token);
 					if (res != 0 || lock < 0) {
 						/* Is this a lock_error don't change error*/
@@ -514,11 +498,8 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 						settings->file = NULL;
 					}
 					else {
-						long code;
-						res = curl_easy_getinfo(
-									curl, CURLINFO_RESPONSE_CODE, &code);
-						if (code != 204) {
-							error->code = code;
+						if (put_code < 200 || put_code >= 300) {
+							error->code = put_code;
 							error->str = g_strdup(chunk.memory);
 							result = TRUE;
 						}
@@ -549,7 +530,128 @@ gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error) {
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
-	curl_easy_cleanup(curl);
+	release_curl(settings, curl);
 	return result;
 }
 
+/**
+ * Function for building the calendar-query which finds an object by UID.
+ * @param uid The UID to search for.
+ * @param tasks TRUE to search for a VTODO, FALSE for a VEVENT.
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_uid_request(const gchar* uid, gboolean tasks) {
+	/*
+	 * collation is not supported by ICalendar.
+	 * <C:text-match collation=\"i;ascii-casemap\">%s</C:text-match>
+	 */
+	return g_strdup_printf(
+		"%s\r\n<C:text-match>%s</C:text-match>\r\n%s",
+		(tasks) ? search_tasks_head : search_head, uid, search_tail);
+}
+
+/**
+ * Function for replacing the object stored at href without searching for
+ * it first. settings->file, or settings->upload if set, holds the new
+ * object. The write is made conditional on the ETag instead of taking a
+ * LOCK.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param href Path or URL of the calendar object resource.
+ * @param etag Pointer to the ETag the stored object must still have or to
+ * NULL for an unconditional write. On success it is replaced by the new
+ * ETag, or NULL if the server did not send one.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_modify_href(caldav_settings* settings, const gchar* href,
+			    gchar** etag, caldav_error* error) {
+	CURL* curl;
+	CURLcode res = 0;
+	char error_buf[CURL_ERROR_SIZE];
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	struct curl_slist *http_header = NULL;
+	gchar* url;
+	gboolean result = FALSE;
+	caldav_upload local;
+	caldav_upload* body = caldav_upload_of(settings, &local);
+
+	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
+	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
+
+	if ((url = caldav_arena_take(object_url(settings, href))) == NULL) {
+		error->code = -1;
+		error->str = g_strdup("Could not build URL for object");
+		return TRUE;
+	}
+	curl = get_curl(settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return TRUE;
+	}
+
+	if ((etag && *etag))
+		http_header = curl_slist_append(http_header,
+				caldav_arena_strdup_printf("If-Match: %s", *etag));
+	http_header = curl_slist_append(http_header,
+			"Content-Type: text/calendar; charset=\"utf-8\"");
+	http_header = curl_slist_append(http_header, "Expect:");
+	http_header = curl_slist_append(http_header, "Transfer-Encoding:");
+	http_header = caldav_lock_header(settings, http_header);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+	/* we pass our 'chunk' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+	/* send all data to this function  */
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+	/* we pass our 'headers' struct to the callback function */
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_header);
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+	res = caldav_put(settings, curl, body, http_header, error_buf);
+	if (res != 0) {
+		error->code = caldav_transfer_code(res);
+		error->str = g_strdup_printf("%s", error_buf);
+		result = TRUE;
+	}
+	else {
+		long code;
+		res = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		/* 412 means the object changed since it was read */
+		if (code < 200 || code >= 300) {
+			error->code = code;
+			error->str = g_strdup((chunk.memory) ? chunk.memory : headers.memory);
+			result = TRUE;
+		}
+		else {
+			if (settings->cache)
+				caldav_cache_written(settings, url,
+						&headers, caldav_upload_text(body));
+			if (etag) {
+				g_free(*etag);
+				*etag = get_response_header("ETag", &headers, FALSE);
+			}
+		}
+	}
+	if (chunk.memory)
+		free(chunk.memory);
+	if (headers.memory)
+		free(headers.memory);
+	curl_slist_free_all(http_header);
+	release_curl(settings, curl);
+	return result;
+}
@@ -39,4 +39,28 @@ gboolean caldav_modify(caldav_settings* settings, caldav_error* error);
  */
 gboolean caldav_tasks_modify(caldav_settings* settings, caldav_error* error);
 
+/**
+ * Function for building the calendar-query which finds an object by UID.
+ * @param uid The UID to search for.
+ * @param tasks TRUE to search for a VTODO, FALSE for a VEVENT.
+ * @return The request. Caller is responsible for freeing the memory.
+ */
+gchar* caldav_uid_request(const gchar* uid, gboolean tasks);
+
+/**
+ * Function for replacing the object stored at href without searching for
+ * it first. settings->file, or settings->upload if set, holds the new
+ * object. The write is made conditional on the ETag instead of taking a
+ * LOCK.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param href Path or URL of the calendar object resource.
+ * @param etag Pointer to the ETag the stored object must still have or to
+ * NULL for an unconditional write. On success it is replaced by the new
+ * ETag, or NULL if the server did not send one.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_modify_href(caldav_settings* settings, const gchar* href,
+			    gchar** etag, caldav_error* error);
+
 #endif
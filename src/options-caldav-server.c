@@ -28,6 +28,187 @@
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * @struct server_capabilities
+ * What an OPTIONS request told us about a collection and when we asked.
+ */
+typedef struct {
+	gchar* dav;
+	gchar* allow;
+	gchar* accept;
+	time_t stamp;
+} server_capabilities;
+
+/* collection key -> server_capabilities, shared by all sessions */
+static GHashTable* capabilities = NULL;
+G_LOCK_DEFINE_STATIC(capabilities);
+
+static void free_capabilities(gpointer data) {
+	server_capabilities* cap = (server_capabilities *) data;
+
+	g_free(cap->dav);
+	g_free(cap->allow);
+	g_free(cap->accept);
+	g_free(cap);
+}
+
+/**
+ * Look up cached capabilities for a collection.
+ * @param settings @see caldav_settings
+ * @param allow Where to store a copy of the Allow header or NULL.
+ * @return TRUE if a fresh entry was found, FALSE otherwise.
+ */
+gboolean caldav_capabilities_lookup(caldav_settings* settings, gchar** allow) {
+	server_capabilities* cap;
+	gchar* key;
+	gboolean found = FALSE;
+	int ttl;
+
+	ttl = (settings->capability_ttl) ?
+		settings->capability_ttl : CALDAV_CAPABILITY_TTL;
+	if (ttl < 0)
+		return FALSE;
+	key = collection_key(settings);
+	G_LOCK(capabilities);
+	if (capabilities) {
+		cap = g_hash_table_lookup(capabilities, key);
+		if (cap && time(NULL) - cap->stamp < ttl) {
+			if (allow)
+				*allow = g_strdup(cap->allow);
+			found = TRUE;
+		}
+		else if (cap) {
+			g_hash_table_remove(capabilities, key);
+		}
+	}
+	G_UNLOCK(capabilities);
+	g_free(key);
+	return found;
+}
+
+/**
+ * Remember the capabilities reported for a collection.
+ * @param settings @see caldav_settings
+ * @param dav Value of the DAV header.
+ * @param allow Value of the Allow header.
+ * @param accept Value of the Accept-Encoding header or NULL.
+ */
+void caldav_capabilities_store(caldav_settings* settings,
+			       const gchar* dav,
+			       const gchar* allow,
+			       const gchar* accept) {
+	server_capabilities* cap;
+
+	if (settings->capability_ttl < 0)
+		return;
+	cap = g_new0(server_capabilities, 1);
+	cap->dav = g_strdup(dav);
+	cap->allow = g_strdup(allow);
+	cap->accept = (accept) ? g_ascii_strdown(accept, -1) : NULL;
+	cap->stamp = time(NULL);
+	G_LOCK(capabilities);
+	if (! capabilities)
+		capabilities = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, free_capabilities);
+	g_hash_table_replace(capabilities, collection_key(settings), cap);
+	G_UNLOCK(capabilities);
+}
+
+/**
+ * Test whether an Accept-Encoding value lists a content coding with a
+ * q-value above zero.
+ * @param accept A lowercase Accept-Encoding value.
+ * @param coding The content coding.
+ */
+static gboolean accept_has(const gchar* accept, const gchar* coding) {
+	gchar** codings;
+	gchar** tmp;
+	gchar* q;
+	gboolean found = FALSE;
+
+	codings = g_strsplit(accept, ",", 0);
+	for (tmp = codings; *tmp && ! found; tmp++) {
+		if ((q = strchr(*tmp, ';')) != NULL) {
+			*q++ = '\0';
+			q = strstr(q, "q=");
+		}
+		if (strcmp(g_strstrip(*tmp), coding) == 0)
+			found = (! q || g_ascii_strtod(q + 2, NULL) > 0);
+	}
+	g_strfreev(codings);
+	return found;
+}
+
+/**
+ * Test whether a collection takes request bodies with a content coding.
+ * @param settings @see caldav_settings
+ * @param coding The content coding, e.g. "gzip".
+ * @return TRUE if the cached Accept-Encoding lists coding.
+ */
+gboolean caldav_capabilities_accept(caldav_settings* settings,
+				    const gchar* coding) {
+	server_capabilities* cap;
+	gchar* key;
+	gboolean found = FALSE;
+
+	key = collection_key(settings);
+	G_LOCK(capabilities);
+	if (capabilities) {
+		cap = g_hash_table_lookup(capabilities, key);
+		if (cap && cap->accept)
+			found = accept_has(cap->accept, coding);
+	}
+	G_UNLOCK(capabilities);
+	g_free(key);
+	return found;
+}
+
+/**
+ * Forget that a collection takes request bodies with a content coding
+ * after it refused one.
+ * @param settings @see caldav_settings
+ * @param coding The content coding.
+ */
+void caldav_capabilities_refuse(caldav_settings* settings,
+				const gchar* coding) {
+	server_capabilities* cap;
+	gchar* key;
+
+	key = collection_key(settings);
+	G_LOCK(capabilities);
+	if (capabilities) {
+		cap = g_hash_table_lookup(capabilities, key);
+		if (cap && cap->accept && accept_has(cap->accept, coding)) {
+			g_free(cap->accept);
+			cap->accept = NULL;
+		}
+	}
+	G_UNLOCK(capabilities);
+	g_free(key);
+}
+
+/**
+ * Function for forgetting cached server capabilities.
+ * @param settings The collection to forget. If NULL the whole cache is
+ * flushed.
+ */
+void caldav_invalidate_capabilities(caldav_settings* settings) {
+	gchar* key;
+
+	G_LOCK(capabilities);
+	if (capabilities) {
+		if (settings) {
+			key = collection_key(settings);
+			g_hash_table_remove(capabilities, key);
+			g_free(key);
+		}
+		else {
+			g_hash_table_remove_all(capabilities);
+		}
+	}
+	G_UNLOCK(capabilities);
+}
+
 /**
  * Function for getting supported options from a server.
  * @param curl A pointer to an initialized CURL instance
@@ -40,6 +221,8 @@
  * @param error A pointer to caldav_error. @see caldav_error
  * @param test if this is true response will be whether the server
  * represented by the URL is a CalDAV collection or not.
+ * A successful answer is cached per collection for settings->capability_ttl
+ * seconds so repeated calls do not cost another round trip.
  * @return FALSE in case of error, TRUE otherwise.
  */
 gboolean caldav_getoptions(CURL* curl, caldav_settings* settings, response* result,
@@ -49,18 +232,30 @@ gboolean caldav_getoptions(CURL* curl, caldav_settings* settings, response* resu
 	struct MemoryStruct chunk;
 	struct MemoryStruct headers;
 	gboolean enabled = FALSE;
+	caldav_error local_error;
 
 	if (! curl)
 		return FALSE;
+	memset(&local_error, 0, sizeof(caldav_error));
 
-	if (!error) {
-		error = (caldav_error *) malloc(sizeof(struct _caldav_error));
-		memset(error, '\0', sizeof(struct _caldav_error));
-	}
+	if (test && caldav_capabilities_lookup(settings, NULL))
+		return TRUE;
+	if (! test && caldav_capabilities_lookup(settings, &result->msg))
+		return TRUE;
+
+	if (!error)
+		error = &local_error;
+	error_buf[0] = 0;
 	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
 	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
 	headers.memory = NULL;
 	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
 
 	/* send all data to this function  */
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
@@ -75,15 +270,24 @@ gboolean caldav_getoptions(CURL* curl, caldav_settings* settings, response* resu
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
 	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
-	res = curl_easy_perform(curl);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
 	if (res == 0) {
 		gchar* head;
-		head = get_response_header("DAV", headers.memory, TRUE);
+		head = get_response_header("DAV", &headers, TRUE);
 		if (head && strstr(head, "calendar-access") != NULL) {
+			gchar* allow;
+			gchar* accept;
 			enabled = TRUE;
+			allow = get_response_header("Allow", &headers, FALSE);
+			accept = get_response_header("Accept-Encoding",
+					&headers, TRUE);
+			caldav_capabilities_store(settings, head, allow, accept);
+			g_free(accept);
 			if (! test) {
-				result->msg = g_strdup(
-						get_response_header("Allow", headers.memory, FALSE));
+				result->msg = allow;
+			}
+			else {
+				g_free(allow);
 			}
 		}
 		else {
@@ -120,7 +324,12 @@ gboolean caldav_getoptions(CURL* curl, caldav_settings* settings, response* resu
 	}
 	else if (res == CURLE_COULDNT_CONNECT) {
 		error->code = -4;
-		error->str = g_strdup("Unable to connect");
+		/* tells a host held back by its circuit breaker apart */
+		error->str = g_strdup((*error_buf) ? error_buf : "Unable to connect");
+	}
+	else if (res == CURLE_OPERATION_TIMEDOUT) {
+		error->code = -5;
+		error->str = g_strdup(error_buf);
 	}
 	else {
 		error->code = -1;
@@ -130,6 +339,7 @@ gboolean caldav_getoptions(CURL* curl, caldav_settings* settings, response* resu
 		free(chunk.memory);
 	if (headers.memory)
 		free(headers.memory);
+	g_free(local_error.str);
 	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
 	return enabled;
 }
@@ -23,6 +23,56 @@
 #include "caldav-utils.h"
 #include "caldav.h"
 
+/** Seconds a cached OPTIONS answer is trusted unless configured otherwise */
+#ifndef CALDAV_CAPABILITY_TTL
+#define CALDAV_CAPABILITY_TTL 300
+#endif
+
+/**
+ * Look up cached capabilities for a collection.
+ * @param settings @see caldav_settings
+ * @param allow Where to store a copy of the Allow header or NULL.
+ * @return TRUE if a fresh entry was found, FALSE otherwise.
+ */
+gboolean caldav_capabilities_lookup(caldav_settings* settings, gchar** allow);
+
+/**
+ * Remember the capabilities reported for a collection.
+ * @param settings @see caldav_settings
+ * @param dav Value of the DAV header.
+ * @param allow Value of the Allow header.
+ * @param accept Value of the Accept-Encoding header or NULL.
+ */
+void caldav_capabilities_store(caldav_settings* settings,
+			       const gchar* dav,
+			       const gchar* allow,
+			       const gchar* accept);
+
+/**
+ * Test whether a collection takes request bodies with a content coding.
+ * @param settings @see caldav_settings
+ * @param coding The content coding, e.g. "gzip".
+ * @return TRUE if the cached Accept-Encoding lists coding.
+ */
+gboolean caldav_capabilities_accept(caldav_settings* settings,
+				    const gchar* coding);
+
+/**
+ * Forget that a collection takes request bodies with a content coding
+ * after it refused one.
+ * @param settings @see caldav_settings
+ * @param coding The content coding.
+ */
+void caldav_capabilities_refuse(caldav_settings* settings,
+				const gchar* coding);
+
+/**
+ * Function for forgetting cached server capabilities.
+ * @param settings The collection to forget. If NULL the whole cache is
+ * flushed.
+ */
+void caldav_invalidate_capabilities(caldav_settings* settings);
+
 /**
  * Function for getting supported options from a server.
  * @param curl A pointer to an initialized CURL instance
@@ -35,9 +85,18 @@
  * @param error A pointer to caldav_error. @see caldav_error
  * @param test if this is true response will be whether the server
  * represented by the URL is a CalDAV collection or not.
+ * A successful answer is cached per collection for settings->capability_ttl
+ * seconds so repeated calls do not cost another round trip.
  * @return FALSE in case of error, TRUE otherwise.
  */
 gboolean caldav_getoptions(CURL* curl, caldav_settings* settings, response* result,
 				caldav_error* error, gboolean test);
 
+/**
+ * Function for forgetting cached server capabilities.
+ * @param settings The collection to forget. If NULL the whole cache is
+ * flushed.
+ */
+void caldav_invalidate_capabilities(caldav_settings* settings);
+
 #endif
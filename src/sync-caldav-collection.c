@@ -0,0 +1,748 @@
+/* vim: set textwidth=80 tabstop=4 smarttab: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "sync-caldav-collection.h"
+#include <glib.h>
+#include <curl/curl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * A static literal string containing the first part of the sync-collection
+ * request. The token is added at runtime.
+ */
+static const char* sync_request_head =
+"<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+"<D:sync-collection xmlns:D=\"DAV:\">"
+" <D:sync-token>";
+
+/**
+ * A static literal string containing the last part of the sync-collection
+ * request
+ */
+static const char* sync_request_foot =
+"</D:sync-token>"
+" <D:sync-level>1</D:sync-level>"
+" <D:prop>"
+"   <D:getetag/>"
+" </D:prop>"
+"</D:sync-collection>\r\n";
+
+/**
+ * A static literal string containing the PROPFIND for the collection CTag
+ */
+static const char* getctag_request =
+"<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+"<D:propfind xmlns:D=\"DAV:\" xmlns:CS=\"http://calendarserver.org/ns/\">"
+" <D:prop>"
+"   <CS:getctag/>"
+" </D:prop>"
+"</D:propfind>\r\n";
+
+/**
+ * A static literal string containing the PROPFIND for all ETags
+ */
+static const char* getetag_request =
+"<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+"<D:propfind xmlns:D=\"DAV:\">"
+" <D:prop>"
+"   <D:getetag/>"
+" </D:prop>"
+"</D:propfind>\r\n";
+
+/**
+ * A static literal string containing the first part of the PROPFIND for a
+ * caldav_etags listing. The optional properties are added at runtime.
+ */
+static const char* etags_request_head =
+"<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+"<D:propfind xmlns:D=\"DAV:\">"
+" <D:prop>"
+"   <D:getetag/>";
+
+/**
+ * A static literal string containing the last part of the PROPFIND for a
+ * caldav_etags listing
+ */
+static const char* etags_request_foot =
+" </D:prop>"
+"</D:propfind>\r\n";
+
+/**
+ * @enum SYNC_STATE the outcome of a sync-collection REPORT.
+ */
+typedef enum {
+	SYNC_DONE,
+	SYNC_PARTIAL,	/* still truncated after CALDAV_SYNC_ROUNDS answers */
+	SYNC_UNSUPPORTED,
+	SYNC_FAILED
+} SYNC_STATE;
+
+/**
+ * Send a request with an XML body to the collection.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param method The HTTP method.
+ * @param kind The headers, CALDAV_HEADERS_XML or the one with the Depth.
+ * @param request The body.
+ * @param reply Where to store the response body. Caller is responsible
+ * for freeing the memory.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, including any answer but 207.
+ */
+static gboolean send_request(caldav_settings* settings,
+			     const gchar* method,
+			     CALDAV_HEADERS kind,
+			     const gchar* request,
+			     gchar** reply,
+			     caldav_error* error) {
+	CURL* curl;
+	CURLcode res = 0;
+	char error_buf[CURL_ERROR_SIZE];
+	struct MemoryStruct chunk;
+	struct MemoryStruct headers;
+	gboolean result = FALSE;
+	long code;
+
+	chunk.memory = NULL; /* we expect realloc(NULL, size) to work */
+	chunk.size = 0;    /* no data at this point */
+	chunk.capacity = 0;
+	chunk.fields = 0;
+	chunk.body = NULL;
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = &chunk;
+	*reply = NULL;
+
+	curl = get_curl(settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return TRUE;
+	}
+
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, caldav_headers(kind));
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(request));
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
+	if (res != 0) {
+		error->code = caldav_transfer_code(res);
+		error->str = g_strdup_printf("%s", error_buf);
+		result = TRUE;
+	}
+	else {
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		if (code != 207) {
+			error->code = code;
+			error->str = g_strdup(headers.memory);
+			result = TRUE;
+		}
+		*reply = (chunk.memory) ? g_strdup(chunk.memory) : NULL;
+	}
+	if (chunk.memory)
+		free(chunk.memory);
+	if (headers.memory)
+		free(headers.memory);
+	release_curl(settings, curl);
+	return result;
+}
+
+/**
+ * Clear the error from a failed attempt which is recovered from.
+ * @param error A pointer to caldav_error. @see caldav_error
+ */
+static void clear_error(caldav_error* error) {
+	g_free(error->str);
+	error->str = NULL;
+	error->code = 0;
+}
+
+/**
+ * Strip scheme and host from an href and any trailing slash.
+ * @param href A path or URL.
+ * @return The path. Caller is responsible for freeing the memory.
+ */
+static gchar* href_path(const gchar* href) {
+	const gchar* path = href;
+	gchar* result;
+	gsize len;
+
+	if (strstr(path, "://")) {
+		path = strchr(strstr(path, "://") + 3, '/');
+		if (! path)
+			path = "/";
+	}
+	result = g_strdup(path);
+	len = strlen(result);
+	while (len > 1 && result[len - 1] == '/')
+		result[--len] = '\0';
+	return result;
+}
+
+/**
+ * Run sync-collection REPORTs from token until the server says the answer
+ * is complete.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param token The previous token or NULL.
+ * @param entries Where to append the returned multistatus_entry.
+ * @param new_token Where to store the token for the next synchronization.
+ * @param full Set to TRUE if the server restarted from an empty token.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return SYNC_DONE, SYNC_PARTIAL if the server still had more changes
+ * after CALDAV_SYNC_ROUNDS answers, SYNC_UNSUPPORTED if the server has no
+ * sync-collection or SYNC_FAILED.
+ */
+static SYNC_STATE sync_collection(caldav_settings* settings,
+				  const gchar* token,
+				  GSList** entries,
+				  gchar** new_token,
+				  gboolean* full,
+				  caldav_error* error) {
+	gchar* current;
+	gchar* escaped;
+	gchar* request;
+	gchar* reply;
+	gchar* collection;
+	gchar* path;
+	GSList* list;
+	GSList* item;
+	multistatus_entry* entry;
+	gboolean truncated = TRUE;
+	gboolean failed;
+	int rounds;
+
+	*full = (! token || ! *token);
+	current = g_strdup((token) ? token : "");
+	collection = href_path(settings->url);
+	for (rounds = 0; truncated && rounds < CALDAV_SYNC_ROUNDS; rounds++) {
+		escaped = g_markup_escape_text(current, -1);
+		request = g_strdup_printf("%s%s%s",
+				sync_request_head, escaped, sync_request_foot);
+		g_free(escaped);
+		failed = send_request(settings, "REPORT", CALDAV_HEADERS_XML,
+				request, &reply, error);
+		g_free(request);
+		if (failed) {
+			g_free(collection);
+			if (error->code > 0 && *current && reply &&
+					strstr(reply, "valid-sync-token")) {
+				/* the server forgot the token, start over */
+				g_free(reply);
+				g_free(current);
+				clear_error(error);
+				free_multistatus(*entries);
+				*entries = NULL;
+				return sync_collection(settings, NULL, entries,
+						new_token, full, error);
+			}
+			g_free(reply);
+			g_free(current);
+			if (error->code == 401 || error->code == 404 ||
+					error->code == 407 || error->code < 0)
+				return SYNC_FAILED;
+			return SYNC_UNSUPPORTED;
+		}
+		g_free(current);
+		current = get_element_text(reply, "sync-token");
+		if (! current)
+			current = g_strdup("");
+		list = parse_multistatus(reply);
+		caldav_account_parse(settings);
+		g_free(reply);
+		truncated = FALSE;
+		/* a 507 on the collection means more changes are waiting */
+		for (item = list; item; item = g_slist_next(item)) {
+			entry = (multistatus_entry *) item->data;
+			if (entry->status == 507 && entry->href) {
+				path = href_path(entry->href);
+				/* settings->url carries the host, compare the path part */
+				if (g_str_has_suffix(collection, path))
+					truncated = TRUE;
+				g_free(path);
+			}
+		}
+		*entries = g_slist_concat(*entries, list);
+		if (! *current)
+			break;
+	}
+	g_free(collection);
+	*new_token = current;
+	return (truncated) ? SYNC_PARTIAL : SYNC_DONE;
+}
+
+/**
+ * Find the ETag the caller knows for an href.
+ * @return The ETag or NULL.
+ */
+static const gchar* known_etag(const caldav_objects* known, const gchar* href) {
+	const caldav_object* object;
+
+	if (! known || ! href)
+		return NULL;
+	object = caldav_objects_lookup(known, href);
+	return (object) ? object->etag : NULL;
+}
+
+static int compare_objects(const void* a, const void* b) {
+	return strcmp(((const caldav_object *) a)->href,
+			((const caldav_object *) b)->href);
+}
+
+/**
+ * Turn multistatus entries into changes relative to what the caller knows.
+ * @param entries A list of multistatus_entry. Hrefs and ETags are moved.
+ * @param complete TRUE if entries lists every object in the collection.
+ * @param known NULL or the objects the caller has, sorted by href.
+ * @param changes A pointer to caldav_changes receiving the changes.
+ */
+static void collect_changes(GSList* entries,
+			    gboolean complete,
+			    const caldav_objects* known,
+			    caldav_changes* changes) {
+	GSList* item;
+	GSList* deleted = NULL;
+	GHashTable* listed = NULL;
+	multistatus_entry* entry;
+	caldav_object* object;
+	const gchar* etag;
+	int i, n;
+
+	n = g_slist_length(entries);
+	changes->changed = g_new0(caldav_object, n + 1);
+	if (complete && known)
+		listed = g_hash_table_new(g_str_hash, g_str_equal);
+	for (item = entries; item; item = g_slist_next(item)) {
+		entry = (multistatus_entry *) item->data;
+		if (! entry->href)
+			continue;
+		if (entry->status == 404 || entry->status == 410) {
+			if (! complete)
+				deleted = g_slist_prepend(deleted, g_strdup(entry->href));
+			continue;
+		}
+		/* no status at all is taken as success */
+		if (entry->status && (entry->status < 200 || entry->status >= 300))
+			continue;
+		if (listed)
+			g_hash_table_insert(listed, entry->href, entry);
+		etag = known_etag(known, entry->href);
+		if (etag && entry->etag && strcmp(etag, entry->etag) == 0)
+			continue;
+		object = &changes->changed[changes->changed_count++];
+		object->href = g_strdup(entry->href);
+		object->etag = g_strdup(entry->etag);
+	}
+	qsort(changes->changed, changes->changed_count, sizeof(caldav_object),
+			compare_objects);
+	if (listed) {
+		/* whatever the caller has and the server no longer lists is gone */
+		for (i = 0; i < known->count; i++) {
+			if (! g_hash_table_lookup(listed, known->objects[i].href))
+				deleted = g_slist_prepend(deleted,
+						g_strdup(known->objects[i].href));
+		}
+		g_hash_table_destroy(listed);
+	}
+	changes->full = (complete && ! known) ? 1 : 0;
+	changes->deleted_count = g_slist_length(deleted);
+	changes->deleted = g_new0(char*, changes->deleted_count + 1);
+	deleted = g_slist_reverse(deleted);
+	for (i = 0, item = deleted; item; item = g_slist_next(item))
+		changes->deleted[i++] = (char *) item->data;
+	g_slist_free(deleted);
+}
+
+/**
+ * @struct etag_stream
+ * Passed between the libcurl write callback and the multistatus parser
+ * while listing ETags
+ */
+struct etag_stream {
+	CURL* curl;
+	multistatus_stream* parser;
+	gchar* collection;
+	int props;
+	GSList* entries;
+};
+
+/**
+ * Test whether a response element is the collection itself or has no
+ * href. Internal function.
+ */
+static gboolean etag_skip(struct etag_stream* stream,
+			  multistatus_entry* entry) {
+	gchar* path;
+	gboolean skip;
+
+	if (! entry->href)
+		return TRUE;
+	path = href_path(entry->href);
+	/* settings->url carries the host, compare the path part */
+	skip = g_str_has_suffix(stream->collection, path);
+	g_free(path);
+	return skip;
+}
+
+/**
+ * Keep one response element for caldav_list_etags. Internal function.
+ */
+static gboolean etag_keep(multistatus_entry* entry, void* data) {
+	struct etag_stream* stream = (struct etag_stream *) data;
+	multistatus_entry* kept;
+
+	if (etag_skip(stream, entry))
+		return FALSE;
+	/* the parser frees the entry, keep its strings */
+	kept = g_new(multistatus_entry, 1);
+	*kept = *entry;
+	kept->content = kept->content_end = NULL;
+	entry->href = entry->etag = entry->data = NULL;
+	stream->entries = g_slist_prepend(stream->entries, kept);
+	return FALSE;
+}
+
+/**
+ * Turn one response element into a caldav_etag for caldav_propfind_etags.
+ * Internal function.
+ */
+static gboolean etag_pair(multistatus_entry* entry, void* data) {
+	struct etag_stream* stream = (struct etag_stream *) data;
+	caldav_etag* etag;
+	gchar* text;
+
+	if (etag_skip(stream, entry))
+		return FALSE;
+	etag = g_new(caldav_etag, 1);
+	etag->href = entry->href;
+	etag->etag = entry->etag;
+	etag->modified = 0;
+	etag->size = -1;
+	entry->href = entry->etag = NULL;
+	if (stream->props & CALDAV_ETAG_MODIFIED &&
+			(text = multistatus_entry_text(entry,
+					"getlastmodified")) != NULL) {
+		/* an RFC1123 date */
+		etag->modified = curl_getdate(text, NULL);
+		if (etag->modified == -1)
+			etag->modified = 0;
+		g_free(text);
+	}
+	if (stream->props & CALDAV_ETAG_SIZE &&
+			(text = multistatus_entry_text(entry,
+					"getcontentlength")) != NULL) {
+		etag->size = strtol(text, NULL, 10);
+		g_free(text);
+	}
+	stream->entries = g_slist_prepend(stream->entries, etag);
+	return FALSE;
+}
+
+/**
+ * libcurl write callback feeding the multistatus parser. Bodies of
+ * anything but the final 207 (redirects, authentication) are dropped.
+ * Internal function.
+ */
+static size_t EtagStreamCallback(void* ptr, size_t size, size_t nmemb,
+				 void* data) {
+	struct etag_stream* stream = (struct etag_stream *) data;
+	size_t realsize = size * nmemb;
+	long code = 0;
+
+	caldav_count_received(realsize);
+	curl_easy_getinfo(stream->curl, CURLINFO_RESPONSE_CODE, &code);
+	if (code != 207)
+		return realsize;
+	if (multistatus_stream_feed(stream->parser, (const gchar *) ptr, realsize))
+		return 0;
+	return realsize;
+}
+
+/**
+ * Run a PROPFIND of depth 1 on the collection feeding the response to a
+ * multistatus parser while it arrives. Internal function.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param request The PROPFIND body.
+ * @param handler Called for every response element.
+ * @param stream Passed to handler. curl, parser and collection are set
+ * here.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+static gboolean etag_run(caldav_settings* settings,
+			 const gchar* request,
+			 multistatus_handler handler,
+			 struct etag_stream* stream,
+			 caldav_error* error) {
+	CURL* curl;
+	CURLcode res = 0;
+	char error_buf[CURL_ERROR_SIZE];
+	struct MemoryStruct headers;
+	gboolean result = FALSE;
+	long code;
+
+	headers.memory = NULL;
+	headers.size = 0;
+	headers.capacity = 0;
+	headers.fields = 0;
+	headers.body = NULL;
+
+	curl = get_curl(settings);
+	if (!curl) {
+		error->code = -1;
+		error->str = g_strdup("Could not initialize libcurl");
+		return TRUE;
+	}
+	stream->curl = curl;
+	stream->parser = multistatus_stream_new(handler, stream);
+	stream->collection = href_path(settings->url);
+
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+			caldav_headers(CALDAV_HEADERS_DEPTH_1));
+	/* parse the body while it arrives */
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, EtagStreamCallback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)stream);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, WriteHeaderCallback);
+	curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)&headers);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(request));
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, (char *) &error_buf);
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PROPFIND");
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+	curl_easy_setopt(curl, CURLOPT_UNRESTRICTED_AUTH, 1);
+	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+	res = caldav_perform_read(settings, curl, &headers, error_buf);
+	if (res != 0) {
+		error->code = caldav_transfer_code(res);
+		error->str = g_strdup_printf("%s", error_buf);
+		result = TRUE;
+	}
+	else {
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		if (code != 207) {
+			error->code = code;
+			error->str = g_strdup(headers.memory);
+			result = TRUE;
+		}
+	}
+	multistatus_stream_free(stream->parser);
+	g_free(stream->collection);
+	if (headers.memory)
+		free(headers.memory);
+	release_curl(settings, curl);
+	return result;
+}
+
+/**
+ * Function for listing the href and ETag of every object in a collection
+ * with a PROPFIND of depth 1. The collection itself is left out.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param entries Where to store the list of multistatus_entry. Free it
+ * with free_multistatus().
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_list_etags(caldav_settings* settings,
+			   GSList** entries,
+			   caldav_error* error) {
+	struct etag_stream stream;
+
+	stream.props = 0;
+	stream.entries = NULL;
+	if (etag_run(settings, getetag_request, etag_keep, &stream, error)) {
+		free_multistatus(stream.entries);
+		*entries = NULL;
+		return TRUE;
+	}
+	*entries = g_slist_reverse(stream.entries);
+	return FALSE;
+}
+
+static int compare_etags(const void* a, const void* b) {
+	return strcmp(((const caldav_etag *) a)->href,
+			((const caldav_etag *) b)->href);
+}
+
+/**
+ * Function for listing the href and ETag of every object in a collection
+ * into a caldav_etags with a PROPFIND of depth 1. No object is fetched and
+ * the collection itself is left out.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param props 0 or CALDAV_ETAG_MODIFIED and/or CALDAV_ETAG_SIZE.
+ * @param result A pointer to caldav_etags where the entries are stored
+ * sorted by href.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_propfind_etags(caldav_settings* settings,
+			       int props,
+			       caldav_etags* result,
+			       caldav_error* error) {
+	struct etag_stream stream;
+	gchar* request;
+	GSList* item;
+	caldav_etag* etag;
+	gboolean res;
+	int i;
+
+	result->etags = NULL;
+	result->count = 0;
+	stream.props = props;
+	stream.entries = NULL;
+	request = g_strconcat(etags_request_head,
+			(props & CALDAV_ETAG_MODIFIED) ?
+				"   <D:getlastmodified/>" : "",
+			(props & CALDAV_ETAG_SIZE) ?
+				"   <D:getcontentlength/>" : "",
+			etags_request_foot, NULL);
+	res = etag_run(settings, request, etag_pair, &stream, error);
+	g_free(request);
+	result->count = (res) ? 0 : g_slist_length(stream.entries);
+	if (result->count > 0)
+		result->etags = g_new(caldav_etag, result->count);
+	for (i = 0, item = stream.entries; item; item = g_slist_next(item)) {
+		etag = (caldav_etag *) item->data;
+		if (res) {
+			g_free(etag->href);
+			g_free(etag->etag);
+		}
+		else
+			result->etags[i++] = *etag;
+		g_free(etag);
+	}
+	g_slist_free(stream.entries);
+	if (result->count > 1)
+		qsort(result->etags, result->count, sizeof(caldav_etag),
+				compare_etags);
+	return res;
+}
+
+/**
+ * Synchronize by comparing the collection CTag and the object ETags.
+ * @see caldav_sync
+ */
+static gboolean sync_ctag(caldav_settings* settings,
+			  const gchar* token,
+			  const caldav_objects* known,
+			  caldav_changes* changes,
+			  caldav_error* error) {
+	gchar* reply;
+	gchar* ctag;
+	const gchar* old_ctag = NULL;
+	GSList* entries;
+
+	if (token && g_str_has_prefix(token, CALDAV_SYNC_CTAG_PREFIX))
+		old_ctag = token + strlen(CALDAV_SYNC_CTAG_PREFIX);
+	if (send_request(settings, "PROPFIND", CALDAV_HEADERS_DEPTH_0,
+				getctag_request, &reply, error)) {
+		g_free(reply);
+		return TRUE;
+	}
+	ctag = get_element_text(reply, "getctag");
+	g_free(reply);
+	if (ctag && old_ctag && strcmp(ctag, old_ctag) == 0) {
+		/* nothing changed since the last time */
+		changes->changed = g_new0(caldav_object, 1);
+		changes->deleted = g_new0(char*, 1);
+		changes->token = g_strdup(token);
+		g_free(ctag);
+		return FALSE;
+	}
+	if (caldav_list_etags(settings, &entries, error)) {
+		g_free(ctag);
+		return TRUE;
+	}
+	collect_changes(entries, TRUE, known, changes);
+	free_multistatus(entries);
+	changes->token = g_strdup_printf("%s%s",
+			CALDAV_SYNC_CTAG_PREFIX, (ctag) ? ctag : "");
+	g_free(ctag);
+	return FALSE;
+}
+
+/**
+ * Function for getting the changes to a collection since an earlier
+ * synchronization.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param token The token from the previous synchronization or NULL.
+ * @param known NULL or the objects the caller has, sorted by href.
+ * @param changes A pointer to caldav_changes receiving the changes.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_sync(caldav_settings* settings,
+		     const gchar* token,
+		     const caldav_objects* known,
+		     caldav_changes* changes,
+		     caldav_error* error) {
+	GSList* entries = NULL;
+	gchar* new_token = NULL;
+	gboolean full = FALSE;
+
+	memset(changes, 0, sizeof(caldav_changes));
+	/* a CTag token means the server had no sync-collection last time */
+	if (token && g_str_has_prefix(token, CALDAV_SYNC_CTAG_PREFIX))
+		return sync_ctag(settings, token, known, changes, error);
+	switch (sync_collection(settings, token, &entries, &new_token,
+				&full, error)) {
+		case SYNC_DONE:
+			collect_changes(entries, full, known, changes);
+			changes->token = new_token;
+			free_multistatus(entries);
+			return FALSE;
+		case SYNC_PARTIAL:
+			/*
+			 * What was listed is applied, but nothing can be said of the
+			 * objects not listed yet. The old token is handed back so the
+			 * next synchronization asks for the rest again.
+			 */
+			collect_changes(entries, FALSE, known, changes);
+			changes->token = g_strdup((token) ? token : "");
+			changes->partial = 1;
+			g_free(new_token);
+			free_multistatus(entries);
+			error->code = 507;
+			error->str = g_strdup_printf("sync-collection still truncated "
+					"after %d answers, the token was kept",
+					CALDAV_SYNC_ROUNDS);
+			return FALSE;
+		case SYNC_UNSUPPORTED:
+			free_multistatus(entries);
+			clear_error(error);
+			return sync_ctag(settings, NULL, known, changes, error);
+		default:
+			free_multistatus(entries);
+			return TRUE;
+	}
+}
@@ -0,0 +1,99 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SYNC_CALDAV_COLLECTION_H__
+#define __SYNC_CALDAV_COLLECTION_H__
+
+#include "caldav-utils.h"
+#include "caldav.h"
+#include <glib.h>
+
+/**
+ * Prefix of the tokens handed out when the server has no sync-collection
+ * and the collection CTag is used instead.
+ */
+#define CALDAV_SYNC_CTAG_PREFIX "libcaldav-ctag:"
+
+/** Maximum number of truncated (507) sync-collection answers followed */
+#ifndef CALDAV_SYNC_ROUNDS
+#define CALDAV_SYNC_ROUNDS 32
+/**
+ * Function for listing the href and ETag of every object in a collection
+ * into a caldav_etags with a PROPFIND of depth 1. No object is fetched and
+ * the collection itself is left out.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param props 0 or CALDAV_ETAG_MODIFIED and/or CALDAV_ETAG_SIZE.
+ * @param result A pointer to caldav_etags where the entries are stored
+ * sorted by href.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_propfind_etags(caldav_settings* settings,
+			       int props,
+			       caldav_etags* result,
+			       caldav_error* error);
+
+#endif
+
+/**
+ * Function for getting the changes to a collection since an earlier
+ * synchronization.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param token The token from the previous synchronization or NULL.
+ * @param known NULL or the objects the caller has, sorted by href.
+ * @param changes A pointer to caldav_changes receiving the changes.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_sync(caldav_settings* settings,
+		     const gchar* token,
+		     const caldav_objects* known,
+		     caldav_changes* changes,
+		     caldav_error* error);
+
+/**
+ * Function for listing the href and ETag of every object in a collection
+ * with a PROPFIND of depth 1. The collection itself is left out.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param entries Where to store the list of multistatus_entry. Free it
+ * with free_multistatus().
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_list_etags(caldav_settings* settings,
+			   GSList** entries,
+			   caldav_error* error);
+
+/**
+ * Function for listing the href and ETag of every object in a collection
+ * into a caldav_etags with a PROPFIND of depth 1. No object is fetched and
+ * the collection itself is left out.
+ * @param settings A pointer to caldav_settings. @see caldav_settings
+ * @param props 0 or CALDAV_ETAG_MODIFIED and/or CALDAV_ETAG_SIZE.
+ * @param result A pointer to caldav_etags where the entries are stored
+ * sorted by href.
+ * @param error A pointer to caldav_error. @see caldav_error
+ * @return TRUE in case of error, FALSE otherwise.
+ */
+gboolean caldav_propfind_etags(caldav_settings* settings,
+			       int props,
+			       caldav_etags* result,
+			       caldav_error* error);
+
+#endif
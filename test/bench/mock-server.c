@@ -0,0 +1,904 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "mock-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/** Token handed out by every sync-collection REPORT */
+#define MOCK_SYNC_TOKEN "http://bench/sync/1"
+
+/** Token handed out by a sync-collection REPORT answering half */
+#define MOCK_SYNC_HALF "http://bench/sync/half"
+
+/**
+ * Large bodies built on first use and then served as they are.
+ */
+typedef enum {
+	CANNED_EVENTS,	/* calendar-query for VEVENT with calendar-data */
+	CANNED_TASKS,	/* calendar-query for VTODO with calendar-data */
+	CANNED_ETAGS,	/* PROPFIND depth 1 for getetag */
+	CANNED_STAT,	/* PROPFIND depth 1 for getetag, size and date */
+	CANNED_SYNC,	/* initial sync-collection REPORT */
+	CANNED_BODIES
+} mock_canned;
+
+struct _mock_server {
+	int fd;
+	int port;
+	int events;
+	GThread* acceptor;
+	gint stopping;
+	GMutex lock;
+	GCond idle;
+	GSList* clients;	/* sockets of open connections */
+	int active;			/* connection threads running */
+	guint64 requests;
+	guint64 connections;
+	guint64 tokens;
+	guint64 encoded;
+	GHashTable* methods;	/* method to guint64 requests */
+	GQueue faults;		/* mock_fault_entry still to happen */
+	GString* canned[CANNED_BODIES];
+};
+
+typedef struct {
+	gchar method[16];
+	mock_fault fault;
+	int wait;
+} mock_fault_entry;
+
+typedef struct {
+	mock_server* server;
+	int fd;
+} mock_client;
+
+typedef struct {
+	gchar method[16];
+	gchar path[1024];
+	gchar depth[16];
+	GString* body;
+	gboolean close;
+	gboolean encoded;
+	int fault;			/* a mock_fault or -1 */
+	int wait;
+} mock_request;
+
+static const char* MULTISTATUS_HEAD =
+"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+"<D:multistatus xmlns:D=\"DAV:\" xmlns:C=\"urn:ietf:params:xml:ns:caldav\" "
+"xmlns:CS=\"http://calendarserver.org/ns/\">";
+
+static const char* MULTISTATUS_FOOT = "</D:multistatus>";
+
+static void append_object(GString* out, int index, gboolean todo) {
+	g_string_append_printf(out,
+		"BEGIN:VCALENDAR\r\n"
+		"VERSION:2.0\r\n"
+		"PRODID:-//libcaldav//bench//EN\r\n"
+		"BEGIN:%s\r\n"
+		"UID:%s-%d\r\n"
+		"DTSTAMP:20080101T000000Z\r\n"
+		"%s:20080415T%02d%02d00Z\r\n"
+		"DURATION:PT1H\r\n"
+		"SUMMARY:Benchmark %s %d\r\n"
+		"DESCRIPTION:Canned object served by the libcaldav benchmark "
+		"& its tests\r\n"
+		"END:%s\r\n"
+		"END:VCALENDAR\r\n",
+		(todo) ? "VTODO" : "VEVENT", (todo) ? "task" : "bench", index,
+		(todo) ? "DUE" : "DTSTART", (index / 60) % 24, index % 60,
+		(todo) ? "task" : "event", index, (todo) ? "VTODO" : "VEVENT");
+}
+
+gchar* mock_server_object(int index, gboolean todo) {
+	GString* out = g_string_sized_new(320);
+
+	append_object(out, index, todo);
+	return g_string_free(out, FALSE);
+}
+
+gchar* mock_server_href(int index) {
+	return g_strdup_printf("%sbench-%d.ics", MOCK_COLLECTION, index);
+}
+
+static void append_response(GString* out, int index, gboolean todo,
+		gboolean data, gboolean stat) {
+	g_string_append_printf(out,
+		"<D:response><D:href>%s%s-%d.ics</D:href><D:propstat><D:prop>"
+		"<D:getetag>\"%s-%d-1\"</D:getetag>",
+		MOCK_COLLECTION, (todo) ? "task" : "bench", index,
+		(todo) ? "task" : "bench", index);
+	if (stat)
+		g_string_append(out,
+			"<D:getlastmodified>Tue, 15 Apr 2008 12:00:00 GMT"
+			"</D:getlastmodified><D:getcontentlength>320"
+			"</D:getcontentlength>");
+	if (data) {
+		/* the text of the object is escaped as any server does */
+		GString* object = g_string_sized_new(320);
+		gchar* escaped;
+		append_object(object, index, todo);
+		escaped = g_markup_escape_text(object->str, object->len);
+		g_string_append_printf(out, "<C:calendar-data>%s</C:calendar-data>",
+				escaped);
+		g_free(escaped);
+		g_string_free(object, TRUE);
+	}
+	g_string_append(out, "</D:prop><D:status>HTTP/1.1 200 OK</D:status>"
+			"</D:propstat></D:response>");
+}
+
+static GString* build_canned(mock_server* server, mock_canned which) {
+	GString* out = g_string_sized_new(
+		(gsize) server->events * ((which < CANNED_ETAGS) ? 700 : 400) + 512);
+	int i;
+
+	g_string_append(out, MULTISTATUS_HEAD);
+	if (which == CANNED_STAT)
+		g_string_append(out, "<D:response><D:href>" MOCK_COLLECTION
+			"</D:href><D:propstat><D:prop><D:resourcetype><D:collection/>"
+			"</D:resourcetype></D:prop><D:status>HTTP/1.1 200 OK"
+			"</D:status></D:propstat></D:response>");
+	for (i = 0; i < server->events; i++) {
+		switch (which) {
+			case CANNED_EVENTS:
+				append_response(out, i, FALSE, TRUE, FALSE);
+				break;
+			case CANNED_TASKS:
+				append_response(out, i, TRUE, TRUE, FALSE);
+				break;
+			default:
+				append_response(out, i, FALSE, FALSE, which == CANNED_STAT);
+				append_response(out, i, TRUE, FALSE, which == CANNED_STAT);
+				break;
+		}
+	}
+	if (which == CANNED_SYNC)
+		g_string_append(out, "<D:sync-token>" MOCK_SYNC_TOKEN
+				"</D:sync-token>");
+	g_string_append(out, MULTISTATUS_FOOT);
+	return out;
+}
+
+/**
+ * @return The canned body, built by the first request asking for it.
+ * Owned by the server.
+ */
+static GString* canned(mock_server* server, mock_canned which) {
+	GString* body;
+
+	g_mutex_lock(&server->lock);
+	if (! server->canned[which])
+		server->canned[which] = build_canned(server, which);
+	body = server->canned[which];
+	g_mutex_unlock(&server->lock);
+	return body;
+}
+
+/**
+ * Find the index of a canned object from its href.
+ * @return The index or -1 if href is not one of the collection.
+ */
+static int href_index(const gchar* href, gboolean* todo) {
+	const gchar* name = strrchr(href, '/');
+	int index;
+
+	name = (name) ? name + 1 : href;
+	if (sscanf(name, "bench-%d.ics", &index) == 1)
+		*todo = FALSE;
+	else if (sscanf(name, "task-%d.ics", &index) == 1)
+		*todo = TRUE;
+	else
+		return -1;
+	return index;
+}
+
+static const char* reason(int code) {
+	switch (code) {
+		case 100: return "Continue";
+		case 200: return "OK";
+		case 201: return "Created";
+		case 204: return "No Content";
+		case 207: return "Multi-Status";
+		case 400: return "Bad Request";
+		case 403: return "Forbidden";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 415: return "Unsupported Media Type";
+		case 503: return "Service Unavailable";
+		case 507: return "Insufficient Storage";
+		default: return "Unknown";
+	}
+}
+
+static gboolean send_all(int fd, const char* data, gsize len, int flags) {
+	while (len > 0) {
+		ssize_t sent = send(fd, data, len, flags | MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		data += sent;
+		len -= sent;
+	}
+	return TRUE;
+}
+
+static gboolean respond(mock_client* client, mock_request* request,
+		int code, const char* type, const char* extra,
+		const gchar* body, gsize len) {
+	GString* padding = g_string_new(NULL);
+	gchar* head;
+	gboolean ok;
+	gsize half = 0;
+	int i;
+
+	if (request->fault == MOCK_STALL)
+		g_usleep(request->wait * 1000);
+	else if (request->fault == MOCK_TRICKLE || request->fault == MOCK_DROP)
+		half = len / 2;
+	else if (request->fault == MOCK_PADDED)
+		for (i = 0; i < request->wait; i++)
+			g_string_append_printf(padding, "X-Padding-%d: %d\r\n", i, i);
+
+	head = g_strdup_printf("HTTP/1.1 %d %s\r\n"
+			"%s"
+			"Content-Type: %s\r\n"
+			"Content-Length: %zu\r\n"
+			"%s%s\r\n",
+			code, reason(code), padding->str, type, len,
+			(extra) ? extra : "",
+			(request->close) ? "Connection: close\r\n" : "");
+	g_string_free(padding, TRUE);
+#ifdef MSG_MORE
+	ok = send_all(client->fd, head, strlen(head), (len) ? MSG_MORE : 0);
+#else
+	ok = send_all(client->fd, head, strlen(head), 0);
+#endif
+	g_free(head);
+	if (ok && half) {
+		ok = send_all(client->fd, body, half, 0);
+		g_usleep(request->wait * 1000);
+		if (request->fault == MOCK_DROP)
+			return FALSE;
+		body += half;
+		len -= half;
+	}
+	if (ok && len)
+		ok = send_all(client->fd, body, len, 0);
+	return ok;
+}
+
+static gboolean respond_string(mock_client* client, mock_request* request,
+		int code, const char* type, const char* extra, GString* body) {
+	return respond(client, request, code, type, extra, body->str, body->len);
+}
+
+static const char* XML = "application/xml; charset=utf-8";
+
+/**
+ * Value of the first element named name in the request body.
+ * @return The value or NULL. Caller is responsible for freeing the memory.
+ */
+static gchar* element_value(const gchar* body, const gchar* name) {
+	const gchar* pos = strstr(body, name);
+	const gchar* end;
+
+	if (! pos || ! (pos = strchr(pos, '>')))
+		return NULL;
+	pos++;
+	if (! (end = strchr(pos, '<')))
+		return NULL;
+	return g_strstrip(g_strndup(pos, end - pos));
+}
+
+/**
+ * Answer a sync-collection with the changes from the first up to the
+ * last index, and a 507 on the collection while truncated.
+ */
+static gboolean sync_answer(mock_client* client, mock_request* request,
+		int first, int last, gboolean truncated) {
+	GString* out = g_string_new(MULTISTATUS_HEAD);
+	gboolean ok;
+	int i;
+
+	for (i = first; i < last; i++) {
+		append_response(out, i, FALSE, FALSE, FALSE);
+		append_response(out, i, TRUE, FALSE, FALSE);
+	}
+	if (truncated)
+		g_string_append(out, "<D:response><D:href>" MOCK_COLLECTION
+			"</D:href><D:status>HTTP/1.1 507 Insufficient Storage"
+			"</D:status></D:response>");
+	g_string_append(out, "<D:sync-token>");
+	g_string_append(out, (truncated) ? MOCK_SYNC_HALF : MOCK_SYNC_TOKEN);
+	g_string_append(out, "</D:sync-token>");
+	g_string_append(out, MULTISTATUS_FOOT);
+	ok = respond_string(client, request, 207, XML, NULL, out);
+	g_string_free(out, TRUE);
+	return ok;
+}
+
+static gboolean report(mock_client* client, mock_request* request) {
+	mock_server* server = client->server;
+	const gchar* body = request->body->str;
+	GString* out;
+	gboolean ok;
+
+	if (strstr(body, "sync-collection")) {
+		gchar* token = element_value(body, "sync-token");
+		int half = server->events / 2;
+		if (request->fault == MOCK_TRUNCATE)
+			/* the first half, or nothing more after it */
+			ok = sync_answer(client, request, 0, (token &&
+					strcmp(token, MOCK_SYNC_HALF) == 0) ? 0 : half, TRUE);
+		else if (token && strcmp(token, MOCK_SYNC_HALF) == 0)
+			ok = sync_answer(client, request, half, server->events, FALSE);
+		else if (! token || ! *token)
+			ok = respond_string(client, request, 207, XML, NULL,
+					canned(server, CANNED_SYNC));
+		else if (strcmp(token, MOCK_SYNC_TOKEN) == 0) {
+			out = g_string_new(MULTISTATUS_HEAD);
+			g_string_append(out, "<D:sync-token>" MOCK_SYNC_TOKEN
+					"</D:sync-token>");
+			g_string_append(out, MULTISTATUS_FOOT);
+			ok = respond_string(client, request, 207, XML, NULL, out);
+			g_string_free(out, TRUE);
+		}
+		else {
+			const char* error = "<?xml version=\"1.0\"?><D:error "
+				"xmlns:D=\"DAV:\"><D:valid-sync-token/></D:error>";
+			ok = respond(client, request, 403, XML, NULL,
+					error, strlen(error));
+		}
+		g_free(token);
+		return ok;
+	}
+	if (strstr(body, "calendar-multiget")) {
+		const gchar* pos = body;
+		out = g_string_new(MULTISTATUS_HEAD);
+		while ((pos = strstr(pos, "href>")) != NULL) {
+			const gchar* end = strchr(pos + 5, '<');
+			gchar* href;
+			gboolean todo;
+			int index;
+			if (! end)
+				break;
+			href = g_strndup(pos + 5, end - pos - 5);
+			index = href_index(href, &todo);
+			if (index >= 0 && index < server->events)
+				append_response(out, index, todo, TRUE, FALSE);
+			g_free(href);
+			pos = end;
+		}
+		g_string_append(out, MULTISTATUS_FOOT);
+		ok = respond_string(client, request, 207, XML, NULL, out);
+		g_string_free(out, TRUE);
+		return ok;
+	}
+	if (strstr(body, "free-busy-query")) {
+		const char* fb = "BEGIN:VCALENDAR\r\nVERSION:2.0\r\n"
+			"PRODID:-//libcaldav//bench//EN\r\nBEGIN:VFREEBUSY\r\n"
+			"DTSTAMP:20080101T000000Z\r\n"
+			"FREEBUSY:20080415T151500Z/20080415T162500Z\r\n"
+			"END:VFREEBUSY\r\nEND:VCALENDAR\r\n";
+		return respond(client, request, 200, "text/calendar", NULL,
+				fb, strlen(fb));
+	}
+	if (strstr(body, "text-match")) {
+		/* a lookup by UID before a modify or delete */
+		gchar* uid = element_value(body, "text-match");
+		gboolean todo = (strstr(body, "\"VTODO\"") != NULL);
+		int index;
+		out = g_string_new(MULTISTATUS_HEAD);
+		if (uid && (sscanf(uid, "bench-%d", &index) == 1 ||
+					sscanf(uid, "task-%d", &index) == 1) &&
+				index >= 0 && index < server->events)
+			append_response(out, index, todo, TRUE, FALSE);
+		g_string_append(out, MULTISTATUS_FOOT);
+		ok = respond_string(client, request, 207, XML, NULL, out);
+		g_string_free(out, TRUE);
+		g_free(uid);
+		return ok;
+	}
+	return respond_string(client, request, 207, XML, NULL, canned(server,
+		(strstr(body, "\"VTODO\"")) ? CANNED_TASKS : CANNED_EVENTS));
+}
+
+static gboolean propfind(mock_client* client, mock_request* request) {
+	const gchar* body = request->body->str;
+	gchar* answer;
+	gboolean ok;
+
+	if (strstr(body, "displayname"))
+		answer = g_strdup_printf("%s<D:response><D:href>%s</D:href>"
+			"<D:propstat><D:prop><D:displayname>Benchmark</D:displayname>"
+			"</D:prop><D:status>HTTP/1.1 200 OK</D:status></D:propstat>"
+			"</D:response>%s",
+			MULTISTATUS_HEAD, MOCK_COLLECTION, MULTISTATUS_FOOT);
+	else if (strstr(body, "getctag") && strcmp(request->depth, "0") == 0)
+		answer = g_strdup_printf("%s<D:response><D:href>%s</D:href>"
+			"<D:propstat><D:prop><CS:getctag>ctag-1</CS:getctag></D:prop>"
+			"<D:status>HTTP/1.1 200 OK</D:status></D:propstat>"
+			"</D:response>%s",
+			MULTISTATUS_HEAD, MOCK_COLLECTION, MULTISTATUS_FOOT);
+	else
+		return respond_string(client, request, 207, XML, NULL,
+			canned(client->server, (strstr(body, "getlastmodified") ||
+				strstr(body, "getcontentlength")) ?
+					CANNED_STAT : CANNED_ETAGS));
+	ok = respond(client, request, 207, XML, NULL, answer, strlen(answer));
+	g_free(answer);
+	return ok;
+}
+
+static gboolean schedule(mock_client* client, mock_request* request) {
+	const gchar* pos = request->body->str;
+	GString* out = g_string_new("<?xml version=\"1.0\"?><C:schedule-response "
+		"xmlns:D=\"DAV:\" xmlns:C=\"urn:ietf:params:xml:ns:caldav\">");
+	gboolean ok;
+
+	while ((pos = strstr(pos, "\nATTENDEE")) != NULL) {
+		const gchar* value = strchr(pos, ':');
+		const gchar* end;
+		if (! value)
+			break;
+		value++;
+		end = value + strcspn(value, "\r\n");
+		g_string_append(out, "<C:response><C:recipient><D:href>");
+		g_string_append_len(out, value, end - value);
+		g_string_append(out, "</D:href></C:recipient><C:request-status>"
+			"2.0;Success</C:request-status><C:calendar-data>"
+			"BEGIN:VCALENDAR\r\nMETHOD:REPLY\r\nBEGIN:VFREEBUSY\r\n"
+			"ATTENDEE:");
+		g_string_append_len(out, value, end - value);
+		g_string_append(out, "\r\nFREEBUSY;FBTYPE=BUSY:"
+			"20080415T151500Z/20080415T162500Z\r\nEND:VFREEBUSY\r\n"
+			"END:VCALENDAR\r\n</C:calendar-data></C:response>");
+		pos = end;
+	}
+	g_string_append(out, "</C:schedule-response>");
+	ok = respond_string(client, request, 200, XML, NULL, out);
+	g_string_free(out, TRUE);
+	return ok;
+}
+
+static gboolean dispatch(mock_client* client, mock_request* request) {
+	mock_server* server = client->server;
+	const gchar* method = request->method;
+	gchar* extra;
+	gchar* body;
+	gboolean ok;
+	gboolean todo;
+	int index;
+
+	if (request->fault == MOCK_UNAVAILABLE) {
+		extra = (request->wait >= 1000) ?
+			g_strdup_printf("Retry-After: %d\r\n", request->wait / 1000) :
+			NULL;
+		ok = respond(client, request, 503, "text/plain", extra, "", 0);
+		g_free(extra);
+		return ok;
+	}
+	if (request->fault == MOCK_UNSUPPORTED && request->encoded)
+		return respond(client, request, 415, "text/plain",
+				"Accept-Encoding: identity\r\n", "", 0);
+	if (strcmp(method, "OPTIONS") == 0)
+		return respond(client, request, 200, "text/plain",
+			"DAV: 1, 2, access-control, calendar-access\r\n"
+			"Accept-Encoding: gzip\r\n"
+			"Allow: OPTIONS, GET, HEAD, POST, PUT, DELETE, PROPFIND, "
+			"PROPPATCH, LOCK, UNLOCK, REPORT\r\n", "", 0);
+	if (strcmp(method, "REPORT") == 0)
+		return report(client, request);
+	if (strcmp(method, "PROPFIND") == 0)
+		return propfind(client, request);
+	if (strcmp(method, "POST") == 0)
+		return schedule(client, request);
+	if (strcmp(method, "GET") == 0) {
+		index = href_index(request->path, &todo);
+		if (index < 0 || index >= server->events)
+			return respond(client, request, 404, "text/plain", NULL, "", 0);
+		body = mock_server_object(index, todo);
+		extra = g_strdup_printf("ETag: \"%s-%d-1\"\r\n",
+				(todo) ? "task" : "bench", index);
+		ok = respond(client, request, 200, "text/calendar", extra,
+				body, strlen(body));
+		g_free(extra);
+		g_free(body);
+		return ok;
+	}
+	if (strcmp(method, "PUT") == 0) {
+		index = href_index(request->path, &todo);
+		extra = g_strdup_printf("ETag: \"put-%u\"\r\n",
+				g_str_hash(request->body->str));
+		ok = respond(client, request, (index < 0) ? 201 : 204, "text/plain",
+				extra, "", 0);
+		g_free(extra);
+		return ok;
+	}
+	if (strcmp(method, "DELETE") == 0 || strcmp(method, "UNLOCK") == 0)
+		return respond(client, request, 204, "text/plain", NULL, "", 0);
+	if (strcmp(method, "LOCK") == 0) {
+		guint64 token;
+		g_mutex_lock(&server->lock);
+		token = ++server->tokens;
+		g_mutex_unlock(&server->lock);
+		extra = g_strdup_printf("Lock-Token: <opaquelocktoken:bench-%"
+				G_GUINT64_FORMAT ">\r\n", token);
+		body = g_strdup_printf("<?xml version=\"1.0\"?><D:prop "
+			"xmlns:D=\"DAV:\"><D:lockdiscovery><D:activelock><D:locktoken>"
+			"<D:href>opaquelocktoken:bench-%" G_GUINT64_FORMAT "</D:href>"
+			"</D:locktoken><D:timeout>Second-120</D:timeout>"
+			"</D:activelock></D:lockdiscovery></D:prop>", token);
+		ok = respond(client, request, 200, XML, extra, body, strlen(body));
+		g_free(extra);
+		g_free(body);
+		return ok;
+	}
+	return respond(client, request, 405, "text/plain", NULL, "", 0);
+}
+
+/**
+ * Read more of a connection.
+ * @return FALSE when the peer is gone.
+ */
+static gboolean fill(int fd, GString* in) {
+	char buf[65536];
+	ssize_t got;
+
+	do
+		got = recv(fd, buf, sizeof(buf), 0);
+	while (got < 0 && errno == EINTR);
+	if (got <= 0)
+		return FALSE;
+	g_string_append_len(in, buf, got);
+	return TRUE;
+}
+
+/**
+ * Decode a chunked body.
+ * @return Bytes of data used or 0 (zero) if the body is not complete.
+ */
+static gsize dechunk(const gchar* data, gsize len, GString* out) {
+	gsize pos = 0;
+
+	for (;;) {
+		const gchar* eol = g_strstr_len(data + pos, len - pos, "\r\n");
+		gsize size;
+		if (! eol)
+			return 0;
+		size = strtoul(data + pos, NULL, 16);
+		pos = eol - data + 2;
+		if (size == 0) {
+			/* no trailers are sent by libcurl */
+			return (pos + 2 <= len) ? pos + 2 : 0;
+		}
+		if (pos + size + 2 > len)
+			return 0;
+		g_string_append_len(out, data + pos, size);
+		pos += size + 2;
+	}
+}
+
+static gboolean header_is(const gchar* line, const gchar* name) {
+	return g_ascii_strncasecmp(line, name, strlen(name)) == 0;
+}
+
+/**
+ * Read the next request of a connection into request.
+ * @return FALSE when the connection is to be closed.
+ */
+static gboolean next_request(mock_client* client, GString* in,
+		mock_request* request) {
+	const gchar* end;
+	gchar** lines;
+	gchar* text;
+	gsize head;
+	gsize length = 0;
+	gboolean chunked = FALSE;
+	gboolean expect = FALSE;
+	int i;
+
+	while (! (end = g_strstr_len(in->str, in->len, "\r\n\r\n")))
+		if (! fill(client->fd, in))
+			return FALSE;
+	head = end - in->str + 4;
+	text = g_strndup(in->str, head - 4);
+	lines = g_strsplit(text, "\r\n", 0);
+	g_free(text);
+	request->path[0] = request->depth[0] = 0;
+	request->close = FALSE;
+	request->encoded = FALSE;
+	if (sscanf(lines[0], "%15s %1023s", request->method, request->path) != 2) {
+		g_strfreev(lines);
+		return FALSE;
+	}
+	for (i = 1; lines[i]; i++) {
+		const gchar* value = strchr(lines[i], ':');
+		if (! value)
+			continue;
+		for (value++; *value == ' '; value++)
+			;
+		if (header_is(lines[i], "Content-Length:"))
+			length = strtoul(value, NULL, 10);
+		else if (header_is(lines[i], "Transfer-Encoding:"))
+			chunked = (g_ascii_strncasecmp(value, "chunked", 7) == 0);
+		else if (header_is(lines[i], "Expect:"))
+			expect = (g_ascii_strncasecmp(value, "100-continue", 12) == 0);
+		else if (header_is(lines[i], "Connection:"))
+			request->close = (g_ascii_strncasecmp(value, "close", 5) == 0);
+		else if (header_is(lines[i], "Content-Encoding:"))
+			request->encoded = (g_ascii_strncasecmp(value, "identity", 8) != 0);
+		else if (header_is(lines[i], "Depth:"))
+			g_strlcpy(request->depth, value, sizeof(request->depth));
+	}
+	g_strfreev(lines);
+	if (expect && in->len == head) {
+		const char* go = "HTTP/1.1 100 Continue\r\n\r\n";
+		if (! send_all(client->fd, go, strlen(go), 0))
+			return FALSE;
+	}
+	g_string_truncate(request->body, 0);
+	if (chunked) {
+		gsize used;
+		while ((used = dechunk(in->str + head, in->len - head,
+						request->body)) == 0) {
+			g_string_truncate(request->body, 0);
+			if (! fill(client->fd, in))
+				return FALSE;
+		}
+		g_string_erase(in, 0, head + used);
+	}
+	else {
+		while (in->len < head + length)
+			if (! fill(client->fd, in))
+				return FALSE;
+		g_string_append_len(request->body, in->str + head, length);
+		g_string_erase(in, 0, head + length);
+	}
+	return TRUE;
+}
+
+/**
+ * Count a request and take the oldest fault queued for its method.
+ */
+static void account_request(mock_server* server, mock_request* request) {
+	mock_fault_entry* entry;
+	guint64* count;
+	GList* item;
+
+	request->fault = -1;
+	request->wait = 0;
+	g_mutex_lock(&server->lock);
+	server->requests++;
+	if (request->encoded)
+		server->encoded++;
+	if (! (count = g_hash_table_lookup(server->methods, request->method))) {
+		count = g_new0(guint64, 1);
+		g_hash_table_insert(server->methods, g_strdup(request->method),
+				count);
+	}
+	(*count)++;
+	for (item = server->faults.head; item; item = item->next) {
+		entry = (mock_fault_entry *) item->data;
+		if (strcmp(entry->method, request->method) == 0) {
+			request->fault = entry->fault;
+			request->wait = entry->wait;
+			g_queue_delete_link(&server->faults, item);
+			g_free(entry);
+			break;
+		}
+	}
+	g_mutex_unlock(&server->lock);
+}
+
+static gpointer serve_client(gpointer data) {
+	mock_client* client = (mock_client *) data;
+	mock_server* server = client->server;
+	GString* in = g_string_sized_new(65536);
+	mock_request request;
+
+	request.body = g_string_sized_new(4096);
+	while (! g_atomic_int_get(&server->stopping) &&
+			next_request(client, in, &request)) {
+		account_request(server, &request);
+		if (! dispatch(client, &request) || request.close)
+			break;
+	}
+	g_string_free(request.body, TRUE);
+	g_string_free(in, TRUE);
+	g_mutex_lock(&server->lock);
+	server->clients = g_slist_remove(server->clients,
+			GINT_TO_POINTER(client->fd));
+	close(client->fd);
+	if (--server->active == 0)
+		g_cond_broadcast(&server->idle);
+	g_mutex_unlock(&server->lock);
+	g_free(client);
+	return NULL;
+}
+
+static gpointer accept_clients(gpointer data) {
+	mock_server* server = (mock_server *) data;
+
+	for (;;) {
+		int fd = accept(server->fd, NULL, NULL);
+		int one = 1;
+		mock_client* client;
+		GThread* thread;
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		if (g_atomic_int_get(&server->stopping)) {
+			close(fd);
+			break;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		client = g_new0(mock_client, 1);
+		client->server = server;
+		client->fd = fd;
+		g_mutex_lock(&server->lock);
+		server->connections++;
+		server->active++;
+		server->clients = g_slist_prepend(server->clients,
+				GINT_TO_POINTER(fd));
+		g_mutex_unlock(&server->lock);
+		thread = g_thread_new("mock-client", serve_client, client);
+		g_thread_unref(thread);
+	}
+	return NULL;
+}
+
+mock_server* mock_server_start(int events) {
+	mock_server* server;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int one = 1;
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		return NULL;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+			listen(fd, 1024) != 0 ||
+			getsockname(fd, (struct sockaddr *) &addr, &len) != 0) {
+		close(fd);
+		return NULL;
+	}
+	server = g_new0(mock_server, 1);
+	server->fd = fd;
+	server->port = ntohs(addr.sin_port);
+	server->events = (events > 0) ? events : 0;
+	server->methods = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, g_free);
+	g_queue_init(&server->faults);
+	g_mutex_init(&server->lock);
+	g_cond_init(&server->idle);
+	server->acceptor = g_thread_new("mock-accept", accept_clients, server);
+	return server;
+}
+
+void mock_server_stop(mock_server** server) {
+	mock_server* s;
+	GSList* client;
+	int i;
+
+	if (! server || ! *server)
+		return;
+	s = *server;
+	g_atomic_int_set(&s->stopping, 1);
+	shutdown(s->fd, SHUT_RDWR);
+	g_thread_join(s->acceptor);
+	close(s->fd);
+	g_mutex_lock(&s->lock);
+	for (client = s->clients; client; client = client->next)
+		shutdown(GPOINTER_TO_INT(client->data), SHUT_RDWR);
+	while (s->active > 0)
+		g_cond_wait(&s->idle, &s->lock);
+	g_mutex_unlock(&s->lock);
+	for (i = 0; i < CANNED_BODIES; i++)
+		if (s->canned[i])
+			g_string_free(s->canned[i], TRUE);
+	g_hash_table_destroy(s->methods);
+	while (! g_queue_is_empty(&s->faults))
+		g_free(g_queue_pop_head(&s->faults));
+	g_mutex_clear(&s->lock);
+	g_cond_clear(&s->idle);
+	g_free(s);
+	*server = NULL;
+}
+
+int mock_server_port(mock_server* server) {
+	return server->port;
+}
+
+guint64 mock_server_requests(mock_server* server) {
+	guint64 requests;
+
+	g_mutex_lock(&server->lock);
+	requests = server->requests;
+	g_mutex_unlock(&server->lock);
+	return requests;
+}
+
+guint64 mock_server_connections(mock_server* server) {
+	guint64 connections;
+
+	g_mutex_lock(&server->lock);
+	connections = server->connections;
+	g_mutex_unlock(&server->lock);
+	return connections;
+}
+
+guint64 mock_server_method(mock_server* server, const gchar* method) {
+	guint64* count;
+	guint64 requests;
+
+	g_mutex_lock(&server->lock);
+	count = g_hash_table_lookup(server->methods, method);
+	requests = (count) ? *count : 0;
+	g_mutex_unlock(&server->lock);
+	return requests;
+}
+
+guint64 mock_server_encoded(mock_server* server) {
+	guint64 encoded;
+
+	g_mutex_lock(&server->lock);
+	encoded = server->encoded;
+	g_mutex_unlock(&server->lock);
+	return encoded;
+}
+
+void mock_server_fault(mock_server* server, const gchar* method,
+		mock_fault fault, int wait) {
+	mock_fault_entry* entry = g_new0(mock_fault_entry, 1);
+
+	g_strlcpy(entry->method, method, sizeof(entry->method));
+	entry->fault = fault;
+	entry->wait = wait;
+	g_mutex_lock(&server->lock);
+	g_queue_push_tail(&server->faults, entry);
+	g_mutex_unlock(&server->lock);
+}
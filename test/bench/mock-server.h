@@ -0,0 +1,119 @@
+/* vim: set textwidth=80 tabstop=4: */
+
+/* Copyright (c) 2008 Michael Rasmussen (mir@datanom.net)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __MOCK_SERVER_H__
+#define __MOCK_SERVER_H__
+
+#include <glib.h>
+
+/** Path of the collection served */
+#define MOCK_COLLECTION "/cal/"
+
+/**
+ * @typedef struct _mock_server mock_server
+ * A plain HTTP/1.1 CalDAV responder on the loopback interface answering
+ * from canned bodies, one thread for every connection.
+ */
+typedef struct _mock_server mock_server;
+
+/**
+ * @enum mock_fault
+ * Misbehaviour of the responder for one request.
+ */
+typedef enum {
+	MOCK_STALL,			/* wait before answering */
+	MOCK_TRICKLE,		/* send half the answer, wait, send the rest */
+	MOCK_DROP,			/* send half the answer, wait, close the connection */
+	MOCK_UNAVAILABLE,	/* 503, with a Retry-After if the wait is 1000 or more */
+	MOCK_UNSUPPORTED,	/* 415 if the body has a Content-Encoding */
+	MOCK_TRUNCATE,		/* sync-collection answers half and a 507 */
+	MOCK_PADDED			/* as many headers as the wait ahead of the others */
+} mock_fault;
+
+/**
+ * Start a responder serving a collection of events on an ephemeral port.
+ * @param events Number of events, and of tasks, in the collection.
+ * @return The running server or NULL if no socket could be opened.
+ */
+mock_server* mock_server_start(int events);
+
+/**
+ * Stop a responder, closing every connection still open.
+ * @param server The server. Set to NULL.
+ */
+void mock_server_stop(mock_server** server);
+
+/**
+ * @param server A running server.
+ * @return The port the server listens on.
+ */
+int mock_server_port(mock_server* server);
+
+/**
+ * @param server A running server.
+ * @return Requests answered since the server started.
+ */
+guint64 mock_server_requests(mock_server* server);
+
+/**
+ * @param server A running server.
+ * @return Connections accepted since the server started.
+ */
+guint64 mock_server_connections(mock_server* server);
+
+/**
+ * @param server A running server.
+ * @param method A method, e.g. "REPORT".
+ * @return Requests with this method answered since the server started.
+ */
+guint64 mock_server_method(mock_server* server, const gchar* method);
+
+/**
+ * @param server A running server.
+ * @return Requests whose body came with a Content-Encoding.
+ */
+guint64 mock_server_encoded(mock_server* server);
+
+/**
+ * Queue a fault for a coming request. Each request takes the oldest fault
+ * queued for its method.
+ * @param server A running server.
+ * @param method The method, e.g. "REPORT".
+ * @param fault @see mock_fault
+ * @param wait Milliseconds, what for depends on fault.
+ */
+void mock_server_fault(mock_server* server, const gchar* method,
+		mock_fault fault, int wait);
+
+/**
+ * Canned event as stored at the index'th href of the collection.
+ * @param index 0 up to the number of events.
+ * @param todo TRUE for the VTODO of the same index.
+ * @return The VCALENDAR. Caller is responsible for freeing the memory.
+ */
+gchar* mock_server_object(int index, gboolean todo);
+
+/**
+ * @param index 0 up to the number of events.
+ * @return The href of the index'th event. Caller is responsible for
+ * freeing the memory.
+ */
+gchar* mock_server_href(int index);
+
+#endif